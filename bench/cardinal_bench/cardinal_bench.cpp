@@ -87,14 +87,48 @@
 #define USE_JSTD_ROBIN16_HASH_MAP       0
 #define USE_JSTD_ROBIN_HASH_MAP         1
 #define USE_JSTD_CLUSTER_FALT_MAP       1
+#define USE_JSTD_CLUSTER_FALT_MAP32     1
+#define USE_JSTD_CLUSTER_FALT_MAP64     1
+#define USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH    1
 #else
 #define USE_STD_UNORDERED_MAP           0
 #define USE_JSTD_FLAT16_HASH_MAP        0
 #define USE_JSTD_ROBIN16_HASH_MAP       0
 #define USE_JSTD_ROBIN_HASH_MAP         1
 #define USE_JSTD_CLUSTER_FALT_MAP       1
+#define USE_JSTD_CLUSTER_FALT_MAP32     1
+#define USE_JSTD_CLUSTER_FALT_MAP64     1
+#define USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH    1
 #endif // _DEBUG
 
+// The optional benchmarks, off by default, define them to 1 to run them
+#ifndef USE_BENCH_COLLISION_CHAIN_LENGTH
+#define USE_BENCH_COLLISION_CHAIN_LENGTH    0
+#endif
+
+#ifndef USE_BENCH_BATCH_VS_SCALAR
+#define USE_BENCH_BATCH_VS_SCALAR       0
+#endif
+
+// The 32-wide cluster group need AVX2
+#if !defined(__AVX2__)
+#undef  USE_JSTD_CLUSTER_FALT_MAP32
+#define USE_JSTD_CLUSTER_FALT_MAP32     0
+#endif
+
+// The 64-wide cluster group need AVX-512BW
+#if !defined(__AVX512BW__)
+#undef  USE_JSTD_CLUSTER_FALT_MAP64
+#define USE_JSTD_CLUSTER_FALT_MAP64     0
+#endif
+
+// The dispatched 64-wide cluster group selects its kernel at runtime, but only on x86
+#if !(defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) \
+   || defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#undef  USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
+#define USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH    0
+#endif
+
 #ifdef __SSE4_2__
 
 // Support SSE 4.2: _mm_crc32_u32(), _mm_crc32_u64().
@@ -129,7 +163,8 @@
 #if USE_JSTD_ROBIN_HASH_MAP
 #include <jstd/hashmap/robin_hash_map.h>
 #endif
-#if USE_JSTD_CLUSTER_FALT_MAP
+#if USE_JSTD_CLUSTER_FALT_MAP || USE_JSTD_CLUSTER_FALT_MAP32 || USE_JSTD_CLUSTER_FALT_MAP64 \
+ || USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
 #include <jstd/hashmap/cluster_flat_map.hpp>
 #endif
 #include <jstd/hashmap/hashmap_analyzer.h>
@@ -190,6 +225,27 @@ static const std::size_t kDefaultIters = 10000;
 
 static const std::size_t kInitCapacity = 8;
 
+#if USE_JSTD_CLUSTER_FALT_MAP32
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+using cluster_flat_map32 = jstd::cluster_flat_map<Key, Value, Hash, std::equal_to<Key>,
+                                                  std::allocator<std::pair<const Key, Value>>,
+                                                  jstd::flat_map_cluster32<jstd::cluster_meta_ctrl>>;
+#endif
+
+#if USE_JSTD_CLUSTER_FALT_MAP64
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+using cluster_flat_map64 = jstd::cluster_flat_map<Key, Value, Hash, std::equal_to<Key>,
+                                                  std::allocator<std::pair<const Key, Value>>,
+                                                  jstd::flat_map_cluster64<jstd::cluster_meta_ctrl>>;
+#endif
+
+#if USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+using cluster_flat_map64_dispatch = jstd::cluster_flat_map<Key, Value, Hash, std::equal_to<Key>,
+                                                  std::allocator<std::pair<const Key, Value>>,
+                                                  jstd::flat_map_cluster64_dispatch<jstd::cluster_meta_ctrl>>;
+#endif
+
 static inline
 std::size_t CurrentMemoryUsage()
 {
@@ -471,6 +527,18 @@ void benchmark_insert_random_impl()
     run_insert_random<jstd::cluster_flat_map<Key, Value>>
         ("jstd::cluster_flat_map", keys, Cardinal);
 #endif
+#if USE_JSTD_CLUSTER_FALT_MAP32
+    run_insert_random<cluster_flat_map32<Key, Value>>
+        ("jstd::cluster_flat_map32", keys, Cardinal);
+#endif
+#if USE_JSTD_CLUSTER_FALT_MAP64
+    run_insert_random<cluster_flat_map64<Key, Value>>
+        ("jstd::cluster_flat_map64", keys, Cardinal);
+#endif
+#if USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
+    run_insert_random<cluster_flat_map64_dispatch<Key, Value>>
+        ("jstd::cluster_flat_map64_dispatch", keys, Cardinal);
+#endif
 }
 
 template <typename Key, typename Value>
@@ -549,6 +617,18 @@ void benchmark_MumHash_insert_random_impl()
     run_insert_random<jstd::cluster_flat_map<Key, Value, test::MumHash<Key>>>
         ("jstd::cluster_flat_map", keys, Cardinal);
 #endif
+#if USE_JSTD_CLUSTER_FALT_MAP32
+    run_insert_random<cluster_flat_map32<Key, Value, test::MumHash<Key>>>
+        ("jstd::cluster_flat_map32", keys, Cardinal);
+#endif
+#if USE_JSTD_CLUSTER_FALT_MAP64
+    run_insert_random<cluster_flat_map64<Key, Value, test::MumHash<Key>>>
+        ("jstd::cluster_flat_map64", keys, Cardinal);
+#endif
+#if USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
+    run_insert_random<cluster_flat_map64_dispatch<Key, Value, test::MumHash<Key>>>
+        ("jstd::cluster_flat_map64_dispatch", keys, Cardinal);
+#endif
 }
 
 template <typename Key, typename Value>
@@ -766,6 +846,243 @@ void test_map_slot_type()
     printf("\n");
 }
 
+//
+// The collision chain length of an element is the number of groups between
+// its home group and the group where it's stored.
+//
+template <typename HashMap>
+void run_collision_chain_length(const std::string & name,
+                                const std::vector<typename HashMap::key_type> & keys)
+{
+    typedef typename HashMap::key_type      key_type;
+    typedef typename HashMap::mapped_type   mapped_type;
+    typedef typename HashMap::size_type     size_type;
+
+    static constexpr size_type kGroupWidth = HashMap::group_type::kGroupWidth;
+
+    HashMap hashmap;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        hashmap.insert(std::make_pair(keys[i], mapped_type(i)));
+    }
+
+    size_type group_capacity = (hashmap.bucket_count() + (kGroupWidth - 1)) / kGroupWidth;
+    size_type total_length = 0, max_length = 0, in_home_group = 0;
+    for (auto iter = hashmap.begin(); iter != hashmap.end(); ++iter) {
+        const key_type & key = iter->first;
+        size_type home_group = hashmap.home_bucket(key) / kGroupWidth;
+        size_type group = hashmap.bucket(key) / kGroupWidth;
+        size_type length = (group + group_capacity - home_group) % group_capacity;
+        total_length += length;
+        if (length > max_length)
+            max_length = length;
+        if (length == 0)
+            in_home_group++;
+    }
+
+    double size = (hashmap.size() != 0) ? (double)hashmap.size() : 1.0;
+    printf("%-36s size = %8u, load_factor = %0.3f, avg_chain = %7.3f, max_chain = %5u, in_home = %6.2f %%\n",
+           name.c_str(), (uint32_t)hashmap.size(), (double)hashmap.load_factor(),
+           (double)total_length / size, (uint32_t)max_length, in_home_group * 100.0 / size);
+}
+
+template <typename Key, std::size_t Stride>
+void benchmark_collision_chain_length_impl(std::size_t data_size)
+{
+    std::vector<Key> keys;
+    keys.reserve(data_size);
+    for (std::size_t i = 0; i < data_size; i++) {
+        keys.push_back(static_cast<Key>(i * Stride));
+    }
+
+    printf("keys = i * %u\n", (uint32_t)Stride);
+    run_collision_chain_length<jstd::cluster_flat_map<Key, Key, std::hash<Key>>>
+        ("cluster_flat_map<std::hash>", keys);
+    run_collision_chain_length<jstd::cluster_flat_map<Key, Key, test::SimpleHash<Key>>>
+        ("cluster_flat_map<test::SimpleHash>", keys);
+    printf("\n");
+}
+
+//
+// The identity hashes, e.g. std::hash<int>, with the sequential and the strided keys.
+//
+void benchmark_collision_chain_length()
+{
+    // Close to the max load factor
+#ifndef _DEBUG
+    static constexpr std::size_t DataSize = 1600000;
+#else
+    static constexpr std::size_t DataSize = 12000;
+#endif
+    printf("%s\n\n", PRINT_MACRO_VAR(CLUSTER_USE_HASH_POLICY));
+
+    benchmark_collision_chain_length_impl<int, 1>(DataSize);
+    benchmark_collision_chain_length_impl<int, 64>(DataSize);
+    benchmark_collision_chain_length_impl<int, 1024>(DataSize);
+}
+
+#if USE_JSTD_CLUSTER_FALT_MAP
+//
+// find_batch(), contains_batch() and insert_batch() against the loops of
+// find() and insert() on the same keys, the batch size is like a request handler.
+//
+template <typename Key, typename Value>
+void run_batch_vs_scalar(const std::vector<Key> & keys, std::size_t batch_size)
+{
+    typedef jstd::cluster_flat_map<Key, Value>  map_type;
+    typedef typename map_type::iterator         iterator;
+    typedef std::pair<Key, Value>               pair_type;
+
+    std::vector<pair_type> values;
+    values.reserve(keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        values.push_back(pair_type(keys[i], static_cast<Value>(i)));
+    }
+
+    jtest::StopWatch sw;
+    map_type scalar_map, batch_map;
+    double insert_time, insert_batch_time;
+
+    sw.start();
+    for (std::size_t i = 0; i < values.size(); i++) {
+        scalar_map.insert(values[i]);
+    }
+    sw.stop();
+    insert_time = sw.getElapsedMillisec();
+
+    sw.start();
+    for (std::size_t first = 0; first < values.size(); first += batch_size) {
+        std::size_t count = (std::min)(values.size() - first, batch_size);
+        batch_map.insert_batch(values.data() + first, count);
+    }
+    sw.stop();
+    insert_batch_time = sw.getElapsedMillisec();
+
+    printf("size = %u, batch_size = %u\n", (uint32_t)batch_map.size(), (uint32_t)batch_size);
+    printf("insert():       %9.2f ms, insert_batch():   %9.2f ms, speedup = %0.2fx  (growing)\n",
+           insert_time, insert_batch_time, insert_time / insert_batch_time);
+
+    // The inserts into the reserved tables, no rehash in the way.
+    {
+        map_type reserved_map, reserved_batch_map;
+        reserved_map.reserve(values.size());
+        reserved_batch_map.reserve(values.size());
+
+        sw.start();
+        for (std::size_t i = 0; i < values.size(); i++) {
+            reserved_map.insert(values[i]);
+        }
+        sw.stop();
+        insert_time = sw.getElapsedMillisec();
+
+        sw.start();
+        for (std::size_t first = 0; first < values.size(); first += batch_size) {
+            std::size_t count = (std::min)(values.size() - first, batch_size);
+            reserved_batch_map.insert_batch(values.data() + first, count);
+        }
+        sw.stop();
+        insert_batch_time = sw.getElapsedMillisec();
+
+        printf("insert():       %9.2f ms, insert_batch():   %9.2f ms, speedup = %0.2fx  (reserved)\n",
+               insert_time, insert_batch_time, insert_time / insert_batch_time);
+    }
+
+    // The updates of the existing keys in another order.
+    {
+        std::vector<pair_type> updates;
+        updates.reserve(values.size());
+        for (std::size_t i = 0; i < values.size(); i++) {
+            std::size_t index = static_cast<std::size_t>((i * 2654435761ull) % values.size());
+            updates.push_back(pair_type(values[index].first, static_cast<Value>(i)));
+        }
+
+        double assign_time, assign_batch_time;
+
+        sw.start();
+        for (std::size_t i = 0; i < updates.size(); i++) {
+            scalar_map.insert_or_assign(updates[i].first, updates[i].second);
+        }
+        sw.stop();
+        assign_time = sw.getElapsedMillisec();
+
+        sw.start();
+        for (std::size_t first = 0; first < updates.size(); first += batch_size) {
+            std::size_t count = (std::min)(updates.size() - first, batch_size);
+            batch_map.insert_or_assign_batch(updates.data() + first, count);
+        }
+        sw.stop();
+        assign_batch_time = sw.getElapsedMillisec();
+
+        printf("insert_or_assign(): %9.2f ms, insert_or_assign_batch(): %9.2f ms, speedup = %0.2fx  (updates)\n",
+               assign_time, assign_batch_time, assign_time / assign_batch_time);
+    }
+
+    std::size_t check_sum = 0, batch_check_sum = 0, found = 0, batch_found = 0;
+    double find_time, find_batch_time, contains_time, contains_batch_time;
+
+    sw.start();
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        auto iter = batch_map.find(keys[i]);
+        check_sum += static_cast<std::size_t>(iter->second);
+    }
+    sw.stop();
+    find_time = sw.getElapsedMillisec();
+
+    std::unique_ptr<iterator[]> iters(new iterator[batch_size]);
+    sw.start();
+    for (std::size_t first = 0; first < keys.size(); first += batch_size) {
+        std::size_t count = (std::min)(keys.size() - first, batch_size);
+        batch_map.find_batch(keys.data() + first, count, iters.get());
+        for (std::size_t i = 0; i < count; i++) {
+            batch_check_sum += static_cast<std::size_t>(iters[i]->second);
+        }
+    }
+    sw.stop();
+    find_batch_time = sw.getElapsedMillisec();
+
+    sw.start();
+    for (std::size_t i = 0; i < keys.size(); i++) {
+        found += batch_map.contains(keys[i]) ? 1 : 0;
+    }
+    sw.stop();
+    contains_time = sw.getElapsedMillisec();
+
+    std::unique_ptr<bool[]> founds(new bool[batch_size]);
+    sw.start();
+    for (std::size_t first = 0; first < keys.size(); first += batch_size) {
+        std::size_t count = (std::min)(keys.size() - first, batch_size);
+        batch_map.contains_batch(keys.data() + first, count, founds.get());
+        for (std::size_t i = 0; i < count; i++) {
+            batch_found += founds[i] ? 1 : 0;
+        }
+    }
+    sw.stop();
+    contains_batch_time = sw.getElapsedMillisec();
+
+    printf("find():         %9.2f ms, find_batch():     %9.2f ms, speedup = %0.2fx, check_sum: %" PRIuPTR " / %" PRIuPTR "\n",
+           find_time, find_batch_time, find_time / find_batch_time, check_sum, batch_check_sum);
+    printf("contains():     %9.2f ms, contains_batch(): %9.2f ms, speedup = %0.2fx, found: %" PRIuPTR " / %" PRIuPTR "\n\n",
+           contains_time, contains_batch_time, contains_time / contains_batch_time, found, batch_found);
+}
+
+void benchmark_batch_vs_scalar()
+{
+    // Larger than the last level cache.
+#ifndef _DEBUG
+    static constexpr std::size_t DataSize = 16 * 1024 * 1024;
+#else
+    static constexpr std::size_t DataSize = 100000;
+#endif
+    static constexpr std::size_t Cardinal = 0xFFFFFFFFull;
+
+    std::vector<std::size_t> keys;
+    generate_random_keys<std::size_t, Cardinal>(keys, DataSize);
+
+    printf("jstd::cluster_flat_map<size_t, size_t>, DataSize = %u\n\n", (uint32_t)DataSize);
+    run_batch_vs_scalar<std::size_t, std::size_t>(keys, 32);
+    run_batch_vs_scalar<std::size_t, std::size_t>(keys, 256);
+}
+#endif // USE_JSTD_CLUSTER_FALT_MAP
+
 int main(int argc, char * argv[])
 {
     jstd::RandomGen   RandomGen(20200831);
@@ -779,12 +1096,39 @@ int main(int argc, char * argv[])
 
     jtest::CPU::warm_up(1000);
 
+#if USE_JSTD_CLUSTER_FALT_MAP
+    printf("jstd::cluster_flat_map group kernel: %s\n", jstd::cluster_flat_map<int, int>::group_kernel_name());
+    printf("%s\n", PRINT_MACRO_VAR(CLUSTER_USE_SEPARATE_SLOTS));
+    printf("%s\n", PRINT_MACRO_VAR(CLUSTER_USE_FASTRANGE_INDEX));
+    printf("%s\n\n", PRINT_MACRO_VAR(CLUSTER_USE_PARALLEL_REHASH));
+#endif
+#if USE_JSTD_CLUSTER_FALT_MAP64_DISPATCH
+    printf("jstd::cluster_flat_map64_dispatch selected kernel: %s\n\n",
+           cluster_flat_map64_dispatch<int, int>::group_kernel_name());
+#endif
+
     if (1) { std_hash_test(); }
     if (1) { int_hash_crc32c_test(); }
 
     if (1) { test_map_slot_type(); }
     if (1) { test_hashmap<std::string, std::string>(); }
 
+#if USE_JSTD_CLUSTER_FALT_MAP && USE_BENCH_COLLISION_CHAIN_LENGTH
+    if (1)
+    {
+        printf("------------------------- benchmark_collision_chain_length -------------------------\n\n");
+        benchmark_collision_chain_length();
+    }
+#endif
+
+#if USE_JSTD_CLUSTER_FALT_MAP && USE_BENCH_BATCH_VS_SCALAR
+    if (1)
+    {
+        printf("---------------------------- benchmark_batch_vs_scalar -----------------------------\n\n");
+        benchmark_batch_vs_scalar();
+    }
+#endif
+
     if (1)
     {
         printf("------------------------------ benchmark_all_hashmaps ------------------------------\n\n");
@@ -511,7 +511,7 @@ else(NOT CMAKE_CROSSCOMPILING)
     if (NOT "${CMAKE_SYSTEM_NAME}" STREQUAL "WindowsStore")
         try_compile(GETARCH_RESULT ${GETARCH_DIR}
             SOURCES ${GETARCH_SRC}
-            COMPILE_DEFINITIONS ${EXFLAGS} ${GETARCH_FLAGS} -I"${GETARCH_DIR}" -I"${PROJECT_SOURCE_DIR}/tools/cpuid/" -I"${PROJECT_BINARY_DIR}"
+            COMPILE_DEFINITIONS ${EXFLAGS} ${GETARCH_FLAGS} -I"${GETARCH_DIR}" -I"${PROJECT_SOURCE_DIR}/tools/cpuid/" -I"${PROJECT_SOURCE_DIR}/src" -I"${PROJECT_BINARY_DIR}"
             OUTPUT_VARIABLE GETARCH_LOG
             COPY_FILE ${PROJECT_BINARY_DIR}/tools/cpuid/${GETARCH_BIN}
         )
@@ -20,6 +20,13 @@
 #define JSTD_USE_AVX            1
 #define JSTD_USE_AVX2           1
 
+#define JSTD_USE_ARM_NEON       1
+
+// Force the portable SWAR kernels, even if SSE2 or NEON is available.
+#ifndef JSTD_USE_SWAR
+#define JSTD_USE_SWAR           0
+#endif
+
 #define JSTD_USE_F16C           1
 #define JSTD_USE_RDRND          1
 #define JSTD_USE_SHA            1
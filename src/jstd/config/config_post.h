@@ -45,6 +45,8 @@
 
 #if !defined(JSTD_IS_ARM)
   #undef JSTD_HAVE_NEON
+  #undef JSTD_HAVE_ARM_NEON
+  #undef JSTD_HAVE_ARM_ACLE
 #endif
 
 #if !defined(JSTD_IS_MIPS)
@@ -650,18 +650,22 @@ std::size_t msvc_fnv_1a(const unsigned char * first, std::size_t count)
 #endif /* defined(_ARCH64) */
 
     std::size_t value = FNV_offset_basis;
+    // Use memcpy() to load the words, casting the pointer breaks the strict aliasing
+    // rule, and the compiler may read the key before it is stored.
     if (count == 8) {
-        const unsigned int * dword = (const unsigned int *)first;
         count /= sizeof(unsigned int);
         for (std::size_t next = 0; next < count; ++next) {
-            value ^= (std::size_t)dword[next];
+            unsigned int dword;
+            ::memcpy(&dword, first + next * sizeof(unsigned int), sizeof(unsigned int));
+            value ^= (std::size_t)dword;
             value *= FNV_prime;
         }
     } else if (count == 4) {
-        const unsigned short * word = (const unsigned short *)first;
         count /= sizeof(unsigned short);
         for (std::size_t next = 0; next < count; ++next) {
-            value ^= (std::size_t)word[next];
+            unsigned short word;
+            ::memcpy(&word, first + next * sizeof(unsigned short), sizeof(unsigned short));
+            value ^= (std::size_t)word;
             value *= FNV_prime;
         }
     } else {
@@ -1546,6 +1550,9 @@ class fibonacci_hash_policy
 public:
     typedef std::size_t size_type;
 
+    // The number of the hash bits of the ctrl byte
+    static constexpr std::uint8_t kCtrlHashBits = 7;
+
 private:
     std::uint8_t shift_;
 
@@ -1592,6 +1599,31 @@ public:
 #endif
     }
 
+    //
+    // Mix the hash code of the Hasher once, the index_for_mixed_hash() takes the high bits
+    // and the ctrl_for_mixed_hash() takes the bits below them, they are independent.
+    // The low bits of the fibonacci product are weak, so they are never used.
+    //
+    template <typename Key>
+    size_type mix_hash_code(size_type hash_code) const noexcept {
+        static constexpr bool isExcludedType = is_excluded_type<Key>::value;
+        if (!isExcludedType) {
+            hash_code = static_cast<size_type>(
+                static_cast<std::uint64_t>(hash_code) * 11400714819323198485ull
+            );
+        }
+        return hash_code;
+    }
+
+    size_type index_for_mixed_hash(size_type hash_code) const noexcept {
+        return (hash_code >> this->shift_);
+    }
+
+    size_type ctrl_for_mixed_hash(size_type hash_code) const noexcept {
+        assert(this->shift_ >= kCtrlHashBits);
+        return (hash_code >> (this->shift_ - kCtrlHashBits));
+    }
+
     void commit(std::uint8_t shift) noexcept {
         this->shift_ = shift;
     }
@@ -1653,6 +1685,29 @@ public:
 #endif
     }
 
+    //
+    // Mix the hash code of the Hasher once, the index_for_mixed_hash() takes the high bits
+    // and the ctrl_for_mixed_hash() takes the low bits, they are independent.
+    //
+    template <typename Key>
+    size_type mix_hash_code(size_type hash_code) const noexcept {
+        static constexpr bool isExcludedType = is_excluded_type<Key>::value;
+        if (!isExcludedType) {
+            hash_code = static_cast<size_type>(
+                hashes::mum_hash64(static_cast<std::uint64_t>(hash_code), 11400714819323198485ull)
+            );
+        }
+        return hash_code;
+    }
+
+    size_type index_for_mixed_hash(size_type hash_code) const noexcept {
+        return (hash_code >> this->shift_);
+    }
+
+    size_type ctrl_for_mixed_hash(size_type hash_code) const noexcept {
+        return hash_code;
+    }
+
     void commit(std::uint8_t shift) noexcept {
         this->shift_ = shift;
     }
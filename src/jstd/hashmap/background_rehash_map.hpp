@@ -0,0 +1,492 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_BACKGROUND_REHASH_MAP_HPP
+#define JSTD_HASHMAP_BACKGROUND_REHASH_MAP_HPP
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <memory>               // For std::unique_ptr<T>
+#include <functional>           // For std::hash<Key>
+#include <type_traits>
+#include <utility>              // For std::pair<F, S>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+
+namespace jstd {
+
+//
+// A cluster_flat_map for the read-mostly maps shared by threads: the readers take
+// a shared lock, and the writers take an exclusive lock for a single operation.
+//
+// When the size crosses a soft watermark below the slot threshold, the grown table
+// is built by a helper thread, it copies the live table in chunks, each chunk under
+// a short shared lock. The writes meanwhile are applied to the live table and logged
+// (the erases are deferred, so the live table never moves an element during the copy),
+// then the logged keys are replayed into the new table, the last few ones under
+// the exclusive lock, right before the table pointer is swapped. So the readers
+// are only blocked by the writers, and by the replay of at most kMaxFinalReplaySize
+// keys and the swap at the end of a rehash, never by the copy. A writer only waits
+// if the live table is full before the new table is ready.
+//
+template <typename Key, typename Value,
+          typename Hash = std::hash< typename std::remove_const<Key>::type >,
+          typename KeyEqual = std::equal_to< typename std::remove_const<Key>::type >,
+          typename Allocator = std::allocator< std::pair<const typename std::remove_const<Key>::type,
+                                                         typename std::remove_const<Value>::type> >,
+          typename Group = flat_map_cluster16<cluster_meta_ctrl>,
+          typename LayoutPolicy = jstd::default_layout_policy<Key, Value> >
+class background_rehash_map
+{
+public:
+    typedef cluster_flat_map<Key, Value, Hash, KeyEqual, Allocator, Group, LayoutPolicy> map_type;
+
+    typedef typename map_type::size_type        size_type;
+    typedef typename map_type::key_type         key_type;
+    typedef typename map_type::mapped_type      mapped_type;
+    typedef typename map_type::value_type       value_type;
+    typedef typename map_type::hasher           hasher;
+    typedef typename map_type::key_equal        key_equal;
+    typedef typename map_type::allocator_type   allocator_type;
+
+    typedef typename map_type::iterator         iterator;
+    typedef typename map_type::const_iterator   const_iterator;
+
+    using this_type = background_rehash_map<Key, Value, Hash, KeyEqual, Allocator, Group, LayoutPolicy>;
+
+    // The helper thread starts to build the grown table at
+    // (kDefaultWatermark * slot_threshold) elements.
+    static constexpr float kDefaultWatermark = 0.75f;
+
+    // The smaller tables just grow in the write, it's fast enough.
+    static constexpr size_type kMinBackgroundRehashSize = 4096;
+
+    // The number of elements copied by the helper thread per shared lock.
+    static constexpr size_type kCopyChunkSize = 4096;
+
+    // The logged keys are replayed under the shared lock until they are less than this.
+    static constexpr size_type kMaxFinalReplaySize = 256;
+    static constexpr size_type kMaxReplayRounds = 8;
+
+private:
+    typedef std::shared_mutex                   mutex_type;
+    typedef std::shared_lock<mutex_type>        shared_lock;
+    typedef std::unique_lock<mutex_type>        unique_lock;
+
+    mutable mutex_type          mutex_;
+    std::unique_ptr<map_type>   map_;           // The live table
+    bool                        building_;      // Is the helper thread building the grown table
+    float                       watermark_;
+
+    // Only used while building: the keys written since the build started,
+    // and the erased keys which are still in the live table.
+    std::vector<key_type>                               write_log_;
+    std::unordered_set<key_type, hasher, key_equal>     erased_;
+
+    std::mutex                  builder_mutex_;
+    std::thread                 builder_;
+
+    hasher                      hasher_;
+    key_equal                   key_equal_;
+    allocator_type              allocator_;
+
+public:
+    background_rehash_map() : background_rehash_map(0) {}
+
+    explicit background_rehash_map(size_type capacity, hasher const & hash = hasher(),
+                                   key_equal const & pred = key_equal(),
+                                   allocator_type const & allocator = allocator_type())
+        : map_(new map_type(capacity, hash, pred, allocator)),
+          building_(false), watermark_(kDefaultWatermark),
+          erased_(0, hash, pred),
+          hasher_(hash), key_equal_(pred), allocator_(allocator) {
+    }
+
+    background_rehash_map(background_rehash_map const &) = delete;
+    background_rehash_map & operator = (background_rehash_map const &) = delete;
+
+    ~background_rehash_map() {
+        this->wait_for_rehash();
+    }
+
+    ///
+    /// Capacity
+    ///
+    bool empty() const {
+        return (this->size() == 0);
+    }
+
+    size_type size() const {
+        shared_lock lock(this->mutex_);
+        return (this->map_->size() - this->erased_.size());
+    }
+
+    size_type capacity() const {
+        shared_lock lock(this->mutex_);
+        return this->map_->capacity();
+    }
+
+    ///
+    /// Background rehash
+    ///
+    bool is_rehashing() const {
+        shared_lock lock(this->mutex_);
+        return this->building_;
+    }
+
+    //
+    // Wait until the grown table is swapped in, don't call it in a visitor.
+    //
+    void wait_for_rehash() {
+        std::lock_guard<std::mutex> guard(this->builder_mutex_);
+        if (this->builder_.joinable()) {
+            this->builder_.join();
+        }
+    }
+
+    float rehash_watermark() const {
+        shared_lock lock(this->mutex_);
+        return this->watermark_;
+    }
+
+    //
+    // The ratio of the slot threshold which starts the background rehash, [0.5, 1.0].
+    //
+    void rehash_watermark(float watermark) {
+        if (watermark < 0.5f)
+            watermark = 0.5f;
+        if (watermark > 1.0f)
+            watermark = 1.0f;
+        unique_lock lock(this->mutex_);
+        this->watermark_ = watermark;
+    }
+
+    void reserve(size_type new_capacity) {
+        unique_lock lock = this->lock_not_building();
+        this->map_->reserve(new_capacity);
+    }
+
+    void clear() {
+        unique_lock lock = this->lock_not_building();
+        this->map_->clear();
+    }
+
+    ///
+    /// Lookup
+    ///
+    size_type count(const key_type & key) const {
+        return (this->contains(key) ? 1 : 0);
+    }
+
+    bool contains(const key_type & key) const {
+        shared_lock lock(this->mutex_);
+        if (unlikely(this->building_ && this->is_erased(key)))
+            return false;
+        return this->map_->contains(key);
+    }
+
+    //
+    // Copy the mapped value out, return false if the key is not exists.
+    //
+    bool find(const key_type & key, mapped_type & value) const {
+        return this->visit(key, [&value](const value_type & kv) {
+            value = kv.second;
+        });
+    }
+
+    //
+    // Call visitor(const value_type &) under the shared lock if the key exists.
+    //
+    template <typename Visitor>
+    bool visit(const key_type & key, Visitor && visitor) const {
+        shared_lock lock(this->mutex_);
+        if (unlikely(this->building_ && this->is_erased(key)))
+            return false;
+        const map_type & map = *this->map_;
+        const_iterator iter = map.find(key);
+        if (iter != map.end()) {
+            visitor(*iter);
+            return true;
+        }
+        return false;
+    }
+
+    //
+    // Call visitor(const value_type &) for each element under the shared lock.
+    //
+    template <typename Visitor>
+    void for_each(Visitor && visitor) const {
+        shared_lock lock(this->mutex_);
+        const map_type & map = *this->map_;
+        for (const_iterator iter = map.begin(); iter != map.end(); ++iter) {
+            if (unlikely(this->building_ && this->is_erased(iter->first)))
+                continue;
+            visitor(*iter);
+        }
+    }
+
+    ///
+    /// Modifiers
+    ///
+    bool insert(const value_type & value) {
+        return this->emplace_impl<false>(value.first, value.second);
+    }
+
+    bool insert(const key_type & key, const mapped_type & value) {
+        return this->emplace_impl<false>(key, value);
+    }
+
+    //
+    // Return true if the key is inserted, false if it's assigned.
+    //
+    bool insert_or_assign(const key_type & key, const mapped_type & value) {
+        return this->emplace_impl<true>(key, value);
+    }
+
+    size_type erase(const key_type & key) {
+        unique_lock lock(this->mutex_);
+        if (likely(!this->building_)) {
+            return this->map_->erase(key);
+        }
+
+        // Defer the erase, the helper thread may be copying the live table.
+        if (!this->map_->contains(key))
+            return 0;
+        if (!this->erased_.insert(key).second)
+            return 0;
+        this->write_log_.push_back(key);
+        return 1;
+    }
+
+private:
+    bool is_erased(const key_type & key) const {
+        return (!this->erased_.empty() && (this->erased_.count(key) != 0));
+    }
+
+    //
+    // Return the exclusive lock when the helper thread isn't building.
+    //
+    unique_lock lock_not_building() {
+        for (;;) {
+            unique_lock lock(this->mutex_);
+            if (!this->building_)
+                return lock;
+            lock.unlock();
+            this->wait_for_rehash();
+        }
+    }
+
+    template <bool AlwaysUpdate>
+    bool emplace_impl(const key_type & key, const mapped_type & value) {
+        for (;;) {
+            unique_lock lock(this->mutex_);
+            map_type & map = *this->map_;
+            if (likely(!this->building_)) {
+                bool inserted;
+                if (AlwaysUpdate)
+                    inserted = map.insert_or_assign(key, value).second;
+                else
+                    inserted = map.try_emplace(key, value).second;
+                // The helper thread walks the live table by the iterators during the build,
+                // and the writes of the build would migrate the old elements under them,
+                // so it must not be left in the middle of an incremental rehash.
+                map.finish_rehash();
+                if (inserted && this->need_background_rehash()) {
+                    this->building_ = true;
+                    size_type new_capacity = map.capacity() * 2;
+                    lock.unlock();
+                    this->start_background_rehash(new_capacity);
+                }
+                return inserted;
+            }
+
+            iterator iter = map.find(key);
+            if (iter != map.end()) {
+                // Revive the key which was erased during the build.
+                bool was_erased = (this->erased_.erase(key) != 0);
+                if (AlwaysUpdate || was_erased) {
+                    iter->second = value;
+                    this->write_log_.push_back(key);
+                }
+                return was_erased;
+            }
+
+            // The live table can't grow while the helper thread is copying it.
+            if (map.size() >= map.slot_threshold()) {
+                lock.unlock();
+                this->wait_for_rehash();
+                continue;
+            }
+
+            map.try_emplace(key, value);
+            this->write_log_.push_back(key);
+            return true;
+        }
+    }
+
+    bool need_background_rehash() const {
+        size_type size = this->map_->size();
+        return ((size >= kMinBackgroundRehashSize) &&
+                (size >= static_cast<size_type>(this->watermark_ * this->map_->slot_threshold())));
+    }
+
+    //
+    // Called out of the table lock after building_ is set, the writes from now on
+    // are logged. The last helper thread may still be destroying the old table,
+    // so it's joined here, the readers never wait for it.
+    //
+    void start_background_rehash(size_type new_capacity) {
+        std::lock_guard<std::mutex> guard(this->builder_mutex_);
+        if (this->builder_.joinable()) {
+            this->builder_.join();
+        }
+        try {
+            this->builder_ = std::thread(&this_type::background_rehash, this, new_capacity);
+        } catch (...) {
+            // Can't start the thread, the live table will grow in the write.
+            unique_lock lock(this->mutex_);
+            this->cancel_build();
+        }
+    }
+
+    //
+    // Called under the exclusive lock: apply the deferred erases to the live table
+    // and stop logging the writes.
+    //
+    void cancel_build() {
+        for (const key_type & key : this->erased_) {
+            this->map_->erase(key);
+        }
+        this->write_log_.clear();
+        this->erased_.clear();
+        this->building_ = false;
+    }
+
+    //
+    // Replay the logged keys, the live table has the latest value of them.
+    //
+    void replay_keys(map_type & new_map, const std::vector<key_type> & keys) const {
+        const map_type & map = *this->map_;
+        for (const key_type & key : keys) {
+            const_iterator iter = map.find(key);
+            if ((iter != map.end()) && !this->is_erased(key))
+                new_map.insert_or_assign(key, iter->second);
+            else
+                new_map.erase(key);
+        }
+    }
+
+    //
+    // The helper thread.
+    //
+    void background_rehash(size_type new_capacity) {
+        try {
+            std::unique_ptr<map_type> new_map(new map_type(0, this->hasher_,
+                                                           this->key_equal_, this->allocator_));
+            new_map->rehash(new_capacity);
+            // Copy the live table in chunks. The live table doesn't grow and
+            // doesn't move the elements during the build, so the iterator is still valid
+            // after the lock is released, the new elements are replayed later.
+            const_iterator iter;
+            bool is_first = true;
+            for (;;) {
+                shared_lock lock(this->mutex_);
+                const map_type & map = *this->map_;
+                if (is_first) {
+                    iter = map.begin();
+                    is_first = false;
+                }
+                const_iterator last = map.end();
+                for (size_type n = 0; (n < kCopyChunkSize) && (iter != last); ++n, ++iter) {
+                    new_map->insert(*iter);
+                }
+                if (iter == last)
+                    break;
+            }
+
+            // Replay the write log, only the writers and this thread touch it,
+            // and the writers hold the exclusive lock.
+            std::vector<key_type> keys;
+            for (size_type round = 0; round < kMaxReplayRounds; round++) {
+                shared_lock lock(this->mutex_);
+                if (this->write_log_.size() <= kMaxFinalReplaySize)
+                    break;
+                keys.clear();
+                keys.swap(this->write_log_);
+                this->replay_keys(*new_map, keys);
+            }
+
+            {
+                unique_lock lock(this->mutex_);
+                this->replay_keys(*new_map, this->write_log_);
+                this->map_.swap(new_map);
+                this->write_log_.clear();
+                this->erased_.clear();
+                this->building_ = false;
+            }
+            // new_map is the old live table now, destroy it out of the lock.
+        } catch (...) {
+            // Give up the build, the live table will grow in the write.
+            unique_lock lock(this->mutex_);
+            this->cancel_build();
+        }
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_BACKGROUND_REHASH_MAP_HPP
@@ -67,14 +67,17 @@
 namespace jstd {
 
 template <typename TypePolicy, typename Hash,
-          typename KeyEqual, typename Allocator>
+          typename KeyEqual, typename Allocator,
+          typename Group, typename LayoutPolicy>
 class cluster_flat_table;
 
 template <typename Key, typename Value,
           typename Hash = std::hash< typename std::remove_const<Key>::type >,
           typename KeyEqual = std::equal_to< typename std::remove_const<Key>::type >,
           typename Allocator = std::allocator< std::pair<const typename std::remove_const<Key>::type,
-                                                         typename std::remove_const<Value>::type> > >
+                                                         typename std::remove_const<Value>::type> >,
+          typename Group = flat_map_cluster16<cluster_meta_ctrl>,
+          typename LayoutPolicy = jstd::default_layout_policy<Key, Value> >
 class JSTD_DLL cluster_flat_map
 {
 public:
@@ -97,16 +100,21 @@ public:
     typedef typename std::allocator_traits<allocator_type>::pointer         pointer;
     typedef typename std::allocator_traits<allocator_type>::const_pointer   const_pointer;
 
+    typedef LayoutPolicy                        layout_policy_t;
+
     typedef cluster_flat_table<type_policy, Hash, KeyEqual,
-        typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>>
-                                                table_type;
+        typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>,
+        Group, LayoutPolicy>                    table_type;
 
+    typedef typename table_type::group_type     group_type;
     typedef typename table_type::ctrl_type      ctrl_type;
     typedef typename table_type::slot_type      slot_type;
 
     typedef typename table_type::iterator       iterator;
     typedef typename table_type::const_iterator const_iterator;
 
+    typedef typename table_type::stats_type     stats_type;
+
 private:
     table_type table_;
 
@@ -149,13 +157,13 @@ public:
 
     template <typename Iterator>
     cluster_flat_map(Iterator first, Iterator last, size_type capacity, allocator_type const & allocator)
-        : cluster_flat_map(first, last, size, hasher(), key_equal(), allocator) {
+        : cluster_flat_map(first, last, capacity, hasher(), key_equal(), allocator) {
     }
 
     template <typename Iterator>
     cluster_flat_map(Iterator first, Iterator last, size_type capacity,
                      hasher const & hash, allocator_type const & allocator)
-        : cluster_flat_map(first, last, size, hash, key_equal(), allocator) {
+        : cluster_flat_map(first, last, capacity, hash, key_equal(), allocator) {
     }
 
     cluster_flat_map(cluster_flat_map const & other) : table_(other.table_) {
@@ -178,7 +186,7 @@ public:
                      size_type capacity = 0, hasher const & hash = hasher(),
                      key_equal const & pred = key_equal(),
                      allocator_type const & allocator = allocator_type())
-        : cluster_flat_map(ilist.begin(), ilist.end(), size, hash, pred, allocator) {
+        : cluster_flat_map(ilist.begin(), ilist.end(), capacity, hash, pred, allocator) {
     }
 
     cluster_flat_map(std::initializer_list<value_type> ilist, allocator_type const & allocator)
@@ -187,12 +195,12 @@ public:
 
     cluster_flat_map(std::initializer_list<value_type> init, size_type capacity,
                      allocator_type const & allocator)
-        : cluster_flat_map(init, size, hasher(), key_equal(), allocator) {
+        : cluster_flat_map(init, capacity, hasher(), key_equal(), allocator) {
     }
 
     cluster_flat_map(std::initializer_list<value_type> init, size_type capacity,
                      hasher const & hash, allocator_type const & allocator)
-        : cluster_flat_map(init, size, hash, key_equal(), allocator) {
+        : cluster_flat_map(init, capacity, hash, key_equal(), allocator) {
     }
 
     ~cluster_flat_map() = default;
@@ -214,6 +222,10 @@ public:
         return *this;
     }
 
+    void swap(cluster_flat_map & other) {
+        table_.swap(other.table_);
+    }
+
     ///
     /// Observers
     ///
@@ -229,10 +241,18 @@ public:
         return table_.key_eq();
     }
 
+    std::size_t prehash(const key_type & key) const {
+        return table_.prehash(key);
+    }
+
     static const char * name() noexcept {
         return table_type::name();
     }
 
+    static const char * group_kernel_name() noexcept {
+        return table_type::group_kernel_name();
+    }
+
     ///
     /// Iterators
     ///
@@ -279,6 +299,9 @@ public:
     size_type bucket(const key_type & key) const {
         return table_.bucket(key);
     }
+    size_type home_bucket(const key_type & key) const {
+        return table_.home_bucket(key);
+    }
 
     ///
     /// Hash policy
@@ -286,7 +309,7 @@ public:
     float load_factor() const { return table_.load_factor(); }
     float max_load_factor() const { return table_.max_load_factor(); }
 
-    void max_load_factor(float mlf) const { table_.max_load_factor(mlf); }
+    void max_load_factor(float mlf) { table_.max_load_factor(mlf); }
 
     ///
     /// Hash policy
@@ -303,6 +326,50 @@ public:
         table_.shrink_to_fit(read_only);
     }
 
+    bool is_rehashing() const noexcept {
+        return table_.is_rehashing();
+    }
+
+    void finish_rehash() {
+        table_.finish_rehash();
+    }
+
+    ///
+    /// Statistics, see CLUSTER_USE_STATS
+    ///
+    stats_type stats() const {
+        return table_.stats();
+    }
+
+    void reset_stats() noexcept {
+        table_.reset_stats();
+    }
+
+    ///
+    /// Layout inspection, see HashMapAnalyzer
+    ///
+    static constexpr size_type group_width() noexcept {
+        return table_type::group_width();
+    }
+
+    template <typename Visitor>
+    void visit_slot_layout(Visitor && visitor) const {
+        table_.visit_slot_layout(std::forward<Visitor>(visitor));
+    }
+
+    size_type group_overflow(size_type group_index) const {
+        return table_.group_overflow(group_index);
+    }
+
+    ///
+    /// Memory usage
+    ///
+    map_memory_usage memory_usage() const {
+        map_memory_usage usage = table_.memory_usage();
+        usage.object_bytes = sizeof(*this);
+        return usage;
+    }
+
     ///
     /// Lookup
     ///
@@ -335,6 +402,34 @@ public:
         return table_.find(key);
     }
 
+    ///
+    /// find(key, hash_code)
+    ///
+    template <typename KeyT>
+    iterator find(const KeyT & key, std::size_t hash_code) {
+        return table_.find(key, hash_code);
+    }
+
+    template <typename KeyT>
+    const_iterator find(const KeyT & key, std::size_t hash_code) const {
+        return table_.find(key, hash_code);
+    }
+
+    ///
+    /// find_batch(keys, count, out)
+    ///
+    void find_batch(const key_type * keys, size_type count, iterator * out) {
+        table_.find_batch(keys, count, out);
+    }
+
+    void find_batch(const key_type * keys, size_type count, const_iterator * out) const {
+        table_.find_batch(keys, count, out);
+    }
+
+    void contains_batch(const key_type * keys, size_type count, bool * out) const {
+        table_.contains_batch(keys, count, out);
+    }
+
     ///
     /// Modifiers
     ///
@@ -408,9 +503,7 @@ public:
     template <typename InputIter>
     JSTD_FORCED_INLINE
     void insert(InputIter first, InputIter last) {
-        for (InputIter pos = first; pos != last; ++pos) {
-            table_.emplace(*first);
-        }
+        table_.insert(first, last);
     }
 
     void insert(std::initializer_list<value_type> ilist) {
@@ -422,32 +515,60 @@ public:
     ///
     template <typename MappedT>
     std::pair<iterator, bool> insert_or_assign(const key_type & key, MappedT && value) {
-        return this->emplace_impl<true>(key, std::forward<MappedT>(value));
+        return table_.insert_or_assign(key, std::forward<MappedT>(value));
     }
 
     template <typename MappedT>
     std::pair<iterator, bool> insert_or_assign(key_type && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value));
+        return table_.insert_or_assign(std::move(key), std::forward<MappedT>(value));
     }
 
     template <typename KeyT, typename MappedT>
     std::pair<iterator, bool> insert_or_assign(KeyT && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value));
+        return table_.insert_or_assign(std::forward<KeyT>(key), std::forward<MappedT>(value));
     }
 
     template <typename MappedT>
     iterator insert_or_assign(const_iterator hint, const key_type & key, MappedT && value) {
-        return this->emplace_impl<true>(key, std::forward<MappedT>(value))->first;
+        return table_.insert_or_assign(hint, key, std::forward<MappedT>(value));
     }
 
     template <typename MappedT>
     iterator insert_or_assign(const_iterator hint, key_type && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value))->first;
+        return table_.insert_or_assign(hint, std::move(key), std::forward<MappedT>(value));
     }
 
     template <typename KeyT, typename MappedT>
     iterator insert_or_assign(const_iterator hint, KeyT && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value))->first;
+        return table_.insert_or_assign(hint, std::forward<KeyT>(key), std::forward<MappedT>(value));
+    }
+
+    ///
+    /// insert_batch(values, count)
+    ///
+    template <typename ValueT>
+    size_type insert_batch(const ValueT * values, size_type count) {
+        return table_.insert_batch(values, count);
+    }
+
+    ///
+    /// insert_or_assign_batch(values, count)
+    ///
+    template <typename ValueT>
+    size_type insert_or_assign_batch(const ValueT * values, size_type count) {
+        return table_.insert_or_assign_batch(values, count);
+    }
+
+    size_type insert_or_assign_batch(const key_type * keys, const mapped_type * values, size_type count) {
+        return table_.insert_or_assign_batch(keys, values, count);
+    }
+
+    ///
+    /// parallel_build(first, last, thread_count)
+    ///
+    template <typename InputIter>
+    size_type parallel_build(InputIter first, InputIter last, size_type thread_count = 0) {
+        return table_.parallel_build(first, last, thread_count);
     }
 
     ///
@@ -546,37 +667,65 @@ public:
         return table_.try_emplace(hint, std::forward<KeyT>(key), std::forward<Args>(args)...);
     }
 
+    ///
+    /// emplace_with_hash(hash_code, args...)
+    ///
+    template <typename ... Args>
+    std::pair<iterator, bool> emplace_with_hash(std::size_t hash_code, Args && ... args) {
+        return table_.emplace_with_hash(hash_code, std::forward<Args>(args)...);
+    }
+
+    ///
+    /// try_emplace_with_hash(hash_code, key, args...)
+    ///
+    template <typename KeyT, typename ... Args>
+    std::pair<iterator, bool> try_emplace_with_hash(std::size_t hash_code, KeyT && key, Args && ... args) {
+        return table_.try_emplace_with_hash(hash_code, std::forward<KeyT>(key), std::forward<Args>(args)...);
+    }
+
     ///
     /// erase(key)
     ///
+    /// In the direct mode, the other elements stay where they are, the iterators
+    /// and the references to them are still valid. Except that:
+    ///   - CLUSTER_USE_ERASE_COMPACTION=1 moves the elements of the next groups
+    ///     back into the erased slot, the iterators to them are invalidated;
+    ///   - the indirect mode (kIsIndirectKV) moves the last slot into the erased one,
+    ///     the references to that element are invalidated.
+    ///
     JSTD_FORCED_INLINE
     size_type erase(const key_type & key) {
         return table_.erase(key);
     }
 
+    ///
+    /// erase(key, hash_code)
+    ///
+    JSTD_FORCED_INLINE
+    size_type erase(const key_type & key, std::size_t hash_code) {
+        return table_.erase(key, hash_code);
+    }
+
     JSTD_FORCED_INLINE
-    size_type erase(iterator pos) {
+    iterator erase(iterator pos) {
         return table_.erase(pos);
     }
 
     JSTD_FORCED_INLINE
-    size_type erase(const_iterator pos) {
+    iterator erase(const_iterator pos) {
         return table_.erase(pos);
     }
 
     JSTD_FORCED_INLINE
     iterator erase(const_iterator first, const_iterator last) {
-        for (; first != last; ++first) {
-            this->erase(first);
-        }
-        return { last };
+        return table_.erase(first, last);
     }
 
     template <typename InputIter, typename std::enable_if<
               !jstd::is_same_ex<InputIter, iterator      >::value &&
               !jstd::is_same_ex<InputIter, const_iterator>::value>::type * = nullptr>
     JSTD_FORCED_INLINE
-    iterator erase(InputIter first, InputIter last) {
+    size_type erase(InputIter first, InputIter last) {
         size_type num_deleted = 0;
         for (; first != last; ++first) {
             num_deleted += static_cast<size_type>(this->erase(*first));
@@ -585,6 +734,16 @@ public:
     }
 };
 
+template <typename Key, typename Value, typename Hash, typename KeyEqual,
+          typename Allocator, typename Group, typename LayoutPolicy>
+inline
+void swap(cluster_flat_map<Key, Value, Hash, KeyEqual, Allocator, Group, LayoutPolicy> & lhs,
+          cluster_flat_map<Key, Value, Hash, KeyEqual, Allocator, Group, LayoutPolicy> & rhs)
+          noexcept(noexcept(lhs.swap(rhs)))
+{
+    lhs.swap(rhs);
+}
+
 } // namespace jstd
 
 #endif // JSTD_HASHMAP_CLUSTER_FLAT_MAP_HPP
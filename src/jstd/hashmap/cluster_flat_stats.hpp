@@ -0,0 +1,405 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_CLUSTER_FLAT_STATS_HPP
+#define JSTD_HASHMAP_CLUSTER_FLAT_STATS_HPP
+
+#pragma once
+
+#include <stdint.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <new>              // For std::nothrow
+#include <thread>           // For std::thread::hardware_concurrency()
+
+#include "jstd/basic/stddef.h"
+
+namespace jstd {
+
+//
+// The probing statistics of one kind of operation.
+//
+struct cluster_flat_probe_stats
+{
+    typedef std::size_t size_type;
+
+    // histogram[n - 1] counts the operations which probed n groups,
+    // the last one also counts the operations which probed more groups.
+    static constexpr size_type kHistogramSize = 16;
+
+    size_type count;
+    size_type hits;
+    size_type misses;
+    size_type probed_groups;
+    size_type max_probed_groups;
+    size_type histogram[kHistogramSize];
+
+    cluster_flat_probe_stats() noexcept {
+        this->reset();
+    }
+
+    void reset() noexcept {
+        this->count = 0;
+        this->hits = 0;
+        this->misses = 0;
+        this->probed_groups = 0;
+        this->max_probed_groups = 0;
+        for (size_type i = 0; i < kHistogramSize; i++) {
+            this->histogram[i] = 0;
+        }
+    }
+
+    void record(bool hit, size_type groups) noexcept {
+        this->count++;
+        if (hit)
+            this->hits++;
+        else
+            this->misses++;
+        this->probed_groups += groups;
+        if (groups > this->max_probed_groups)
+            this->max_probed_groups = groups;
+        size_type index = (groups > 0) ? (groups - 1) : 0;
+        if (index >= kHistogramSize)
+            index = kHistogramSize - 1;
+        this->histogram[index]++;
+    }
+
+    double avg_probed_groups() const noexcept {
+        return (this->count != 0) ? ((double)this->probed_groups / this->count) : 0.0;
+    }
+};
+
+//
+// The statistics of cluster_flat_table, see cluster_flat_map::stats().
+//
+// The counters are only updated when CLUSTER_USE_STATS is enabled, and the lookups
+// of the old arrays in the incremental rehash aren't counted. The counters and
+// the table fields are a snapshot taken by stats().
+//
+struct cluster_flat_stats
+{
+    typedef std::size_t size_type;
+
+    bool enabled;
+
+    // find(), count(), contains() and find_batch(), the hit is the key is found.
+    cluster_flat_probe_stats find;
+    // insert(), emplace() and so on, the hit is the key already exists,
+    // the probed groups include the groups probed to find the empty slot.
+    cluster_flat_probe_stats insert;
+    // erase(key), the hit is the key is erased.
+    cluster_flat_probe_stats erase;
+
+    // The incremental rehash only times the switch to the new arrays.
+    size_type       rehash_count;
+    std::uint64_t   rehash_time_ns;
+
+    size_type       size;
+    size_type       slot_capacity;
+    size_type       group_capacity;
+    // The groups which have any overflow bit (or a non-zero overflow counter).
+    size_type       overflow_groups;
+
+    cluster_flat_stats() noexcept
+        : enabled(false), rehash_count(0), rehash_time_ns(0),
+          size(0), slot_capacity(0), group_capacity(0), overflow_groups(0) {
+    }
+
+    void reset_counters() noexcept {
+        this->find.reset();
+        this->insert.reset();
+        this->erase.reset();
+        this->rehash_count = 0;
+        this->rehash_time_ns = 0;
+    }
+
+    double load_factor() const noexcept {
+        return (this->slot_capacity != 0) ? ((double)this->size / this->slot_capacity) : 0.0;
+    }
+
+    double overflow_density() const noexcept {
+        return (this->group_capacity != 0) ? ((double)this->overflow_groups / this->group_capacity) : 0.0;
+    }
+};
+
+//
+// The probing counters of one kind of operation kept by a stripe of the table.
+//
+// A stripe is only written by the threads mapped to it, so the counters are
+// bumped by a relaxed load and store instead of the locked read-modify-write.
+// If more threads than the stripes record at the same time, two of them may
+// share a stripe and lose a few counts, it's good enough for the statistics.
+//
+struct cluster_flat_atomic_probe_stats
+{
+    typedef std::size_t size_type;
+
+    static constexpr size_type kHistogramSize = cluster_flat_probe_stats::kHistogramSize;
+
+    std::atomic<size_type> hits;
+    std::atomic<size_type> misses;
+    std::atomic<size_type> probed_groups;
+    std::atomic<size_type> max_probed_groups;
+    std::atomic<size_type> histogram[kHistogramSize];
+
+    cluster_flat_atomic_probe_stats() noexcept {
+        this->reset();
+    }
+
+    static void add(std::atomic<size_type> & counter, size_type n) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void reset() noexcept {
+        this->hits.store(0, std::memory_order_relaxed);
+        this->misses.store(0, std::memory_order_relaxed);
+        this->probed_groups.store(0, std::memory_order_relaxed);
+        this->max_probed_groups.store(0, std::memory_order_relaxed);
+        for (size_type i = 0; i < kHistogramSize; i++) {
+            this->histogram[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(bool hit, size_type groups) noexcept {
+        if (hit)
+            add(this->hits, 1);
+        else
+            add(this->misses, 1);
+        add(this->probed_groups, groups);
+        if (groups > this->max_probed_groups.load(std::memory_order_relaxed))
+            this->max_probed_groups.store(groups, std::memory_order_relaxed);
+        size_type index = (groups > 0) ? (groups - 1) : 0;
+        if (index >= kHistogramSize)
+            index = kHistogramSize - 1;
+        add(this->histogram[index], 1);
+    }
+
+    // Sum the counters of this stripe into the stats.
+    void add_to(cluster_flat_probe_stats & stats) const noexcept {
+        size_type hits = this->hits.load(std::memory_order_relaxed);
+        size_type misses = this->misses.load(std::memory_order_relaxed);
+        stats.hits += hits;
+        stats.misses += misses;
+        stats.count += hits + misses;
+        stats.probed_groups += this->probed_groups.load(std::memory_order_relaxed);
+        size_type max_groups = this->max_probed_groups.load(std::memory_order_relaxed);
+        if (max_groups > stats.max_probed_groups)
+            stats.max_probed_groups = max_groups;
+        for (size_type i = 0; i < kHistogramSize; i++) {
+            stats.histogram[i] += this->histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+//
+// The counters of cluster_flat_stats kept by the table, see cluster_flat_stats.
+//
+// The const lookups may run on many threads at the same time, so the counters
+// are striped over some cache lines, each one is aligned to a cache line, a thread
+// only records into the stripe of its own, and load() sums all the stripes.
+//
+// The stripes are about 500 bytes each, so they are allocated at the first record
+// instead of being embedded in the table, and there are only as many of them as
+// the hardware threads (rounded up to power of 2, at most kMaxStripes).
+//
+struct cluster_flat_atomic_stats
+{
+    typedef std::size_t size_type;
+
+    static constexpr size_type kMaxStripes = 16;
+    static constexpr size_type kCacheLineSize = 64;
+
+    static_assert(((kMaxStripes & (kMaxStripes - 1)) == 0),
+                  "jstd::cluster_flat_atomic_stats: kMaxStripes must be power of 2.");
+
+    struct alignas(kCacheLineSize) stripe_type {
+        cluster_flat_atomic_probe_stats find;
+        cluster_flat_atomic_probe_stats insert;
+        cluster_flat_atomic_probe_stats erase;
+
+        std::atomic<size_type>      rehash_count;
+        std::atomic<std::uint64_t>  rehash_time_ns;
+
+        stripe_type() noexcept
+            : rehash_count(0), rehash_time_ns(0) {
+        }
+
+        void reset() noexcept {
+            this->find.reset();
+            this->insert.reset();
+            this->erase.reset();
+            this->rehash_count.store(0, std::memory_order_relaxed);
+            this->rehash_time_ns.store(0, std::memory_order_relaxed);
+        }
+
+        void record_rehash(std::uint64_t time_ns) noexcept {
+            cluster_flat_atomic_probe_stats::add(this->rehash_count, 1);
+            this->rehash_time_ns.store(this->rehash_time_ns.load(std::memory_order_relaxed) + time_ns,
+                                       std::memory_order_relaxed);
+        }
+    };
+
+private:
+    // nullptr until the first record.
+    std::atomic<stripe_type *> stripes_;
+
+    static size_type stripe_count() noexcept {
+        static const size_type s_stripe_count = cluster_flat_atomic_stats::calc_stripe_count();
+        return s_stripe_count;
+    }
+
+    static size_type calc_stripe_count() noexcept {
+        size_type threads = static_cast<size_type>(std::thread::hardware_concurrency());
+        size_type stripes = 1;
+        while (stripes < threads && stripes < kMaxStripes) {
+            stripes <<= 1;
+        }
+        return stripes;
+    }
+
+    // The thread_local is constant initialized, so it's read without the TLS init wrapper.
+    static size_type thread_stripe() noexcept {
+        static std::atomic<size_type> s_next_stripe(0);
+        static thread_local size_type t_stripe = kMaxStripes;
+        if (t_stripe == kMaxStripes) {
+            t_stripe = s_next_stripe.fetch_add(1, std::memory_order_relaxed) & (kMaxStripes - 1);
+        }
+        return (t_stripe & (cluster_flat_atomic_stats::stripe_count() - 1));
+    }
+
+    // The concurrent const lookups may race to allocate, the loser frees its stripes.
+    // Returns nullptr if out of memory, then the counters are not recorded.
+    JSTD_NO_INLINE
+    stripe_type * allocate_stripes() noexcept {
+        stripe_type * stripes = new (std::nothrow) stripe_type[cluster_flat_atomic_stats::stripe_count()];
+        if (stripes != nullptr) {
+            stripe_type * expected = nullptr;
+            if (!this->stripes_.compare_exchange_strong(expected, stripes,
+                                                        std::memory_order_acq_rel,
+                                                        std::memory_order_acquire)) {
+                delete[] stripes;
+                stripes = expected;
+            }
+        }
+        return stripes;
+    }
+
+public:
+    cluster_flat_atomic_stats() noexcept : stripes_(nullptr) {}
+
+    // The statistics belong to a table object, they aren't copied.
+    cluster_flat_atomic_stats(const cluster_flat_atomic_stats &) = delete;
+    cluster_flat_atomic_stats & operator = (const cluster_flat_atomic_stats &) = delete;
+
+    ~cluster_flat_atomic_stats() {
+        delete[] this->stripes_.load(std::memory_order_relaxed);
+    }
+
+    // The stripe of the calling thread, or nullptr if the stripes can't be allocated.
+    stripe_type * local() noexcept {
+        stripe_type * stripes = this->stripes_.load(std::memory_order_acquire);
+        if (likely(stripes != nullptr))
+            return (stripes + cluster_flat_atomic_stats::thread_stripe());
+        stripes = this->allocate_stripes();
+        return (stripes != nullptr) ? (stripes + cluster_flat_atomic_stats::thread_stripe()) : nullptr;
+    }
+
+    void record_find(bool hit, size_type groups) noexcept {
+        stripe_type * stripe = this->local();
+        if (stripe != nullptr)
+            stripe->find.record(hit, groups);
+    }
+
+    void record_insert(bool hit, size_type groups) noexcept {
+        stripe_type * stripe = this->local();
+        if (stripe != nullptr)
+            stripe->insert.record(hit, groups);
+    }
+
+    void record_erase(bool hit, size_type groups) noexcept {
+        stripe_type * stripe = this->local();
+        if (stripe != nullptr)
+            stripe->erase.record(hit, groups);
+    }
+
+    void record_rehash(std::uint64_t time_ns) noexcept {
+        stripe_type * stripe = this->local();
+        if (stripe != nullptr)
+            stripe->record_rehash(time_ns);
+    }
+
+    void reset_counters() noexcept {
+        stripe_type * stripes = this->stripes_.load(std::memory_order_acquire);
+        if (stripes != nullptr) {
+            for (size_type i = 0; i < cluster_flat_atomic_stats::stripe_count(); i++) {
+                stripes[i].reset();
+            }
+        }
+    }
+
+    void load(cluster_flat_stats & stats) const noexcept {
+        stats.reset_counters();
+        const stripe_type * stripes = this->stripes_.load(std::memory_order_acquire);
+        if (stripes != nullptr) {
+            for (size_type i = 0; i < cluster_flat_atomic_stats::stripe_count(); i++) {
+                const stripe_type & stripe = stripes[i];
+                stripe.find.add_to(stats.find);
+                stripe.insert.add_to(stats.insert);
+                stripe.erase.add_to(stats.erase);
+                stats.rehash_count += stripe.rehash_count.load(std::memory_order_relaxed);
+                stats.rehash_time_ns += stripe.rehash_time_ns.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_CLUSTER_FLAT_STATS_HPP
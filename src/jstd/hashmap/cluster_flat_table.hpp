@@ -55,12 +55,18 @@
 #include <stdint.h>
 
 #include <cstdint>
+#include <cstring>          // For std::memcpy()
 #include <memory>           // For std::allocator<T>
 #include <limits>           // For std::numeric_limits<T>
 #include <initializer_list>
 #include <type_traits>
 #include <algorithm>        // For std::max()
 #include <utility>          // For std::pair<F, S>
+#include <chrono>           // For std::chrono::steady_clock
+#include <iterator>         // For std::iterator_traits<T>
+#include <vector>
+#include <thread>           // For std::thread::hardware_concurrency()
+#include <atomic>
 
 #include <assert.h>
 
@@ -75,18 +81,116 @@
 
 #include "jstd/hashmap/flat_map_iterator.hpp"
 #include "jstd/hashmap/flat_map_cluster.hpp"
+#include "jstd/hashmap/flat_map_cluster_dispatch.hpp"
 
 #include "jstd/hashmap/flat_map_type_policy.hpp"
 #include "jstd/hashmap/flat_map_slot_policy.hpp"
 #include "jstd/hashmap/slot_policy_traits.h"
 #include "jstd/hashmap/flat_map_slot_storage.hpp"
-
-#define CLUSTER_USE_HASH_POLICY     0
+#include "jstd/hashmap/map_layout_policy.h"
+#include "jstd/hashmap/cluster_flat_stats.hpp"
+#include "jstd/hashmap/map_memory_usage.h"
+#include "jstd/hashmap/run_in_threads.hpp"
+
+// Allocate the groups and the slots separately, otherwise they share one allocation,
+// the ctrls (with the indexes and the overflow counters) are placed just before the slots.
+#ifndef CLUSTER_USE_SEPARATE_SLOTS
 #define CLUSTER_USE_SEPARATE_SLOTS  1
+#endif
 #define CLUSTER_USE_SWAP_TRAITS     1
 
 #define CLUSTER_USE_GROUP_SCAN      1
 
+// Pull the displaced elements back into the group after erase(key),
+// and clear the overflow bits that no probe chain needs any more.
+// It moves the other elements, so the iterators to them are invalidated.
+// Otherwise erase(key) only clears the overflow bits, like erase(iterator).
+#ifndef CLUSTER_USE_ERASE_COMPACTION
+#define CLUSTER_USE_ERASE_COMPACTION    0
+#endif
+
+// Use a saturating overflow counter per group instead of the overflow bit of
+// the ctrls. Erase decrements the counters along the probe chain, so the misses
+// stop at the home group again after the displaced keys are erased.
+#ifndef CLUSTER_USE_OVERFLOW_COUNTER
+#define CLUSTER_USE_OVERFLOW_COUNTER    0
+#endif
+
+// Store the large key/value types in a dense slot array, and the ctrl only maps
+// to the slot by an index, so the probing and the rehash don't touch the big slots.
+#ifndef CLUSTER_USE_INDIRECT_KV
+#define CLUSTER_USE_INDIRECT_KV         1
+#endif
+
+// Grow the table incrementally: the old arrays are kept after the growth, and each
+// insert, find and erase migrates a few old groups into the new arrays, so no single
+// insert pays for the whole rehash. The lookups consult both arrays until the migration
+// is complete. Only the non-const operations migrate, the const lookups are read-only.
+#ifndef CLUSTER_USE_INCREMENTAL_REHASH
+#define CLUSTER_USE_INCREMENTAL_REHASH  0
+#endif
+
+// The number of the old groups migrated by each insert, find and erase.
+#ifndef CLUSTER_INCREMENTAL_REHASH_GROUPS
+#define CLUSTER_INCREMENTAL_REHASH_GROUPS   1
+#endif
+
+// Map the hash code to the slot index by the multiply-shift range reduction (fastrange)
+// instead of the slot mask, so the capacity can be any multiple of the group width,
+// the table grows by CLUSTER_FASTRANGE_GROWTH_PERCENT and reserve() isn't rounded up to the power of 2.
+#ifndef CLUSTER_USE_FASTRANGE_INDEX
+#define CLUSTER_USE_FASTRANGE_INDEX     0
+#endif
+
+// The growth rate in the fastrange index mode, in percent.
+#ifndef CLUSTER_FASTRANGE_GROWTH_PERCENT
+#define CLUSTER_FASTRANGE_GROWTH_PERCENT    150
+#endif
+
+// Mix the hash code of the Hasher once by the hash policy (see hashes.h), the index
+// and the ctrl hash are taken from the independent bits of the mixed hash code,
+// so the identity hashes (e.g. std::hash<int>) don't cluster the probe chains.
+// The incremental rehash and the fastrange index still use the slot mask path.
+#ifndef CLUSTER_USE_HASH_POLICY
+#if CLUSTER_USE_INCREMENTAL_REHASH || CLUSTER_USE_FASTRANGE_INDEX
+#define CLUSTER_USE_HASH_POLICY     0
+#else
+#define CLUSTER_USE_HASH_POLICY     1
+#endif
+#endif
+
+#if CLUSTER_USE_INCREMENTAL_REHASH && CLUSTER_USE_HASH_POLICY
+#error "CLUSTER_USE_INCREMENTAL_REHASH doesn't support CLUSTER_USE_HASH_POLICY."
+#endif
+
+#if CLUSTER_USE_FASTRANGE_INDEX && CLUSTER_USE_HASH_POLICY
+#error "CLUSTER_USE_FASTRANGE_INDEX doesn't support CLUSTER_USE_HASH_POLICY."
+#endif
+
+// Migrate the elements of rehash_impl() (the growth, reserve(), rehash() and shrink_to_fit())
+// by a pool of threads: the old groups are split into stripes, and the threads claim the empty
+// ctrl bytes of the new groups by the atomic compare-and-swap. The small tables, the indirect mode,
+// the overflow counter and the throwing moves are still migrated serially.
+#ifndef CLUSTER_USE_PARALLEL_REHASH
+#define CLUSTER_USE_PARALLEL_REHASH     0
+#endif
+
+// The number of the threads of the parallel rehash, 0 means std::thread::hardware_concurrency().
+#ifndef CLUSTER_PARALLEL_REHASH_THREADS
+#define CLUSTER_PARALLEL_REHASH_THREADS     0
+#endif
+
+// The parallel rehash only migrates the tables which have this number of elements at least.
+#ifndef CLUSTER_PARALLEL_REHASH_MIN_SIZE
+#define CLUSTER_PARALLEL_REHASH_MIN_SIZE    (256 * 1024)
+#endif
+
+// Count the groups probed by find, insert and erase, the hits and the misses,
+// and the rehashes, see cluster_flat_map::stats().
+#ifndef CLUSTER_USE_STATS
+#define CLUSTER_USE_STATS               0
+#endif
+
 #ifdef _DEBUG
 #define CLUSTER_DISPLAY_DEBUG_INFO  1
 #endif
@@ -94,7 +198,10 @@
 namespace jstd {
 
 template <typename TypePolicy, typename Hash,
-          typename KeyEqual, typename Allocator>
+          typename KeyEqual, typename Allocator,
+          typename Group = flat_map_cluster16<cluster_meta_ctrl>,
+          typename LayoutPolicy = default_layout_policy<typename TypePolicy::key_type,
+                                                        typename TypePolicy::mapped_type>>
 class JSTD_DLL cluster_flat_table
 {
 public:
@@ -118,7 +225,7 @@ public:
     typedef typename std::allocator_traits<allocator_type>::pointer         pointer;
     typedef typename std::allocator_traits<allocator_type>::const_pointer   const_pointer;
 
-    using this_type = cluster_flat_table<TypePolicy, Hash, KeyEqual, Allocator>;
+    using this_type = cluster_flat_table<TypePolicy, Hash, KeyEqual, Allocator, Group, LayoutPolicy>;
 
     static constexpr bool kUseIndexSalt = false;
     static constexpr bool kEnableExchange = true;
@@ -128,8 +235,9 @@ public:
 
     static constexpr size_type npos = static_cast<size_type>(-1);
 
-    using ctrl_type = cluster_meta_ctrl;
-    using group_type = flat_map_cluster16<cluster_meta_ctrl>;
+    using group_type = Group;
+    using ctrl_type = typename group_type::ctrl_type;
+    using bitmask_type = typename group_type::bitmask_type;
 
     static constexpr std::uint8_t kHashMask     = ctrl_type::kHashMask;
     static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
@@ -171,18 +279,30 @@ public:
     static constexpr bool kIsSmallKeyType   = (sizeof(key_type)    <= kSizeTypeLength * 2);
     static constexpr bool kIsSmallValueType = (sizeof(mapped_type) <= kSizeTypeLength * 2);
 
+    //
+    // The types up to 32 bytes (e.g. std::string) are cheap enough to move,
+    // the extra slot index only pays off for the larger types.
+    //
     static constexpr bool kDetectIsIndirectKey = !(jstd::is_plain_type<key_type>::value ||
-                                                  (sizeof(key_type) <= kSizeTypeLength * 2) ||
-                                                 ((sizeof(key_type) <= (kSizeTypeLength * 4)) &&
-                                                   is_slot_trivial_destructor));
+                                                  (sizeof(key_type) <= kSizeTypeLength * 4));
 
     static constexpr bool kDetectIsIndirectValue = !(jstd::is_plain_type<mapped_type>::value ||
-                                                    (sizeof(mapped_type) <= kSizeTypeLength * 2) ||
-                                                   ((sizeof(mapped_type) <= (kSizeTypeLength * 4)) &&
-                                                     is_slot_trivial_destructor));
+                                                    (sizeof(mapped_type) <= kSizeTypeLength * 4));
+
+    using layout_policy_t = LayoutPolicy;
+
+    //
+    // The layout policy can force the indirect mode, e.g. dense_layout_policy<K, V>,
+    // then the slots are dense and in insertion order (erase moves the last slot into the hole),
+    // the iteration, clear() and destroy only touch the live slots.
+    //
+    static constexpr bool kIsIndirectKey =
+        (!layout_policy_t::autoDetectIsIndirectKey && layout_policy_t::isIndirectKey) ||
+         (layout_policy_t::autoDetectIsIndirectKey && (CLUSTER_USE_INDIRECT_KV != 0) && kDetectIsIndirectKey);
 
-    static constexpr bool kIsIndirectKey = false;
-    static constexpr bool kIsIndirectValue = false;
+    static constexpr bool kIsIndirectValue =
+        (!layout_policy_t::autoDetectIsIndirectValue && layout_policy_t::isIndirectValue) ||
+         (layout_policy_t::autoDetectIsIndirectValue && (CLUSTER_USE_INDIRECT_KV != 0) && kDetectIsIndirectValue);
     static constexpr bool kIsIndirectKV = kIsIndirectKey | kIsIndirectValue;
     static constexpr bool kNeedStoreHash = true;
 
@@ -214,9 +334,89 @@ public:
     static constexpr size_type kLoadFactorAmplify = 256;
     static constexpr size_type kDefaultMaxLoadFactor =
         static_cast<size_type>((double)kLoadFactorAmplify * (double)kDefaultLoadFactorF + 0.5);
+    static constexpr size_type kMaxLoadFactor =
+        static_cast<size_type>((double)kLoadFactorAmplify * (double)kMaxLoadFactorF + 0.5);
 
     static constexpr size_type kSkipGroupsLimit = 5;
 
+    // The max number of groups that erase compaction shifts backward at once, and
+    // that an erase clears the overflow bits of. The overflow bits set by a longer
+    // probe chain stay set until the next rehash, they only make the misses probe
+    // more groups.
+    static constexpr size_type kCompactGroupsLimit = 4;
+
+    // The number of the old groups migrated by each insert, find and erase,
+    // and the smaller tables are still rehashed at once.
+    static constexpr bool kIsIncrementalRehash = (CLUSTER_USE_INCREMENTAL_REHASH != 0);
+    static constexpr size_type kRehashGroupsPerStep = CLUSTER_INCREMENTAL_REHASH_GROUPS;
+    static constexpr size_type kMinIncrementalRehashSize = kGroupWidth * 64;
+
+    // The growth rate of the fastrange index mode, the power of 2 mode always doubles.
+    static constexpr size_type kGrowthPercent = CLUSTER_FASTRANGE_GROWTH_PERCENT;
+
+    static_assert((kGrowthPercent > 100),
+                  "jstd::cluster_flat_table: CLUSTER_FASTRANGE_GROWTH_PERCENT must be bigger than 100.");
+
+    // The headroom of reserve() in the fastrange index mode, in percent.
+    static constexpr size_type kReserveHeadroomPercent = (100 + kGrowthPercent) / 2;
+
+#if CLUSTER_USE_OVERFLOW_COUNTER
+    // The overflow counter saturates at this value and never decreases again
+    static constexpr std::uint8_t kOverflowCounterMax = 0xFF;
+    static constexpr size_type kOverflowCounterBytes = 1;
+#else
+    static constexpr size_type kOverflowCounterBytes = 0;
+#endif
+
+    // In the indirect mode, each ctrl has a slot index, and each slot has
+    // the ctrl index back, they are stored after the groups.
+    using index_type = std::uint32_t;
+
+    static constexpr size_type kIndexBytes = kIsIndirectKV ? (sizeof(index_type) * 2) : 0;
+
+    // The bytes per group of the backing group array: the group, the indexes and the overflow counter.
+    static constexpr size_type kGroupTotalBytes = sizeof(group_type) + kGroupWidth * kIndexBytes +
+                                                  kOverflowCounterBytes;
+
+    // The number of keys per chunk of find_batch() and insert_batch()
+    static constexpr size_type kFindBatchSize = 16;
+    // The prefetch distance of find_batch() in keys, must be power of 2
+    static constexpr size_type kFindBatchDistance = kFindBatchSize * 2;
+    // insert_batch() only prefetches if the slots are this large at least, the smaller
+    // tables are mostly in the cache, the prefetches make the inserts slower
+    static constexpr size_type kBatchPrefetchMinBytes = 16 * 1024 * 1024;
+
+    static_assert(((kFindBatchDistance & (kFindBatchDistance - 1)) == 0) &&
+                  (kFindBatchDistance >= kFindBatchSize * 2),
+                  "jstd::cluster_flat_table: kFindBatchDistance must be power of 2 and >= 2 chunks.");
+
+    // parallel_build(): the smaller ranges are inserted serially, the partition
+    // of each value is stored in a byte, and each thread fills 16 groups at least.
+    static constexpr size_type kMinParallelBuildSize = 16384;
+    static constexpr size_type kMaxBuildThreads = 256;
+    static constexpr size_type kMinBuildGroupsPerThread = 16;
+
+    // The atomic ctrl bytes need the compiler intrinsics.
+#if defined(__GNUC__) || defined(__clang__) || \
+    (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)))
+    static constexpr bool kHasAtomicCtrl = (sizeof(ctrl_type) == 1);
+#else
+    static constexpr bool kHasAtomicCtrl = false;
+#endif
+
+    static constexpr bool kIsParallelRehash =
+        (CLUSTER_USE_PARALLEL_REHASH != 0) && (CLUSTER_USE_OVERFLOW_COUNTER == 0) &&
+        !kIsIndirectKV && kHasAtomicCtrl &&
+        std::is_nothrow_move_constructible<key_type>::value &&
+        std::is_nothrow_move_constructible<mapped_type>::value;
+
+    static constexpr size_type kParallelRehashThreads = CLUSTER_PARALLEL_REHASH_THREADS;
+    static constexpr size_type kMinParallelRehashSize = CLUSTER_PARALLEL_REHASH_MIN_SIZE;
+
+    // The old groups are split into (threads * kRehashStripesPerThread) stripes,
+    // the threads take the next stripe when they finish one.
+    static constexpr size_type kRehashStripesPerThread = 8;
+
     using group_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<group_type>;
     using ctrl_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<ctrl_type>;
     using slot_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<slot_type>;
@@ -229,17 +429,43 @@ public:
 
     using hash_policy_t = typename hash_policy_selector<Hash>::type;
 
+    using kernel_traits = cluster_kernel_traits<group_type>;
+    using kernel_type = typename kernel_traits::kernel_type;
+
+    using stats_type = cluster_flat_stats;
+
 private:
     group_type *    groups_;
     slot_type *     slots_;
+    index_type *    indices_;       // Only used in the indirect mode
     size_type       slot_size_;
     size_type       slot_mask_;     // slot_capacity = slot_mask + 1
     size_type       slot_threshold_;
 
     size_type       mlf_;
 
-#if CLUSTER_USE_SEPARATE_SLOTS
-    group_type *    groups_alloc_;
+    kernel_type     kernel_;        // The match kernel of the groups, chosen once
+
+    group_type *    groups_alloc_;  // The beginning of the backing allocation of groups
+
+#if CLUSTER_USE_INCREMENTAL_REHASH
+    //
+    // The old arrays which are being migrated by the incremental rehash,
+    // slots is nullptr if there is no rehash in progress.
+    //
+    struct old_arrays {
+        group_type *    groups = nullptr;
+        group_type *    groups_alloc = nullptr;
+        slot_type *     slots = nullptr;
+        index_type *    indices = nullptr;
+        size_type       slot_size = 0;      // The elements haven't been migrated yet
+        size_type       slot_mask = 0;
+        size_type       group_capacity = 0;
+        size_type       migrate_pos = 0;    // The next group, or the next dense slot in the indirect mode
+        size_type       last_pos = 0;
+    };
+
+    old_arrays      old_;
 #endif
 
 #if CLUSTER_USE_HASH_POLICY
@@ -254,40 +480,124 @@ private:
     ctrl_allocator_type     ctrl_allocator_;
     slot_allocator_type     slot_allocator_;
 
+#if CLUSTER_USE_STATS
+    // The statistics belong to this table object, they aren't copied, moved or swapped.
+    // The const lookups update them too, so they are striped by the threads,
+    // and the stripes are allocated at the first record.
+    mutable cluster_flat_atomic_stats stats_;
+#endif
+
     static constexpr bool kIsExists = false;
     static constexpr bool kNeedInsert = true;
 
+    // The iterator uses skip_empty_slots()
+    template <typename, typename, bool>
+    friend class flat_map_iterator;
+
 public:
     cluster_flat_table() : cluster_flat_table(kDefaultCapacity) {}
 
     explicit cluster_flat_table(size_type capacity, hasher const & hash = hasher(),
                                 key_equal const & pred = key_equal(),
                                 allocator_type const & allocator = allocator_type())
-        : groups_(nullptr), slots_(nullptr), slot_size_(0), slot_mask_(static_cast<size_type>(capacity - 1)),
-          slot_threshold_(calc_slot_threshold(kDefaultMaxLoadFactor, capacity)), mlf_(kDefaultMaxLoadFactor)
-#if CLUSTER_USE_SEPARATE_SLOTS
-          , groups_alloc_(nullptr)
-#endif
+        : groups_(nullptr), slots_(nullptr), indices_(nullptr),
+          slot_size_(0), slot_mask_(static_cast<size_type>(capacity - 1)),
+          slot_threshold_(calc_slot_threshold(kDefaultMaxLoadFactor, capacity)), mlf_(kDefaultMaxLoadFactor),
+          kernel_(kernel_traits::kernel()),
+          groups_alloc_(nullptr),
+          hasher_(hash), key_equal_(pred),
+          allocator_(allocator), group_allocator_(allocator),
+          ctrl_allocator_(allocator), slot_allocator_(allocator)
     {
         this->create_slots<true>(capacity);
     }
 
-    cluster_flat_table(cluster_flat_table const & other) {
-    }
-
-    cluster_flat_table(cluster_flat_table const & other, allocator_type const & allocator) {
+    cluster_flat_table(cluster_flat_table const & other)
+        : cluster_flat_table(other, AllocTraits::select_on_container_copy_construction(other.get_allocator())) {
     }
 
-    cluster_flat_table(cluster_flat_table && other) {
+    cluster_flat_table(cluster_flat_table const & other, allocator_type const & allocator)
+        : groups_(this_type::default_empty_groups()), slots_(nullptr), indices_(nullptr),
+          slot_size_(0), slot_mask_(0), slot_threshold_(0), mlf_(other.mlf_),
+          kernel_(kernel_traits::kernel()),
+          groups_alloc_(this_type::default_empty_groups()),
+#if CLUSTER_USE_HASH_POLICY
+          hash_policy_(other.hash_policy_),
+#endif
+          hasher_(other.hasher_), key_equal_(other.key_equal_),
+          allocator_(allocator), group_allocator_(allocator),
+          ctrl_allocator_(allocator), slot_allocator_(allocator) {
+        this->copy_slots_from<false>(other);
+    }
+
+    cluster_flat_table(cluster_flat_table && other) noexcept(
+            std::is_nothrow_copy_constructible<hasher>::value &&
+            std::is_nothrow_copy_constructible<key_equal>::value &&
+            std::is_nothrow_copy_constructible<allocator_type>::value)
+        : groups_(jstd::exchange(other.groups_, this_type::default_empty_groups())),
+          slots_(jstd::exchange(other.slots_, nullptr)),
+          indices_(jstd::exchange(other.indices_, nullptr)),
+          slot_size_(jstd::exchange(other.slot_size_, 0)),
+          slot_mask_(jstd::exchange(other.slot_mask_, 0)),
+          slot_threshold_(jstd::exchange(other.slot_threshold_, 0)),
+          mlf_(other.mlf_),
+          kernel_(kernel_traits::kernel()),
+          groups_alloc_(jstd::exchange(other.groups_alloc_, this_type::default_empty_groups())),
+#if CLUSTER_USE_INCREMENTAL_REHASH
+          old_(jstd::exchange(other.old_, old_arrays())),
+#endif
+#if CLUSTER_USE_HASH_POLICY
+          hash_policy_(jstd::exchange(other.hash_policy_, hash_policy_t())),
+#endif
+          hasher_(other.hasher_), key_equal_(other.key_equal_),
+          allocator_(other.allocator_), group_allocator_(other.group_allocator_),
+          ctrl_allocator_(other.ctrl_allocator_), slot_allocator_(other.slot_allocator_) {
     }
 
-    cluster_flat_table(cluster_flat_table && other, allocator_type const & allocator) {
+    cluster_flat_table(cluster_flat_table && other, allocator_type const & allocator)
+        : groups_(this_type::default_empty_groups()), slots_(nullptr), indices_(nullptr),
+          slot_size_(0), slot_mask_(0), slot_threshold_(0), mlf_(other.mlf_),
+          kernel_(kernel_traits::kernel()),
+          groups_alloc_(this_type::default_empty_groups()),
+#if CLUSTER_USE_HASH_POLICY
+          hash_policy_(other.hash_policy_),
+#endif
+          hasher_(other.hasher_), key_equal_(other.key_equal_),
+          allocator_(allocator), group_allocator_(allocator),
+          ctrl_allocator_(allocator), slot_allocator_(allocator) {
+        if (allocator == other.get_allocator()) {
+            // Swap content only
+            this->swap_content(other);
+        } else {
+            // The allocators are different, move the elements one by one.
+            this->copy_slots_from<true>(other);
+            other.destroy();
+        }
     }
 
     ~cluster_flat_table() {
         this->destroy();
     }
 
+    cluster_flat_table & operator = (cluster_flat_table const & other) {
+        if (std::addressof(other) != this) {
+            this_type tmp(other,
+                          AllocTraits::propagate_on_container_copy_assignment::value
+                          ? other.get_allocator()
+                          : this->get_allocator());
+            this->assign_impl(tmp, AllocTraits::propagate_on_container_copy_assignment::value);
+        }
+        return *this;
+    }
+
+    cluster_flat_table & operator = (cluster_flat_table && other) noexcept(
+        AllocTraits::is_always_equal::value &&
+        std::is_nothrow_copy_constructible<hasher>::value &&
+        std::is_nothrow_copy_constructible<key_equal>::value) {
+        return this->move_assign(std::move(other),
+                     typename AllocTraits::propagate_on_container_move_assignment());
+    }
+
     ///
     /// Observers
     ///
@@ -323,6 +633,18 @@ public:
         return this->key_equal_;
     }
 
+    ///
+    /// prehash(key)
+    ///
+    /// Return the hash code of the key, it's consistent with the hash code
+    /// used internally, so it can be passed to find(key, hash_code),
+    /// emplace_with_hash(hash_code, args...) and erase(key, hash_code).
+    ///
+    std::size_t prehash(const key_type & key) const
+        noexcept(noexcept(this->hash_for(key))) {
+        return this->hash_for(key);
+    }
+
 #if CLUSTER_USE_HASH_POLICY
     hash_policy_t & hash_policy_ref() noexcept {
         return this->hash_policy_;
@@ -349,12 +671,22 @@ public:
         return "jstd::cluster_flat_map";
     }
 
+    //
+    // The SIMD kernel used by the group matching, e.g. "sse2", "avx2", "avx512bw".
+    //
+    static const char * group_kernel_name() noexcept {
+        return group_type::kernel_name();
+    }
+
     ///
     /// Iterators
     ///
+    //
+    // In the middle of an incremental rehash, the iterators walk the old elements
+    // first and then the new arrays, so the iteration doesn't migrate anything.
+    //
     iterator begin() noexcept {
-        size_type slot_index = this->find_first_used_index();
-        return this->iterator_at(slot_index);
+        return iterator(const_cast<const this_type *>(this)->begin());
     }
 
     iterator end() noexcept {
@@ -362,26 +694,39 @@ public:
     }
 
     const_iterator begin() const noexcept {
-        return const_cast<this_type *>(this)->begin();
+        if (!kIsIndirectKV) {
+            size_type slot_index = this->find_first_used_index();
+            return this->iterator_at(slot_index);
+        } else {
+            return this->iterator_at(this->first_used_slot());
+        }
     }
     const_iterator end() const noexcept {
-        return const_cast<this_type *>(this)->end();
+        return this->iterator_at(this->slot_capacity());
     }
 
-    const_iterator cbegin() const noexcept { this->begin(); }
-    const_iterator cend() const noexcept { this->end(); }
+    const_iterator cbegin() const noexcept { return this->begin(); }
+    const_iterator cend() const noexcept { return this->end(); }
 
     ///
     /// Capacity
     ///
     bool empty() const noexcept { return (this->size() == 0); }
-    size_type size() const noexcept { return this->slot_size(); }
+    size_type size() const noexcept { return (this->slot_size() + this->old_slot_size()); }
     size_type capacity() const noexcept { return this->slot_capacity(); }
     size_type max_size() const noexcept {
         return (std::numeric_limits<difference_type>::max)() / sizeof(value_type);
     }
 
     size_type slot_size() const { return this->slot_size_; }
+    // The elements of the old arrays haven't been migrated by the incremental rehash.
+    size_type old_slot_size() const {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        return this->old_.slot_size;
+#else
+        return 0;
+#endif
+    }
     size_type slot_mask() const { return this->slot_mask_; }
     size_type slot_capacity() const { return (this->slot_mask_ + 1); }
     size_type slot_threshold() const { return this->slot_threshold_; }
@@ -407,7 +752,122 @@ public:
 
     size_type bucket(const key_type & key) const {
         size_type ctrl_index = this->find_index(key);
-        return ctrl_index;
+        // The elements of the old arrays haven't had a bucket in the new arrays yet.
+        return (!this->is_old_index(ctrl_index)) ? ctrl_index : this->bucket_count();
+    }
+
+    //
+    // The slot index where the probing of the key starts, the distance to
+    // the bucket(key) is the length of its collision chain.
+    //
+    size_type home_bucket(const key_type & key) const {
+        return this->index_for_hash(this->hash_for(key));
+    }
+
+    ///
+    /// Statistics
+    ///
+
+    //
+    // The counters are only updated when CLUSTER_USE_STATS is enabled,
+    // the overflow groups are counted by scanning all groups.
+    //
+    stats_type stats() const {
+        stats_type stats;
+#if CLUSTER_USE_STATS
+        this->stats_.load(stats);
+        stats.enabled = true;
+#endif
+        stats.size = this->size();
+        stats.slot_capacity = this->slot_capacity();
+        stats.group_capacity = this->group_capacity();
+        stats.overflow_groups = 0;
+        if (this->slots_ != nullptr) {
+            const group_type * group = this->groups();
+            for (size_type group_index = 0; group_index < this->group_capacity(); group_index++) {
+#if CLUSTER_USE_OVERFLOW_COUNTER
+                if (this->overflow_counters()[group_index] != 0)
+                    stats.overflow_groups++;
+#else
+                if (group->has_overflow())
+                    stats.overflow_groups++;
+#endif
+                group++;
+            }
+        }
+        return stats;
+    }
+
+    void reset_stats() noexcept {
+#if CLUSTER_USE_STATS
+        this->stats_.reset_counters();
+#endif
+    }
+
+    ///
+    /// Layout inspection, see HashMapAnalyzer
+    ///
+    static constexpr size_type group_width() noexcept { return kGroupWidth; }
+
+    //
+    // Call visitor(slot_index, probe_start, ctrl_hash) for each element, the lookup
+    // of the element begins probing at the first slot of its home group.
+    // The elements not migrated yet by the incremental rehash are not visited.
+    //
+    template <typename Visitor>
+    void visit_slot_layout(Visitor && visitor) const {
+        if (this->slots_ == nullptr)
+            return;
+        for (size_type slot_index = 0; slot_index < this->slot_capacity(); slot_index++) {
+            const ctrl_type * ctrl = this->ctrl_at(slot_index);
+            if (ctrl->is_used()) {
+                const slot_type * slot = this->slot_at(slot_index);
+                size_type slot_pos = this->index_for_hash(this->hash_for(slot->value.first));
+                size_type probe_start = (slot_pos / kGroupWidth) * kGroupWidth;
+                visitor(slot_index, probe_start, ctrl->get_hash());
+            }
+        }
+    }
+
+    //
+    // The number of overflow marks of the group: the overflow bits of its ctrls,
+    // or the overflow counter when CLUSTER_USE_OVERFLOW_COUNTER is enabled.
+    //
+    size_type group_overflow(size_type group_index) const {
+        assert(group_index < this->group_capacity());
+        if (this->slots_ == nullptr)
+            return 0;
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        return static_cast<size_type>(this->overflow_counters()[group_index]);
+#else
+        size_type overflow_marks = 0;
+        const ctrl_type * ctrl = this->ctrls() + std::ptrdiff_t(group_index * kGroupWidth);
+        for (size_type group_pos = 0; group_pos < kGroupWidth; group_pos++) {
+            if (ctrl[group_pos].is_overflow())
+                overflow_marks++;
+        }
+        return overflow_marks;
+#endif
+    }
+
+    ///
+    /// Memory usage
+    ///
+    map_memory_usage memory_usage() const {
+        map_memory_usage usage;
+        usage.object_bytes = sizeof(*this);
+        if (this->slots_ != nullptr) {
+            this->add_arrays_usage(usage, this->group_capacity(), this->slot_capacity());
+        }
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (this->old_.slots != nullptr) {
+            this->add_arrays_usage(usage, this->old_.group_capacity, this->old_.slot_mask + 1);
+        }
+#endif
+        if (heap_usage<value_type>::value) {
+            usage.heap_bytes = this->heap_bytes_of_elements();
+        }
+        return usage;
     }
 
     ///
@@ -415,7 +875,7 @@ public:
     ///
     float load_factor() const {
         if (this->slot_capacity() != 0)
-            return ((float)this->slot_size() / this->slot_capacity());
+            return ((float)this->size() / this->slot_capacity());
         else
             return 0.0;
     }
@@ -424,7 +884,7 @@ public:
         return ((float)this->mlf_ / kLoadFactorAmplify);
     }
 
-    void max_load_factor(float mlf) const {
+    void max_load_factor(float mlf) {
         // mlf: [0.2, 0.875]
         if (mlf < kMinLoadFactorF)
             mlf = kMinLoadFactorF;
@@ -433,10 +893,11 @@ public:
         size_type mlf_int = static_cast<size_type>((float)kLoadFactorAmplify * mlf);
         this->mlf_ = mlf_int;
 
-        size_type new_slot_threshold = this->calc_slot_threshold(this->slot_size());
-        size_type new_slot_capacity = this->calc_capacity(new_slot_threshold);
-        if (new_slot_capacity > this->slot_capacity()) {
-            this->rehash(new_slot_capacity);
+        if (this->slots_ != nullptr) {
+            this->slot_threshold_ = this->calc_slot_threshold(this->slot_capacity());
+            if (this->size() > this->slot_threshold()) {
+                this->rehash_impl<false>(this->shrink_to_fit_capacity(this->size()));
+            }
         }
     }
 
@@ -448,17 +909,10 @@ public:
         return const_cast<const group_type *>(this->groups_);
     }
 
-#if CLUSTER_USE_SEPARATE_SLOTS
     group_type * groups_alloc() { return this->groups_alloc_; }
     const group_type * groups_alloc() const {
         return const_cast<const group_type *>(this->groups_alloc_);
     }
-#else
-    group_type * groups_alloc() { return nullptr; }
-    const group_type * groups_alloc() const {
-        return nullptr;
-    }
-#endif
 
     group_type * last_group() {
         return (this->groups() + this->group_capacity());
@@ -486,6 +940,10 @@ public:
         return const_cast<const slot_type *>(this->slots_);
     }
 
+    //
+    // In the indirect mode, the migration of the incremental rehash appends
+    // the old elements to the dense slots, so the end counts them in advance.
+    //
     slot_type * last_slot() {
         if (!kIsIndirectKV)
             return (this->slots() + this->slot_capacity());
@@ -499,6 +957,24 @@ public:
             return (this->slots() + this->slot_size());
     }
 
+    //
+    // Indirect mode only: the slot index of each ctrl.
+    //
+    index_type * slot_indices() { return this->indices_; }
+    const index_type * slot_indices() const {
+        return const_cast<const index_type *>(this->indices_);
+    }
+
+    //
+    // Indirect mode only: the ctrl index of each slot.
+    //
+    index_type * ctrl_indices() {
+        return (this->indices_ + this->max_ctrl_capacity());
+    }
+    const index_type * ctrl_indices() const {
+        return (this->slot_indices() + this->max_ctrl_capacity());
+    }
+
     ///
     /// Hash policy
     ///
@@ -515,6 +991,13 @@ public:
     void reserve(size_type new_capacity) {
         if (likely(new_capacity != 0)) {
             new_capacity = this->shrink_to_fit_capacity(new_capacity);
+#if CLUSTER_USE_FASTRANGE_INDEX
+            // The capacity isn't rounded up to the power of 2, so leave the headroom of
+            // half a growth, like the power of 2 rounding does on average, otherwise
+            // the table is at the max load factor when it holds the reserved size.
+            new_capacity = new_capacity / 100 * kReserveHeadroomPercent +
+                           new_capacity % 100 * kReserveHeadroomPercent / 100;
+#endif
             this->rehash_impl<false>(new_capacity);
         } else {
             this->reset<false>();
@@ -535,15 +1018,58 @@ public:
         this->rehash_impl<true>(new_capacity);
     }
 
+    void swap(cluster_flat_table & other) {
+        if (std::addressof(other) != this) {
+            this->swap_impl(other);
+        }
+    }
+
     void shrink_to_fit(bool read_only = false) {
         size_type new_capacity;
         if (likely(!read_only))
-            new_capacity = this->shrink_to_fit_capacity(this->slot_size());
+            new_capacity = this->shrink_to_fit_capacity(this->size());
         else
-            new_capacity = this->slot_size();
+            new_capacity = this->size();
         this->rehash_impl<true>(new_capacity);
     }
 
+    //
+    // Whether an incremental rehash is in progress, see CLUSTER_USE_INCREMENTAL_REHASH.
+    //
+    bool is_rehashing() const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        return (this->old_.slots != nullptr);
+#else
+        return false;
+#endif
+    }
+
+    //
+    // The const lookups return the element of the old arrays as an old index,
+    // it's the old ctrl index minus the old ctrl capacity, so it's negative and
+    // the old indexes are walked before the new indexes by the iterators.
+    //
+    bool is_old_index(size_type index) const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        return (static_cast<ssize_type>(index) < 0);
+#else
+        (void)index;
+        return false;
+#endif
+    }
+
+    //
+    // Migrate all the rest of the old arrays at once. The const operations never migrate,
+    // they look up the new arrays and then the old arrays.
+    //
+    void finish_rehash() {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            this->migrate_old_groups(this->old_.group_capacity);
+        }
+#endif
+    }
+
     ///
     /// Lookup
     ///
@@ -561,7 +1087,8 @@ public:
     /// find(key)
     ///
     iterator find(const key_type & key) {
-        return const_cast<const this_type *>(this)->find(key);
+        size_type slot_index = this->find_index(key);
+        return this->iterator_at(slot_index);
     }
 
     const_iterator find(const key_type & key) const {
@@ -571,7 +1098,8 @@ public:
 
     template <typename KeyT>
     iterator find(const KeyT & key) {
-        return const_cast<const this_type *>(this)->find(key);
+        size_type slot_index = this->find_index(key);
+        return this->iterator_at(slot_index);
     }
 
     template <typename KeyT>
@@ -580,10 +1108,71 @@ public:
         return this->iterator_at(slot_index);
     }
 
+    ///
+    /// find(key, hash_code)
+    ///
+    template <typename KeyT>
+    iterator find(const KeyT & key, std::size_t hash_code) {
+        assert(hash_code == this->hash_for(key));
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            size_type slot_index = this->find_index_rehashing(key, hash_code);
+            return this->iterator_at(slot_index);
+        }
+#endif
+        return iterator(const_cast<const this_type *>(this)->find(key, hash_code));
+    }
+
+    template <typename KeyT>
+    const_iterator find(const KeyT & key, std::size_t hash_code) const {
+        assert(hash_code == this->hash_for(key));
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            size_type slot_index = this->find_index_no_migrate(key, hash_code);
+            return this->iterator_at(slot_index);
+        }
+#endif
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        this->record_find(slot_index != this->slot_capacity(), probed_groups);
+        return this->iterator_at(slot_index);
+    }
+
+    ///
+    /// find_batch(keys, count, out)
+    ///
+    /// Look up a batch of keys, the lookups are software-pipelined:
+    /// the home group of a key is prefetched some keys ahead, and its first
+    /// candidate slot half as many keys ahead, so the cache misses of
+    /// the different keys overlap each other.
+    ///
+    void find_batch(const key_type * keys, size_type count, iterator * out) {
+        this->find_batch_impl(keys, count, [this, out](size_type i, size_type slot_index) {
+            out[i] = this->iterator_at(slot_index);
+        });
+    }
+
+    void find_batch(const key_type * keys, size_type count, const_iterator * out) const {
+        this->find_batch_impl(keys, count, [this, out](size_type i, size_type slot_index) {
+            out[i] = this->iterator_at(slot_index);
+        });
+    }
+
+    void contains_batch(const key_type * keys, size_type count, bool * out) const {
+        this->find_batch_impl(keys, count, [this, out](size_type i, size_type slot_index) {
+            out[i] = (slot_index != this->slot_capacity());
+        });
+    }
+
     ///
     /// Modifiers
     ///
     void clear(bool need_destroy = false) noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        this->destroy_old_arrays();
+#endif
         if (need_destroy) {
             this->create_slots<false>(kDefaultCapacity);
             assert(this->slot_size() == 0);
@@ -682,22 +1271,101 @@ public:
 
     template <typename KeyT, typename MappedT>
     std::pair<iterator, bool> insert_or_assign(KeyT && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value));
+        return this->emplace_impl<true>(std::forward<KeyT>(key), std::forward<MappedT>(value));
     }
 
     template <typename MappedT>
     iterator insert_or_assign(const_iterator hint, const key_type & key, MappedT && value) {
-        return this->emplace_impl<true>(key, std::forward<MappedT>(value))->first;
+        return this->emplace_impl<true>(key, std::forward<MappedT>(value)).first;
     }
 
     template <typename MappedT>
     iterator insert_or_assign(const_iterator hint, key_type && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value))->first;
+        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value)).first;
     }
 
     template <typename KeyT, typename MappedT>
     iterator insert_or_assign(const_iterator hint, KeyT && key, MappedT && value) {
-        return this->emplace_impl<true>(std::move(key), std::forward<MappedT>(value))->first;
+        return this->emplace_impl<true>(std::forward<KeyT>(key), std::forward<MappedT>(value)).first;
+    }
+
+    ///
+    /// insert_batch(values, count)
+    ///
+    /// Insert a batch of values, reserve once for the worst case, and then
+    /// insert them in software-pipelined order (see find_batch()).
+    /// Return the number of values actually inserted.
+    ///
+    /// It pays off when the table is much larger than the cache, e.g. the updates
+    /// or the inserts into a reserved table, otherwise it's the same as the loop
+    /// of insert(). Even then the small batches gain little: at 16M keys and 32 values
+    /// per batch, the inserts into a reserved table are about 1.1x faster than the
+    /// loop and the inserts into a growing table are slower (0.87x), only the updates
+    /// reach 1.5x. See run_batch_vs_scalar() of cardinal_bench.
+    ///
+    /// If the key of ValueT isn't a key_type, e.g. a const char * of a std::string
+    /// key, a key_type is converted from it each time the key is hashed or compared.
+    ///
+    template <typename ValueT>
+    size_type insert_batch(const ValueT * values, size_type count) {
+        return this->insert_batch_impl(count,
+            [values](size_type i) -> batch_key_t<typename ValueT::first_type> {
+                return values[i].first;
+            },
+            [this, values](size_type i, slot_type * slot, bool need_insert) {
+                if (need_insert) {
+                    SlotPolicyTraits::construct(&this->slot_allocator_, slot, values[i]);
+                }
+            });
+    }
+
+    ///
+    /// insert_or_assign_batch(values, count)
+    ///
+    template <typename ValueT>
+    size_type insert_or_assign_batch(const ValueT * values, size_type count) {
+        return this->insert_batch_impl(count,
+            [values](size_type i) -> batch_key_t<typename ValueT::first_type> {
+                return values[i].first;
+            },
+            [this, values](size_type i, slot_type * slot, bool need_insert) {
+                if (need_insert)
+                    SlotPolicyTraits::construct(&this->slot_allocator_, slot, values[i]);
+                else
+                    slot->value.second = values[i].second;
+            });
+    }
+
+    size_type insert_or_assign_batch(const key_type * keys, const mapped_type * values, size_type count) {
+        return this->insert_batch_impl(count,
+            [keys](size_type i) -> const key_type & {
+                return keys[i];
+            },
+            [this, keys, values](size_type i, slot_type * slot, bool need_insert) {
+                if (need_insert)
+                    SlotPolicyTraits::construct(&this->slot_allocator_, slot, keys[i], values[i]);
+                else
+                    slot->value.second = values[i];
+            });
+    }
+
+    ///
+    /// parallel_build(first, last, thread_count)
+    ///
+    /// Insert the values of a random access range into an empty table by thread_count
+    /// threads (0 means std::thread::hardware_concurrency()). The values are partitioned
+    /// by their home groups into the disjoint group ranges, each thread fills its own
+    /// range without synchronization, and the values which probe past the end of their
+    /// range are inserted serially at last. The duplicate keys keep the first value,
+    /// like insert(first, last). The other tables, the small ranges, the indirect mode
+    /// and the non random access iterators just use insert(first, last).
+    /// Return the number of values actually inserted.
+    ///
+    template <typename InputIter>
+    size_type parallel_build(InputIter first, InputIter last, size_type thread_count = 0) {
+        using iterator_category = typename std::iterator_traits<InputIter>::iterator_category;
+        return this->parallel_build_impl(first, last, thread_count,
+            std::is_base_of<std::random_access_iterator_tag, iterator_category>{});
     }
 
     ///
@@ -747,38 +1415,138 @@ public:
     }
 
     ///
-    /// erase(key)
+    /// emplace_with_hash(hash_code, args...)
     ///
-    JSTD_FORCED_INLINE
-    size_type erase(const key_type & key) {
-        size_type num_deleted = this->find_and_erase(key);
-        return num_deleted;
-    }
-
-    JSTD_FORCED_INLINE
-    iterator erase(iterator pos) {
-        size_type slot_index = pos.index();
-        this->erase_index(slot_index);
-        ctrl_type * ctrl = this->ctrl_at(slot_index);
-        return this->next_valid_iterator(ctrl, pos);
-    }
+    template <typename ... Args>
+    std::pair<iterator, bool> emplace_with_hash(std::size_t hash_code, Args && ... args) {
+        alignas(slot_type) unsigned char raw[sizeof(slot_type)];
+        slot_type * tmp_slot = reinterpret_cast<slot_type *>(&raw);
 
-    JSTD_FORCED_INLINE
-    iterator erase(const_iterator pos) {
-        return this->erase(iterator(pos));
-    }
+        SlotPolicyTraits::construct(&this->slot_allocator_, tmp_slot,
+                                    std::forward<Args>(args)...);
 
-    ///
+        auto find_info = this->find_and_insert(tmp_slot->value.first, hash_code);
+        size_type slot_index = find_info.first;
+        bool need_insert = find_info.second;
+        if (need_insert) {
+            // The key to be inserted is not exists.
+            slot_type * slot = this->slot_at(slot_index);
+            assert(slot != nullptr);
+            SlotPolicyTraits::transfer(&this->slot_allocator_, slot, tmp_slot);
+            this->slot_size_++;
+        } else {
+            // The key already exists, transfer() destroys the tmp_slot in the insert case.
+            SlotPolicyTraits::destroy(&this->slot_allocator_, tmp_slot);
+        }
+        return { this->iterator_at(slot_index), need_insert };
+    }
+
+    ///
+    /// try_emplace_with_hash(hash_code, key, args...)
+    ///
+    template <typename KeyT, typename ... Args>
+    std::pair<iterator, bool> try_emplace_with_hash(std::size_t hash_code, KeyT && key, Args && ... args) {
+        auto find_info = this->find_and_insert(key, hash_code);
+        size_type slot_index = find_info.first;
+        bool need_insert = find_info.second;
+        if (need_insert) {
+            // The key to be inserted is not exists.
+            slot_type * slot = this->slot_at(slot_index);
+            assert(slot != nullptr);
+            SlotPolicyTraits::construct(&this->slot_allocator_, slot,
+                                        std::piecewise_construct,
+                                        std::forward_as_tuple(std::forward<KeyT>(key)),
+                                        std::forward_as_tuple(std::forward<Args>(args)...));
+            this->slot_size_++;
+        }
+        return { this->iterator_at(slot_index), need_insert };
+    }
+
+    ///
+    /// erase(key)
+    ///
+    JSTD_FORCED_INLINE
+    size_type erase(const key_type & key) {
+        size_type num_deleted = this->find_and_erase(key);
+        return num_deleted;
+    }
+
+    ///
+    /// erase(key, hash_code)
+    ///
+    JSTD_FORCED_INLINE
+    size_type erase(const key_type & key, std::size_t hash_code) {
+        size_type num_deleted = this->find_and_erase(key, hash_code);
+        return num_deleted;
+    }
+
+    JSTD_FORCED_INLINE
+    iterator erase(iterator pos) {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_old_iterator(pos))) {
+            return this->erase_old(pos);
+        }
+#endif
+        size_type slot_index = this->index_of(pos);
+        size_type home_index = this->erase_home_index(slot_index);
+        this->erase_index(slot_index, home_index);
+        this->clear_overflow_after_erase(slot_index / kGroupWidth, home_index);
+        if (!kIsIndirectKV) {
+            ctrl_type * ctrl = this->ctrl_at(slot_index);
+            return this->next_valid_iterator(ctrl, pos);
+        } else {
+            // The last slot has been moved into the erased slot, or the erased slot
+            // was the last one, either way the next element is at the same place.
+            return pos;
+        }
+    }
+
+    JSTD_FORCED_INLINE
+    iterator erase(const_iterator pos) {
+        return this->erase(iterator(pos));
+    }
+
+    iterator erase(const_iterator first, const_iterator last) {
+        if (!kIsIndirectKV) {
+            iterator pos(first);
+            while (pos != last) {
+                pos = this->erase(pos);
+            }
+            return iterator(last);
+        } else {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+            // The old elements come first and are erased in place.
+            iterator old_pos(first);
+            while ((old_pos != last) && this->is_old_iterator(old_pos)) {
+                old_pos = this->erase(old_pos);
+            }
+            first = old_pos;
+#endif
+            // Erase from the back, so the last slots moved into the holes
+            // are always out of the range that is not erased yet.
+            iterator pos(last);
+            while (pos != first) {
+                --pos;
+                this->erase(pos);
+            }
+            return iterator(first);
+        }
+    }
+
+    ///
     /// For iterator
     ///
     inline size_type next_index(size_type index) const noexcept {
-        assert(index < this->slot_capacity());
-        return ((index + 1) & this->slot_mask_);
+        return this->next_index(index, this->slot_mask_);
     }
 
     inline size_type next_index(size_type index, size_type slot_mask) const noexcept {
         assert(index < this->slot_capacity());
+#if CLUSTER_USE_FASTRANGE_INDEX
+        return ((index < slot_mask) ? (index + 1) : 0);
+#else
         return ((index + 1) & slot_mask);
+#endif
     }
 
     inline ctrl_type * ctrl_at(size_type slot_index) noexcept {
@@ -801,6 +1569,21 @@ public:
         return (this->groups() + std::ptrdiff_t(group_index));
     }
 
+    //
+    // The matches of a group by the kernel of this table, see cluster_kernel_traits.
+    //
+    inline bitmask_type match_empty(const group_type * group) const {
+        return kernel_traits::match_empty(this->kernel_, group);
+    }
+
+    inline bitmask_type match_used(const group_type * group) const {
+        return kernel_traits::match_used(this->kernel_, group);
+    }
+
+    inline bitmask_type match_hash(const group_type * group, std::uint8_t ctrl_hash) const {
+        return kernel_traits::match_hash(this->kernel_, group, ctrl_hash);
+    }
+
     inline group_type * group_by_slot_index(size_type slot_index) noexcept {
         assert(slot_index <= this->slot_capacity());
         size_type group_index = slot_index / kGroupWidth;
@@ -813,44 +1596,62 @@ public:
         return (this->groups() + std::ptrdiff_t(group_idx));
     }
 
+    //
+    // In the indirect mode, the slot_index is the index of the ctrl,
+    // and the slot is mapped by the slot index of the ctrl.
+    //
     inline slot_type * slot_at(size_type slot_index) noexcept {
-        assert(slot_index <= this->slot_capacity());
-        return (this->slots() + std::ptrdiff_t(slot_index));
+        return const_cast<slot_type *>(
+            const_cast<const this_type *>(this)->slot_at(slot_index)
+        );
     }
 
     inline const slot_type * slot_at(size_type slot_index) const noexcept {
-        assert(slot_index <= this->slot_capacity());
-        return (this->slots() + std::ptrdiff_t(slot_index));
+        if (!kIsIndirectKV) {
+            assert(slot_index <= this->slot_capacity());
+            return (this->slots() + std::ptrdiff_t(slot_index));
+        } else {
+            assert(slot_index < this->max_ctrl_capacity());
+            return (this->slots() + std::ptrdiff_t(this->slot_indices()[slot_index]));
+        }
+    }
+
+    //
+    // The iterators use these, the index may be an old index of the incremental rehash,
+    // see is_old_index().
+    //
+    inline const slot_type * iterator_slot_at(size_type index) const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_old_index(index))) {
+            return this->old_slot_at(this->old_ctrl_index(index));
+        }
+#endif
+        return this->slot_at(index);
+    }
+
+    inline const ctrl_type * iterator_ctrl_at(size_type index) const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_old_index(index))) {
+            return (reinterpret_cast<const ctrl_type *>(this->old_.groups) +
+                    std::ptrdiff_t(this->old_ctrl_index(index)));
+        }
+#endif
+        return this->ctrl_at(index);
     }
 
     inline slot_type * slot_at(ctrl_type * ctrl) noexcept {
-        size_type slot_index;
-        if (kIsIndirectKV)
-            slot_index = ctrl->get_index();
-        else
-            slot_index = this->index_of(ctrl);
-        assert(slot_index <= this->slot_capacity());
-        return (this->slots() + std::ptrdiff_t(slot_index));
+        return this->slot_at(this->index_of_ctrl(ctrl));
     }
 
     inline const slot_type * slot_at(const ctrl_type * ctrl) const noexcept {
-        size_type slot_index;
-        if (kIsIndirectKV)
-            slot_index = ctrl->get_index();
-        else
-            slot_index = this->index_of(ctrl);
-        assert(slot_index <= this->slot_capacity());
-        return (this->slots() + std::ptrdiff_t(slot_index));
+        return this->slot_at(this->index_of_ctrl(ctrl));
     }
 
 private:
     static group_type * default_empty_groups() {
-        alignas(16) static const ctrl_type s_empty_ctrls[16] = {
-            { kEmptySlot }, { kEmptySlot }, { kEmptySlot }, { kEmptySlot },
-            { kEmptySlot }, { kEmptySlot }, { kEmptySlot }, { kEmptySlot },
-            { kEmptySlot }, { kEmptySlot }, { kEmptySlot }, { kEmptySlot },
-            { kEmptySlot }, { kEmptySlot }, { kEmptySlot }, { kEmptySlot }
-        };
+        // The default constructor of ctrl_type is kEmptySlot.
+        // The indexes and the overflow counter (if used) of the empty group follow the ctrls.
+        alignas(kGroupAlignment) static const ctrl_type s_empty_ctrls[kGroupWidth * 2 + kGroupWidth * kIndexBytes];
 
         return reinterpret_cast<group_type *>(const_cast<ctrl_type *>(&s_empty_ctrls[0]));
     }
@@ -863,6 +1664,14 @@ private:
     size_type calc_capacity(size_type init_capacity) const noexcept {
         size_type new_capacity = (std::max)(init_capacity, kMinCapacity);
                   new_capacity = (std::max)(new_capacity, this->slot_size());
+#if CLUSTER_USE_FASTRANGE_INDEX
+        // The groups must be full except the only one, so the larger
+        // capacity is rounded up to the multiple of the group width.
+        if (new_capacity > kGroupWidth) {
+            new_capacity = (new_capacity + (kGroupWidth - 1)) / kGroupWidth * kGroupWidth;
+            return new_capacity;
+        }
+#endif
         if (!pow2::is_pow2(new_capacity)) {
             new_capacity = pow2::round_up<size_type, kMinCapacity>(new_capacity);
         }
@@ -884,6 +1693,17 @@ private:
         return this_type::calc_slot_threshold(this->mlf_, slot_capacity);
     }
 
+    //
+    // The slots of the indirect mode are dense, so they only need to hold
+    // the max number of elements, the max load factor is used because mlf_ can be changed.
+    //
+    static size_type calc_slot_alloc_capacity(size_type slot_capacity) {
+        if (!kIsIndirectKV)
+            return slot_capacity;
+        else
+            return this_type::calc_slot_threshold(kMaxLoadFactor, slot_capacity);
+    }
+
     inline size_type shrink_to_fit_capacity(size_type init_capacity) const {
         size_type new_capacity = init_capacity * kLoadFactorAmplify / this->mlf_;
         return new_capacity;
@@ -896,43 +1716,41 @@ private:
     inline iterator iterator_at(size_type index) noexcept {
         if (!kIsIndirectKV)
             return { this, index };
+        else if (index != this->slot_capacity())
+            return { this, this->iterator_slot_at(index) };
         else
-            return { this->slot_at(index) };
+            return { this, this->last_slot() };
     }
 
     inline const_iterator iterator_at(size_type index) const noexcept {
         if (!kIsIndirectKV)
             return { this, index };
+        else if (index != this->slot_capacity())
+            return { this, this->iterator_slot_at(index) };
         else
-            return { this->slot_at(index) };
+            return { this, this->last_slot() };
     }
 
     inline iterator iterator_at(ctrl_type * ctrl) noexcept {
-        if (!kIsIndirectKV)
-            return { this, this->index_of(ctrl) };
-        else
-            return { this->slot_at(ctrl->get_index()) };
+        return this->iterator_at(this->index_of_ctrl(ctrl));
     }
 
     inline const_iterator iterator_at(const ctrl_type * ctrl) const noexcept {
-        if (!kIsIndirectKV)
-            return { this, this->index_of(ctrl) };
-        else
-            return { this->slot_at(ctrl->get_index()) };
+        return this->iterator_at(this->index_of_ctrl(ctrl));
     }
 
     inline iterator iterator_at(slot_type * slot) noexcept {
         if (!kIsIndirectKV)
             return { this, this->index_of(slot) };
         else
-            return { slot };
+            return { this, slot };
     }
 
     inline const_iterator iterator_at(const slot_type * slot) const noexcept {
         if (!kIsIndirectKV)
             return { this, this->index_of(slot) };
         else
-            return { slot };
+            return { this, slot };
     }
 
     inline iterator next_valid_iterator(ctrl_type * ctrl, iterator iter) {
@@ -979,7 +1797,8 @@ private:
         noexcept(noexcept(this->hasher_(key))) {
 #if CLUSTER_USE_HASH_POLICY
         std::size_t hash_code = static_cast<std::size_t>(
-            this->hash_policy_.get_hash_code(key)
+            this->hash_policy_.template mix_hash_code<key_type>(
+                static_cast<std::size_t>(this->hasher_(key)))
         );
 #elif defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
         std::size_t hash_code;
@@ -997,7 +1816,32 @@ private:
     // Do the index hash on the basis of hash code for the index_for_hash().
     //
     inline std::size_t index_hasher(std::size_t value) const noexcept {
+#if CLUSTER_USE_FASTRANGE_INDEX
+        // The fastrange takes the high bits, mix the low bits of the weak hashes into them.
+        return static_cast<std::size_t>(static_cast<std::uint64_t>(value) * 11400714819323198485ull);
+#else
         return value;
+#endif
+    }
+
+    //
+    // Map the index hash into [0, slot_mask], slot_mask = slot_capacity - 1.
+    //
+    static inline size_type index_in_range(std::size_t index_hash, size_type slot_mask) noexcept {
+#if CLUSTER_USE_FASTRANGE_INDEX
+        // index = index_hash * slot_capacity / 2^N, see: https://github.com/lemire/fastrange
+        if (sizeof(std::size_t) >= 8) {
+            hashes::_uint128_t product = hashes::uint128_mul(static_cast<std::uint64_t>(index_hash),
+                                                             static_cast<std::uint64_t>(slot_mask + 1));
+            return static_cast<size_type>(product.high);
+        } else {
+            std::uint64_t product = static_cast<std::uint64_t>(index_hash) *
+                                    static_cast<std::uint64_t>(slot_mask + 1);
+            return static_cast<size_type>(product >> 32);
+        }
+#else
+        return (index_hash & slot_mask);
+#endif
     }
 
     //
@@ -1005,7 +1849,7 @@ private:
     //
     inline std::size_t ctrl_hasher(std::size_t hash_code) const noexcept {
 #if CLUSTER_USE_HASH_POLICY
-        return hash_code;
+        return this->hash_policy_.ctrl_for_mixed_hash(hash_code);
 #elif 0
         return (size_type)hashes::mum_hash64((std::uint64_t)hash_code, 11400714819323198485ull);
 #elif 1
@@ -1018,14 +1862,14 @@ private:
         if (kUseIndexSalt) {
             hash_code ^= this->index_salt();
         }
-        size_type index = this->hash_policy_.template index_for_hash<key_type>(hash_code, this->slot_mask());
+        size_type index = this->hash_policy_.index_for_mixed_hash(hash_code);
         return index;
 #else
         hash_code = this->index_hasher(hash_code);
         if (kUseIndexSalt) {
             hash_code ^= this->index_salt();
         }
-        size_type index = hash_code & this->slot_mask();
+        size_type index = this_type::index_in_range(hash_code, this->slot_mask());
         return index;
 #endif
     }
@@ -1036,34 +1880,27 @@ private:
         return ((ctrl_hash8 != kEmptySlot) ? ctrl_hash8 : std::uint8_t(8));
     }
 
+    //
+    // Return the index of the ctrl which the iterator points to.
+    //
     size_type index_of(iterator iter) const {
         if (!kIsIndirectKV) {
             return iter.index();
         } else {
-            const slot_type * slot = iter.slot();
-            size_type ctrl_index = this->bucket(slot->key);
-            return ctrl_index;
+            size_type slot_pos = this->index_of(iter.slot());
+            assert(slot_pos < this->slot_size());
+            return this->ctrl_indices()[slot_pos];
         }
     }
 
     size_type index_of(const_iterator iter) const {
-        if (!kIsIndirectKV) {
-            return iter.index();
-        } else {
-            const slot_type * slot = iter.slot();
-            size_type ctrl_index = this->bucket(slot->key);
-            return ctrl_index;
-        }
+        return this->index_of(iterator(iter));
     }
 
     size_type index_of(ctrl_type * ctrl) const {
         assert(ctrl != nullptr);
         assert(ctrl >= this->ctrls());
-        size_type index;
-        if (!kIsIndirectKV)
-            index = (size_type)(ctrl - this->ctrls());
-        else
-            index = ctrl->get_index();
+        size_type index = (size_type)(ctrl - this->ctrls());
         assert(is_positive(index));
         return index;
     }
@@ -1081,7 +1918,7 @@ private:
     }
 
     size_type index_of(const slot_type * slot) const {
-        return this->index_of(reinterpret_cast<slot_type *>(slot));
+        return this->index_of(const_cast<slot_type *>(slot));
     }
 
     size_type index_of_ctrl(ctrl_type * ctrl) const {
@@ -1128,51 +1965,232 @@ private:
     }
 
     void destroy_data() {
-        // Note!!: destroy_slots() need use this->ctrls(), so must destroy slots first.
-        size_type group_capacity = this->group_capacity();
-        this->destroy_slots();
-        this->destroy_groups(group_capacity);
-    }
-
-    void destroy_groups(size_type group_capacity) noexcept {
-        if (this->groups_ != this_type::default_empty_groups()) {
-            size_type total_group_alloc_count = this->TotalGroupAllocCount<kGroupAlignment>(group_capacity);
-#if CLUSTER_USE_SEPARATE_SLOTS
-            GroupAllocTraits::deallocate(this->group_allocator_, this->groups_alloc_, total_group_alloc_count);
-            this->groups_alloc_ = this_type::default_empty_groups();
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        this->destroy_old_arrays();
 #endif
+        // Note!!: clear_slots() need use this->ctrls(), so must destroy slots first.
+        this->clear_slots();
+
+        if (this->slots_ != nullptr) {
+            this->deallocate_groups_and_slots(this->groups_alloc_, this->slots_,
+                                              this->group_capacity(), this->slot_capacity());
             this->groups_ = this_type::default_empty_groups();
+            this->groups_alloc_ = this_type::default_empty_groups();
+            this->slots_ = nullptr;
+            this->indices_ = nullptr;
+            this->slot_size_ = 0;
+            this->slot_mask_ = 0;
+            this->slot_threshold_ = 0;
         }
     }
 
-    void destroy_slots() {
-        this->clear_slots();
+    void add_arrays_usage(map_memory_usage & usage, size_type group_capacity,
+                          size_type slot_capacity) const noexcept {
+        size_type slot_alloc_capacity = this_type::calc_slot_alloc_capacity(slot_capacity);
+#if CLUSTER_USE_SEPARATE_SLOTS
+        size_type alloc_bytes = this->TotalGroupAllocCount<kGroupAlignment>(group_capacity) * sizeof(group_type) +
+                                slot_alloc_capacity * sizeof(slot_type);
+#else
+        size_type alloc_bytes = this->TotalAllocCount<kGroupAlignment>(group_capacity, slot_alloc_capacity) *
+                                sizeof(group_type);
+#endif
+        size_type ctrl_bytes = group_capacity * kGroupTotalBytes;
+        size_type slot_bytes = slot_alloc_capacity * sizeof(slot_type);
+        usage.ctrl_bytes += ctrl_bytes;
+        usage.slot_bytes += slot_bytes;
+        usage.padding_bytes += (alloc_bytes - ctrl_bytes - slot_bytes);
+    }
 
+    std::size_t heap_bytes_of_elements() const noexcept {
+        std::size_t heap_bytes = 0;
         if (this->slots_ != nullptr) {
+            for (size_type slot_index = 0; slot_index < this->slot_capacity(); slot_index++) {
+                if (this->ctrl_at(slot_index)->is_used()) {
+                    heap_bytes += heap_usage_of(this->slot_at(slot_index)->value);
+                }
+            }
+        }
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (this->old_.slots != nullptr) {
+            size_type old_slot_capacity = this->old_.slot_mask + 1;
+            for (size_type ctrl_index = 0; ctrl_index < old_slot_capacity; ctrl_index++) {
+                const ctrl_type * ctrl = reinterpret_cast<const ctrl_type *>(this->old_.groups) + ctrl_index;
+                if (ctrl->is_used()) {
+                    heap_bytes += heap_usage_of(this->old_slot_at(ctrl_index)->value);
+                }
+            }
+        }
+#endif
+        return heap_bytes;
+    }
+
+    void deallocate_groups_and_slots(group_type * groups_alloc, slot_type * slots,
+                                     size_type group_capacity, size_type slot_capacity) noexcept {
+        assert(groups_alloc != nullptr);
+        assert(groups_alloc != this_type::default_empty_groups());
+        assert(slots != nullptr);
+        size_type slot_alloc_capacity = this_type::calc_slot_alloc_capacity(slot_capacity);
 #if CLUSTER_USE_SEPARATE_SLOTS
-            SlotAllocTraits::deallocate(this->slot_allocator_, this->slots_, this->slot_capacity());
+        size_type total_group_alloc_count = this->TotalGroupAllocCount<kGroupAlignment>(group_capacity);
+        GroupAllocTraits::deallocate(this->group_allocator_, groups_alloc, total_group_alloc_count);
+        SlotAllocTraits::deallocate(this->slot_allocator_, slots, slot_alloc_capacity);
 #else
-            size_type total_slot_alloc_size = this->TotalSlotAllocCount<kGroupAlignment>(
-                                                    this->group_capacity(), this->slot_capacity());
-            SlotAllocTraits::deallocate(this->slot_allocator_, this->slots_, total_slot_alloc_size);
+        size_type total_alloc_count = this->TotalAllocCount<kGroupAlignment>(group_capacity, slot_alloc_capacity);
+        GroupAllocTraits::deallocate(this->group_allocator_, groups_alloc, total_alloc_count);
 #endif
-            this->slots_ = nullptr;
-            this->slot_size_ = 0;
-            this->slot_mask_ = 0;
-            this->slot_threshold_ = 0;
-        }
     }
 
     void clear_data() {
         // Note!!: clear_slots() need use this->ctrls(), so must clear slots first.
         this->clear_slots();
-        this->clear_ctrls();
+        this->clear_groups(this->groups(), this->group_capacity());
     }
 
     void clear_groups(group_type * groups, size_type group_capacity) {
         init_groups(groups, group_capacity);
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        if (groups != this_type::default_empty_groups()) {
+            std::memset((void *)this_type::overflow_counters(groups, group_capacity), 0,
+                        group_capacity * kOverflowCounterBytes);
+        }
+#endif
+    }
+
+    //
+    // The overflow counters are stored after the groups and the indexes (if used).
+    //
+    static std::uint8_t * overflow_counters(group_type * groups, size_type group_capacity) noexcept {
+        return (reinterpret_cast<std::uint8_t *>(groups + group_capacity) +
+                group_capacity * kGroupWidth * kIndexBytes);
+    }
+
+    inline std::uint8_t * overflow_counters() noexcept {
+        return this_type::overflow_counters(this->groups(), this->group_capacity());
+    }
+
+    inline const std::uint8_t * overflow_counters() const noexcept {
+        return this_type::overflow_counters(const_cast<group_type *>(this->groups()), this->group_capacity());
+    }
+
+    ///
+    /// Statistics, they do nothing if CLUSTER_USE_STATS is disabled
+    ///
+    // The probing functions return the probed groups by the caller's local variable,
+    // the concurrent const lookups don't share it.
+    JSTD_FORCED_INLINE
+    static void set_probed_groups(size_type & probed_groups, size_type groups) noexcept {
+#if CLUSTER_USE_STATS
+        probed_groups = groups;
+#else
+        JSTD_UNUSED(probed_groups);
+        JSTD_UNUSED(groups);
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    void record_find(bool hit, size_type probed_groups) const noexcept {
+#if CLUSTER_USE_STATS
+        this->stats_.record_find(hit, probed_groups);
+#else
+        JSTD_UNUSED(hit);
+        JSTD_UNUSED(probed_groups);
+#endif
     }
 
+    JSTD_FORCED_INLINE
+    void record_insert(bool hit, size_type probed_groups) const noexcept {
+#if CLUSTER_USE_STATS
+        this->stats_.record_insert(hit, probed_groups);
+#else
+        JSTD_UNUSED(hit);
+        JSTD_UNUSED(probed_groups);
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    void record_erase(bool hit, size_type probed_groups) const noexcept {
+#if CLUSTER_USE_STATS
+        this->stats_.record_erase(hit, probed_groups);
+#else
+        JSTD_UNUSED(hit);
+        JSTD_UNUSED(probed_groups);
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    std::uint64_t stats_clock_ns() const noexcept {
+#if CLUSTER_USE_STATS
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+#else
+        return 0;
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    void record_rehash(std::uint64_t start_ns) const noexcept {
+#if CLUSTER_USE_STATS
+        this->stats_.record_rehash(this->stats_clock_ns() - start_ns);
+#else
+        JSTD_UNUSED(start_ns);
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    bool is_overflow(const group_type * group, size_type group_pos) const noexcept {
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        size_type group_index = static_cast<size_type>(group - this->groups());
+        return (this->overflow_counters()[group_index] != 0);
+#else
+        return group->is_overflow(group_pos);
+#endif
+    }
+
+    JSTD_FORCED_INLINE
+    void set_overflow(group_type * group, size_type group_pos) noexcept {
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        size_type group_index = static_cast<size_type>(group - this->groups());
+        std::uint8_t & counter = this->overflow_counters()[group_index];
+        if (likely(counter != kOverflowCounterMax)) {
+            counter++;
+        }
+#else
+        // If it's not overflow, set the overflow bit.
+        if (likely(!group->is_overflow(group_pos))) {
+            group->set_overflow(group_pos);
+        }
+#endif
+    }
+
+#if CLUSTER_USE_OVERFLOW_COUNTER
+    JSTD_FORCED_INLINE
+    void decrease_overflow_counter(size_type group_index) noexcept {
+        std::uint8_t & counter = this->overflow_counters()[group_index];
+        assert(counter != 0);
+        // A saturated counter is sticky, the real count is unknown.
+        if (likely(counter != kOverflowCounterMax)) {
+            counter--;
+        }
+    }
+
+    //
+    // The element at slot_index is leaving, decrease the counters of
+    // the groups it passed, from its home group to the group before it.
+    //
+    JSTD_FORCED_INLINE
+    void decrease_overflow_counters(size_type home_index, size_type slot_index) noexcept {
+        size_type group_capacity = this->group_capacity();
+        size_type group_index = home_index / kGroupWidth;
+        size_type last_group_index = slot_index / kGroupWidth;
+        while (group_index != last_group_index) {
+            this->decrease_overflow_counter(group_index);
+            group_index++;
+            if (unlikely(group_index >= group_capacity))
+                group_index = 0;
+        }
+    }
+#endif
+
     JSTD_FORCED_INLINE
     void clear_slots() {
         if (!is_slot_trivial_destructor && (this->slots_ != nullptr)) {
@@ -1182,10 +2200,10 @@ private:
                 group_type * last_group = this->last_group();
                 slot_type * slot_base = this->slots();
                 for (; group < last_group; ++group) {
-                    std::uint32_t used_mask = group->match_used();
+                    bitmask_type used_mask = this->match_used(group);
                     while (used_mask != 0) {
-                        std::uint32_t used_pos = BitUtils::bsf32(used_mask);
-                        used_mask = BitUtils::clearLowBit32(used_mask);
+                        size_type used_pos = group_type::bsf(used_mask);
+                        used_mask = group_type::clear_low_bit(used_mask);
                         slot_type * slot = slot_base + used_pos;
                         this->destroy_slot(slot);
                     }
@@ -1213,16 +2231,34 @@ private:
     }
 
     inline bool need_grow() const {
-        return (this->slot_size() >= this->slot_threshold());
+        // The elements of the old arrays will be migrated into the new arrays too.
+        return (this->size() >= this->slot_threshold());
     }
 
-    inline void grow_if_necessary() {
+    inline size_type grow_capacity() const {
+#if CLUSTER_USE_FASTRANGE_INDEX
+        size_type new_capacity = this->slot_capacity() * kGrowthPercent / 100;
+        return (std::max)(new_capacity, this->slot_capacity() + 1);
+#else
         // The growth rate is 2 times
-        size_type new_capacity = this->slot_capacity() * 2;
+        return (this->slot_capacity() * 2);
+#endif
+    }
+
+    inline void grow_if_necessary() {
+        size_type new_capacity = this->grow_capacity();
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        this->start_incremental_rehash(new_capacity);
+#else
         this->rehash_impl<false>(new_capacity);
+#endif
     }
 
     bool is_valid_capacity(size_type capacity) const {
+#if CLUSTER_USE_FASTRANGE_INDEX
+        if (capacity > kGroupWidth)
+            return ((capacity % kGroupWidth) == 0);
+#endif
         return ((capacity >= kMinCapacity) && pow2::is_pow2(capacity));
     }
 
@@ -1246,23 +2282,20 @@ private:
     }
 
     //
-    // Given the pointer of slots and the capacity of slot, computes the padding of
-    // between slots and groups (from the start of the backing allocation)
-    // and return the beginning of groups.
+    // Given the pointer of groups and the capacity of group, computes the padding of
+    // between the groups (with the indexes and the overflow counters) and slots
+    // in the same backing allocation, and return the beginning of slots.
     //
-    template <size_type GroupAlignment>
-    inline group_type * AlignedSlotsAndGroups(const slot_type * slots, size_type slot_capacity) {
-        static_assert((GroupAlignment > 0),
-                      "jstd::cluster_flat_map::AlignedSlotsAndGroups<N>(): GroupAlignment must bigger than 0.");
-        static_assert(((GroupAlignment & (GroupAlignment - 1)) == 0),
-                      "jstd::cluster_flat_map::AlignedSlotsAndGroups<N>(): GroupAlignment must be power of 2.");
-        const slot_type * last_slots = slots + slot_capacity;
-        size_type last_slot = reinterpret_cast<size_type>(last_slots);
-        size_type groups_first = (last_slot + GroupAlignment - 1) & (~(GroupAlignment - 1));
-        size_type groups_padding = static_cast<size_type>(groups_first - last_slot);
-        group_type * groups = reinterpret_cast<group_type *>(
-                                    reinterpret_cast<char *>(last_slot) + groups_padding);
-        return groups;
+    template <size_type SlotAlignment>
+    inline slot_type * AlignedGroupsAndSlots(const group_type * groups, size_type group_capacity) {
+        static_assert((SlotAlignment > 0),
+                      "jstd::cluster_flat_map::AlignedGroupsAndSlots<N>(): SlotAlignment must bigger than 0.");
+        static_assert(((SlotAlignment & (SlotAlignment - 1)) == 0),
+                      "jstd::cluster_flat_map::AlignedGroupsAndSlots<N>(): SlotAlignment must be power of 2.");
+        size_type groups_last = reinterpret_cast<size_type>(groups) + group_capacity * kGroupTotalBytes;
+        size_type slots_first = (groups_last + SlotAlignment - 1) & (~(SlotAlignment - 1));
+        slot_type * slots = reinterpret_cast<slot_type *>(slots_first);
+        return slots;
     }
 
     //
@@ -1270,23 +2303,23 @@ private:
     // computes the total allocate count of the backing group array.
     //
     template <size_type GroupAlignment>
-    inline size_type TotalGroupAllocCount(size_type group_capacity) {
-        const size_type num_group_bytes = group_capacity * sizeof(group_type);
+    inline size_type TotalGroupAllocCount(size_type group_capacity) const {
+        const size_type num_group_bytes = group_capacity * kGroupTotalBytes;
         const size_type total_bytes = num_group_bytes + GroupAlignment;
         const size_type total_alloc_count = (total_bytes + sizeof(group_type) - 1) / sizeof(group_type);
         return total_alloc_count;
     }
 
     //
-    // Given the pointer of slots, the capacity of a group and slot,
-    // computes the total allocate count of the backing slot array.
+    // Given the capacity of a group and slot, computes the total allocate count
+    // of the backing array of groups, it holds the groups and then the slots.
     //
     template <size_type GroupAlignment>
-    inline size_type TotalSlotAllocCount(size_type group_capacity, size_type slot_capacity) {
-        const size_type num_group_bytes = group_capacity * sizeof(group_type);
+    inline size_type TotalAllocCount(size_type group_capacity, size_type slot_capacity) const {
+        const size_type num_group_bytes = group_capacity * kGroupTotalBytes;
         const size_type num_slot_bytes = slot_capacity * sizeof(slot_type);
-        const size_type total_bytes = num_slot_bytes + GroupAlignment + num_group_bytes;
-        const size_type total_alloc_count = (total_bytes + sizeof(slot_type) - 1) / sizeof(slot_type);
+        const size_type total_bytes = GroupAlignment + num_group_bytes + kSlotAlignment + num_slot_bytes;
+        const size_type total_alloc_count = (total_bytes + sizeof(group_type) - 1) / sizeof(group_type);
         return total_alloc_count;
     }
 
@@ -1295,12 +2328,11 @@ private:
         if (!NeedDestory) {
             this->groups_ = this_type::default_empty_groups();
             this->slots_ = nullptr;
+            this->indices_ = nullptr;
             this->slot_size_ = 0;
             this->slot_mask_ = 0;
             this->slot_threshold_ = 0;
-#if CLUSTER_USE_SEPARATE_SLOTS
             this->groups_alloc_ = this_type::default_empty_groups();
-#endif
         } else {
             this->destroy_data();
         }
@@ -1335,8 +2367,7 @@ private:
         size_type new_group_capacity = (new_ctrl_capacity + (kGroupWidth - 1)) / kGroupWidth;
         assert(new_group_capacity > 0);
 
-        size_type new_max_slot_size = new_capacity * this->mlf_ / kLoadFactorAmplify;
-        size_type new_slot_capacity = (!kIsIndirectKV) ? new_capacity : new_max_slot_size;
+        size_type new_slot_capacity = this_type::calc_slot_alloc_capacity(new_capacity);
 
 #if CLUSTER_USE_SEPARATE_SLOTS
         size_type total_group_alloc_count = this->TotalGroupAllocCount<kGroupAlignment>(new_group_capacity);
@@ -1345,10 +2376,11 @@ private:
 
         slot_type * new_slots = SlotAllocTraits::allocate(this->slot_allocator_, new_slot_capacity);
 #else
-        size_type total_slot_alloc_count = this->TotalSlotAllocCount<kGroupAlignment>(new_group_capacity, new_slot_capacity);
+        size_type total_alloc_count = this->TotalAllocCount<kGroupAlignment>(new_group_capacity, new_slot_capacity);
+        group_type * new_groups_alloc = GroupAllocTraits::allocate(this->group_allocator_, total_alloc_count);
+        group_type * new_groups = this->AlignedGroups<kGroupAlignment>(new_groups_alloc);
 
-        slot_type * new_slots = SlotAllocTraits::allocate(this->slot_allocator_, total_slot_alloc_count);
-        group_type * new_groups = this->AlignedSlotsAndGroups<kGroupAlignment>(new_slots, new_slot_capacity);
+        slot_type * new_slots = this->AlignedGroupsAndSlots<kSlotAlignment>(new_groups, new_group_capacity);
 #endif
 
         // Reset groups to default state
@@ -1356,9 +2388,11 @@ private:
 
         this->groups_ = new_groups;
         this->slots_ = new_slots;
-#if CLUSTER_USE_SEPARATE_SLOTS
+        if (kIsIndirectKV) {
+            assert(new_capacity <= size_type(std::numeric_limits<index_type>::max()));
+            this->indices_ = reinterpret_cast<index_type *>(new_groups + new_group_capacity);
+        }
         this->groups_alloc_ = new_groups_alloc;
-#endif
 
         if (isInitialize) {
             assert(this->slot_size_ == 0);
@@ -1372,15 +2406,25 @@ private:
     template <bool AllowShrink>
     JSTD_NO_INLINE
     void rehash_impl(size_type new_capacity) {
+        this->finish_rehash();
+
         new_capacity = this->calc_capacity(new_capacity);
         assert(new_capacity > 0);
         assert(new_capacity >= kMinCapacity);
+        if (kIsIndirectKV) {
+            // The dense slots must be able to hold all the elements.
+            while (this_type::calc_slot_alloc_capacity(new_capacity) < this->slot_size()) {
+                new_capacity *= 2;
+            }
+        }
         if ((!AllowShrink && (new_capacity > this->slot_capacity())) ||
             (AllowShrink && (new_capacity != this->slot_capacity()))) {
             if (!AllowShrink) {
                 assert(new_capacity >= this->slot_size());
             }
 
+            std::uint64_t start_ns = this->stats_clock_ns();
+
             group_type * old_groups = this->groups();
             group_type * old_groups_alloc = this->groups_alloc();
             size_type old_group_capacity = this->group_capacity();
@@ -1394,16 +2438,28 @@ private:
 
             this->create_slots<false>(new_capacity);
 
-            if (old_groups != this_type::default_empty_groups()) {
+            if (kIsIndirectKV) {
+                // The slots are dense, move them in order, so the new slots are still dense
+                // and the ctrls only need to be rebuilt.
+                slot_type * old_slot = old_slots;
+                for (; old_slot < old_last_slot; ++old_slot) {
+                    this->insert_unique_and_no_grow(old_slot);
+                    this->destroy_slot(old_slot);
+                }
+            } else if (kIsParallelRehash && (old_slot_size >= kMinParallelRehashSize) &&
+                       this->parallel_rehash_threads() > 1 &&
+                       this->parallel_migrate(old_groups, old_slots, old_group_capacity)) {
+                this->slot_size_ = old_slot_size;
+            } else if (old_groups != this_type::default_empty_groups()) {
                 group_type * group = old_groups;
                 group_type * last_group = old_groups + old_group_capacity;
                 slot_type * slot_base = old_slots;
 
                 for (; group < last_group; ++group) {
-                    uint32_t used_mask = group->match_used();
+                    bitmask_type used_mask = this->match_used(group);
                     while (used_mask != 0) {
-                        std::uint32_t used_pos = BitUtils::bsf32(used_mask);
-                        used_mask = BitUtils::clearLowBit32(used_mask);
+                        size_type used_pos = group_type::bsf(used_mask);
+                        used_mask = group_type::clear_low_bit(used_mask);
                         slot_type * old_slot = slot_base + used_pos;
                         assert(old_slot < old_last_slot);
                         this->insert_unique_and_no_grow(old_slot);
@@ -1415,22 +2471,338 @@ private:
 
             assert(this->slot_size() == old_slot_size);
 
-#if CLUSTER_USE_SEPARATE_SLOTS
-            if (old_groups != this_type::default_empty_groups()) {
-                assert(old_groups_alloc != nullptr);
-                size_type total_group_alloc_count = this->TotalGroupAllocCount<kGroupAlignment>(old_group_capacity);
-                GroupAllocTraits::deallocate(this->group_allocator_, old_groups_alloc, total_group_alloc_count);
-            }
             if (old_slots != nullptr) {
-                SlotAllocTraits::deallocate(this->slot_allocator_, old_slots, old_slot_capacity);
+                this->deallocate_groups_and_slots(old_groups_alloc, old_slots,
+                                                  old_group_capacity, old_slot_capacity);
+            }
+
+            this->record_rehash(start_ns);
+        }
+    }
+
+    static size_type parallel_rehash_threads() noexcept {
+        size_type thread_count = kParallelRehashThreads;
+        if (thread_count == 0) {
+            thread_count = static_cast<size_type>(std::thread::hardware_concurrency());
+        }
+        return (std::min)(thread_count, kMaxBuildThreads);
+    }
+
+    //
+    // Move the elements of the old groups into the new arrays by the threads,
+    // the slot size isn't updated. Return false if the threads can't be created,
+    // nothing is moved then, the caller migrates them serially.
+    //
+    bool parallel_migrate(group_type * old_groups, slot_type * old_slots, size_type old_group_capacity) {
+        size_type thread_count = this->parallel_rehash_threads();
+        size_type stripe_count = thread_count * kRehashStripesPerThread;
+        size_type stripe_size = (old_group_capacity + stripe_count - 1) / stripe_count;
+        std::atomic<size_type> next_stripe(0);
+
+        return jstd::run_in_threads(thread_count, [&](size_type /* t */) {
+            for (;;) {
+                size_type stripe = next_stripe.fetch_add(1, std::memory_order_relaxed);
+                size_type first_group = stripe * stripe_size;
+                if (first_group >= old_group_capacity)
+                    break;
+                size_type last_group = (std::min)(first_group + stripe_size, old_group_capacity);
+                for (size_type group_index = first_group; group_index < last_group; group_index++) {
+                    const group_type * group = old_groups + group_index;
+                    bitmask_type used_mask = this->match_used(group);
+                    while (used_mask != 0) {
+                        size_type used_pos = group_type::bsf(used_mask);
+                        used_mask = group_type::clear_low_bit(used_mask);
+                        slot_type * old_slot = old_slots + group_index * kGroupWidth + used_pos;
+                        this->insert_unique_atomic(old_slot);
+                        this->destroy_slot(old_slot);
+                    }
+                }
+            }
+        });
+    }
+
+    //
+    // The insert_unique_and_no_grow() of the parallel rehash, the other threads are
+    // inserting too, so the empty ctrl byte is claimed by the compare-and-swap,
+    // and the overflow bit is set by the atomic or. No one erases in the rehash,
+    // a full group never has an empty slot again.
+    //
+    size_type insert_unique_atomic(slot_type * old_slot) {
+        std::size_t hash_code = this->hash_for(old_slot->value.first);
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type group_index = slot_pos / kGroupWidth;
+        size_type group_pos = slot_pos % kGroupWidth;
+
+        for (;;) {
+            // The snapshot may be stale, the claim is checked by the compare-and-swap.
+            group_type snapshot;
+            this_type::atomic_group_load(this->group_at(group_index), snapshot);
+            bitmask_type empty_mask = this->match_empty(&snapshot);
+            while (empty_mask != 0) {
+                size_type empty_pos = group_type::bsf(empty_mask);
+                empty_mask = group_type::clear_low_bit(empty_mask);
+
+                size_type slot_index = group_index * kGroupWidth + empty_pos;
+                std::uint8_t * ctrl = reinterpret_cast<std::uint8_t *>(this->ctrl_at(slot_index));
+                std::uint8_t expected = this_type::atomic_ctrl_load(ctrl);
+                // The overflow bit of the empty ctrl may be set by the other threads meanwhile.
+                while (ctrl_type::hash_bits(expected) == kEmptySlot) {
+                    std::uint8_t desired = static_cast<std::uint8_t>((expected & kOverflowMask) | ctrl_hash);
+                    if (this_type::atomic_ctrl_compare_exchange(ctrl, expected, desired)) {
+                        SlotPolicyTraits::construct(&this->slot_allocator_, this->slot_at(slot_index), old_slot);
+                        return slot_index;
+                    }
+                }
+            }
+
+            // The group is full, set the overflow bit of the home position.
+            std::uint8_t * overflow_ctrl = reinterpret_cast<std::uint8_t *>(
+                this->ctrl_at(group_index * kGroupWidth + group_pos));
+            this_type::atomic_ctrl_fetch_or(overflow_ctrl, kOverflowMask);
+
+            group_index++;
+            if (unlikely(group_index >= this->group_capacity())) {
+                group_index = 0;
             }
+        }
+    }
+
+    //
+    // The other threads claim the ctrl bytes of the group meanwhile, so the group isn't
+    // read by the plain SIMD load, it's copied by the relaxed atomic loads of the words.
+    //
+    static void atomic_group_load(const group_type * group, group_type & snapshot) noexcept {
+        static_assert((sizeof(group_type) % sizeof(std::uint64_t)) == 0,
+                      "The size of group_type must be a multiple of 8 bytes.");
+        const std::uint64_t * words = reinterpret_cast<const std::uint64_t *>(group);
+        for (std::size_t i = 0; i < sizeof(group_type) / sizeof(std::uint64_t); i++) {
+#if defined(__GNUC__) || defined(__clang__)
+            std::uint64_t word = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
 #else
-            if (old_slots != nullptr) {
-                size_type total_slot_alloc_count = this->TotalSlotAllocCount<kGroupAlignment>(
-                                                        old_group_capacity, old_slot_capacity);
-                SlotAllocTraits::deallocate(this->slot_allocator_, old_slots, total_slot_alloc_count);
+            std::uint64_t word = *static_cast<const volatile std::uint64_t *>(&words[i]);
+#endif
+            std::memcpy(reinterpret_cast<char *>(&snapshot) + i * sizeof(std::uint64_t),
+                        &word, sizeof(std::uint64_t));
+        }
+    }
+
+    static std::uint8_t atomic_ctrl_load(const std::uint8_t * ctrl) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_load_n(ctrl, __ATOMIC_RELAXED);
+#else
+        return *static_cast<const volatile std::uint8_t *>(ctrl);
+#endif
+    }
+
+    //
+    // If it fails, expected is updated to the current value.
+    //
+    static bool atomic_ctrl_compare_exchange(std::uint8_t * ctrl, std::uint8_t & expected,
+                                             std::uint8_t desired) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        return __atomic_compare_exchange_n(ctrl, &expected, desired, false,
+                                           __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+        char comparand = static_cast<char>(expected);
+        char prev = _InterlockedCompareExchange8(reinterpret_cast<volatile char *>(ctrl),
+                                                 static_cast<char>(desired), comparand);
+        if (prev == comparand)
+            return true;
+        expected = static_cast<std::uint8_t>(prev);
+        return false;
+#else
+        JSTD_UNUSED(desired);
+        expected = *ctrl;
+        return false;
+#endif
+    }
+
+    static void atomic_ctrl_fetch_or(std::uint8_t * ctrl, std::uint8_t bits) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        __atomic_fetch_or(ctrl, bits, __ATOMIC_RELAXED);
+#elif defined(_MSC_VER)
+        _InterlockedOr8(reinterpret_cast<volatile char *>(ctrl), static_cast<char>(bits));
+#else
+        *ctrl |= bits;
+#endif
+    }
+
+    //
+    // Copy (or move) all slots from other, at the identical capacity, so the layout
+    // of ctrls is the same and no rehash is needed. If the slot is trivially copyable,
+    // just memcpy() the groups and the slot array.
+    //
+    template <bool IsMove, typename Table>
+    void copy_slots_from(Table & other) {
+        // The moved table can be migrated, but the copied table is const,
+        // its old elements are copied into the new arrays by copy_old_slots_from().
+        this_type::finish_rehash_if_movable(other);
+
+        if (other.slots_ == nullptr) {
+            this->reset<false>();
+            return;
+        }
+
+        this->create_slots<false>(other.slot_capacity());
+        assert(this->slot_capacity() == other.slot_capacity());
+        assert(this->group_capacity() == other.group_capacity());
+
+        // Copy the groups, the indexes and the overflow counters (if used) after them.
+        std::memcpy((void *)this->groups(), (const void *)other.groups(),
+                    this->group_capacity() * kGroupTotalBytes);
+
+        if (is_slot_trivial_copyable) {
+            // The slots of the indirect mode are dense, only copy the used slots.
+            size_type num_slots = (!kIsIndirectKV) ? this->slot_capacity() : other.slot_size();
+            std::memcpy((void *)this->slots(), (const void *)other.slots(),
+                        num_slots * sizeof(slot_type));
+        } else if (kIsIndirectKV) {
+            // The slots are dense, the slot indexes of the ctrls keep the same.
+            slot_type * slot = this->slots();
+            const slot_type * other_slot = other.slots();
+            const slot_type * other_last_slot = other.last_slot();
+            try {
+                for (; other_slot < other_last_slot; ++other_slot) {
+                    if (IsMove)
+                        SlotPolicyTraits::construct(&this->slot_allocator_, slot,
+                                                    const_cast<slot_type *>(other_slot));
+                    else
+                        SlotPolicyTraits::construct(&this->slot_allocator_, slot, other_slot);
+                    ++slot;
+                }
+            } catch (...) {
+                // Only the slots before slot have been constructed.
+                this->slot_size_ = static_cast<size_type>(slot - this->slots());
+                this->destroy();
+                throw;
+            }
+        } else {
+            size_type slot_index = 0;
+            try {
+                const ctrl_type * ctrl = other.ctrls();
+                for (; slot_index < this->slot_capacity(); slot_index++) {
+                    if (ctrl->is_used()) {
+                        slot_type * slot = this->slot_at(slot_index);
+                        if (IsMove)
+                            SlotPolicyTraits::construct(&this->slot_allocator_, slot,
+                                                        const_cast<slot_type *>(other.slot_at(slot_index)));
+                        else
+                            SlotPolicyTraits::construct(&this->slot_allocator_, slot,
+                                                        const_cast<const slot_type *>(other.slot_at(slot_index)));
+                    }
+                    ctrl++;
+                }
+            } catch (...) {
+                // The slots from slot_index haven't been constructed, mark them as empty.
+                for (; slot_index < this->slot_capacity(); slot_index++) {
+                    this->ctrl_at(slot_index)->set_empty();
+                }
+                this->destroy();
+                throw;
             }
+        }
+
+        this->slot_size_ = other.slot_size_;
+        this->slot_threshold_ = other.slot_threshold_;
+
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (other.is_rehashing()) {
+            this->copy_old_slots_from(other);
+        }
+#endif
+    }
+
+    static void finish_rehash_if_movable(this_type & other) {
+        other.finish_rehash();
+    }
+
+    static void finish_rehash_if_movable(const this_type & other) noexcept {
+        /* The const table never migrates */
+        (void)other;
+    }
+
+    this_type & move_assign(this_type && other, std::true_type) {
+        if (std::addressof(other) != this) {
+            this_type tmp(std::move(other));
+            this->assign_impl(tmp, true);
+        }
+        return *this;
+    }
+
+    this_type & move_assign(this_type && other, std::false_type) {
+        if (std::addressof(other) != this) {
+            this_type tmp(std::move(other), this->get_allocator());
+            this->assign_impl(tmp, false);
+        }
+        return *this;
+    }
+
+    void swap_content(this_type & other) noexcept {
+        using std::swap;
+        swap(this->groups_, other.groups_);
+        swap(this->slots_, other.slots_);
+        swap(this->indices_, other.indices_);
+        swap(this->slot_size_, other.slot_size_);
+        swap(this->slot_mask_, other.slot_mask_);
+        swap(this->slot_threshold_, other.slot_threshold_);
+        swap(this->mlf_, other.mlf_);
+        swap(this->groups_alloc_, other.groups_alloc_);
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        swap(this->old_, other.old_);
+#endif
+#if CLUSTER_USE_HASH_POLICY
+        swap(this->hash_policy_, other.hash_policy_);
 #endif
+    }
+
+    void swap_functors(this_type & other) noexcept {
+        using std::swap;
+        swap(this->hasher_, other.hasher_);
+        swap(this->key_equal_, other.key_equal_);
+    }
+
+    void swap_allocators(this_type & other) noexcept {
+        using std::swap;
+        swap(this->allocator_, other.allocator_);
+        swap(this->group_allocator_, other.group_allocator_);
+        swap(this->ctrl_allocator_, other.ctrl_allocator_);
+        swap(this->slot_allocator_, other.slot_allocator_);
+    }
+
+    void swap_policy(this_type & other) noexcept {
+        using std::swap;
+        this->swap_functors(other);
+        if (std::allocator_traits<allocator_type>::propagate_on_container_swap::value) {
+            swap(this->allocator_, other.allocator_);
+        }
+        if (std::allocator_traits<group_allocator_type>::propagate_on_container_swap::value) {
+            swap(this->group_allocator_, other.group_allocator_);
+        }
+        if (std::allocator_traits<ctrl_allocator_type>::propagate_on_container_swap::value) {
+            swap(this->ctrl_allocator_, other.ctrl_allocator_);
+        }
+        if (std::allocator_traits<slot_allocator_type>::propagate_on_container_swap::value) {
+            swap(this->slot_allocator_, other.slot_allocator_);
+        }
+    }
+
+    void swap_impl(this_type & other) noexcept {
+        this->swap_content(other);
+        this->swap_policy(other);
+    }
+
+    //
+    // The copy and move assignments take over the content of tmp. If the allocators
+    // propagate, tmp was built with the other's allocators, they are swapped with the
+    // content whatever propagate_on_container_swap is, so the old content is freed by
+    // its own allocators when tmp is destroyed. Otherwise tmp has this's allocators.
+    //
+    void assign_impl(this_type & tmp, bool propagate_allocator) noexcept {
+        this->swap_content(tmp);
+        this->swap_functors(tmp);
+        if (propagate_allocator) {
+            this->swap_allocators(tmp);
         }
     }
 
@@ -1474,14 +2846,21 @@ private:
 
     JSTD_FORCED_INLINE
     size_type find_first_used_index() const {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            size_type old_index = this->skip_empty_old_slots(0);
+            if (old_index != npos)
+                return this->old_iterator_index(old_index);
+        }
+#endif
         if (this->size() != 0) {
-            group_type * group = this->groups();
-            group_type * last_group = this->last_group();
+            const group_type * group = this->groups();
+            const group_type * last_group = this->last_group();
             size_type slot_base_index = 0;
             for (; group < last_group; ++group) {
-                std::uint32_t used_mask = group->match_used();
+                bitmask_type used_mask = this->match_used(group);
                 if (likely(used_mask != 0)) {
-                    std::uint32_t used_pos = BitUtils::bsf32(used_mask);
+                    size_type used_pos = group_type::bsf(used_mask);
                     size_type slot_index = slot_base_index + used_pos;
                     return slot_index;
                 }
@@ -1491,24 +2870,62 @@ private:
         return this->slot_capacity();
     }
 
+    //
+    // The dense slots of the indirect mode, the live old slots of the incremental rehash
+    // are walked before the new slots.
+    //
+    const slot_type * first_used_slot() const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            size_type old_pos = this->skip_empty_old_dense_slots(this->old_.migrate_pos);
+            if (old_pos != npos)
+                return (this->old_.slots + std::ptrdiff_t(old_pos));
+        }
+#endif
+        return this->slots();
+    }
+
+    const slot_type * next_used_slot(const slot_type * slot) const noexcept {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_old_slot(slot))) {
+            size_type old_pos = static_cast<size_type>(slot - this->old_.slots);
+            old_pos = this->skip_empty_old_dense_slots(old_pos + 1);
+            if (old_pos != npos)
+                return (this->old_.slots + std::ptrdiff_t(old_pos));
+            else
+                return this->slots();
+        }
+#endif
+        return (slot + 1);
+    }
+
     JSTD_FORCED_INLINE
     size_type skip_empty_slots(size_type start_slot_index) const {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_old_index(start_slot_index))) {
+            size_type old_index = this->skip_empty_old_slots(this->old_ctrl_index(start_slot_index));
+            if (old_index != npos)
+                return this->old_iterator_index(old_index);
+            // Continue with the new arrays.
+            start_slot_index = 0;
+        }
+#endif
         if (this->size() != 0) {
-            group_type * group = this->group_by_slot_index(start_slot_index);
-            group_type * last_group = this->last_group();
+            const group_type * group = this->group_by_slot_index(start_slot_index);
+            const group_type * last_group = this->last_group();
             size_type slot_pos = start_slot_index % kGroupWidth;
             size_type slot_base_index = start_slot_index - slot_pos;
             // Last 4 items use ctrl seek, maybe faster.
             static const size_type kCtrlFasterSeekPos = 4;
             if (likely(slot_pos < (kGroupWidth - kCtrlFasterSeekPos))) {
                 if (group < last_group) {
-                    std::uint32_t used_mask = group->match_used();
+                    bitmask_type used_mask = this->match_used(group);
                     // Filter out the bits in the leading position
-                    // std::uint32_t non_excluded_mask = ~((std::uint32_t(1) << std::uint32_t(slot_pos)) - 1);
-                    std::uint32_t non_excluded_mask = (std::uint32_t(0xFFFFFFFFu) << std::uint32_t(slot_pos));
+                    // bitmask_type non_excluded_mask = ~((bitmask_type(1) << bitmask_type(slot_pos)) - 1);
+                    bitmask_type non_excluded_mask = (static_cast<bitmask_type>(~bitmask_type(0)) << slot_pos);
                     used_mask &= non_excluded_mask;
                     if (likely(used_mask != 0)) {
-                        std::uint32_t used_pos = BitUtils::bsf32(used_mask);
+                        size_type used_pos = group_type::bsf(used_mask);
                         size_type slot_index = slot_base_index + used_pos;
                         return slot_index;
                     }
@@ -1517,7 +2934,7 @@ private:
                 }
             } else {
                 size_type last_index = slot_base_index + kGroupWidth;
-                ctrl_type * ctrl = this->ctrl_at(start_slot_index);
+                const ctrl_type * ctrl = this->ctrl_at(start_slot_index);
                 while (start_slot_index < last_index) {
                     if (ctrl->is_used()) {
                         return start_slot_index;
@@ -1525,11 +2942,13 @@ private:
                     ++ctrl;
                     ++start_slot_index;
                 }
+                slot_base_index += kGroupWidth;
+                group++;
             }
             for (; group < last_group; ++group) {
-                std::uint32_t used_mask = group->match_used();
+                bitmask_type used_mask = this->match_used(group);
                 if (likely(used_mask != 0)) {
-                    std::uint32_t used_pos = BitUtils::bsf32(used_mask);
+                    size_type used_pos = group_type::bsf(used_mask);
                     size_type slot_index = slot_base_index + used_pos;
                     return slot_index;
                 }
@@ -1549,6 +2968,11 @@ private:
     template <typename KeyT>
     const slot_type * find_impl(const KeyT & key) const {
         std::size_t hash_code = this->hash_for(key);
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            return this->find_impl_rehashing(key, hash_code);
+        }
+#endif
         size_type slot_index = this->index_for_hash(hash_code);
         std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
         size_type group_index = slot_index / kGroupWidth;
@@ -1561,22 +2985,24 @@ private:
         size_type skip_groups = 0;
 
         for (;;) {
-            std::uint32_t match_mask = group->match_hash(ctrl_hash);
+            bitmask_type match_mask = this->match_hash(group, ctrl_hash);
             if (match_mask != 0) {
                 do {
-                    std::uint32_t match_pos = BitUtils::bsf32(match_mask);
-                    match_mask = BitUtils::clearLowBit32(match_mask);
+                    size_type match_pos = group_type::bsf(match_mask);
+                    match_mask = group_type::clear_low_bit(match_mask);
 
                     size_type slot_pos = slot_base + match_pos;
                     const slot_type * slot = this->slot_at(slot_pos);
                     if (likely(this->key_equal_(key, slot->value.first))) {
+                        this->record_find(true, skip_groups + 1);
                         return slot;
                     }
                 } while (match_mask != 0);
             }
 
             // If it's not overflow, means it hasn't been found.
-            if (likely(!group->is_overflow(group_pos))) {
+            if (likely(!this->is_overflow(group, group_pos))) {
+                this->record_find(false, skip_groups + 1);
                 return this->last_slot();
             }
 
@@ -1586,13 +3012,15 @@ private:
                 group = this->groups();
                 slot_base = 0;
             }
-#if 0
+            // All groups are probed, the overflow bits may be left by the erases.
             if (unlikely(group == first_group)) {
+                this->record_find(false, skip_groups + 1);
                 return this->last_slot();
             }
+#if CLUSTER_USE_STATS || CLUSTER_DISPLAY_DEBUG_INFO
+            skip_groups++;
 #endif
 #if CLUSTER_DISPLAY_DEBUG_INFO
-            skip_groups++;
             if (unlikely(skip_groups > kSkipGroupsLimit)) {
                 std::cout << "find_impl(): key = " << key <<
                              ", skip_groups = " << skip_groups <<
@@ -1602,22 +3030,117 @@ private:
         }
     }
 
+    //
+    // A rolling pipeline: while the keys [i, i + kFindBatchSize) are resolved, the home groups
+    // of the keys (i + kFindBatchDistance) onwards and the first candidate slots of the keys
+    // (i + kFindBatchDistance / 2) onwards are prefetched, the groups of the latter should be
+    // in the cache by then. The prefetches of a chunk run in the tight loops, so their loads
+    // overlap each other. The hash codes of the keys in flight are kept in a ring.
+    //
+    template <typename KeyT, typename ResolveFunc>
+    void find_batch_impl(const KeyT * keys, size_type count, ResolveFunc && resolve) const {
+        static constexpr size_type kDistance = kFindBatchDistance;
+        static constexpr size_type kHalfDistance = kFindBatchDistance / 2;
+        static constexpr size_type kRingSize = kFindBatchDistance * 2;
+        static constexpr size_type kRingMask = kRingSize - 1;
+
+        std::size_t hash_codes[kRingSize];
+
+        // Prime the pipeline.
+        size_type prime_count = (std::min)(count, kDistance);
+        for (size_type i = 0; i < prime_count; i++) {
+            std::size_t hash_code = this->hash_for(keys[i]);
+            hash_codes[i] = hash_code;
+            Prefetch_Read_T0(this->group_by_slot_index(this->index_for_hash(hash_code)));
+        }
+        prime_count = (std::min)(count, kHalfDistance);
+        for (size_type i = 0; i < prime_count; i++) {
+            this->prefetch_first_candidate(hash_codes[i]);
+        }
+
+        for (size_type first = 0; first < count; first += kFindBatchSize) {
+            size_type last = (std::min)(first + kFindBatchSize, count);
+
+            size_type ahead_last = (std::min)(last + kDistance, count);
+            for (size_type i = first + kDistance; i < ahead_last; i++) {
+                std::size_t hash_code = this->hash_for(keys[i]);
+                hash_codes[i & kRingMask] = hash_code;
+                Prefetch_Read_T0(this->group_by_slot_index(this->index_for_hash(hash_code)));
+            }
+
+            ahead_last = (std::min)(last + kHalfDistance, count);
+            for (size_type i = first + kHalfDistance; i < ahead_last; i++) {
+                this->prefetch_first_candidate(hash_codes[i & kRingMask]);
+            }
+
+            for (size_type i = first; i < last; i++) {
+                std::size_t hash_code = hash_codes[i & kRingMask];
+                size_type slot_pos = this->index_for_hash(hash_code);
+                std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+                size_type probed_groups = 0;
+                size_type slot_index = this->find_index(keys[i], slot_pos, ctrl_hash, probed_groups);
+#if CLUSTER_USE_INCREMENTAL_REHASH
+                if (unlikely((slot_index == this->slot_capacity()) && this->is_rehashing())) {
+                    size_type old_index = this->find_old_index(keys[i], hash_code);
+                    if (old_index != npos)
+                        slot_index = this->old_iterator_index(old_index);
+                }
+#endif
+                this->record_find(slot_index != this->slot_capacity(), probed_groups);
+                resolve(i, slot_index);
+            }
+        }
+    }
+
+    //
+    // If nothing matches, nothing is prefetched, the slot of an empty lane may be
+    // uninitialized. In the indirect mode, the slot index of the first match is
+    // prefetched instead of the slot, the index isn't loaded yet.
+    //
+    JSTD_FORCED_INLINE
+    void prefetch_first_candidate(std::size_t hash_code) const {
+        size_type group_index = this->index_for_hash(hash_code) / kGroupWidth;
+        const group_type * group = this->group_at(group_index);
+        bitmask_type match_mask = this->match_hash(group, this->ctrl_for_hash(hash_code));
+        if (match_mask != 0) {
+            size_type slot_index = group_index * kGroupWidth + group_type::bsf(match_mask);
+            if (kIsIndirectKV)
+                Prefetch_Read_T0(this->slot_indices() + slot_index);
+            else
+                Prefetch_Read_T0(this->slot_at(slot_index));
+        }
+    }
+
     template <typename KeyT>
     size_type find_index(const KeyT & key) {
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            return this->find_index_rehashing(key, this->hash_for(key));
+        }
+#endif
         return const_cast<const this_type *>(this)->find_index<KeyT>(key);
     }
 
     template <typename KeyT>
     size_type find_index(const KeyT & key) const {
         std::size_t hash_code = this->hash_for(key);
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            return this->find_index_no_migrate(key, hash_code);
+        }
+#endif
         size_type slot_pos = this->index_for_hash(hash_code);
         std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
-        return this->find_index(key, slot_pos, ctrl_hash);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        this->record_find(slot_index != this->slot_capacity(), probed_groups);
+        return slot_index;
     }
 
     template <typename KeyT>
     JSTD_NO_INLINE
-    size_type find_index(const KeyT & key, size_type slot_pos, std::uint8_t ctrl_hash) const {
+    size_type find_index(const KeyT & key, size_type slot_pos, std::uint8_t ctrl_hash,
+                         size_type & probed_groups) const {
         size_type group_index = slot_pos / kGroupWidth;
         size_type group_pos = slot_pos % kGroupWidth;
         const group_type * group = this->group_at(group_index);
@@ -1628,22 +3151,24 @@ private:
         size_type skip_groups = 0;
 
         for (;;) {
-            std::uint32_t match_mask = group->match_hash(ctrl_hash);
+            bitmask_type match_mask = this->match_hash(group, ctrl_hash);
             if (match_mask != 0) {
                 do {
-                    std::uint32_t match_pos = BitUtils::bsf32(match_mask);
-                    match_mask = BitUtils::clearLowBit32(match_mask);
+                    size_type match_pos = group_type::bsf(match_mask);
+                    match_mask = group_type::clear_low_bit(match_mask);
 
                     size_type slot_index = slot_base + match_pos;
                     const slot_type * slot = this->slot_at(slot_index);
                     if (likely(this->key_equal_(key, slot->value.first))) {
+                        this_type::set_probed_groups(probed_groups, skip_groups + 1);
                         return slot_index;
                     }
                 } while (match_mask != 0);
             }
 
             // If it's not overflow, means it hasn't been found.
-            if (likely(!group->is_overflow(group_pos))) {
+            if (likely(!this->is_overflow(group, group_pos))) {
+                this_type::set_probed_groups(probed_groups, skip_groups + 1);
                 return this->slot_capacity();
             }
 
@@ -1653,13 +3178,15 @@ private:
                 group = this->groups();
                 slot_base = 0;
             }
-#if 0
+            // All groups are probed, the overflow bits may be left by the erases.
             if (unlikely(group == first_group)) {
+                this_type::set_probed_groups(probed_groups, skip_groups + 1);
                 return this->slot_capacity();
             }
+#if CLUSTER_USE_STATS || CLUSTER_DISPLAY_DEBUG_INFO
+            skip_groups++;
 #endif
 #if CLUSTER_DISPLAY_DEBUG_INFO
-            skip_groups++;
             if (unlikely(skip_groups > kSkipGroupsLimit)) {
                 std::cout << "find_index(): key = " << key <<
                              ", skip_groups = " << skip_groups <<
@@ -1682,9 +3209,19 @@ private:
         printf(" ]\n");
     }
 
+    JSTD_FORCED_INLINE
+    void bind_slot_index(size_type ctrl_index, size_type slot_pos) noexcept {
+        assert(kIsIndirectKV);
+        assert(ctrl_index < this->max_ctrl_capacity());
+        assert(slot_pos < this_type::calc_slot_alloc_capacity(this->slot_capacity()));
+        this->slot_indices()[ctrl_index] = static_cast<index_type>(slot_pos);
+        this->ctrl_indices()[slot_pos] = static_cast<index_type>(ctrl_index);
+    }
+
     template <typename KeyT>
     JSTD_FORCED_INLINE
-    size_type find_first_empty_to_insert(const KeyT & key, size_type slot_pos, std::uint8_t ctrl_hash) {
+    size_type find_first_empty_to_insert(const KeyT & key, size_type slot_pos, std::uint8_t ctrl_hash,
+                                         size_type & probed_groups) {
         size_type group_index = slot_pos / kGroupWidth;
         size_type group_pos = slot_pos % kGroupWidth;
         group_type * group = this->group_at(group_index);
@@ -1696,18 +3233,20 @@ private:
         size_type slot_base = group_index * kGroupWidth;
 
         for (;;) {
-            std::uint32_t empty_mask = group->match_empty();
+            bitmask_type empty_mask = this->match_empty(group);
             if (empty_mask != 0) {
-                std::uint32_t empty_pos = BitUtils::bsf32(empty_mask);
+                size_type empty_pos = group_type::bsf(empty_mask);
                 assert(group->is_empty(empty_pos));
                 group->set_used(empty_pos, ctrl_hash);
                 size_type slot_index = slot_base + empty_pos;
+                if (kIsIndirectKV) {
+                    // The new element always be appended to the end of the dense slots.
+                    this->bind_slot_index(slot_index, this->slot_size());
+                }
+                this_type::set_probed_groups(probed_groups, skip_groups + 1);
                 return slot_index;
             } else {
-                // If it's not overflow, set the overflow bit.
-                if (likely(!group->is_overflow(group_pos))) {
-                    group->set_overflow(group_pos);
-                }
+                this->set_overflow(group, group_pos);
             }
 #if CLUSTER_DISPLAY_DEBUG_INFO
             prev_group = group;
@@ -1718,13 +3257,15 @@ private:
                 group = this->groups();
                 slot_base = 0;
             }
-#if 0
+            // The table is full, it can't happen below the slot threshold.
             if (unlikely(group == first_group)) {
+                this_type::set_probed_groups(probed_groups, skip_groups + 1);
                 return this->slot_capacity();
             }
+#if CLUSTER_USE_STATS || CLUSTER_DISPLAY_DEBUG_INFO
+            skip_groups++;
 #endif
 #if CLUSTER_DISPLAY_DEBUG_INFO
-            skip_groups++;
             if (unlikely(skip_groups > kSkipGroupsLimit)) {
                 std::cout << "find_first_empty_to_insert(): key = " << key <<
                              ", skip_groups = " << skip_groups <<
@@ -1740,11 +3281,26 @@ private:
     std::pair<size_type, bool>
     find_and_insert(const KeyT & key) {
         std::size_t hash_code = this->hash_for(key);
+        return this->find_and_insert(key, hash_code);
+    }
+
+    template <typename KeyT>
+    JSTD_NO_INLINE
+    std::pair<size_type, bool>
+    find_and_insert(const KeyT & key, std::size_t hash_code) {
+        assert(hash_code == this->hash_for(key));
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            return this->find_and_insert_rehashing(key, hash_code);
+        }
+#endif
         size_type slot_pos = this->index_for_hash(hash_code);
         std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
 
-        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
         if (slot_index != this->slot_capacity()) {
+            this->record_insert(true, probed_groups);
             return { slot_index, kIsExists };
         }
 
@@ -1753,82 +3309,408 @@ private:
             this->grow_if_necessary();
 
             slot_pos = this->index_for_hash(hash_code);
+#if CLUSTER_USE_HASH_POLICY
+            // The ctrl hash of the hash policy may be taken from the bits below the index.
+            ctrl_hash = this->ctrl_for_hash(hash_code);
+#else
             // Ctrl hash will not change
             // ctrl_hash = this->ctrl_for_hash(hash_code);
+#endif
         }
 
-        slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash);
+        size_type empty_probed_groups = 0;
+        slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash, empty_probed_groups);
         assert(slot_index < this->slot_capacity());
+        this->record_insert(false, probed_groups + empty_probed_groups);
         return { slot_index, kNeedInsert };
     }
 
+    //
+    // The first candidate slot of insert_batch(): the first match, or the first empty
+    // slot which the new element is going to be constructed in. In the indirect mode,
+    // the slot index of the first match is prefetched, the new elements are appended
+    // to the dense slots.
+    //
     JSTD_FORCED_INLINE
-    size_type insert_unique_and_no_grow(const key_type & key) {
-        std::size_t hash_code = this->hash_for(key);
+    void prefetch_insert_candidate(std::size_t hash_code) {
+        size_type group_index = this->index_for_hash(hash_code) / kGroupWidth;
+        const group_type * group = this->group_at(group_index);
+        bitmask_type match_mask = this->match_hash(group, this->ctrl_for_hash(hash_code));
+        if (match_mask != 0) {
+            size_type slot_index = group_index * kGroupWidth + group_type::bsf(match_mask);
+            if (kIsIndirectKV)
+                Prefetch_Write_T0(this->slot_indices() + slot_index);
+            else
+                Prefetch_Write_T0(this->slot_at(slot_index));
+        } else if (!kIsIndirectKV) {
+            match_mask = this->match_empty(group);
+            if (match_mask != 0) {
+                size_type slot_index = group_index * kGroupWidth + group_type::bsf(match_mask);
+                Prefetch_Write_T0(this->slot_at(slot_index));
+            }
+        }
+    }
+
+    // The key of a batch value: a reference if it's a key_type already, otherwise
+    // a key_type converted from it, never a reference to a temporary.
+    template <typename KeyT>
+    using batch_key_t = typename std::conditional<jstd::is_same_ex<KeyT, key_type>::value,
+                                                  const key_type &, key_type>::type;
+
+    template <typename KeyOfFunc, typename ConstructFunc>
+    JSTD_FORCED_INLINE
+    void insert_batch_one(size_type i, std::size_t hash_code, KeyOfFunc && key_of, ConstructFunc && construct) {
+        const key_type & key = key_of(i);
         size_type slot_pos = this->index_for_hash(hash_code);
         std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
 
-        size_type slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash);
-        return slot_index;
-    }
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        if (slot_index != this->slot_capacity()) {
+            this->record_insert(true, probed_groups);
+            construct(i, this->slot_at(slot_index), kIsExists);
+            return;
+        }
 
-    ///
-    /// Use in rehash_impl()
-    ///
-    JSTD_FORCED_INLINE
-    void insert_unique_and_no_grow(slot_type * old_slot) {
-        assert(old_slot != nullptr);
-        size_type slot_index = this->insert_unique_and_no_grow(old_slot->value.first);
-        slot_type * new_slot = this->slot_at(slot_index);
-        assert(new_slot != nullptr);
+        // The reserve() is rounded by the max load factor,
+        // so still check it here, it rarely happens.
+        if (unlikely(this->need_grow())) {
+            // Rehash at once, the batch doesn't look up the old arrays.
+            this->rehash_impl<false>(this->grow_capacity());
+            slot_pos = this->index_for_hash(hash_code);
+#if CLUSTER_USE_HASH_POLICY
+            ctrl_hash = this->ctrl_for_hash(hash_code);
+#endif
+        }
 
-        SlotPolicyTraits::construct(&this->slot_allocator_, new_slot, old_slot);
+        size_type empty_probed_groups = 0;
+        slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash, empty_probed_groups);
+        assert(slot_index < this->slot_capacity());
+        this->record_insert(false, probed_groups + empty_probed_groups);
+        construct(i, this->slot_at(slot_index), kNeedInsert);
         this->slot_size_++;
-        assert(this->slot_size() <= this->slot_capacity());
     }
 
-    template <bool AlwaysUpdate, typename ValueT, typename std::enable_if<
-              (std::is_same<ValueT, value_type>::value ||
-               std::is_constructible<value_type, const ValueT &>::value) ||
-              (std::is_same<ValueT, init_type>::value ||
-               std::is_constructible<init_type, const ValueT &>::value)>::type * = nullptr>
-    JSTD_FORCED_INLINE
-    std::pair<iterator, bool> emplace_impl(const ValueT & value) {
-        auto find_info = this->find_and_insert(value.first);
-        size_type slot_index = find_info.first;
-        bool need_insert = find_info.second;        
-        if (need_insert) {
-            // The key to be inserted is not exists.
-            slot_type * slot = this->slot_at(slot_index);
-            assert(slot != nullptr);
-            SlotPolicyTraits::construct(&this->slot_allocator_, slot, value);
-            this->slot_size_++;
-        } else {
-            // The key to be inserted already exists.
-            if (AlwaysUpdate) {
-                slot_type * slot = this->slot_at(slot_index);
-                slot->value.second = value.second;
+    //
+    // The same rolling pipeline as find_batch_impl(), the keys are inserted in order,
+    // so the duplicate keys in the batch are handled. A rehash in the batch only makes
+    // the prefetches in flight useless, the hash codes are still valid.
+    //
+    // If the table fits in the cache, the prefetches only cost instructions, so the
+    // keys are inserted one by one.
+    //
+    template <typename KeyOfFunc, typename ConstructFunc>
+    size_type insert_batch_impl(size_type count, KeyOfFunc && key_of, ConstructFunc && construct) {
+        static constexpr size_type kDistance = kFindBatchDistance;
+        static constexpr size_type kHalfDistance = kFindBatchDistance / 2;
+        static constexpr size_type kRingSize = kFindBatchDistance * 2;
+        static constexpr size_type kRingMask = kRingSize - 1;
+
+        // The batch only looks up the new arrays.
+        this->finish_rehash();
+
+        // Reserve once for the worst case, all keys are not exists.
+        if ((this->slot_size() + count) > this->slot_threshold()) {
+            this->reserve(this->slot_size() + count);
+        }
+
+        size_type old_slot_size = this->slot_size();
+
+        if (this->slot_capacity() * sizeof(slot_type) < kBatchPrefetchMinBytes) {
+            for (size_type i = 0; i < count; i++) {
+                this->insert_batch_one(i, this->hash_for(key_of(i)), key_of, construct);
             }
+            return (this->slot_size() - old_slot_size);
         }
-        return { this->iterator_at(slot_index), need_insert };
-    }
 
-    template <bool AlwaysUpdate, typename ValueT, typename std::enable_if<
-              (jstd::is_same_ex<ValueT, value_type>::value ||
-               std::is_constructible<value_type, ValueT &&>::value) ||
-              (jstd::is_same_ex<ValueT, init_type>::value ||
-               std::is_constructible<init_type, ValueT &&>::value)>::type * = nullptr>
-    JSTD_FORCED_INLINE
-    std::pair<iterator, bool> emplace_impl(ValueT && value) {
-        auto find_info = this->find_and_insert(value.first);
-        size_type slot_index = find_info.first;
-        bool need_insert = find_info.second;
+        std::size_t hash_codes[kRingSize];
+
+        // Prime the pipeline.
+        size_type prime_count = (std::min)(count, kDistance);
+        for (size_type i = 0; i < prime_count; i++) {
+            std::size_t hash_code = this->hash_for(key_of(i));
+            hash_codes[i] = hash_code;
+            Prefetch_Write_T0(this->group_by_slot_index(this->index_for_hash(hash_code)));
+        }
+        prime_count = (std::min)(count, kHalfDistance);
+        for (size_type i = 0; i < prime_count; i++) {
+            this->prefetch_insert_candidate(hash_codes[i]);
+        }
+
+        for (size_type first = 0; first < count; first += kFindBatchSize) {
+            size_type last = (std::min)(first + kFindBatchSize, count);
+
+            size_type ahead_last = (std::min)(last + kDistance, count);
+            for (size_type i = first + kDistance; i < ahead_last; i++) {
+                std::size_t hash_code = this->hash_for(key_of(i));
+                hash_codes[i & kRingMask] = hash_code;
+                Prefetch_Write_T0(this->group_by_slot_index(this->index_for_hash(hash_code)));
+            }
+
+            ahead_last = (std::min)(last + kHalfDistance, count);
+            for (size_type i = first + kHalfDistance; i < ahead_last; i++) {
+                this->prefetch_insert_candidate(hash_codes[i & kRingMask]);
+            }
+
+            for (size_type i = first; i < last; i++) {
+                this->insert_batch_one(i, hash_codes[i & kRingMask], key_of, construct);
+            }
+        }
+
+        return (this->slot_size() - old_slot_size);
+    }
+
+    template <typename InputIter>
+    size_type parallel_build_impl(InputIter first, InputIter last, size_type thread_count,
+                                  std::false_type /* isRandomAccessIter */) {
+        JSTD_UNUSED(thread_count);
+        size_type old_slot_size = this->slot_size();
+        this->insert(first, last);
+        return (this->slot_size() - old_slot_size);
+    }
+
+    template <typename InputIter>
+    size_type parallel_build_impl(InputIter first, InputIter last, size_type thread_count,
+                                  std::true_type /* isRandomAccessIter */) {
+        size_type count = static_cast<size_type>(std::distance(first, last));
+        if (thread_count == 0) {
+            thread_count = static_cast<size_type>(std::thread::hardware_concurrency());
+        }
+        thread_count = (std::min)(thread_count, kMaxBuildThreads);
+
+        this->finish_rehash();
+        this->reserve(this->slot_size() + count);
+
+        // Each thread fills kMinBuildGroupsPerThread groups at least.
+        size_type group_count = this->group_capacity();
+        thread_count = (std::min)(thread_count, group_count / kMinBuildGroupsPerThread);
+
+        if (kIsIndirectKV || (thread_count <= 1) || (count < kMinParallelBuildSize) || !this->empty()) {
+            return this->parallel_build_impl(first, last, thread_count, std::false_type{});
+        }
+
+        // The stages don't change the table until the stage 3 is started, so if the threads
+        // of any stage can't be created, the values are inserted serially into the empty table.
+
+        // The thread t fills the groups [group_first(t), group_first(t + 1)).
+        auto group_first = [group_count, thread_count](size_type t) -> size_type {
+            return (t * group_count / thread_count);
+        };
+        auto part_of = [group_count, thread_count](size_type group_index) -> size_type {
+            return (((group_index + 1) * thread_count - 1) / group_count);
+        };
+
+        // Stage 1: find the partition of each value, and count the partitions of each chunk.
+        std::vector<std::uint8_t> parts(count);
+        std::vector<size_type> part_counts(thread_count * thread_count, 0);
+        bool is_started = jstd::run_in_threads(thread_count, [&](size_type t) {
+            size_type chunk_first = t * count / thread_count;
+            size_type chunk_last = (t + 1) * count / thread_count;
+            size_type * counts = &part_counts[t * thread_count];
+            for (size_type i = chunk_first; i < chunk_last; i++) {
+                std::size_t hash_code = this->hash_for(first[i].first);
+                size_type part = part_of(this->index_for_hash(hash_code) / kGroupWidth);
+                parts[i] = static_cast<std::uint8_t>(part);
+                counts[part]++;
+            }
+        });
+        if (!is_started) {
+            return this->parallel_build_impl(first, last, thread_count, std::false_type{});
+        }
+
+        // Stage 2: scatter the indexes into the partitions, the chunks keep their input
+        // order in each partition, so the first one of the duplicate keys is inserted.
+        std::vector<size_type> part_offsets(thread_count * thread_count);
+        std::vector<size_type> part_bounds(thread_count + 1);
+        size_type offset = 0;
+        for (size_type part = 0; part < thread_count; part++) {
+            part_bounds[part] = offset;
+            for (size_type t = 0; t < thread_count; t++) {
+                part_offsets[t * thread_count + part] = offset;
+                offset += part_counts[t * thread_count + part];
+            }
+        }
+        part_bounds[thread_count] = offset;
+
+        std::vector<size_type> order(count);
+        is_started = jstd::run_in_threads(thread_count, [&](size_type t) {
+            size_type chunk_first = t * count / thread_count;
+            size_type chunk_last = (t + 1) * count / thread_count;
+            size_type * offsets = &part_offsets[t * thread_count];
+            for (size_type i = chunk_first; i < chunk_last; i++) {
+                order[offsets[parts[i]]++] = i;
+            }
+        });
+        if (!is_started) {
+            return this->parallel_build_impl(first, last, thread_count, std::false_type{});
+        }
+
+        // Stage 3: each thread fills its group range, the values which can't be placed
+        // in the range are deferred.
+        std::vector<size_type> inserted(thread_count, 0);
+        std::vector<std::vector<size_type>> deferred(thread_count);
+        is_started = jstd::run_in_threads(thread_count, [&](size_type t) {
+            size_type range_first = group_first(t);
+            size_type range_last = group_first(t + 1);
+            for (size_type n = part_bounds[t]; n < part_bounds[t + 1]; n++) {
+                size_type i = order[n];
+                std::size_t hash_code = this->hash_for(first[i].first);
+                bool need_insert;
+                size_type slot_index = this->find_or_claim_in_range(first[i].first, hash_code,
+                                                                    range_first, range_last, need_insert);
+                if (need_insert) {
+                    try {
+                        SlotPolicyTraits::construct(&this->slot_allocator_,
+                                                    this->slot_at(slot_index), first[i]);
+                    } catch (...) {
+                        this->group_by_slot_index(slot_index)->set_empty(slot_index % kGroupWidth);
+                        throw;
+                    }
+                    inserted[t]++;
+                } else if (slot_index == npos) {
+                    deferred[t].push_back(i);
+                }
+            }
+        }, [&]() {
+            for (size_type t = 0; t < thread_count; t++) {
+                this->slot_size_ += inserted[t];
+            }
+        });
+        if (!is_started) {
+            return this->parallel_build_impl(first, last, thread_count, std::false_type{});
+        }
+
+        // Stage 4: insert the deferred values serially, in the order of the partitions.
+        for (size_type t = 0; t < thread_count; t++) {
+            for (size_type i : deferred[t]) {
+                this->emplace_impl<false>(first[i]);
+            }
+        }
+        return this->slot_size();
+    }
+
+    //
+    // Find the key or claim an empty slot only in the groups [range_first, range_last),
+    // it's the probing of parallel_build(), the other threads are filling the other ranges.
+    // Return the slot index (need_insert = true if it's claimed), or npos if the key
+    // can't be placed in the range.
+    //
+    template <typename KeyT>
+    size_type find_or_claim_in_range(const KeyT & key, std::size_t hash_code,
+                                     size_type range_first, size_type range_last,
+                                     bool & need_insert) {
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type home_index = slot_pos / kGroupWidth;
+        size_type group_pos = slot_pos % kGroupWidth;
+        assert(home_index >= range_first && home_index < range_last);
+        JSTD_UNUSED(range_first);
+
+        need_insert = false;
+        for (size_type group_index = home_index; group_index < range_last; group_index++) {
+            const group_type * group = this->group_at(group_index);
+            bitmask_type match_mask = this->match_hash(group, ctrl_hash);
+            while (match_mask != 0) {
+                size_type match_pos = group_type::bsf(match_mask);
+                match_mask = group_type::clear_low_bit(match_mask);
+
+                size_type slot_index = group_index * kGroupWidth + match_pos;
+                if (this->key_equal_(key, this->slot_at(slot_index)->value.first)) {
+                    return slot_index;
+                }
+            }
+            // There is no erase in the build, the overflow groups are still full.
+            if (likely(!this->is_overflow(group, group_pos))) {
+                break;
+            }
+        }
+
+        for (size_type group_index = home_index; group_index < range_last; group_index++) {
+            group_type * group = this->group_at(group_index);
+            bitmask_type empty_mask = this->match_empty(group);
+            if (empty_mask != 0) {
+                size_type empty_pos = group_type::bsf(empty_mask);
+                group->set_used(empty_pos, ctrl_hash);
+                need_insert = true;
+                return (group_index * kGroupWidth + empty_pos);
+            } else {
+                this->set_overflow(group, group_pos);
+            }
+        }
+        return npos;
+    }
+
+    JSTD_FORCED_INLINE
+    size_type insert_unique_and_no_grow(const key_type & key) {
+        std::size_t hash_code = this->hash_for(key);
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash, probed_groups);
+        return slot_index;
+    }
+
+    ///
+    /// Use in rehash_impl()
+    ///
+    JSTD_FORCED_INLINE
+    size_type insert_unique_and_no_grow(slot_type * old_slot) {
+        assert(old_slot != nullptr);
+        size_type slot_index = this->insert_unique_and_no_grow(old_slot->value.first);
+        slot_type * new_slot = this->slot_at(slot_index);
+        assert(new_slot != nullptr);
+
+        SlotPolicyTraits::construct(&this->slot_allocator_, new_slot, old_slot);
+        this->slot_size_++;
+        assert(this->slot_size() <= this->slot_capacity());
+        return slot_index;
+    }
+
+    template <bool AlwaysUpdate, typename ValueT, typename std::enable_if<
+              (std::is_same<ValueT, value_type>::value ||
+               std::is_constructible<value_type, const ValueT &>::value) ||
+              (std::is_same<ValueT, init_type>::value ||
+               std::is_constructible<init_type, const ValueT &>::value)>::type * = nullptr>
+    JSTD_FORCED_INLINE
+    std::pair<iterator, bool> emplace_impl(const ValueT & value) {
+        auto find_info = this->find_and_insert(value.first);
+        size_type slot_index = find_info.first;
+        bool need_insert = find_info.second;        
+        if (need_insert) {
+            // The key to be inserted is not exists.
+            slot_type * slot = this->slot_at(slot_index);
+            assert(slot != nullptr);
+            SlotPolicyTraits::construct(&this->slot_allocator_, slot, value);
+            this->slot_size_++;
+        } else {
+            // The key to be inserted already exists.
+            if (AlwaysUpdate) {
+                slot_type * slot = this->slot_at(slot_index);
+                slot->value.second = value.second;
+            }
+        }
+        return { this->iterator_at(slot_index), need_insert };
+    }
+
+    template <bool AlwaysUpdate, typename ValueT, typename std::enable_if<
+              (jstd::is_same_ex<ValueT, value_type>::value ||
+               std::is_constructible<value_type, ValueT &&>::value) ||
+              (jstd::is_same_ex<ValueT, init_type>::value ||
+               std::is_constructible<init_type, ValueT &&>::value)>::type * = nullptr>
+    JSTD_FORCED_INLINE
+    std::pair<iterator, bool> emplace_impl(ValueT && value) {
+        auto find_info = this->find_and_insert(value.first);
+        size_type slot_index = find_info.first;
+        bool need_insert = find_info.second;
         if (need_insert) {
             // The key to be inserted is not exists.
             slot_type * slot = this->slot_at(slot_index);
             assert(slot != nullptr);
             assert(slot_index < this->slot_capacity());
-            SlotPolicyTraits::construct(&this->slot_allocator_, slot, std::move(value));
+            // ValueT may be an lvalue reference, e.g. the *first of insert(first, last),
+            // so it must not be moved from.
+            SlotPolicyTraits::construct(&this->slot_allocator_, slot, std::forward<ValueT>(value));
             this->slot_size_++;
         } else {
             // The key to be inserted already exists.
@@ -1993,8 +3875,9 @@ private:
                 slot_type * slot = this->slot_at(slot_index);
                 slot->value.second = std::move(tmp_slot->value.second);
             }
+            // The key already exists, transfer() destroys the tmp_slot in the insert case.
+            SlotPolicyTraits::destroy(&this->slot_allocator_, tmp_slot);
         }
-        SlotPolicyTraits::destroy(&this->slot_allocator_, tmp_slot);
         return { this->iterator_at(slot_index), need_insert };
     }
 
@@ -2038,40 +3921,687 @@ private:
         return { this->iterator_at(slot_index), need_insert };
     }
 
+    //
+    // The home index of the element to be erased by the iterator, for the overflow
+    // counters and clear_overflow_after_erase(). Without the overflow counters, the
+    // key is only rehashed if the group before it has any overflow bit, otherwise
+    // the slot index is returned as if the element is in its home group.
+    //
     JSTD_FORCED_INLINE
-    bool ctrl_is_last_bit(size_type slot_index) {
-        group_type * group = this->groups() + slot_index / kGroupWidth;
-        size_type ctrl_pos = slot_index % kGroupWidth;
-        std::uint32_t used_mask = group->match_used();
-        std::uint32_t last_bit_pos = BitUtils::bsr32(used_mask);
-        return (ctrl_pos == static_cast<size_type>(last_bit_pos));
+    size_type erase_home_index(size_type slot_index) const {
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        return this->index_for_hash(this->hash_for(this->slot_at(slot_index)->value.first));
+#else
+        size_type group_index = slot_index / kGroupWidth;
+        size_type prev_group_index = (group_index != 0) ? (group_index - 1) : (this->group_capacity() - 1);
+        if (likely(!this->group_at(prev_group_index)->has_overflow()))
+            return slot_index;
+        else
+            return this->index_for_hash(this->hash_for(this->slot_at(slot_index)->value.first));
+#endif
     }
 
     JSTD_FORCED_INLINE
-    void erase_index(size_type slot_index) {
+    void erase_index(size_type slot_index, size_type home_index) {
         assert(slot_index >= 0 && slot_index < this->slot_capacity());
-        bool is_last_bit = this->ctrl_is_last_bit(slot_index);
-        if (likely(!is_last_bit)) {
-            assert(this->slot_threshold_ > 0);
-            this->slot_threshold_--;
-        }
         assert(this->slot_size_ > 0);
+#if CLUSTER_USE_OVERFLOW_COUNTER
+        this->decrease_overflow_counters(home_index, slot_index);
+#endif
         this->slot_size_--;
-        this->destroy_slot_data(slot_index);
+        if (!kIsIndirectKV) {
+            this->destroy_slot_data(slot_index);
+        } else {
+            size_type slot_pos = this->slot_indices()[slot_index];
+            size_type last_slot_pos = this->slot_size();
+            this->destroy_slot_data(slot_index);
+            if (slot_pos != last_slot_pos) {
+                // Move the last slot into the hole to keep the slots dense.
+                SlotPolicyTraits::transfer(&this->slot_allocator_, this->slots() + slot_pos,
+                                           this->slots() + last_slot_pos);
+                this->bind_slot_index(this->ctrl_indices()[last_slot_pos], slot_pos);
+            }
+        }
+    }
+
+#if !CLUSTER_USE_OVERFLOW_COUNTER
+    //
+    // Clear the overflow bits of the group that neither an element displaced into
+    // the next group nor the overflow bit of the next group needs any more.
+    // Return true if any overflow bit is cleared.
+    //
+    bool clear_unneeded_overflow(size_type group_index) {
+        group_type * group = this->group_at(group_index);
+        if (likely(!group->has_overflow()))
+            return false;
+
+        size_type next_group_index = group_index + 1;
+        if (unlikely(next_group_index >= this->group_capacity()))
+            next_group_index = 0;
+        if (unlikely(next_group_index == group_index))
+            return false;
+        group_type * next_group = this->group_at(next_group_index);
+
+        // The overflow bits which the overflow bits of the next group don't keep,
+        // only they may be cleared, so the keys are rehashed only if there are any.
+        bitmask_type clearable_lanes = 0;
+        for (size_type pos = 0; pos < kGroupWidth; pos++) {
+            if (group->is_overflow(pos) && !next_group->is_overflow(pos))
+                clearable_lanes |= static_cast<bitmask_type>(bitmask_type(1) << pos);
+        }
+        if (likely(clearable_lanes == 0))
+            return false;
+
+        bitmask_type used_mask = this->match_used(next_group);
+        while (used_mask != 0) {
+            size_type used_pos = group_type::bsf(used_mask);
+            used_mask = group_type::clear_low_bit(used_mask);
+
+            slot_type * slot = this->slot_at(next_group_index * kGroupWidth + used_pos);
+            size_type home_index = this->index_for_hash(this->hash_for(slot->value.first));
+            if ((home_index / kGroupWidth) != next_group_index) {
+                size_type home_lane = home_index % kGroupWidth;
+                clearable_lanes &= static_cast<bitmask_type>(~(bitmask_type(1) << home_lane));
+                // Stop rehashing the keys once all of the overflow bits are needed.
+                if (clearable_lanes == 0)
+                    return false;
+            }
+        }
+
+        while (clearable_lanes != 0) {
+            size_type pos = group_type::bsf(clearable_lanes);
+            clearable_lanes = group_type::clear_low_bit(clearable_lanes);
+            group->clear_overflow(pos);
+        }
+        return true;
+    }
+#endif
+
+    //
+    // The erased ctrl keeps its overflow bit, so the probe chains passing it
+    // are not broken, and the slot can be reused by insert at once.
+    //
+    // The erase which doesn't move any element: the erased element may be the last one
+    // which needed the overflow bits of the groups before it, so clear them backward,
+    // while the group before still gets its overflow bits cleared.
+    // If the erased element was in its home group, it didn't set any overflow bit,
+    // so there is nothing to clear and no key is rehashed.
+    // The overflow counters are decreased by erase_index() already.
+    //
+    JSTD_FORCED_INLINE
+    void clear_overflow_after_erase(size_type group_index, size_type home_index) {
+#if !CLUSTER_USE_OVERFLOW_COUNTER
+        if (likely((home_index / kGroupWidth) == group_index))
+            return;
+        size_type group_capacity = this->group_capacity();
+        for (size_type step = 0; step < kCompactGroupsLimit; step++) {
+            group_index = (group_index != 0) ? (group_index - 1) : (group_capacity - 1);
+            if (!this->clear_unneeded_overflow(group_index))
+                break;
+        }
+#else
+        JSTD_UNUSED(group_index);
+        JSTD_UNUSED(home_index);
+#endif
+    }
+
+#if CLUSTER_USE_ERASE_COMPACTION
+    //
+    // Backward-shift compaction after erase:
+    //
+    // If the group has overflow bits, some elements were displaced into the next group.
+    // Move them back into the free slots of this group, and then clear the overflow bits
+    // of this group that neither an element left in the next group nor the overflow bit
+    // of the next group needs any more. Cascade to the next group while it got holes.
+    //
+    // It moves the elements, so it's not used by erase(iterator),
+    // which calls clear_overflow_after_erase() instead.
+    //
+    JSTD_NO_INLINE
+    void compact_after_erase(size_type group_index) {
+        size_type group_capacity = this->group_capacity();
+        for (size_type step = 0; step < kCompactGroupsLimit; step++) {
+            group_type * group = this->group_at(group_index);
+#if CLUSTER_USE_OVERFLOW_COUNTER
+            if (likely(this->overflow_counters()[group_index] == 0))
+                break;
+#else
+            if (likely(!group->has_overflow()))
+                break;
+#endif
+
+            size_type next_group_index = group_index + 1;
+            if (unlikely(next_group_index >= group_capacity))
+                next_group_index = 0;
+            if (unlikely(next_group_index == group_index))
+                break;
+            group_type * next_group = this->group_at(next_group_index);
+
+            bitmask_type empty_mask = this->match_empty(group);
+            bitmask_type used_mask = this->match_used(next_group);
+            bitmask_type needed_lanes = 0;
+            bool has_moved = false;
+
+            while (used_mask != 0) {
+                size_type used_pos = group_type::bsf(used_mask);
+                used_mask = group_type::clear_low_bit(used_mask);
+
+                slot_type * slot = this->slot_at(next_group_index * kGroupWidth + used_pos);
+                std::size_t hash_code = this->hash_for(slot->value.first);
+                size_type home_index = this->index_for_hash(hash_code);
+                if ((home_index / kGroupWidth) == next_group_index) {
+                    // It's in the home group.
+                    continue;
+                }
+
+                if (empty_mask != 0) {
+                    size_type empty_pos = group_type::bsf(empty_mask);
+                    empty_mask = group_type::clear_low_bit(empty_mask);
+
+                    size_type new_slot_index = group_index * kGroupWidth + empty_pos;
+                    size_type old_slot_index = next_group_index * kGroupWidth + used_pos;
+                    group->set_used(empty_pos, this->ctrl_for_hash(hash_code));
+                    if (!kIsIndirectKV) {
+                        slot_type * new_slot = this->slot_at(new_slot_index);
+                        SlotPolicyTraits::transfer(&this->slot_allocator_, new_slot, slot);
+                    } else {
+                        // Only the ctrl moves, the slot stays where it is.
+                        this->bind_slot_index(new_slot_index, this->slot_indices()[old_slot_index]);
+                    }
+                    next_group->set_empty(used_pos);
+#if CLUSTER_USE_OVERFLOW_COUNTER
+                    // It doesn't pass this group any more.
+                    this->decrease_overflow_counter(group_index);
+#endif
+                    has_moved = true;
+                } else {
+                    size_type home_lane = home_index % kGroupWidth;
+                    needed_lanes |= static_cast<bitmask_type>(bitmask_type(1) << home_lane);
+                }
+            }
+
+#if !CLUSTER_USE_OVERFLOW_COUNTER
+            for (size_type pos = 0; pos < kGroupWidth; pos++) {
+                if (group->is_overflow(pos) && !next_group->is_overflow(pos) &&
+                    ((needed_lanes & static_cast<bitmask_type>(bitmask_type(1) << pos)) == 0)) {
+                    group->clear_overflow(pos);
+                }
+            }
+#endif
+
+            if (!has_moved)
+                break;
+            group_index = next_group_index;
+        }
     }
+#endif // CLUSTER_USE_ERASE_COMPACTION
 
     JSTD_FORCED_INLINE
     size_type find_and_erase(const key_type & key) {
         std::size_t hash_code = this->hash_for(key);
+        return this->find_and_erase(key, hash_code);
+    }
+
+    JSTD_FORCED_INLINE
+    size_type find_and_erase(const key_type & key, std::size_t hash_code) {
+        assert(hash_code == this->hash_for(key));
+#if CLUSTER_USE_INCREMENTAL_REHASH
+        if (unlikely(this->is_rehashing())) {
+            return this->find_and_erase_rehashing(key, hash_code);
+        }
+#endif
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        this->record_erase(slot_index != this->slot_capacity(), probed_groups);
+        if (slot_index != this->slot_capacity()) {
+            this->erase_index(slot_index, slot_pos);
+#if CLUSTER_USE_ERASE_COMPACTION
+            this->compact_after_erase(slot_index / kGroupWidth);
+#else
+            this->clear_overflow_after_erase(slot_index / kGroupWidth, slot_pos);
+#endif
+            return 1;
+        }
+        return 0;
+    }
+
+#if CLUSTER_USE_INCREMENTAL_REHASH
+    ///
+    /// Incremental rehash
+    ///
+
+    //
+    // Keep the current arrays as the old arrays, and switch to the new arrays,
+    // the old elements are migrated later by migrate_old_groups().
+    //
+    JSTD_NO_INLINE
+    void start_incremental_rehash(size_type new_capacity) {
+        this->finish_rehash();
+        if (this->slot_size() < kMinIncrementalRehashSize) {
+            this->rehash_impl<false>(new_capacity);
+            return;
+        }
+
+        new_capacity = this->calc_capacity(new_capacity);
+        if (kIsIndirectKV) {
+            // The dense slots must be able to hold all the elements.
+            while (this_type::calc_slot_alloc_capacity(new_capacity) < this->slot_size()) {
+                new_capacity *= 2;
+            }
+        }
+        assert(new_capacity > this->slot_capacity());
+
+        std::uint64_t start_ns = this->stats_clock_ns();
+
+        old_arrays old;
+        old.groups = this->groups();
+        old.groups_alloc = this->groups_alloc();
+        old.slots = this->slots();
+        old.indices = this->indices_;
+        old.slot_size = this->slot_size();
+        old.slot_mask = this->slot_mask();
+        old.group_capacity = this->group_capacity();
+        old.migrate_pos = 0;
+        old.last_pos = (!kIsIndirectKV) ? this->group_capacity() : this->slot_size();
+
+        this->create_slots<false>(new_capacity);
+        this->old_ = old;
+
+        // The migration is spread over the later operations, it isn't timed.
+        this->record_rehash(start_ns);
+    }
+
+    inline ctrl_type * old_ctrl_at(size_type ctrl_index) noexcept {
+        return (reinterpret_cast<ctrl_type *>(this->old_.groups) + std::ptrdiff_t(ctrl_index));
+    }
+
+    inline const slot_type * old_slot_at(size_type ctrl_index) const noexcept {
+        const old_arrays & old = this->old_;
+        if (!kIsIndirectKV)
+            return (old.slots + std::ptrdiff_t(ctrl_index));
+        else
+            return (old.slots + std::ptrdiff_t(old.indices[ctrl_index]));
+    }
+
+    inline slot_type * old_slot_at(size_type ctrl_index) noexcept {
+        return const_cast<slot_type *>(
+            const_cast<const this_type *>(this)->old_slot_at(ctrl_index)
+        );
+    }
+
+    size_type old_ctrl_capacity() const noexcept {
+        return (this->old_.group_capacity * kGroupWidth);
+    }
+
+    // See is_old_index().
+    size_type old_iterator_index(size_type ctrl_index) const noexcept {
+        assert(ctrl_index < this->old_ctrl_capacity());
+        return (ctrl_index - this->old_ctrl_capacity());
+    }
+
+    size_type old_ctrl_index(size_type index) const noexcept {
+        assert(this->is_old_index(index));
+        return (index + this->old_ctrl_capacity());
+    }
+
+    // The dense slot in the indirect mode.
+    bool is_old_slot(const slot_type * slot) const noexcept {
+        const old_arrays & old = this->old_;
+        return ((old.slots != nullptr) && (slot >= old.slots) && (slot < old.slots + old.last_pos));
+    }
+
+    bool is_old_iterator(const_iterator iter) const noexcept {
+        if (!kIsIndirectKV)
+            return this->is_old_index(static_cast<size_type>(iter.index()));
+        else
+            return this->is_old_slot(iter.slot());
+    }
+
+    //
+    // Return the first used old ctrl index from ctrl_index, or npos.
+    //
+    size_type skip_empty_old_slots(size_type ctrl_index) const noexcept {
+        const old_arrays & old = this->old_;
+        size_type group_index = ctrl_index / kGroupWidth;
+        size_type group_pos = ctrl_index % kGroupWidth;
+        for (; group_index < old.group_capacity; group_index++) {
+            bitmask_type used_mask = this->match_used(&old.groups[group_index]);
+            used_mask &= (static_cast<bitmask_type>(~bitmask_type(0)) << group_pos);
+            if (used_mask != 0) {
+                size_type used_pos = group_type::bsf(used_mask);
+                return (group_index * kGroupWidth + used_pos);
+            }
+            group_pos = 0;
+        }
+        return npos;
+    }
+
+    //
+    // Return the first live old dense slot from old_pos in the indirect mode, or npos.
+    // The migrated and the erased slots are the holes, their ctrls are empty.
+    //
+    size_type skip_empty_old_dense_slots(size_type old_pos) const noexcept {
+        const old_arrays & old = this->old_;
+        const index_type * ctrl_indices = old.indices + old.group_capacity * kGroupWidth;
+        old_pos = (std::max)(old_pos, old.migrate_pos);
+        for (; old_pos < old.last_pos; ++old_pos) {
+            const ctrl_type * ctrl = reinterpret_cast<const ctrl_type *>(old.groups) +
+                                     std::ptrdiff_t(ctrl_indices[old_pos]);
+            if (ctrl->is_used())
+                return old_pos;
+        }
+        return npos;
+    }
+
+    //
+    // Erase an element of the old arrays in place, the ctrl keeps its overflow bit.
+    //
+    void erase_old_index(size_type ctrl_index) {
+        this->old_ctrl_at(ctrl_index)->set_empty();
+        this->destroy_slot(this->old_slot_at(ctrl_index));
+        assert(this->old_.slot_size > 0);
+        this->old_.slot_size--;
+        if (this->old_.slot_size == 0) {
+            this->release_old_arrays();
+        }
+    }
+
+    iterator erase_old(iterator pos) {
+        size_type ctrl_index;
+        if (!kIsIndirectKV) {
+            ctrl_index = this->old_ctrl_index(static_cast<size_type>(pos.index()));
+        } else {
+            const old_arrays & old = this->old_;
+            const index_type * ctrl_indices = old.indices + old.group_capacity * kGroupWidth;
+            ctrl_index = ctrl_indices[pos.slot() - old.slots];
+        }
+        // The next element is found before the old arrays may be released,
+        // it's in the new arrays if this one is the last old element.
+        iterator next(pos);
+        ++next;
+        this->erase_old_index(ctrl_index);
+        return next;
+    }
+
+    //
+    // Copy the old elements of a const table into the new arrays.
+    //
+    void copy_old_slots_from(const this_type & other) {
+        size_type ctrl_index = other.skip_empty_old_slots(0);
+        while (ctrl_index != npos) {
+            const slot_type * old_slot = other.old_slot_at(ctrl_index);
+            size_type slot_index = this->insert_unique_and_no_grow(old_slot->value.first);
+            try {
+                SlotPolicyTraits::construct(&this->slot_allocator_, this->slot_at(slot_index), old_slot);
+            } catch (...) {
+                this->ctrl_at(slot_index)->set_empty();
+                this->destroy();
+                throw;
+            }
+            this->slot_size_++;
+            ctrl_index = other.skip_empty_old_slots(ctrl_index + 1);
+        }
+        assert(this->slot_size() == other.size());
+    }
+
+    //
+    // Look up the key in the old arrays, return the ctrl index or npos.
+    // The migrated ctrls are empty but keep their overflow bits (or counters),
+    // so the probe chains passing them still reach the rest of the old elements.
+    //
+    template <typename KeyT>
+    size_type find_old_index(const KeyT & key, std::size_t hash_code) const {
+        static_assert(!kUseIndexSalt, "The incremental rehash doesn't support the index salt.");
+        const old_arrays & old = this->old_;
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type slot_pos = this_type::index_in_range(this->index_hasher(hash_code), old.slot_mask);
+        size_type group_index = slot_pos / kGroupWidth;
+        size_type group_pos = slot_pos % kGroupWidth;
+        const group_type * group = old.groups + group_index;
+        const group_type * first_group = group;
+        const group_type * last_group = old.groups + old.group_capacity;
+
+        size_type slot_base = group_index * kGroupWidth;
+
+        for (;;) {
+            bitmask_type match_mask = this->match_hash(group, ctrl_hash);
+            while (match_mask != 0) {
+                size_type match_pos = group_type::bsf(match_mask);
+                match_mask = group_type::clear_low_bit(match_mask);
+
+                size_type slot_index = slot_base + match_pos;
+                const slot_type * slot = this->old_slot_at(slot_index);
+                if (likely(this->key_equal_(key, slot->value.first))) {
+                    return slot_index;
+                }
+            }
+
+#if CLUSTER_USE_OVERFLOW_COUNTER
+            size_type cur_group_index = static_cast<size_type>(group - old.groups);
+            if (likely(this_type::overflow_counters(old.groups, old.group_capacity)[cur_group_index] == 0)) {
+                return npos;
+            }
+#else
+            if (likely(!group->is_overflow(group_pos))) {
+                return npos;
+            }
+#endif
+
+            slot_base += kGroupWidth;
+            group++;
+            if (unlikely(group >= last_group)) {
+                group = old.groups;
+                slot_base = 0;
+            }
+            if (unlikely(group == first_group)) {
+                return npos;
+            }
+        }
+    }
+
+    //
+    // Move an old element into the new arrays, return its new slot index.
+    //
+    JSTD_FORCED_INLINE
+    size_type migrate_old_slot(size_type ctrl_index) {
+        ctrl_type * ctrl = this->old_ctrl_at(ctrl_index);
+        slot_type * slot = this->old_slot_at(ctrl_index);
+        assert(ctrl->is_used());
+        size_type slot_index = this->insert_unique_and_no_grow(slot);
+        this->destroy_slot(slot);
+        ctrl->set_empty();
+        assert(this->old_.slot_size > 0);
+        this->old_.slot_size--;
+        return slot_index;
+    }
+
+    //
+    // Migrate the next groups (or the next dense slots in the indirect mode,
+    // so the insertion order is kept) of the old arrays, and release the old arrays
+    // when all the old elements have been migrated.
+    //
+    JSTD_NO_INLINE
+    void migrate_old_groups(size_type num_groups) {
+        old_arrays & old = this->old_;
+        assert(this->is_rehashing());
+        size_type step = (!kIsIndirectKV) ? num_groups : (num_groups * kGroupWidth);
+        size_type pos = old.migrate_pos;
+        size_type last_pos = ((old.last_pos - pos) > step) ? (pos + step) : old.last_pos;
+
+        if (!kIsIndirectKV) {
+            for (; pos < last_pos; ++pos) {
+                const group_type * group = old.groups + pos;
+                bitmask_type used_mask = this->match_used(group);
+                while (used_mask != 0) {
+                    size_type used_pos = group_type::bsf(used_mask);
+                    used_mask = group_type::clear_low_bit(used_mask);
+                    this->migrate_old_slot(pos * kGroupWidth + used_pos);
+                }
+            }
+        } else {
+            // The holes left by the lookups and the erases have an empty ctrl.
+            const index_type * ctrl_indices = old.indices + old.group_capacity * kGroupWidth;
+            for (; pos < last_pos; ++pos) {
+                size_type ctrl_index = ctrl_indices[pos];
+                if (this->old_ctrl_at(ctrl_index)->is_used()) {
+                    this->migrate_old_slot(ctrl_index);
+                }
+            }
+        }
+
+        old.migrate_pos = last_pos;
+        if ((old.migrate_pos == old.last_pos) || (old.slot_size == 0)) {
+            this->release_old_arrays();
+        }
+    }
+
+    void release_old_arrays() noexcept {
+        old_arrays & old = this->old_;
+        assert(old.slot_size == 0);
+        this->deallocate_groups_and_slots(old.groups_alloc, old.slots,
+                                          old.group_capacity, old.slot_mask + 1);
+        this->old_ = old_arrays();
+    }
+
+    void destroy_old_arrays() noexcept {
+        if (this->is_rehashing()) {
+            old_arrays & old = this->old_;
+            if (!is_slot_trivial_destructor) {
+                for (size_type group_index = 0; group_index < old.group_capacity; group_index++) {
+                    const group_type * group = old.groups + group_index;
+                    bitmask_type used_mask = this->match_used(group);
+                    while (used_mask != 0) {
+                        size_type used_pos = group_type::bsf(used_mask);
+                        used_mask = group_type::clear_low_bit(used_mask);
+                        this->destroy_slot(this->old_slot_at(group_index * kGroupWidth + used_pos));
+                    }
+                }
+            }
+            old.slot_size = 0;
+            this->release_old_arrays();
+        }
+    }
+
+    template <typename KeyT>
+    const slot_type * find_impl_rehashing(const KeyT & key, std::size_t hash_code) const {
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        if (slot_index != this->slot_capacity()) {
+            return this->slot_at(slot_index);
+        }
+
+        size_type old_index = this->find_old_index(key, hash_code);
+        if (old_index != npos)
+            return this->old_slot_at(old_index);
+        else
+            return this->last_slot();
+    }
+
+    //
+    // Look up the new arrays and then the old arrays without migrating anything,
+    // the element found in the old arrays is returned as an old index.
+    //
+    template <typename KeyT>
+    size_type find_index_no_migrate(const KeyT & key, std::size_t hash_code) const {
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        if (slot_index == this->slot_capacity()) {
+            size_type old_index = this->find_old_index(key, hash_code);
+            if (old_index != npos)
+                slot_index = this->old_iterator_index(old_index);
+        }
+        this->record_find(slot_index != this->slot_capacity(), probed_groups);
+        return slot_index;
+    }
+
+    //
+    // The element found in the old arrays is moved into the new arrays,
+    // so the returned index always belongs to the new arrays.
+    //
+    template <typename KeyT>
+    JSTD_NO_INLINE
+    size_type find_index_rehashing(const KeyT & key, std::size_t hash_code) {
+        this->migrate_old_groups(kRehashGroupsPerStep);
+
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
+        if ((slot_index == this->slot_capacity()) && this->is_rehashing()) {
+            size_type old_index = this->find_old_index(key, hash_code);
+            if (old_index != npos) {
+                slot_index = this->migrate_old_slot(old_index);
+                if (this->old_.slot_size == 0) {
+                    this->release_old_arrays();
+                }
+            }
+        }
+        return slot_index;
+    }
+
+    template <typename KeyT>
+    JSTD_NO_INLINE
+    std::pair<size_type, bool>
+    find_and_insert_rehashing(const KeyT & key, std::size_t hash_code) {
+        size_type slot_index = this->find_index_rehashing(key, hash_code);
+        if (slot_index != this->slot_capacity()) {
+            this->record_insert(true, 1);
+            return { slot_index, kIsExists };
+        }
+
+        if (this->need_grow()) {
+            // It rarely happens, the migration is much faster than the growth.
+            this->grow_if_necessary();
+        }
+
         size_type slot_pos = this->index_for_hash(hash_code);
         std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        slot_index = this->find_first_empty_to_insert(key, slot_pos, ctrl_hash, probed_groups);
+        assert(slot_index < this->slot_capacity());
+        this->record_insert(false, probed_groups);
+        return { slot_index, kNeedInsert };
+    }
 
-        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash);
+    JSTD_NO_INLINE
+    size_type find_and_erase_rehashing(const key_type & key, std::size_t hash_code) {
+        this->migrate_old_groups(kRehashGroupsPerStep);
+
+        size_type slot_pos = this->index_for_hash(hash_code);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(hash_code);
+        size_type probed_groups = 0;
+        size_type slot_index = this->find_index(key, slot_pos, ctrl_hash, probed_groups);
         if (slot_index != this->slot_capacity()) {
-            this->erase_index(slot_index);
+            this->record_erase(true, probed_groups);
+            this->erase_index(slot_index, slot_pos);
+#if CLUSTER_USE_ERASE_COMPACTION
+            this->compact_after_erase(slot_index / kGroupWidth);
+#else
+            this->clear_overflow_after_erase(slot_index / kGroupWidth, slot_pos);
+#endif
+            return 1;
+        }
+
+        if (this->is_rehashing()) {
+            // Erase it from the old arrays in place, the ctrl keeps its overflow bit.
+            size_type old_index = this->find_old_index(key, hash_code);
+            if (old_index != npos) {
+                this->erase_old_index(old_index);
+                this->record_erase(true, probed_groups);
+                return 1;
+            }
         }
-        return (slot_index != this->slot_capacity()) ? 1 : 0;
+        this->record_erase(false, probed_groups);
+        return 0;
     }
+#endif // CLUSTER_USE_INCREMENTAL_REHASH
 };
 
 } // namespace jstd
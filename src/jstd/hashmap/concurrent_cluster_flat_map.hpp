@@ -0,0 +1,1184 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_CONCURRENT_CLUSTER_FLAT_MAP_HPP
+#define JSTD_HASHMAP_CONCURRENT_CLUSTER_FLAT_MAP_HPP
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstring>              // For std::memcpy()
+#include <memory>               // For std::allocator<T>
+#include <functional>           // For std::hash<Key>
+#include <type_traits>
+#include <utility>              // For std::pair<F, S>
+#include <algorithm>            // For std::max()
+#include <atomic>
+#include <mutex>                // For std::lock_guard<T>
+
+#include "jstd/basic/stddef.h"
+
+#include "jstd/hasher/hashes.h"
+
+#include "jstd/hashmap/flat_map_cluster.hpp"
+#include "jstd/hashmap/flat_map_cluster_dispatch.hpp"
+#include "jstd/hashmap/flat_map_type_policy.hpp"
+#include "jstd/hashmap/flat_map_slot_policy.hpp"
+#include "jstd/hashmap/slot_policy_traits.h"
+#include "jstd/hashmap/map_slot_policy.h"
+#include "jstd/hashmap/concurrent_rw_spinlock.hpp"
+
+// The lookups (cvisit, contains and the lookup of insert) of the trivially copyable
+// elements don't take the group lock, they copy the element out and validate the copy
+// by the group version, and retry or fall back to the shared group lock if a writer
+// has changed the group meanwhile. cvisit and contains don't take the table lock
+// either, they don't store anything to the shared memory, see table_arrays.
+#ifndef CLUSTER_USE_OPTIMISTIC_READ
+#define CLUSTER_USE_OPTIMISTIC_READ     1
+#endif
+
+namespace jstd {
+
+//
+// A cluster flat map shared by threads, it has the same group layout as cluster_flat_table
+// (flat_map_cluster16 ctrls, the overflow bit of the home slot, the mixed hash of the hash
+// policy), and a reader/writer spinlock next to each group, similar to the concurrent_flat_map
+// of Boost.Unordered. So the operations on the different groups don't wait for each other.
+//
+// There is no iterator, the elements are accessed by visitation: the visitor is called
+// with the group lock held, exclusive for visit() and insert_or_visit(), shared for cvisit()
+// (or with a validated copy, see CLUSTER_USE_OPTIMISTIC_READ).
+// Don't call the map itself in a visitor.
+//
+// Each operation takes the shared table lock (one stripe of a striped lock), the rehash
+// takes the exclusive table lock, so it is coordinated with all the other operations.
+// The optimistic cvisit and contains are the exception, they validate their reads by
+// the table version instead, and the arrays replaced by the rehash are retired rather
+// than freed, so a late reader never touches the unmapped memory.
+//
+// To avoid inserting the same key twice, an insert records the insert counter of the home
+// group before the lookup, and bumps it when it takes the empty slot, if the counter has
+// been changed by another insert meanwhile, it looks up again.
+//
+// The erase doesn't compact the groups, the overflow bits are cleared by the next rehash.
+// So the erase from an overflowed group counts against the slot threshold, like a tombstone,
+// and when the inserts reach it while the table still has room, the table is rehashed at
+// the same capacity instead of growing, see grow_if_necessary().
+//
+template <typename Key, typename Value,
+          typename Hash = std::hash< typename std::remove_const<Key>::type >,
+          typename KeyEqual = std::equal_to< typename std::remove_const<Key>::type >,
+          typename Allocator = std::allocator< std::pair<const typename std::remove_const<Key>::type,
+                                                         typename std::remove_const<Value>::type> >,
+          typename Group = flat_map_cluster16<cluster_meta_ctrl> >
+class concurrent_cluster_flat_map
+{
+public:
+    typedef flat_map_type_policy<Key, Value>    type_policy;
+    typedef std::size_t                         size_type;
+    typedef std::intptr_t                       ssize_type;
+    typedef std::ptrdiff_t                      difference_type;
+
+    typedef typename type_policy::key_type      key_type;
+    typedef typename type_policy::mapped_type   mapped_type;
+    typedef typename type_policy::value_type    value_type;
+    typedef typename type_policy::init_type     init_type;
+    typedef Hash                                hasher;
+    typedef KeyEqual                            key_equal;
+    typedef Allocator                           allocator_type;
+
+    typedef value_type &                        reference;
+    typedef value_type const &                  const_reference;
+
+    using this_type = concurrent_cluster_flat_map<Key, Value, Hash, KeyEqual, Allocator, Group>;
+
+    using group_type = Group;
+    using ctrl_type = typename group_type::ctrl_type;
+    using bitmask_type = typename group_type::bitmask_type;
+
+    static constexpr std::uint8_t kEmptySlot = ctrl_type::kEmptySlot;
+    static constexpr size_type kGroupWidth = group_type::kGroupWidth;
+
+    using slot_type = map_slot_type<key_type, mapped_type>;
+    using slot_policy_t = flat_map_slot_policy<key_type, mapped_type, slot_type>;
+    using SlotPolicyTraits = slot_policy_traits<slot_policy_t>;
+
+    using hash_policy_t = typename hash_policy_selector<Hash>::type;
+
+    using kernel_traits = cluster_kernel_traits<group_type>;
+    using kernel_type = typename kernel_traits::kernel_type;
+
+    // The table always has one group at least.
+    static constexpr size_type kMinCapacity = kGroupWidth;
+
+    static constexpr float kDefaultLoadFactorF = 0.8f;
+    static constexpr size_type kLoadFactorAmplify = 256;
+    static constexpr size_type kDefaultMaxLoadFactor =
+        static_cast<size_type>((double)kLoadFactorAmplify * (double)kDefaultLoadFactorF + 0.5);
+
+    //
+    // Reading a slot while it's being written is only harmless for the trivially
+    // copyable types, the others are always read under the shared group lock.
+    //
+    static constexpr bool kIsOptimisticRead = (CLUSTER_USE_OPTIMISTIC_READ != 0) &&
+                                              std::is_trivially_copyable<key_type>::value &&
+                                              std::is_trivially_copyable<mapped_type>::value;
+
+    // The optimistic reads of a group before falling back to the shared group lock.
+    static constexpr size_type kOptimisticReadRetries = 8;
+
+private:
+    //
+    // The lock, the insert counter and the version of a group, they are kept in a parallel
+    // array, so the groups keep the same layout as cluster_flat_table.
+    //
+    // The version is odd while a writer holds the exclusive group lock, the optimistic readers
+    // validate their reads by it, like a seqlock.
+    //
+    struct group_access {
+        rw_spinlock                 lock;
+        std::atomic<std::uint32_t>  insert_counter;
+        std::atomic<std::uint32_t>  version;
+
+        group_access() noexcept : insert_counter(0), version(0) {}
+    };
+
+    class shared_group_lock {
+    private:
+        group_access & access_;
+
+    public:
+        explicit shared_group_lock(group_access & access) noexcept : access_(access) {
+            this->access_.lock.lock_shared();
+        }
+
+        ~shared_group_lock() {
+            this->access_.lock.unlock_shared();
+        }
+
+        shared_group_lock(const shared_group_lock &) = delete;
+        shared_group_lock & operator = (const shared_group_lock &) = delete;
+    };
+
+    //
+    // Any change of the group or its slots must be made under this lock,
+    // it makes the version odd until the lock is released.
+    //
+    class exclusive_group_lock {
+    private:
+        group_access & access_;
+
+    public:
+        explicit exclusive_group_lock(group_access & access) noexcept : access_(access) {
+            this->access_.lock.lock();
+            std::uint32_t version = this->access_.version.load(std::memory_order_relaxed);
+            this->access_.version.store(version + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ~exclusive_group_lock() {
+            std::uint32_t version = this->access_.version.load(std::memory_order_relaxed);
+            this->access_.version.store(version + 1, std::memory_order_release);
+            this->access_.lock.unlock();
+        }
+
+        exclusive_group_lock(const exclusive_group_lock &) = delete;
+        exclusive_group_lock & operator = (const exclusive_group_lock &) = delete;
+    };
+
+    typedef striped_rw_spinlock<>                   table_lock_type;
+
+    using group_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<group_type>;
+    using slot_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<slot_type>;
+    using access_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<group_access>;
+
+    using GroupAllocTraits = typename std::allocator_traits<allocator_type>::template rebind_traits<group_type>;
+    using SlotAllocTraits = typename std::allocator_traits<allocator_type>::template rebind_traits<slot_type>;
+    using AccessAllocTraits = typename std::allocator_traits<allocator_type>::template rebind_traits<group_access>;
+
+    //
+    // The shared table lock of an operation, it remembers the locked stripe.
+    //
+    class shared_table_lock {
+    private:
+        table_lock_type *   lock_;
+        size_type           stripe_;
+
+    public:
+        explicit shared_table_lock(table_lock_type & lock) noexcept
+            : lock_(&lock), stripe_(lock.lock_shared()) {
+        }
+
+        ~shared_table_lock() {
+            this->unlock();
+        }
+
+        shared_table_lock(const shared_table_lock &) = delete;
+        shared_table_lock & operator = (const shared_table_lock &) = delete;
+
+        void unlock() noexcept {
+            if (this->lock_ != nullptr) {
+                this->lock_->unlock_shared(this->stripe_);
+                this->lock_ = nullptr;
+            }
+        }
+    };
+
+    //
+    // The exclusive table lock of the rehash and clear(), it makes the table version odd
+    // until the lock is released, the lock-free readers validate their reads by it.
+    //
+    class exclusive_table_lock {
+    private:
+        table_lock_type &               lock_;
+        std::atomic<std::uint32_t> &    version_;
+
+    public:
+        exclusive_table_lock(table_lock_type & lock, std::atomic<std::uint32_t> & version) noexcept
+            : lock_(lock), version_(version) {
+            this->lock_.lock();
+            std::uint32_t table_version = this->version_.load(std::memory_order_relaxed);
+            this->version_.store(table_version + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ~exclusive_table_lock() {
+            std::uint32_t table_version = this->version_.load(std::memory_order_relaxed);
+            this->version_.store(table_version + 1, std::memory_order_release);
+            this->lock_.unlock();
+        }
+
+        exclusive_table_lock(const exclusive_table_lock &) = delete;
+        exclusive_table_lock & operator = (const exclusive_table_lock &) = delete;
+    };
+
+    //
+    // The arrays of a capacity, the pointers, the mask and the hash policy never change
+    // after they are created. The lock-free readers load them by one pointer, so the mask
+    // and the hash policy always match the arrays read.
+    //
+    // For the optimistic reads, the arrays replaced by the rehash are retired instead of
+    // freed, and reused by a later rehash to the same capacity. So there is one retired set
+    // of the arrays per capacity at most, the memory is bounded by three times the largest
+    // capacity (the current arrays and the retired ones), and it's released by the destructor.
+    //
+    struct table_arrays {
+        group_type *    groups;
+        slot_type *     slots;
+        group_access *  accesses;
+        size_type       group_mask;
+        hash_policy_t   hash_policy;
+        table_arrays *  next_retired;
+
+        table_arrays(group_type * groups, slot_type * slots, group_access * accesses,
+                     size_type group_mask, const hash_policy_t & hash_policy) noexcept
+            : groups(groups), slots(slots), accesses(accesses),
+              group_mask(group_mask), hash_policy(hash_policy), next_retired(nullptr) {
+        }
+    };
+
+    using arrays_allocator_type = typename std::allocator_traits<allocator_type>::template rebind_alloc<table_arrays>;
+    using ArraysAllocTraits = typename std::allocator_traits<allocator_type>::template rebind_traits<table_arrays>;
+
+    enum emplace_result {
+        kIsExists,
+        kIsInserted,
+        kNeedGrow
+    };
+
+    group_type *    groups_;
+    slot_type *     slots_;
+    group_access *  accesses_;
+    size_type       group_mask_;        // group_capacity = group_mask + 1
+    size_type       slot_threshold_;
+    size_type       mlf_;
+    kernel_type     kernel_;            // The match kernel of the groups, chosen once
+
+    // The elements and the reserved slots of the inserts in flight
+    std::atomic<size_type>  slot_size_;
+    // The erases from the overflowed groups since the last rehash
+    std::atomic<size_type>  overflow_erases_;
+
+    hash_policy_t           hash_policy_;
+
+    hasher                  hasher_;
+    key_equal               key_equal_;
+
+    allocator_type          allocator_;
+    group_allocator_type    group_allocator_;
+    slot_allocator_type     slot_allocator_;
+    access_allocator_type   access_allocator_;
+    arrays_allocator_type   arrays_allocator_;
+
+    // The current arrays for the lock-free readers, the members above mirror them.
+    std::atomic<table_arrays *> arrays_;
+    table_arrays *              retired_arrays_;
+    std::atomic<std::uint32_t>  table_version_;
+
+    mutable table_lock_type table_lock_;
+
+public:
+    ///
+    /// Constructors
+    ///
+    concurrent_cluster_flat_map() : concurrent_cluster_flat_map(0) {}
+
+    explicit concurrent_cluster_flat_map(size_type capacity, hasher const & hash = hasher(),
+                                         key_equal const & pred = key_equal(),
+                                         allocator_type const & allocator = allocator_type())
+        : groups_(nullptr), slots_(nullptr), accesses_(nullptr),
+          group_mask_(0), slot_threshold_(0), mlf_(kDefaultMaxLoadFactor),
+          kernel_(kernel_traits::kernel()),
+          slot_size_(0), overflow_erases_(0), hasher_(hash), key_equal_(pred),
+          allocator_(allocator), group_allocator_(allocator),
+          slot_allocator_(allocator), access_allocator_(allocator), arrays_allocator_(allocator),
+          arrays_(nullptr), retired_arrays_(nullptr), table_version_(0) {
+        this->create_arrays(this->calc_capacity(capacity));
+    }
+
+    concurrent_cluster_flat_map(size_type capacity, allocator_type const & allocator)
+        : concurrent_cluster_flat_map(capacity, hasher(), key_equal(), allocator) {
+    }
+
+    concurrent_cluster_flat_map(concurrent_cluster_flat_map const &) = delete;
+    concurrent_cluster_flat_map & operator = (concurrent_cluster_flat_map const &) = delete;
+
+    ~concurrent_cluster_flat_map() {
+        this->destroy_slots();
+        this->destroy_arrays(this->arrays_.load(std::memory_order_relaxed));
+        while (this->retired_arrays_ != nullptr) {
+            table_arrays * arrays = this->retired_arrays_;
+            this->retired_arrays_ = arrays->next_retired;
+            this->destroy_arrays(arrays);
+        }
+    }
+
+    ///
+    /// Observers
+    ///
+    hasher hash_function() const {
+        return this->hasher_;
+    }
+
+    key_equal key_eq() const {
+        return this->key_equal_;
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return this->allocator_;
+    }
+
+    static constexpr size_type group_width() noexcept {
+        return kGroupWidth;
+    }
+
+    ///
+    /// Capacity
+    ///
+    bool empty() const noexcept {
+        return (this->size() == 0);
+    }
+
+    //
+    // The size may include the inserts in flight.
+    //
+    size_type size() const noexcept {
+        return this->slot_size_.load(std::memory_order_relaxed);
+    }
+
+    size_type capacity() const {
+        shared_table_lock lock(this->table_lock_);
+        return this->slot_capacity();
+    }
+
+    float load_factor() const {
+        shared_table_lock lock(this->table_lock_);
+        return ((float)this->size() / this->slot_capacity());
+    }
+
+    float max_load_factor() const noexcept {
+        return ((float)this->mlf_ / kLoadFactorAmplify);
+    }
+
+    //
+    // The groups which have an overflow bit, the misses probe past them.
+    //
+    size_type overflow_groups() const {
+        shared_table_lock lock(this->table_lock_);
+        size_type count = 0;
+        for (size_type group_index = 0; group_index <= this->group_mask_; group_index++) {
+            shared_group_lock group_lock(this->accesses_[group_index]);
+            if (this->groups_[group_index].has_overflow())
+                count++;
+        }
+        return count;
+    }
+
+    void reserve(size_type new_capacity) {
+        exclusive_table_lock lock(this->table_lock_, this->table_version_);
+        new_capacity = this->calc_capacity(new_capacity);
+        if (new_capacity > this->slot_capacity()) {
+            this->rehash_unprotected(new_capacity);
+        }
+    }
+
+    void rehash(size_type new_capacity) {
+        exclusive_table_lock lock(this->table_lock_, this->table_version_);
+        new_capacity = this->calc_capacity((std::max)(new_capacity, this->size()));
+        if (new_capacity != this->slot_capacity()) {
+            this->rehash_unprotected(new_capacity);
+        }
+    }
+
+    ///
+    /// Lookup
+    ///
+    size_type count(const key_type & key) const {
+        return (this->contains(key) ? 1 : 0);
+    }
+
+    bool contains(const key_type & key) const {
+        return this->cvisit(key, [](const value_type &) {});
+    }
+
+    //
+    // Call visitor(value_type &) under the exclusive group lock if the key exists.
+    //
+    template <typename Visitor>
+    size_type visit(const key_type & key, Visitor && visitor) {
+        std::size_t hash_code = this->get_hash(key);
+        shared_table_lock lock(this->table_lock_);
+        slot_type * slot = this->find_and_lock<exclusive_group_lock>(key, hash_code,
+            [&visitor](slot_type * slot) {
+                visitor(slot->value);
+            });
+        return (slot != nullptr) ? 1 : 0;
+    }
+
+    //
+    // Call visitor(const value_type &) under the shared group lock if the key exists.
+    //
+    template <typename Visitor>
+    size_type visit(const key_type & key, Visitor && visitor) const {
+        return this->cvisit(key, std::forward<Visitor>(visitor));
+    }
+
+    //
+    // For the trivially copyable elements, the visitor is called with a validated copy
+    // of the element, no lock is taken, see CLUSTER_USE_OPTIMISTIC_READ.
+    //
+    template <typename Visitor>
+    size_type cvisit(const key_type & key, Visitor && visitor) const {
+        std::size_t hash_code = this->get_hash(key);
+        int found = this->find_lock_free(key, hash_code, visitor,
+                                         std::integral_constant<bool, kIsOptimisticRead>{});
+        if (likely(found >= 0)) {
+            return static_cast<size_type>(found);
+        }
+        shared_table_lock lock(this->table_lock_);
+        slot_type * slot = const_cast<this_type *>(this)->template find_and_lock<shared_group_lock>(
+            key, hash_code,
+            [&visitor](slot_type * slot) {
+                visitor(static_cast<const value_type &>(slot->value));
+            });
+        return (slot != nullptr) ? 1 : 0;
+    }
+
+    //
+    // Call visitor(value_type &) for each element, return the number of the elements visited.
+    // The groups are locked one by one, so it isn't a snapshot.
+    //
+    template <typename Visitor>
+    size_type visit_all(Visitor && visitor) {
+        return this->for_each_locked<exclusive_group_lock>([&visitor](slot_type * slot) {
+            visitor(slot->value);
+        });
+    }
+
+    template <typename Visitor>
+    size_type visit_all(Visitor && visitor) const {
+        return this->cvisit_all(std::forward<Visitor>(visitor));
+    }
+
+    template <typename Visitor>
+    size_type cvisit_all(Visitor && visitor) const {
+        return const_cast<this_type *>(this)->template for_each_locked<shared_group_lock>(
+            [&visitor](slot_type * slot) {
+                visitor(static_cast<const value_type &>(slot->value));
+            });
+    }
+
+    ///
+    /// Modifiers
+    ///
+    bool insert(const value_type & value) {
+        return this->emplace_impl(value.first, this_type::no_visitor(), value);
+    }
+
+    bool insert(value_type && value) {
+        return this->emplace_impl(value.first, this_type::no_visitor(), std::move(value));
+    }
+
+    bool insert(const init_type & value) {
+        return this->emplace_impl(value.first, this_type::no_visitor(), value);
+    }
+
+    bool insert(init_type && value) {
+        return this->emplace_impl(value.first, this_type::no_visitor(), std::move(value));
+    }
+
+    template <typename... Args>
+    bool emplace(const key_type & key, Args && ... args) {
+        return this->emplace_impl(key, this_type::no_visitor(),
+                                  std::piecewise_construct,
+                                  std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(const key_type & key, Args && ... args) {
+        return this->emplace_impl(key, this_type::no_visitor(),
+                                  std::piecewise_construct,
+                                  std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    template <typename... Args>
+    bool try_emplace(key_type && key, Args && ... args) {
+        return this->emplace_impl(key, this_type::no_visitor(),
+                                  std::piecewise_construct,
+                                  std::forward_as_tuple(std::move(key)),
+                                  std::forward_as_tuple(std::forward<Args>(args)...));
+    }
+
+    //
+    // Return true if the key is inserted, false if it's assigned.
+    //
+    template <typename MappedT>
+    bool insert_or_assign(const key_type & key, MappedT && value) {
+        return this->emplace_impl(key,
+            [&value](value_type & exists) {
+                exists.second = std::forward<MappedT>(value);
+            },
+            key, std::forward<MappedT>(value));
+    }
+
+    //
+    // Insert the value, or call visitor(value_type &) under the exclusive group lock
+    // if the key already exists. Return true if the value is inserted.
+    //
+    template <typename Visitor>
+    bool insert_or_visit(const value_type & value, Visitor && visitor) {
+        return this->emplace_impl(value.first, std::forward<Visitor>(visitor), value);
+    }
+
+    template <typename Visitor>
+    bool insert_or_visit(value_type && value, Visitor && visitor) {
+        return this->emplace_impl(value.first, std::forward<Visitor>(visitor), std::move(value));
+    }
+
+    template <typename Visitor>
+    bool insert_or_visit(const init_type & value, Visitor && visitor) {
+        return this->emplace_impl(value.first, std::forward<Visitor>(visitor), value);
+    }
+
+    template <typename Visitor>
+    bool insert_or_visit(init_type && value, Visitor && visitor) {
+        return this->emplace_impl(value.first, std::forward<Visitor>(visitor), std::move(value));
+    }
+
+    size_type erase(const key_type & key) {
+        return this->erase_if(key, [](const value_type &) { return true; });
+    }
+
+    //
+    // Erase the element of the key if pred(value_type &) returns true,
+    // the pred is called under the exclusive group lock.
+    //
+    template <typename Pred>
+    size_type erase_if(const key_type & key, Pred && pred) {
+        std::size_t hash_code = this->get_hash(key);
+        shared_table_lock lock(this->table_lock_);
+        size_type erased = 0;
+        this->find_and_lock<exclusive_group_lock>(key, hash_code,
+            [this, &pred, &erased](slot_type * slot) {
+                if (pred(slot->value)) {
+                    this->erase_slot(slot);
+                    erased = 1;
+                }
+            });
+        return erased;
+    }
+
+    //
+    // Erase all the elements which pred(value_type &) returns true,
+    // return the number of the elements erased.
+    //
+    template <typename Pred>
+    size_type erase_if(Pred && pred) {
+        size_type erased = 0;
+        this->for_each_locked<exclusive_group_lock>([this, &pred, &erased](slot_type * slot) {
+            if (pred(slot->value)) {
+                this->erase_slot(slot);
+                erased++;
+            }
+        });
+        return erased;
+    }
+
+    void clear() {
+        exclusive_table_lock lock(this->table_lock_, this->table_version_);
+        this->destroy_slots();
+        this->init_groups(this->groups_, this->group_capacity());
+        this->slot_size_.store(0, std::memory_order_relaxed);
+        this->overflow_erases_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct no_visitor {
+        void operator () (const value_type &) const noexcept {}
+    };
+
+    size_type group_capacity() const noexcept {
+        return (this->group_mask_ + 1);
+    }
+
+    size_type slot_capacity() const noexcept {
+        return (this->group_capacity() * kGroupWidth);
+    }
+
+    std::size_t get_hash(const key_type & key) const {
+        return static_cast<std::size_t>(this->hasher_(key));
+    }
+
+    //
+    // The hash policy is changed by the rehash, call them under the table lock,
+    // or pass the hash policy of the table_arrays read.
+    //
+    static std::size_t mix_hash(const hash_policy_t & hash_policy, std::size_t hash_code) noexcept {
+        return static_cast<std::size_t>(hash_policy.template mix_hash_code<key_type>(hash_code));
+    }
+
+    static size_type index_for_hash(const hash_policy_t & hash_policy, std::size_t mixed_hash) noexcept {
+        return hash_policy.index_for_mixed_hash(mixed_hash);
+    }
+
+    static std::uint8_t ctrl_for_hash(const hash_policy_t & hash_policy, std::size_t mixed_hash) noexcept {
+        std::uint8_t ctrl_hash8 = ctrl_type::hash_bits(hash_policy.ctrl_for_mixed_hash(mixed_hash));
+        return ((ctrl_hash8 != kEmptySlot) ? ctrl_hash8 : std::uint8_t(8));
+    }
+
+    std::size_t mix_hash(std::size_t hash_code) const noexcept {
+        return this_type::mix_hash(this->hash_policy_, hash_code);
+    }
+
+    size_type index_for_hash(std::size_t mixed_hash) const noexcept {
+        return this_type::index_for_hash(this->hash_policy_, mixed_hash);
+    }
+
+    std::uint8_t ctrl_for_hash(std::size_t mixed_hash) const noexcept {
+        return this_type::ctrl_for_hash(this->hash_policy_, mixed_hash);
+    }
+
+    // The matches of a group by the kernel of this map, see cluster_kernel_traits.
+    bitmask_type match_empty(const group_type * group) const {
+        return kernel_traits::match_empty(this->kernel_, group);
+    }
+
+    bitmask_type match_used(const group_type * group) const {
+        return kernel_traits::match_used(this->kernel_, group);
+    }
+
+    bitmask_type match_hash(const group_type * group, std::uint8_t ctrl_hash) const {
+        return kernel_traits::match_hash(this->kernel_, group, ctrl_hash);
+    }
+
+    size_type calc_capacity(size_type init_capacity) const noexcept {
+        // The slot threshold must be able to hold init_capacity elements.
+        size_type min_capacity = (init_capacity * kLoadFactorAmplify + this->mlf_ - 1) / this->mlf_;
+        size_type new_capacity = kMinCapacity;
+        while (new_capacity < min_capacity) {
+            new_capacity *= 2;
+        }
+        return new_capacity;
+    }
+
+    size_type calc_slot_threshold(size_type slot_capacity) const noexcept {
+        return (slot_capacity * this->mlf_ / kLoadFactorAmplify);
+    }
+
+    static void init_groups(group_type * groups, size_type group_capacity) {
+        for (size_type i = 0; i < group_capacity; i++) {
+            groups[i].init();
+        }
+    }
+
+    //
+    // Call it in the constructor or under the exclusive table lock.
+    //
+    void create_arrays(size_type new_capacity) {
+        assert(new_capacity >= kMinCapacity);
+        size_type new_group_capacity = new_capacity / kGroupWidth;
+
+        auto hash_policy_setting = this->hash_policy_.calc_next_capacity(new_capacity);
+        this->hash_policy_.commit(hash_policy_setting);
+
+        // The group versions and the locks of the retired arrays are still valid,
+        // only the groups are initialized again.
+        table_arrays * arrays = this->reuse_retired_arrays(new_group_capacity);
+        if (arrays == nullptr) {
+            group_type * new_groups = GroupAllocTraits::allocate(this->group_allocator_, new_group_capacity);
+            slot_type * new_slots = SlotAllocTraits::allocate(this->slot_allocator_, new_capacity);
+            group_access * new_accesses = AccessAllocTraits::allocate(this->access_allocator_, new_group_capacity);
+
+            for (size_type i = 0; i < new_group_capacity; i++) {
+                AccessAllocTraits::construct(this->access_allocator_, &new_accesses[i]);
+            }
+
+            arrays = ArraysAllocTraits::allocate(this->arrays_allocator_, 1);
+            ArraysAllocTraits::construct(this->arrays_allocator_, arrays, new_groups, new_slots,
+                                         new_accesses, new_group_capacity - 1, this->hash_policy_);
+        }
+        this_type::init_groups(arrays->groups, new_group_capacity);
+
+        this->groups_ = arrays->groups;
+        this->slots_ = arrays->slots;
+        this->accesses_ = arrays->accesses;
+        this->group_mask_ = new_group_capacity - 1;
+        this->slot_threshold_ = this->calc_slot_threshold(new_capacity);
+        this->overflow_erases_.store(0, std::memory_order_relaxed);
+        this->arrays_.store(arrays, std::memory_order_release);
+    }
+
+    table_arrays * reuse_retired_arrays(size_type group_capacity) noexcept {
+        table_arrays ** link = &this->retired_arrays_;
+        while (*link != nullptr) {
+            table_arrays * arrays = *link;
+            if (arrays->group_mask == (group_capacity - 1)) {
+                *link = arrays->next_retired;
+                arrays->next_retired = nullptr;
+                return arrays;
+            }
+            link = &arrays->next_retired;
+        }
+        return nullptr;
+    }
+
+    //
+    // The lock-free readers may still read the old arrays, keep them until the destructor.
+    // The elements have been transferred, the trivially copyable slots need no destruction.
+    //
+    void retire_arrays(table_arrays * arrays) {
+        if (kIsOptimisticRead) {
+            arrays->next_retired = this->retired_arrays_;
+            this->retired_arrays_ = arrays;
+        } else {
+            this->destroy_arrays(arrays);
+        }
+    }
+
+    void destroy_arrays(table_arrays * arrays) {
+        size_type group_capacity = arrays->group_mask + 1;
+        for (size_type i = 0; i < group_capacity; i++) {
+            AccessAllocTraits::destroy(this->access_allocator_, &arrays->accesses[i]);
+        }
+        AccessAllocTraits::deallocate(this->access_allocator_, arrays->accesses, group_capacity);
+        SlotAllocTraits::deallocate(this->slot_allocator_, arrays->slots, group_capacity * kGroupWidth);
+        GroupAllocTraits::deallocate(this->group_allocator_, arrays->groups, group_capacity);
+        ArraysAllocTraits::destroy(this->arrays_allocator_, arrays);
+        ArraysAllocTraits::deallocate(this->arrays_allocator_, arrays, 1);
+    }
+
+    // Call it under the exclusive table lock.
+    void destroy_slots() {
+        for (size_type group_index = 0; group_index <= this->group_mask_; group_index++) {
+            group_type * group = this->groups_ + group_index;
+            bitmask_type used_mask = this->match_used(group);
+            while (used_mask != 0) {
+                size_type used_pos = group_type::bsf(used_mask);
+                used_mask = group_type::clear_low_bit(used_mask);
+                slot_type * slot = this->slots_ + group_index * kGroupWidth + used_pos;
+                SlotPolicyTraits::destroy(&this->slot_allocator_, slot);
+            }
+        }
+    }
+
+    //
+    // Call it under the exclusive lock of the slot's group. The erase from an overflowed
+    // group leaves the overflow bits, it's counted until the next rehash clears them.
+    //
+    void erase_slot(slot_type * slot) {
+        size_type slot_index = static_cast<size_type>(slot - this->slots_);
+        group_type * group = this->groups_ + slot_index / kGroupWidth;
+        SlotPolicyTraits::destroy(&this->slot_allocator_, slot);
+        group->set_empty(slot_index % kGroupWidth);
+        this->slot_size_.fetch_sub(1, std::memory_order_relaxed);
+        if (unlikely(group->has_overflow())) {
+            this->overflow_erases_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    //
+    // Find the key, and call func(slot_type *) with the lock of the found group held.
+    // Return the slot found or nullptr. Call it under the shared table lock.
+    //
+    template <typename GroupLock, typename Func>
+    slot_type * find_and_lock(const key_type & key, std::size_t hash_code, Func && func) {
+        std::size_t mixed_hash = this->mix_hash(hash_code);
+        size_type slot_index = this->index_for_hash(mixed_hash);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(mixed_hash);
+        size_type group_index = slot_index / kGroupWidth;
+        size_type group_pos = slot_index % kGroupWidth;
+
+        for (size_type probes = 0; probes <= this->group_mask_; probes++) {
+            GroupLock lock(this->accesses_[group_index]);
+            const group_type * group = this->groups_ + group_index;
+            bitmask_type match_mask = this->match_hash(group, ctrl_hash);
+            while (match_mask != 0) {
+                size_type match_pos = group_type::bsf(match_mask);
+                match_mask = group_type::clear_low_bit(match_mask);
+
+                slot_type * slot = this->slots_ + group_index * kGroupWidth + match_pos;
+                if (likely(this->key_equal_(key, slot->value.first))) {
+                    func(slot);
+                    return slot;
+                }
+            }
+
+            // If it's not overflow, means it hasn't been found.
+            if (likely(!group->is_overflow(group_pos))) {
+                break;
+            }
+            group_index = (group_index + 1) & this->group_mask_;
+        }
+        return nullptr;
+    }
+
+    //
+    // Find the key in the arrays without the group locks, and copy the element found
+    // to value_copy, validated by the group versions. Return 1 if it's found, 0 if it's
+    // not found, or -1 if a group is kept changing by the writers. Under the shared table
+    // lock, the arrays are the current ones, otherwise validate the result by the table version.
+    //
+    int find_optimistic(const table_arrays & arrays, const key_type & key, std::size_t hash_code,
+                        void * value_copy) const {
+        std::size_t mixed_hash = this_type::mix_hash(arrays.hash_policy, hash_code);
+        size_type slot_index = this_type::index_for_hash(arrays.hash_policy, mixed_hash);
+        std::uint8_t ctrl_hash = this_type::ctrl_for_hash(arrays.hash_policy, mixed_hash);
+        size_type group_index = slot_index / kGroupWidth;
+        size_type group_pos = slot_index % kGroupWidth;
+
+        for (size_type probes = 0; probes <= arrays.group_mask; probes++) {
+            const group_access & access = arrays.accesses[group_index];
+            const group_type * group = arrays.groups + group_index;
+            size_type retries = 0;
+            bool is_found, is_overflow;
+            for (;;) {
+                std::uint32_t version = access.version.load(std::memory_order_acquire);
+                if (likely((version & 1) == 0)) {
+                    // The reads below may race with a writer, the version check discards them.
+                    is_found = false;
+                    bitmask_type match_mask = this->match_hash(group, ctrl_hash);
+                    while (match_mask != 0) {
+                        size_type match_pos = group_type::bsf(match_mask);
+                        match_mask = group_type::clear_low_bit(match_mask);
+
+                        const slot_type * slot = arrays.slots + group_index * kGroupWidth + match_pos;
+                        if (this->key_equal_(key, slot->value.first)) {
+                            std::memcpy(value_copy, (const void *)&slot->value, sizeof(value_type));
+                            is_found = true;
+                            break;
+                        }
+                    }
+                    is_overflow = group->is_overflow(group_pos);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (likely(access.version.load(std::memory_order_relaxed) == version)) {
+                        break;
+                    }
+                }
+                if (unlikely(++retries >= kOptimisticReadRetries)) {
+                    return -1;
+                }
+                spin_backoff::pause();
+            }
+
+            if (is_found) {
+                return 1;
+            }
+            // If it's not overflow, means it hasn't been found.
+            if (likely(!is_overflow)) {
+                break;
+            }
+            group_index = (group_index + 1) & arrays.group_mask;
+        }
+        return 0;
+    }
+
+    //
+    // Find the key without any lock, and call visitor(const value_type &) with the copy
+    // of the element validated by the table version, nothing is stored. Return -1 if
+    // the table is kept being rehashed or a group is kept changing, take the locks then.
+    //
+    template <typename Visitor>
+    int find_lock_free(const key_type & key, std::size_t hash_code, Visitor & visitor,
+                       std::true_type /* isOptimisticRead */) const {
+        alignas(value_type) unsigned char value_copy[sizeof(value_type)];
+
+        for (size_type retries = 0; retries < kOptimisticReadRetries; retries++) {
+            std::uint32_t table_version = this->table_version_.load(std::memory_order_acquire);
+            if (likely((table_version & 1) == 0)) {
+                // The arrays may be retired and reused meanwhile, but never freed.
+                const table_arrays * arrays = this->arrays_.load(std::memory_order_acquire);
+                int found = this->find_optimistic(*arrays, key, hash_code, (void *)value_copy);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (likely(this->table_version_.load(std::memory_order_relaxed) == table_version)) {
+                    if (found > 0) {
+                        visitor(*reinterpret_cast<const value_type *>(value_copy));
+                    }
+                    return found;
+                }
+            }
+            spin_backoff::pause();
+        }
+        return -1;
+    }
+
+    template <typename Visitor>
+    int find_lock_free(const key_type & key, std::size_t hash_code, Visitor & visitor,
+                       std::false_type /* isOptimisticRead */) const {
+        JSTD_UNUSED(key);
+        JSTD_UNUSED(hash_code);
+        JSTD_UNUSED(visitor);
+        return -1;
+    }
+
+    template <typename GroupLock, typename Func>
+    size_type for_each_locked(Func && func) {
+        shared_table_lock lock(this->table_lock_);
+        size_type count = 0;
+        for (size_type group_index = 0; group_index <= this->group_mask_; group_index++) {
+            GroupLock group_lock(this->accesses_[group_index]);
+            group_type * group = this->groups_ + group_index;
+            bitmask_type used_mask = this->match_used(group);
+            while (used_mask != 0) {
+                size_type used_pos = group_type::bsf(used_mask);
+                used_mask = group_type::clear_low_bit(used_mask);
+                func(this->slots_ + group_index * kGroupWidth + used_pos);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    template <typename Visitor, typename... Args>
+    bool emplace_impl(const key_type & key, Visitor && visitor, Args && ... args) {
+        std::size_t hash_code = this->get_hash(key);
+        for (;;) {
+            {
+                shared_table_lock lock(this->table_lock_);
+                emplace_result result = this->emplace_unprotected(key, hash_code, visitor,
+                                                                  std::forward<Args>(args)...);
+                if (likely(result != kNeedGrow)) {
+                    return (result == kIsInserted);
+                }
+            }
+            this->grow_if_necessary();
+        }
+    }
+
+    //
+    // Call it under the shared table lock.
+    //
+    template <typename Visitor, typename... Args>
+    emplace_result emplace_unprotected(const key_type & key, std::size_t hash_code,
+                                       Visitor & visitor, Args && ... args) {
+        std::size_t mixed_hash = this->mix_hash(hash_code);
+        size_type slot_index = this->index_for_hash(mixed_hash);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(mixed_hash);
+        size_type first_group = slot_index / kGroupWidth;
+        size_type group_pos = slot_index % kGroupWidth;
+        std::atomic<std::uint32_t> & insert_counter = this->accesses_[first_group].insert_counter;
+
+        static constexpr bool isNoVisitor = std::is_same<typename std::decay<Visitor>::type, no_visitor>::value;
+        typedef typename std::conditional<isNoVisitor, shared_group_lock,
+                                          exclusive_group_lock>::type lookup_group_lock;
+
+        for (;;) {
+            std::uint32_t counter = insert_counter.load(std::memory_order_acquire);
+            int found = -1;
+            if (isNoVisitor && kIsOptimisticRead) {
+                // Under the shared table lock, the arrays can't be changed.
+                alignas(value_type) unsigned char value_copy[sizeof(value_type)];
+                found = this->find_optimistic(*this->arrays_.load(std::memory_order_relaxed),
+                                              key, hash_code, (void *)value_copy);
+            }
+            if (found < 0) {
+                slot_type * slot = this->find_and_lock<lookup_group_lock>(key, hash_code,
+                    [&visitor](slot_type * slot) {
+                        visitor(slot->value);
+                    });
+                found = (slot != nullptr) ? 1 : 0;
+            }
+            if (found != 0) {
+                return kIsExists;
+            }
+
+            // Reserve a slot, the rehash needs the exclusive table lock.
+            size_type slot_size = this->slot_size_.fetch_add(1, std::memory_order_relaxed);
+            if (unlikely(slot_size + this->overflow_erases_.load(std::memory_order_relaxed) >=
+                         this->slot_threshold_)) {
+                this->slot_size_.fetch_sub(1, std::memory_order_relaxed);
+                return kNeedGrow;
+            }
+
+            size_type group_index = first_group;
+            for (;;) {
+                exclusive_group_lock lock(this->accesses_[group_index]);
+                group_type * group = this->groups_ + group_index;
+                bitmask_type empty_mask = this->match_empty(group);
+                if (empty_mask != 0) {
+                    if (unlikely(insert_counter.fetch_add(1, std::memory_order_acq_rel) != counter)) {
+                        // Another insert to the same home group may have inserted the key, look up again.
+                        this->slot_size_.fetch_sub(1, std::memory_order_relaxed);
+                        break;
+                    }
+                    size_type empty_pos = group_type::bsf(empty_mask);
+                    slot_type * new_slot = this->slots_ + group_index * kGroupWidth + empty_pos;
+                    try {
+                        SlotPolicyTraits::construct(&this->slot_allocator_, new_slot,
+                                                    std::forward<Args>(args)...);
+                    } catch (...) {
+                        this->slot_size_.fetch_sub(1, std::memory_order_relaxed);
+                        throw;
+                    }
+                    group->set_used(empty_pos, ctrl_hash);
+                    return kIsInserted;
+                } else {
+                    // If it's not overflow, set the overflow bit.
+                    if (likely(!group->is_overflow(group_pos))) {
+                        group->set_overflow(group_pos);
+                    }
+                }
+                group_index = (group_index + 1) & this->group_mask_;
+            }
+        }
+    }
+
+    //
+    // The erases from the overflowed groups lower the threshold, if the table still has
+    // 1/8 of its room, only the overflow bits need to be cleared, rehash it in place.
+    //
+    void grow_if_necessary() {
+        exclusive_table_lock lock(this->table_lock_, this->table_version_);
+        // Another thread may have grown the table.
+        size_type size = this->size();
+        if (size + this->overflow_erases_.load(std::memory_order_relaxed) >= this->slot_threshold_) {
+            if (size < (this->slot_threshold_ - this->slot_threshold_ / 8))
+                this->rehash_unprotected(this->slot_capacity());
+            else
+                this->rehash_unprotected(this->slot_capacity() * 2);
+        }
+    }
+
+    //
+    // Call it under the exclusive table lock, no group lock is needed.
+    //
+    void rehash_unprotected(size_type new_capacity) {
+        table_arrays * old_arrays = this->arrays_.load(std::memory_order_relaxed);
+        group_type * old_groups = this->groups_;
+        slot_type * old_slots = this->slots_;
+        size_type old_group_capacity = this->group_capacity();
+
+        this->create_arrays(new_capacity);
+
+        for (size_type group_index = 0; group_index < old_group_capacity; group_index++) {
+            group_type * group = old_groups + group_index;
+            bitmask_type used_mask = this->match_used(group);
+            while (used_mask != 0) {
+                size_type used_pos = group_type::bsf(used_mask);
+                used_mask = group_type::clear_low_bit(used_mask);
+                slot_type * old_slot = old_slots + group_index * kGroupWidth + used_pos;
+                this->transfer_slot(old_slot);
+            }
+        }
+
+        this->retire_arrays(old_arrays);
+    }
+
+    void transfer_slot(slot_type * old_slot) {
+        std::size_t mixed_hash = this->mix_hash(this->get_hash(old_slot->value.first));
+        size_type slot_index = this->index_for_hash(mixed_hash);
+        std::uint8_t ctrl_hash = this->ctrl_for_hash(mixed_hash);
+        size_type group_index = slot_index / kGroupWidth;
+        size_type group_pos = slot_index % kGroupWidth;
+
+        for (;;) {
+            group_type * group = this->groups_ + group_index;
+            bitmask_type empty_mask = this->match_empty(group);
+            if (empty_mask != 0) {
+                size_type empty_pos = group_type::bsf(empty_mask);
+                slot_type * new_slot = this->slots_ + group_index * kGroupWidth + empty_pos;
+                SlotPolicyTraits::transfer(&this->slot_allocator_, new_slot, old_slot);
+                group->set_used(empty_pos, ctrl_hash);
+                return;
+            } else if (!group->is_overflow(group_pos)) {
+                group->set_overflow(group_pos);
+            }
+            group_index = (group_index + 1) & this->group_mask_;
+        }
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_CONCURRENT_CLUSTER_FLAT_MAP_HPP
@@ -0,0 +1,242 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_CONCURRENT_RW_SPINLOCK_HPP
+#define JSTD_HASHMAP_CONCURRENT_RW_SPINLOCK_HPP
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+
+#include "jstd/basic/stddef.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+namespace jstd {
+
+//
+// Spin a little, and give up the time slice after a while, the waiting thread
+// may be the one which holds the lock on a machine with few cores.
+//
+class spin_backoff
+{
+public:
+    static constexpr std::uint32_t kSpinLimit = 64;
+
+private:
+    std::uint32_t spins_;
+
+public:
+    spin_backoff() noexcept : spins_(0) {}
+    ~spin_backoff() {}
+
+    static inline void pause() noexcept {
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || \
+    (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+        _mm_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+        __asm__ __volatile__("yield" ::: "memory");
+#endif
+    }
+
+    inline void wait() noexcept {
+        if (this->spins_ < kSpinLimit) {
+            this->spins_++;
+            spin_backoff::pause();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
+
+//
+// A 4 bytes reader/writer spinlock, for the short critical sections like
+// the probing of a group. The writer sets the writer bit first, then waits
+// for the readers to leave, so the new readers can't starve it.
+//
+class rw_spinlock
+{
+public:
+    static constexpr std::uint32_t kWriterBit   = 0x80000000ul;
+    static constexpr std::uint32_t kReadersMask = 0x7FFFFFFFul;
+
+private:
+    std::atomic<std::uint32_t> state_;
+
+public:
+    rw_spinlock() noexcept : state_(0) {}
+    ~rw_spinlock() {}
+
+    rw_spinlock(const rw_spinlock &) = delete;
+    rw_spinlock & operator = (const rw_spinlock &) = delete;
+
+    bool try_lock_shared() noexcept {
+        std::uint32_t state = this->state_.load(std::memory_order_relaxed);
+        return (((state & kWriterBit) == 0) &&
+                this->state_.compare_exchange_weak(state, state + 1,
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_relaxed));
+    }
+
+    void lock_shared() noexcept {
+        spin_backoff backoff;
+        while (!this->try_lock_shared()) {
+            backoff.wait();
+        }
+    }
+
+    void unlock_shared() noexcept {
+        assert((this->state_.load(std::memory_order_relaxed) & kReadersMask) != 0);
+        this->state_.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool try_lock() noexcept {
+        std::uint32_t state = 0;
+        return this->state_.compare_exchange_strong(state, kWriterBit,
+                                                    std::memory_order_acquire,
+                                                    std::memory_order_relaxed);
+    }
+
+    void lock() noexcept {
+        spin_backoff backoff;
+        for (;;) {
+            std::uint32_t state = this->state_.load(std::memory_order_relaxed);
+            if (((state & kWriterBit) == 0) &&
+                this->state_.compare_exchange_weak(state, state | kWriterBit,
+                                                   std::memory_order_acquire,
+                                                   std::memory_order_relaxed)) {
+                break;
+            }
+            backoff.wait();
+        }
+        // Wait for the readers to leave.
+        while ((this->state_.load(std::memory_order_acquire) & kReadersMask) != 0) {
+            backoff.wait();
+        }
+    }
+
+    void unlock() noexcept {
+        assert(this->state_.load(std::memory_order_relaxed) == kWriterBit);
+        this->state_.store(0, std::memory_order_release);
+    }
+};
+
+//
+// A reader/writer lock striped over some cache lines, a reader only touches
+// the stripe of its thread, a writer locks all the stripes. It's the table lock
+// of the concurrent maps: all the operations are readers, the rehash is the writer.
+//
+template <std::size_t Stripes = 64>
+class striped_rw_spinlock
+{
+public:
+    static constexpr std::size_t kStripes = Stripes;
+    static constexpr std::size_t kCacheLineSize = 64;
+
+    static_assert(((kStripes & (kStripes - 1)) == 0),
+                  "jstd::striped_rw_spinlock<N>: Stripes must be power of 2.");
+
+private:
+    struct alignas(kCacheLineSize) stripe_type {
+        rw_spinlock lock;
+    };
+
+    stripe_type stripes_[kStripes];
+
+    static std::size_t thread_stripe() noexcept {
+        static std::atomic<std::size_t> s_next_stripe(0);
+        thread_local std::size_t t_stripe =
+            s_next_stripe.fetch_add(1, std::memory_order_relaxed) & (kStripes - 1);
+        return t_stripe;
+    }
+
+public:
+    striped_rw_spinlock() noexcept {}
+    ~striped_rw_spinlock() {}
+
+    striped_rw_spinlock(const striped_rw_spinlock &) = delete;
+    striped_rw_spinlock & operator = (const striped_rw_spinlock &) = delete;
+
+    // Return the stripe locked, pass it to unlock_shared().
+    std::size_t lock_shared() noexcept {
+        std::size_t stripe = striped_rw_spinlock::thread_stripe();
+        this->stripes_[stripe].lock.lock_shared();
+        return stripe;
+    }
+
+    void unlock_shared(std::size_t stripe) noexcept {
+        assert(stripe < kStripes);
+        this->stripes_[stripe].lock.unlock_shared();
+    }
+
+    void lock() noexcept {
+        for (std::size_t i = 0; i < kStripes; i++) {
+            this->stripes_[i].lock.lock();
+        }
+    }
+
+    void unlock() noexcept {
+        for (std::size_t i = kStripes; i > 0; i--) {
+            this->stripes_[i - 1].lock.unlock();
+        }
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_CONCURRENT_RW_SPINLOCK_HPP
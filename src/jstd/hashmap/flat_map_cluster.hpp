@@ -52,12 +52,35 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>          // For std::memset(), std::memcpy()
 #include <assert.h>
 
 #include "jstd/basic/stddef.h"
+#include "jstd/support/BitUtils.h"
 #include "jstd/support/BitVec.h"
 #include "jstd/memory/memory_barrier.h"
 
+//
+// The match kernel of flat_map_cluster16, chosen at compile time by config_hw.h:
+//
+//   SSE2 on x86, NEON on AArch64, otherwise the portable 64-bit SWAR version.
+//
+#define CLUSTER_GROUP16_KERNEL_SWAR     0
+#define CLUSTER_GROUP16_KERNEL_SSE2     1
+#define CLUSTER_GROUP16_KERNEL_NEON     2
+
+#if (JSTD_USE_SWAR == 0) && (JSTD_USE_SSE2 != 0) && defined(JSTD_HAVE_SSE2)
+  #define CLUSTER_GROUP16_KERNEL    CLUSTER_GROUP16_KERNEL_SSE2
+#elif (JSTD_USE_SWAR == 0) && (JSTD_USE_ARM_NEON != 0) && defined(JSTD_HAVE_ARM_NEON) && defined(JSTD_IS_ARM64)
+  #define CLUSTER_GROUP16_KERNEL    CLUSTER_GROUP16_KERNEL_NEON
+#else
+  #define CLUSTER_GROUP16_KERNEL    CLUSTER_GROUP16_KERNEL_SWAR
+#endif
+
+#if (CLUSTER_GROUP16_KERNEL == CLUSTER_GROUP16_KERNEL_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace jstd {
 
 class JSTD_DLL cluster_meta_ctrl
@@ -125,23 +148,27 @@ public:
         return 0;
     }
 
+    //
+    // The overflow bit belongs to the probe chains passing this position,
+    // not to the slot itself, so set_empty() and set_used() keep it.
+    //
     inline void set_empty() {
-        this->value = kEmptySlot;
+        this->value = overflow_bits(this->value) | kEmptySlot;
     }
 
     inline void set_used(hash_type hash) {
         assert(hash_bits(hash) != kEmptySlot);
-        this->value = hash;
+        this->value = overflow_bits(this->value) | hash;
     }
 
     inline void set_used64(std::size_t hash) {
         assert(hash_bits(hash) != kEmptySlot);
-        this->value = hash_bits(hash);
+        this->value = overflow_bits(this->value) | hash_bits(hash);
     }
 
     inline void set_used_strict(hash_type hash) {
         assert(hash_bits(hash) != kEmptySlot);
-        this->value = hash_bits(hash);
+        this->value = overflow_bits(this->value) | hash_bits(hash);
     }
 
     inline void set_overflow() {
@@ -149,6 +176,10 @@ public:
         this->value |= kOverflowMask;
     }
 
+    inline void clear_overflow() {
+        this->value &= kHashMask;
+    }
+
     inline void set_value(value_type value) {
         this->value = value;
     }
@@ -157,8 +188,8 @@ private:
     value_type value;
 };
 
-template <typename T>
-class JSTD_DLL flat_map_cluster16
+template <typename T, std::size_t GroupWidth>
+class JSTD_DLL flat_map_cluster_base
 {
 public:
     typedef T                       ctrl_type;
@@ -173,29 +204,10 @@ public:
     static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
     static constexpr std::uint8_t kOverflowMask = ctrl_type::kOverflowMask;
 
-    static constexpr std::size_t kGroupWidth = 16;
-
-    flat_map_cluster16() {}
-    ~flat_map_cluster16() {}
-
-    void init() {
-        if (kEmptySlot == 0b00000000) {
-            __m128i zeros = _mm_setzero_si128();
-            _mm_store_si128(reinterpret_cast<__m128i *>(ctrls), zeros);
-        }
-        else if (kEmptySlot == 0b11111111) {
-            __m128i ones = _mm_setones_si128();
-            _mm_store_si128(reinterpret_cast<__m128i *>(ctrls), ones);
-        }
-        else {
-            __m128i empty_bits = _mm_set1_epi8(kEmptySlot);
-            _mm_store_si128(reinterpret_cast<__m128i *>(ctrls), empty_bits);
-        }
-    }
+    static constexpr std::size_t kGroupWidth = GroupWidth;
 
-    inline __m128i _load_data() const {
-        return _mm_load_si128(reinterpret_cast<const __m128i *>(ctrls));
-    }
+    flat_map_cluster_base() {}
+    ~flat_map_cluster_base() {}
 
     inline bool is_empty(std::size_t pos) const {
         assert(pos < kGroupWidth);
@@ -256,7 +268,92 @@ public:
         ctrl->set_overflow();
     }
 
-    inline std::uint32_t match_empty() const {
+    inline void clear_overflow(std::size_t pos) {
+        assert(pos < kGroupWidth);
+        ctrl_type * ctrl = &ctrls[pos];
+        ctrl->clear_overflow();
+    }
+
+    inline bool has_overflow() const {
+        static_assert((sizeof(ctrl_type) == 1), "flat_map_cluster_base::has_overflow(): sizeof(ctrl_type) must be 1.");
+        static_assert(((kGroupWidth % 8) == 0), "flat_map_cluster_base::has_overflow(): kGroupWidth must be a multiple of 8.");
+        static constexpr std::uint64_t kOverflowBits64 = 0x0101010101010101ull * kOverflowMask;
+        std::uint64_t overflow_bits = 0;
+        for (std::size_t i = 0; i < kGroupWidth; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, &ctrls[i], sizeof(word));
+            overflow_bits |= word;
+        }
+        return ((overflow_bits & kOverflowBits64) != 0);
+    }
+
+protected:
+    alignas(GroupWidth) ctrl_type ctrls[kGroupWidth];
+};
+
+template <typename T>
+class JSTD_DLL flat_map_cluster16 : public flat_map_cluster_base<T, 16>
+{
+public:
+    typedef flat_map_cluster_base<T, 16>    base_type;
+    typedef typename base_type::ctrl_type   ctrl_type;
+    typedef typename base_type::value_type  value_type;
+    typedef typename base_type::hash_type   hash_type;
+    typedef std::uint32_t                   bitmask_type;
+
+    static constexpr std::uint8_t kHashMask     = ctrl_type::kHashMask;
+    static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
+    static constexpr std::uint8_t kOverflowMask = ctrl_type::kOverflowMask;
+
+    static constexpr std::size_t kGroupWidth = base_type::kGroupWidth;
+
+    flat_map_cluster16() {}
+    ~flat_map_cluster16() {}
+
+    static inline std::size_t bsf(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsf32(mask));
+    }
+
+    static inline std::size_t bsr(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsr32(mask));
+    }
+
+    static inline bitmask_type clear_low_bit(bitmask_type mask) {
+        return BitUtils::clearLowBit32(mask);
+    }
+
+    static const char * kernel_name() {
+#if (CLUSTER_GROUP16_KERNEL == CLUSTER_GROUP16_KERNEL_SSE2)
+        return "sse2";
+#elif (CLUSTER_GROUP16_KERNEL == CLUSTER_GROUP16_KERNEL_NEON)
+        return "neon";
+#else
+        return "swar";
+#endif
+    }
+
+#if (CLUSTER_GROUP16_KERNEL == CLUSTER_GROUP16_KERNEL_SSE2)
+
+    void init() {
+        if (kEmptySlot == 0b00000000) {
+            __m128i zeros = _mm_setzero_si128();
+            _mm_store_si128(reinterpret_cast<__m128i *>(this->ctrls), zeros);
+        }
+        else if (kEmptySlot == 0b11111111) {
+            __m128i ones = _mm_setones_si128();
+            _mm_store_si128(reinterpret_cast<__m128i *>(this->ctrls), ones);
+        }
+        else {
+            __m128i empty_bits = _mm_set1_epi8(kEmptySlot);
+            _mm_store_si128(reinterpret_cast<__m128i *>(this->ctrls), empty_bits);
+        }
+    }
+
+    inline __m128i _load_data() const {
+        return _mm_load_si128(reinterpret_cast<const __m128i *>(this->ctrls));
+    }
+
+    inline bitmask_type match_empty() const {
         // Latency = 6
         __m128i ctrl_bits = _load_data();
         __COMPILER_BARRIER();
@@ -273,10 +370,10 @@ public:
 
         __m128i match_mask = _mm_cmpeq_epi8(_mm_and_si128(ctrl_bits, mask_bits), empty_bits);
         int mask = _mm_movemask_epi8(match_mask);
-        return static_cast<std::uint32_t>(mask);
+        return static_cast<bitmask_type>(mask);
     }
 
-    inline std::uint32_t match_used() const {
+    inline bitmask_type match_used() const {
         // Latency = 6
         __m128i ctrl_bits = _load_data();
         __COMPILER_BARRIER();
@@ -301,10 +398,10 @@ public:
         if (kEmptySlot != 0b00000000 && kEmptySlot != 0b11111111) {
             mask = ~mask & 0xFFFF;
         }
-        return static_cast<std::uint32_t>(mask);
+        return static_cast<bitmask_type>(mask);
     }
 
-    inline std::uint32_t match_hash(hash_type hash) const {
+    inline bitmask_type match_hash(hash_type hash) const {
         // Latency = 6
         __m128i ctrl_bits  = _load_data();
         __COMPILER_BARRIER();
@@ -313,13 +410,327 @@ public:
         __m128i hash_bits  = _mm_set1_epi8(hash);
         __m128i match_mask = _mm_cmpeq_epi8(_mm_and_si128(ctrl_bits, mask_bits), hash_bits);
         int mask = _mm_movemask_epi8(match_mask);
-        return static_cast<std::uint32_t>(mask);
+        return static_cast<bitmask_type>(mask);
     }
 
-private:
-    alignas(16) ctrl_type ctrls[kGroupWidth];
+#elif (CLUSTER_GROUP16_KERNEL == CLUSTER_GROUP16_KERNEL_NEON)
+
+    void init() {
+        vst1q_u8(reinterpret_cast<std::uint8_t *>(this->ctrls), vdupq_n_u8(kEmptySlot));
+    }
+
+    inline uint8x16_t _load_data() const {
+        return vld1q_u8(reinterpret_cast<const std::uint8_t *>(this->ctrls));
+    }
+
+    //
+    // NEON has no movemask, keep one bit per lane (1, 2, 4, ..., 128)
+    // and add up the lanes of each half.
+    //
+    static inline bitmask_type _movemask(uint8x16_t match_mask) {
+        static const std::uint8_t kLaneBits[16] = {
+            1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+        };
+        uint8x16_t lane_bits = vandq_u8(match_mask, vld1q_u8(kLaneBits));
+        bitmask_type mask_low  = static_cast<bitmask_type>(vaddv_u8(vget_low_u8(lane_bits)));
+        bitmask_type mask_high = static_cast<bitmask_type>(vaddv_u8(vget_high_u8(lane_bits)));
+        return (mask_low | (mask_high << 8));
+    }
+
+    inline bitmask_type match_empty() const {
+        uint8x16_t ctrl_bits = vandq_u8(_load_data(), vdupq_n_u8(kHashMask));
+        uint8x16_t match_mask = vceqq_u8(ctrl_bits, vdupq_n_u8(kEmptySlot));
+        return _movemask(match_mask);
+    }
+
+    inline bitmask_type match_used() const {
+        uint8x16_t ctrl_bits = vandq_u8(_load_data(), vdupq_n_u8(kHashMask));
+        uint8x16_t match_mask = vmvnq_u8(vceqq_u8(ctrl_bits, vdupq_n_u8(kEmptySlot)));
+        return _movemask(match_mask);
+    }
+
+    inline bitmask_type match_hash(hash_type hash) const {
+        uint8x16_t ctrl_bits = vandq_u8(_load_data(), vdupq_n_u8(kHashMask));
+        uint8x16_t match_mask = vceqq_u8(ctrl_bits, vdupq_n_u8(hash));
+        return _movemask(match_mask);
+    }
+
+#else // CLUSTER_GROUP16_KERNEL_SWAR
+
+    //
+    // Portable SWAR (SIMD within a register), the group is handled as two 64-bit words.
+    //
+    // The hash bits of a ctrl are at most 0x7F, so adding 0x7F to each byte never
+    // carries into the next byte, and the top bit of each byte is set
+    // if and only if the byte is not zero, there are no false positives.
+    //
+    static constexpr std::uint64_t kLowBits64  = 0x0101010101010101ull;
+    static constexpr std::uint64_t kHashBits64 = 0x7F7F7F7F7F7F7F7Full;
+    static constexpr std::uint64_t kHighBits64 = 0x8080808080808080ull;
+
+    void init() {
+        std::memset(reinterpret_cast<void *>(this->ctrls), kEmptySlot, sizeof(this->ctrls));
+    }
+
+    inline std::uint64_t _load_word(std::size_t index) const {
+        std::uint64_t word;
+        std::memcpy(&word, reinterpret_cast<const char *>(this->ctrls) + index * sizeof(word), sizeof(word));
+#if (JSTD_ENDIAN == JSTD_BIG_ENDIAN)
+        word = __builtin_bswap64(word);
+#endif
+        return word;
+    }
+
+    // Return 0x80 in each byte which is not zero.
+    static inline std::uint64_t _non_zero_bytes(std::uint64_t hash_bits) {
+        return ((hash_bits + kHashBits64) & kHighBits64);
+    }
+
+    // Gather the top bit of each byte into the low 8 bits.
+    static inline bitmask_type _movemask(std::uint64_t high_bits) {
+        return static_cast<bitmask_type>(((high_bits >> 7) * 0x0102040810204080ull) >> 56);
+    }
+
+    static inline bitmask_type _combine(std::uint64_t high_bits0, std::uint64_t high_bits1) {
+        return (_movemask(high_bits0) | (_movemask(high_bits1) << 8));
+    }
+
+    inline bitmask_type match_empty() const {
+        std::uint64_t empty_bits = kLowBits64 * kEmptySlot;
+        std::uint64_t word0 = (_load_word(0) & kHashBits64) ^ empty_bits;
+        std::uint64_t word1 = (_load_word(1) & kHashBits64) ^ empty_bits;
+        return _combine(_non_zero_bytes(word0) ^ kHighBits64,
+                        _non_zero_bytes(word1) ^ kHighBits64);
+    }
+
+    inline bitmask_type match_used() const {
+        std::uint64_t empty_bits = kLowBits64 * kEmptySlot;
+        std::uint64_t word0 = (_load_word(0) & kHashBits64) ^ empty_bits;
+        std::uint64_t word1 = (_load_word(1) & kHashBits64) ^ empty_bits;
+        return _combine(_non_zero_bytes(word0), _non_zero_bytes(word1));
+    }
+
+    inline bitmask_type match_hash(hash_type hash) const {
+        std::uint64_t hash_bits = kLowBits64 * static_cast<std::uint64_t>(hash);
+        std::uint64_t word0 = (_load_word(0) & kHashBits64) ^ hash_bits;
+        std::uint64_t word1 = (_load_word(1) & kHashBits64) ^ hash_bits;
+        return _combine(_non_zero_bytes(word0) ^ kHighBits64,
+                        _non_zero_bytes(word1) ^ kHighBits64);
+    }
+
+#endif // CLUSTER_GROUP16_KERNEL
+};
+
+#if defined(__AVX2__)
+
+//
+// 32 ctrls per group, one AVX2 compare covers the whole group,
+// so the probe hops half as many groups as flat_map_cluster16.
+//
+template <typename T>
+class JSTD_DLL flat_map_cluster32 : public flat_map_cluster_base<T, 32>
+{
+public:
+    typedef flat_map_cluster_base<T, 32>    base_type;
+    typedef typename base_type::ctrl_type   ctrl_type;
+    typedef typename base_type::value_type  value_type;
+    typedef typename base_type::hash_type   hash_type;
+    typedef std::uint32_t                   bitmask_type;
+
+    static constexpr std::uint8_t kHashMask     = ctrl_type::kHashMask;
+    static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
+    static constexpr std::uint8_t kOverflowMask = ctrl_type::kOverflowMask;
+
+    static constexpr std::size_t kGroupWidth = base_type::kGroupWidth;
+
+    flat_map_cluster32() {}
+    ~flat_map_cluster32() {}
+
+    static inline std::size_t bsf(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsf32(mask));
+    }
+
+    static inline std::size_t bsr(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsr32(mask));
+    }
+
+    static inline bitmask_type clear_low_bit(bitmask_type mask) {
+        return BitUtils::clearLowBit32(mask);
+    }
+
+    static const char * kernel_name() {
+        return "avx2";
+    }
+
+    void init() {
+        if (kEmptySlot == 0b00000000) {
+            __m256i zeros = _mm256_setzero_si256();
+            _mm256_store_si256(reinterpret_cast<__m256i *>(this->ctrls), zeros);
+        }
+        else if (kEmptySlot == 0b11111111) {
+            __m256i ones = _mm256_setones_si256();
+            _mm256_store_si256(reinterpret_cast<__m256i *>(this->ctrls), ones);
+        }
+        else {
+            __m256i empty_bits = _mm256_set1_epi8(kEmptySlot);
+            _mm256_store_si256(reinterpret_cast<__m256i *>(this->ctrls), empty_bits);
+        }
+    }
+
+    inline __m256i _load_data() const {
+        return _mm256_load_si256(reinterpret_cast<const __m256i *>(this->ctrls));
+    }
+
+    inline bitmask_type match_empty() const {
+        __m256i ctrl_bits = _load_data();
+        __COMPILER_BARRIER();
+        __m256i mask_bits = _mm256_set1_epi8(kHashMask);
+        __COMPILER_BARRIER();
+
+        __m256i empty_bits;
+        if (kEmptySlot == 0b00000000)
+            empty_bits = _mm256_setzero_si256();
+        else if (kEmptySlot == 0b11111111)
+            empty_bits = _mm256_setones_si256();
+        else
+            empty_bits = _mm256_set1_epi8(kEmptySlot);
+
+        __m256i match_mask = _mm256_cmpeq_epi8(_mm256_and_si256(ctrl_bits, mask_bits), empty_bits);
+        int mask = _mm256_movemask_epi8(match_mask);
+        return static_cast<bitmask_type>(mask);
+    }
+
+    inline bitmask_type match_used() const {
+        __m256i ctrl_bits = _load_data();
+        __COMPILER_BARRIER();
+        __m256i mask_bits = _mm256_set1_epi8(kHashMask);
+        __COMPILER_BARRIER();
+
+        __m256i empty_bits, match_mask;
+        if (kEmptySlot == 0b00000000) {
+            empty_bits = _mm256_setzero_si256();
+            match_mask = _mm256_cmpgt_epi8(_mm256_and_si256(ctrl_bits, mask_bits), empty_bits);
+        }
+        else {
+            empty_bits = _mm256_set1_epi8(kEmptySlot);
+            match_mask = _mm256_cmpeq_epi8(_mm256_and_si256(ctrl_bits, mask_bits), empty_bits);
+        }
+
+        int mask = _mm256_movemask_epi8(match_mask);
+        if (kEmptySlot != 0b00000000) {
+            mask = ~mask;
+        }
+        return static_cast<bitmask_type>(mask);
+    }
+
+    inline bitmask_type match_hash(hash_type hash) const {
+        __m256i ctrl_bits  = _load_data();
+        __COMPILER_BARRIER();
+        __m256i mask_bits  = _mm256_set1_epi8(kHashMask);
+        __COMPILER_BARRIER();
+        __m256i hash_bits  = _mm256_set1_epi8(hash);
+        __m256i match_mask = _mm256_cmpeq_epi8(_mm256_and_si256(ctrl_bits, mask_bits), hash_bits);
+        int mask = _mm256_movemask_epi8(match_mask);
+        return static_cast<bitmask_type>(mask);
+    }
+};
+
+#endif // __AVX2__
+
+#if defined(__AVX512BW__)
+
+//
+// 64 ctrls per group, the group fills exactly one cache line.
+// The AVX-512BW compares write straight into a __mmask64,
+// so there is no movemask step.
+//
+template <typename T>
+class JSTD_DLL flat_map_cluster64 : public flat_map_cluster_base<T, 64>
+{
+public:
+    typedef flat_map_cluster_base<T, 64>    base_type;
+    typedef typename base_type::ctrl_type   ctrl_type;
+    typedef typename base_type::value_type  value_type;
+    typedef typename base_type::hash_type   hash_type;
+    typedef std::uint64_t                   bitmask_type;
+
+    static constexpr std::uint8_t kHashMask     = ctrl_type::kHashMask;
+    static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
+    static constexpr std::uint8_t kOverflowMask = ctrl_type::kOverflowMask;
+
+    static constexpr std::size_t kGroupWidth = base_type::kGroupWidth;
+
+    flat_map_cluster64() {}
+    ~flat_map_cluster64() {}
+
+    static inline std::size_t bsf(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsf64(mask));
+    }
+
+    static inline std::size_t bsr(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsr64(mask));
+    }
+
+    static inline bitmask_type clear_low_bit(bitmask_type mask) {
+        return BitUtils::clearLowBit64(mask);
+    }
+
+    static const char * kernel_name() {
+        return "avx512bw";
+    }
+
+    void init() {
+        __m512i empty_bits;
+        if (kEmptySlot == 0b00000000)
+            empty_bits = _mm512_setzero_si512();
+        else
+            empty_bits = _mm512_set1_epi8(static_cast<char>(kEmptySlot));
+        _mm512_store_si512(reinterpret_cast<void *>(this->ctrls), empty_bits);
+    }
+
+    inline __m512i _load_data() const {
+        return _mm512_load_si512(reinterpret_cast<const void *>(this->ctrls));
+    }
+
+    inline bitmask_type match_empty() const {
+        __m512i ctrl_bits = _load_data();
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(kHashMask));
+        __mmask64 mask;
+        if (kEmptySlot == 0b00000000) {
+            // (ctrl & kHashMask) == 0
+            mask = _mm512_testn_epi8_mask(ctrl_bits, mask_bits);
+        } else {
+            __m512i empty_bits = _mm512_set1_epi8(static_cast<char>(kEmptySlot));
+            mask = _mm512_cmpeq_epi8_mask(_mm512_and_si512(ctrl_bits, mask_bits), empty_bits);
+        }
+        return static_cast<bitmask_type>(mask);
+    }
+
+    inline bitmask_type match_used() const {
+        __m512i ctrl_bits = _load_data();
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(kHashMask));
+        __mmask64 mask;
+        if (kEmptySlot == 0b00000000) {
+            // (ctrl & kHashMask) != 0
+            mask = _mm512_test_epi8_mask(ctrl_bits, mask_bits);
+        } else {
+            __m512i empty_bits = _mm512_set1_epi8(static_cast<char>(kEmptySlot));
+            mask = _mm512_cmpneq_epi8_mask(_mm512_and_si512(ctrl_bits, mask_bits), empty_bits);
+        }
+        return static_cast<bitmask_type>(mask);
+    }
+
+    inline bitmask_type match_hash(hash_type hash) const {
+        __m512i ctrl_bits = _load_data();
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(kHashMask));
+        __m512i hash_bits = _mm512_set1_epi8(static_cast<char>(hash));
+        __mmask64 mask = _mm512_cmpeq_epi8_mask(_mm512_and_si512(ctrl_bits, mask_bits), hash_bits);
+        return static_cast<bitmask_type>(mask);
+    }
 };
 
+#endif // __AVX512BW__
+
 } // namespace jstd
 
 #endif // JSTD_HASHMAP_FLAT_MAP_CLUSTER_HPP
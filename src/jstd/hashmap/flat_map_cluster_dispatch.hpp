@@ -0,0 +1,352 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_FLAT_MAP_CLUSTER_DISPATCH_HPP
+#define JSTD_HASHMAP_FLAT_MAP_CLUSTER_DISPATCH_HPP
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>          // For std::memset()
+#include <assert.h>
+
+#include "jstd/basic/stddef.h"
+#include "jstd/support/BitUtils.h"
+#include "jstd/support/CPUFeatures.h"
+#include "jstd/traits/type_traits.h"
+#include "jstd/hashmap/flat_map_cluster.hpp"
+
+namespace jstd {
+
+//
+// The kernel of a group type, the tables keep it and pass it to the matches.
+// A group whose match kernels are chosen at runtime defines kernel_type and kernel(),
+// so the kernel is chosen once by a table, not by each match. The kernel of
+// the other groups is empty, their matches are inlined as before.
+//
+struct cluster_inline_kernel {};
+
+template <typename Group, typename = void>
+struct cluster_kernel_traits {
+    typedef cluster_inline_kernel           kernel_type;
+    typedef typename Group::hash_type       hash_type;
+    typedef typename Group::bitmask_type    bitmask_type;
+
+    static kernel_type kernel() {
+        return kernel_type();
+    }
+
+    static inline bitmask_type match_empty(const kernel_type &, const Group * group) {
+        return group->match_empty();
+    }
+
+    static inline bitmask_type match_used(const kernel_type &, const Group * group) {
+        return group->match_used();
+    }
+
+    static inline bitmask_type match_hash(const kernel_type &, const Group * group, hash_type hash) {
+        return group->match_hash(hash);
+    }
+};
+
+template <typename Group>
+struct cluster_kernel_traits<Group, void_t<typename Group::kernel_type>> {
+    typedef const typename Group::kernel_type * kernel_type;
+    typedef typename Group::hash_type           hash_type;
+    typedef typename Group::bitmask_type        bitmask_type;
+
+    static kernel_type kernel() {
+        return &Group::kernel();
+    }
+
+    static inline bitmask_type match_empty(kernel_type kernel, const Group * group) {
+        return group->match_empty(*kernel);
+    }
+
+    static inline bitmask_type match_used(kernel_type kernel, const Group * group) {
+        return group->match_used(*kernel);
+    }
+
+    static inline bitmask_type match_hash(kernel_type kernel, const Group * group, hash_type hash) {
+        return group->match_hash(*kernel, hash);
+    }
+};
+
+} // namespace jstd
+
+#if defined(JSTD_IS_X86)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+//
+// The kernels are compiled for their own instruction set by the target attribute,
+// so the binary doesn't need to be built with -mavx2 or -march=native.
+//
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CLUSTER_TARGET_SSE2
+#define CLUSTER_TARGET_AVX2
+#define CLUSTER_TARGET_AVX512BW
+#else
+#define CLUSTER_TARGET_SSE2         __attribute__((target("sse2")))
+#define CLUSTER_TARGET_AVX2         __attribute__((target("avx2")))
+#define CLUSTER_TARGET_AVX512BW     __attribute__((target("avx512f,avx512bw")))
+#endif
+
+namespace jstd {
+
+//
+// The match kernels of a 64 ctrls group, ctrl byte: bit 0-6 is hash, bit 7 is overflow,
+// and 0 is the empty hash (see cluster_meta_ctrl).
+//
+struct cluster64_kernel {
+    typedef std::uint64_t (*match_hash_func)(const void * ctrls, std::uint8_t hash);
+    typedef std::uint64_t (*match_func)(const void * ctrls);
+
+    const char *    name;
+    match_hash_func match_hash;
+    match_func      match_empty;
+    match_func      match_used;
+};
+
+struct cluster64_kernels {
+    ///
+    /// SSE2: 4 x 16 ctrls
+    ///
+    CLUSTER_TARGET_SSE2
+    static std::uint64_t match_hash_sse2(const void * ctrls, std::uint8_t hash) {
+        const __m128i * ctrl_ptr = reinterpret_cast<const __m128i *>(ctrls);
+        __m128i mask_bits = _mm_set1_epi8(static_cast<char>(0x7F));
+        __m128i hash_bits = _mm_set1_epi8(static_cast<char>(hash));
+        std::uint64_t mask = 0;
+        for (std::size_t i = 0; i < 4; i++) {
+            __m128i ctrl_bits = _mm_and_si128(_mm_load_si128(ctrl_ptr + i), mask_bits);
+            std::uint32_t mask16 = static_cast<std::uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl_bits, hash_bits)));
+            mask |= static_cast<std::uint64_t>(mask16) << (i * 16);
+        }
+        return mask;
+    }
+
+    CLUSTER_TARGET_SSE2
+    static std::uint64_t match_empty_sse2(const void * ctrls) {
+        return match_hash_sse2(ctrls, 0);
+    }
+
+    CLUSTER_TARGET_SSE2
+    static std::uint64_t match_used_sse2(const void * ctrls) {
+        return ~match_hash_sse2(ctrls, 0);
+    }
+
+    ///
+    /// AVX2: 2 x 32 ctrls
+    ///
+    CLUSTER_TARGET_AVX2
+    static std::uint64_t match_hash_avx2(const void * ctrls, std::uint8_t hash) {
+        const __m256i * ctrl_ptr = reinterpret_cast<const __m256i *>(ctrls);
+        __m256i mask_bits = _mm256_set1_epi8(static_cast<char>(0x7F));
+        __m256i hash_bits = _mm256_set1_epi8(static_cast<char>(hash));
+        __m256i ctrl_bits0 = _mm256_and_si256(_mm256_load_si256(ctrl_ptr + 0), mask_bits);
+        __m256i ctrl_bits1 = _mm256_and_si256(_mm256_load_si256(ctrl_ptr + 1), mask_bits);
+        std::uint32_t mask0 = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl_bits0, hash_bits)));
+        std::uint32_t mask1 = static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(ctrl_bits1, hash_bits)));
+        return (static_cast<std::uint64_t>(mask0) | (static_cast<std::uint64_t>(mask1) << 32));
+    }
+
+    CLUSTER_TARGET_AVX2
+    static std::uint64_t match_empty_avx2(const void * ctrls) {
+        return match_hash_avx2(ctrls, 0);
+    }
+
+    CLUSTER_TARGET_AVX2
+    static std::uint64_t match_used_avx2(const void * ctrls) {
+        return ~match_hash_avx2(ctrls, 0);
+    }
+
+    ///
+    /// AVX-512BW: 1 x 64 ctrls
+    ///
+    CLUSTER_TARGET_AVX512BW
+    static std::uint64_t match_hash_avx512bw(const void * ctrls, std::uint8_t hash) {
+        __m512i ctrl_bits = _mm512_load_si512(ctrls);
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(0x7F));
+        __m512i hash_bits = _mm512_set1_epi8(static_cast<char>(hash));
+        __mmask64 mask = _mm512_cmpeq_epi8_mask(_mm512_and_si512(ctrl_bits, mask_bits), hash_bits);
+        return static_cast<std::uint64_t>(mask);
+    }
+
+    CLUSTER_TARGET_AVX512BW
+    static std::uint64_t match_empty_avx512bw(const void * ctrls) {
+        __m512i ctrl_bits = _mm512_load_si512(ctrls);
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(0x7F));
+        return static_cast<std::uint64_t>(_mm512_testn_epi8_mask(ctrl_bits, mask_bits));
+    }
+
+    CLUSTER_TARGET_AVX512BW
+    static std::uint64_t match_used_avx512bw(const void * ctrls) {
+        __m512i ctrl_bits = _mm512_load_si512(ctrls);
+        __m512i mask_bits = _mm512_set1_epi8(static_cast<char>(0x7F));
+        return static_cast<std::uint64_t>(_mm512_test_epi8_mask(ctrl_bits, mask_bits));
+    }
+
+    static const cluster64_kernel & sse2() {
+        static const cluster64_kernel s_kernel = {
+            "sse2", &match_hash_sse2, &match_empty_sse2, &match_used_sse2
+        };
+        return s_kernel;
+    }
+
+    static const cluster64_kernel & avx2() {
+        static const cluster64_kernel s_kernel = {
+            "avx2", &match_hash_avx2, &match_empty_avx2, &match_used_avx2
+        };
+        return s_kernel;
+    }
+
+    static const cluster64_kernel & avx512bw() {
+        static const cluster64_kernel s_kernel = {
+            "avx512bw", &match_hash_avx512bw, &match_empty_avx512bw, &match_used_avx512bw
+        };
+        return s_kernel;
+    }
+
+    static const cluster64_kernel & select() {
+        const CPUFeatures & cpu = CPUFeatures::get();
+        if (cpu.hasAVX512BW)
+            return avx512bw();
+        else if (cpu.hasAVX2)
+            return avx2();
+        else
+            return sse2();
+    }
+
+    //
+    // Chosen once, at the first use.
+    //
+    static const cluster64_kernel & current() {
+        static const cluster64_kernel & s_kernel = select();
+        return s_kernel;
+    }
+};
+
+//
+// A 64 ctrls group (one cache line) whose match kernels are chosen at runtime
+// by the CPU features (SSE2, AVX2 or AVX-512BW), for the binaries which
+// can't be compiled with -march=native. The table keeps the kernel chosen
+// at its construction (see cluster_kernel_traits), each match is an indirect call.
+//
+template <typename T>
+class JSTD_DLL flat_map_cluster64_dispatch : public flat_map_cluster_base<T, 64>
+{
+public:
+    typedef flat_map_cluster_base<T, 64>    base_type;
+    typedef typename base_type::ctrl_type   ctrl_type;
+    typedef typename base_type::value_type  value_type;
+    typedef typename base_type::hash_type   hash_type;
+    typedef std::uint64_t                   bitmask_type;
+    typedef cluster64_kernel                kernel_type;
+
+    static constexpr std::uint8_t kHashMask     = ctrl_type::kHashMask;
+    static constexpr std::uint8_t kEmptySlot    = ctrl_type::kEmptySlot;
+    static constexpr std::uint8_t kOverflowMask = ctrl_type::kOverflowMask;
+
+    static constexpr std::size_t kGroupWidth = base_type::kGroupWidth;
+
+    static_assert((kHashMask == 0x7F && kEmptySlot == 0),
+                  "flat_map_cluster64_dispatch<T>: the kernels require kHashMask = 0x7F and kEmptySlot = 0.");
+
+    flat_map_cluster64_dispatch() {}
+    ~flat_map_cluster64_dispatch() {}
+
+    static inline std::size_t bsf(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsf64(mask));
+    }
+
+    static inline std::size_t bsr(bitmask_type mask) {
+        return static_cast<std::size_t>(BitUtils::bsr64(mask));
+    }
+
+    static inline bitmask_type clear_low_bit(bitmask_type mask) {
+        return BitUtils::clearLowBit64(mask);
+    }
+
+    static const kernel_type & kernel() {
+        return cluster64_kernels::current();
+    }
+
+    static const char * kernel_name() {
+        return cluster64_kernels::current().name;
+    }
+
+    void init() {
+        std::memset(reinterpret_cast<void *>(this->ctrls), kEmptySlot, sizeof(this->ctrls));
+    }
+
+    inline bitmask_type match_empty(const kernel_type & kernel) const {
+        return kernel.match_empty(this->ctrls);
+    }
+
+    inline bitmask_type match_used(const kernel_type & kernel) const {
+        return kernel.match_used(this->ctrls);
+    }
+
+    inline bitmask_type match_hash(const kernel_type & kernel, hash_type hash) const {
+        return kernel.match_hash(this->ctrls, hash);
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_IS_X86
+
+#endif // JSTD_HASHMAP_FLAT_MAP_CLUSTER_DISPATCH_HPP
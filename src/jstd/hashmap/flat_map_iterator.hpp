@@ -108,6 +108,9 @@ public:
     flat_map_iterator(const slot_type * slot) noexcept
         : owner_(nullptr), index_(0) {
     }
+    flat_map_iterator(const hashmap_type * owner, const slot_type * slot) noexcept
+        : owner_(owner), index_(static_cast<ssize_type>(owner->index_of(slot))) {
+    }
     flat_map_iterator(const flat_map_iterator & src) noexcept
         : owner_(src.owner_), index_(src.index()) {
     }
@@ -145,7 +148,7 @@ public:
 
     flat_map_iterator & operator ++ () {
 #if ITERATOR_USE_GROUP_SCAN
-        ssize_type next_used_index = this->owner_->skip_empty_slots(this->index_);
+        ssize_type next_used_index = this->owner_->skip_empty_slots(this->index_ + 1);
         this->index_ = next_used_index;
         return *this;
 #else
@@ -229,22 +232,22 @@ public:
     }
 
     ctrl_type * ctrl() {
-        ctrl_type * _ctrl = const_cast<ctrl_type *>(this->owner_)->ctrl_at(this->index_);
-        return _ctrl;
+        const ctrl_type * _ctrl = this->owner_->iterator_ctrl_at(this->index_);
+        return const_cast<ctrl_type *>(_ctrl);
     }
 
     const ctrl_type * ctrl() const {
-        const ctrl_type * _ctrl = this->owner_->ctrl_at(this->index_);
+        const ctrl_type * _ctrl = this->owner_->iterator_ctrl_at(this->index_);
         return _ctrl;
     }
 
     slot_type * slot() {
-        const slot_type * _slot = this->owner_->slot_at(this->index_);
+        const slot_type * _slot = this->owner_->iterator_slot_at(this->index_);
         return const_cast<slot_type *>(_slot);
     }
 
     const slot_type * slot() const {
-        const slot_type * _slot = this->owner_->slot_at(this->index_);
+        const slot_type * _slot = this->owner_->iterator_slot_at(this->index_);
         return _slot;
     }
 };
@@ -276,36 +279,45 @@ public:
     using difference_type = typename HashMap::difference_type;
 
 private:
-    const slot_type * slot_;
+    // The owner is only used to step from the old slots of an incremental rehash
+    // into the new slots, see HashMap::next_used_slot().
+    const hashmap_type * owner_;
+    const slot_type *    slot_;
 
 public:
-    flat_map_iterator() noexcept : slot_(nullptr) {
+    flat_map_iterator() noexcept : owner_(nullptr), slot_(nullptr) {
     }
     flat_map_iterator(slot_type * slot) noexcept
-        : slot_(const_cast<const slot_type *>(slot)) {
+        : owner_(nullptr), slot_(const_cast<const slot_type *>(slot)) {
     }
     flat_map_iterator(const slot_type * slot) noexcept
-        : slot_(slot) {
+        : owner_(nullptr), slot_(slot) {
+    }
+    flat_map_iterator(const hashmap_type * owner, const slot_type * slot) noexcept
+        : owner_(owner), slot_(slot) {
     }
     flat_map_iterator(hashmap_type * owner, size_type index) noexcept
-        : slot_(owner->slot_at(index)) {
+        : owner_(const_cast<const hashmap_type *>(owner)),
+          slot_(owner->iterator_slot_at(index)) {
     }
     flat_map_iterator(const hashmap_type * owner, size_type index) noexcept
-        : slot_(owner->slot_at(index)) {
+        : owner_(owner), slot_(owner->iterator_slot_at(index)) {
     }
     flat_map_iterator(const flat_map_iterator & src) noexcept
-        : slot_(src.slot()) {
+        : owner_(src.owner()), slot_(src.slot()) {
     }
     flat_map_iterator(const opp_flat_map_iterator & src) noexcept
-        : slot_(src.slot()) {
+        : owner_(src.owner()), slot_(src.slot()) {
     }
 
     flat_map_iterator & operator = (const flat_map_iterator & rhs) noexcept {
+        this->owner_ = rhs.owner();
         this->slot_ = rhs.slot();
         return *this;
     }
 
     flat_map_iterator & operator = (const opp_flat_map_iterator & rhs) noexcept {
+        this->owner_ = rhs.owner();
         this->slot_ = rhs.slot();
         return *this;
     }
@@ -327,7 +339,10 @@ public:
     }
 
     flat_map_iterator & operator ++ () {
-        ++(this->slot_);
+        if (!HashMap::kIsIncrementalRehash)
+            ++(this->slot_);
+        else
+            this->slot_ = this->owner_->next_used_slot(this->slot_);
         return *this;
     }
 
@@ -368,6 +383,10 @@ public:
         return 0;
     }
 
+    const hashmap_type * owner() const {
+        return this->owner_;
+    }
+
     slot_type * slot() {
         return const_cast<slot_type *>(this->slot_);
     }
@@ -19,6 +19,9 @@
 #include <cmath>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
 
 #include "jstd/traits/type_traits.h"
 #include "jstd/string/string_utils.h"
@@ -99,13 +102,133 @@ public:
         }
     };
 
+    //
+    // The analysis of the group-based open addressing maps, the groups are
+    // the aligned runs of group_width() slots.
+    //
+    struct ClusterResult {
+        bool     isInited;
+        bool     hasOverflow;
+
+        size_type entry_size;
+        size_type slot_capacity;
+        size_type group_width;
+        size_type group_capacity;
+
+        std::vector<size_type> group_occupancy;     // group count by the used slots
+        std::vector<size_type> displacements;       // entry count by the probed groups - 1
+
+        size_type displaced_count;
+        size_type max_displacement;
+        size_type overflow_groups;
+        size_type overflow_marks;
+        size_type probed_slots;
+        size_type false_positives;
+
+        double displaced_rate;
+        double avg_displacement;
+        double overflow_saturation;
+        double overflow_bit_rate;
+        double false_positive_rate;
+        double false_positives_per_key;
+
+        ClusterResult() {
+            this->reset();
+        }
+        ~ClusterResult() {}
+
+        void reset() {
+            isInited = false;
+            hasOverflow = false;
+
+            entry_size = 0;
+            slot_capacity = 0;
+            group_width = 0;
+            group_capacity = 0;
+
+            group_occupancy.clear();
+            displacements.clear();
+
+            displaced_count = 0;
+            max_displacement = 0;
+            overflow_groups = 0;
+            overflow_marks = 0;
+            probed_slots = 0;
+            false_positives = 0;
+
+            displaced_rate = 0.0;
+            avg_displacement = 0.0;
+            overflow_saturation = 0.0;
+            overflow_bit_rate = 0.0;
+            false_positive_rate = 0.0;
+            false_positives_per_key = 0.0;
+        }
+    };
+
 private:
+    static constexpr std::uint8_t kUnusedSlot = 0xFF;
+
+    struct SlotLayout {
+        size_type    probe_start;
+        std::uint8_t ctrl_hash;
+        bool         used;
+    };
+
+    struct SlotLayoutRecorder {
+        std::vector<SlotLayout> * layouts;
+
+        void operator () (size_type slot_index, size_type probe_start, std::uint8_t ctrl_hash) {
+            if (slot_index >= layouts->size()) {
+                layouts->resize(slot_index + 1, SlotLayout{ 0, kUnusedSlot, false });
+            }
+            SlotLayout & layout = (*layouts)[slot_index];
+            layout.probe_start = probe_start;
+            layout.ctrl_hash = ctrl_hash;
+            layout.used = true;
+        }
+    };
+
+    template <typename T>
+    struct has_visit_slot_layout {
+        template <typename U>
+        static constexpr auto check(void *)
+            -> decltype(std::declval<const U &>().visit_slot_layout(std::declval<SlotLayoutRecorder &>()), true) {
+            return true;
+        }
+
+        template <typename>
+        static constexpr bool check(...) {
+            return false;
+        }
+
+        static constexpr bool value = check<T>(nullptr);
+    };
+
+    template <typename T>
+    struct has_group_overflow {
+        template <typename U>
+        static constexpr auto check(void *)
+            -> decltype(std::declval<const U &>().group_overflow(size_type(0)), true) {
+            return true;
+        }
+
+        template <typename>
+        static constexpr bool check(...) {
+            return false;
+        }
+
+        static constexpr bool value = check<T>(nullptr);
+    };
+
     const container_type &  container_;
     std::string             name_;
 
     std::vector<size_type>  bucket_counts_;
     Result                  result_;
 
+    std::vector<SlotLayout> slot_layouts_;
+    ClusterResult           cluster_result_;
+
 public:
     HashMapAnalyzer(const container_type & container)
         : container_(container) {}
@@ -353,7 +476,116 @@ private:
         return (perfect_rate * 100.0);
     }
 
+    bool read_slot_layouts(std::true_type) {
+        size_type group_width = container_type::group_width();
+        this->slot_layouts_.clear();
+        this->slot_layouts_.resize(this->container_.slot_capacity(), SlotLayout{ 0, kUnusedSlot, false });
+
+        SlotLayoutRecorder recorder{ &this->slot_layouts_ };
+        this->container_.visit_slot_layout(recorder);
+
+        // Pad the layouts to whole groups, the extra slots are unused.
+        size_type slot_capacity = this->slot_layouts_.size();
+        size_type group_capacity = (slot_capacity + group_width - 1) / group_width;
+
+        cluster_result_.slot_capacity  = slot_capacity;
+        cluster_result_.group_width    = group_width;
+        cluster_result_.group_capacity = group_capacity;
+        return true;
+    }
+
+    bool read_slot_layouts(std::false_type) {
+        return false;
+    }
+
+    void read_group_overflows(std::true_type) {
+        cluster_result_.hasOverflow = true;
+        for (size_type group_index = 0; group_index < this->container_.group_capacity(); group_index++) {
+            size_type overflow_marks = this->container_.group_overflow(group_index);
+            if (overflow_marks != 0) {
+                cluster_result_.overflow_groups++;
+                cluster_result_.overflow_marks += (std::min)(overflow_marks, cluster_result_.group_width);
+            }
+        }
+    }
+
+    void read_group_overflows(std::false_type) {
+        cluster_result_.hasOverflow = false;
+    }
+
+    void calc_group_occupancy() {
+        size_type group_width = cluster_result_.group_width;
+        size_type slot_capacity = cluster_result_.slot_capacity;
+
+        cluster_result_.group_occupancy.assign(group_width + 1, 0);
+        for (size_type slot_base = 0; slot_base < slot_capacity; slot_base += group_width) {
+            size_type used_count = 0;
+            size_type slot_last = (std::min)(slot_base + group_width, slot_capacity);
+            for (size_type slot_index = slot_base; slot_index < slot_last; slot_index++) {
+                if (this->slot_layouts_[slot_index].used)
+                    used_count++;
+            }
+            cluster_result_.group_occupancy[used_count]++;
+        }
+    }
+
+    //
+    // Walk the probe sequence of every element, from its probe start to itself.
+    // The ctrl hash matches of the other elements on the way are the false
+    // positives, which a successful lookup has to compare the keys with.
+    //
+    void calc_probe_sequences() {
+        size_type group_width = cluster_result_.group_width;
+        size_type slot_capacity = cluster_result_.slot_capacity;
+
+        size_type entry_size = 0;
+        size_type total_displacement = 0;
+        for (size_type slot_index = 0; slot_index < slot_capacity; slot_index++) {
+            const SlotLayout & layout = this->slot_layouts_[slot_index];
+            if (!layout.used)
+                continue;
+            entry_size++;
+
+            size_type distance = (slot_index + slot_capacity - layout.probe_start) % slot_capacity;
+            size_type displacement = distance / group_width;
+            if (displacement >= cluster_result_.displacements.size())
+                cluster_result_.displacements.resize(displacement + 1, 0);
+            cluster_result_.displacements[displacement]++;
+            if (displacement > 0)
+                cluster_result_.displaced_count++;
+            if (displacement > cluster_result_.max_displacement)
+                cluster_result_.max_displacement = displacement;
+            total_displacement += displacement;
+
+            size_type probe_index = layout.probe_start;
+            for (size_type i = 0; i < distance; i++) {
+                const SlotLayout & other = this->slot_layouts_[probe_index];
+                if (other.used) {
+                    cluster_result_.probed_slots++;
+                    if (other.ctrl_hash == layout.ctrl_hash)
+                        cluster_result_.false_positives++;
+                }
+                probe_index++;
+                if (probe_index >= slot_capacity)
+                    probe_index = 0;
+            }
+        }
+
+        cluster_result_.entry_size = entry_size;
+        if (entry_size != 0) {
+            cluster_result_.displaced_rate = (double)cluster_result_.displaced_count / entry_size * 100.0;
+            cluster_result_.avg_displacement = (double)total_displacement / entry_size;
+            cluster_result_.false_positives_per_key = (double)cluster_result_.false_positives / entry_size;
+        }
+        if (cluster_result_.probed_slots != 0) {
+            cluster_result_.false_positive_rate =
+                (double)cluster_result_.false_positives / cluster_result_.probed_slots * 100.0;
+        }
+    }
+
 public:
+    static constexpr bool kIsClusterSupported = has_visit_slot_layout<container_type>::value;
+
     bool start_analyse() {
         result_.reset();
 
@@ -417,6 +649,96 @@ public:
         printf("\n");
     }
 
+    //
+    // The bucket analysis is meaningless for the group-based maps, their
+    // bucket_size() is always 1, so analyse the groups and probe sequences.
+    // It needs the container supports visit_slot_layout(visitor).
+    //
+    bool start_cluster_analyse() {
+        cluster_result_.reset();
+
+        bool supported = this->read_slot_layouts(
+            std::integral_constant<bool, kIsClusterSupported>{});
+        if (!supported)
+            return false;
+
+        this->read_group_overflows(
+            std::integral_constant<bool, has_group_overflow<container_type>::value>{});
+
+        this->calc_group_occupancy();
+        this->calc_probe_sequences();
+        this->slot_layouts_.clear();
+        this->slot_layouts_.shrink_to_fit();
+
+        if (cluster_result_.hasOverflow && cluster_result_.group_capacity != 0) {
+            cluster_result_.overflow_saturation =
+                (double)cluster_result_.overflow_groups / cluster_result_.group_capacity * 100.0;
+            cluster_result_.overflow_bit_rate = (double)cluster_result_.overflow_marks /
+                (cluster_result_.group_capacity * cluster_result_.group_width) * 100.0;
+        }
+
+        cluster_result_.isInited = true;
+        return true;
+    }
+
+    const ClusterResult & cluster_result() const {
+        return this->cluster_result_;
+    }
+
+    void display_cluster_status() {
+        printf("--------------------------------------------------------------\n");
+        printf("  %s (cluster)\n", this->name().c_str());
+        printf("--------------------------------------------------------------\n");
+        printf("\n");
+
+        if (!this->cluster_result_.isInited) {
+            printf("  Unsupported or not analysed.\n\n");
+            return;
+        }
+
+        const ClusterResult & result = this->cluster_result_;
+        size_type group_capacity = (result.group_capacity != 0) ? result.group_capacity : 1;
+        size_type entry_size = (result.entry_size != 0) ? result.entry_size : 1;
+
+        printf("  entry_size       = %" PRIuPTR "\n", result.entry_size);
+        printf("  slot_capacity    = %" PRIuPTR "\n", result.slot_capacity);
+        printf("  group_width      = %" PRIuPTR "\n", result.group_width);
+        printf("  group_capacity   = %" PRIuPTR "\n", result.group_capacity);
+        printf("\n");
+        printf("  displaced_rate   = %6.2f %%  - outside the home group\n", result.displaced_rate);
+        printf("  avg_displacement = %0.6f groups\n", result.avg_displacement);
+        printf("  max_displacement = %" PRIuPTR " groups\n", result.max_displacement);
+        if (result.hasOverflow) {
+            printf("  overflow_groups  = %6.2f %%  (%" PRIuPTR " groups)\n",
+                                         result.overflow_saturation, result.overflow_groups);
+            printf("  overflow_bits    = %6.2f %%\n", result.overflow_bit_rate);
+        } else {
+            printf("  overflow_groups  =    N/A\n");
+        }
+        printf("  false_positive   = %6.2f %%  - ctrl hash matches of the other probed entries\n",
+                                     result.false_positive_rate);
+        printf("  false_pos / key  = %0.6f\n", result.false_positives_per_key);
+        printf("\n");
+
+        printf("  group occupancy:\n");
+        for (size_type used = 0; used < result.group_occupancy.size(); used++) {
+            size_type count = result.group_occupancy[used];
+            printf("    [%2" PRIuPTR "] = %-10" PRIuPTR " %6.2f %%\n", used, count,
+                   (double)count / group_capacity * 100.0);
+        }
+        printf("\n");
+
+        printf("  displacement (groups):\n");
+        for (size_type groups = 0; groups < result.displacements.size(); groups++) {
+            size_type count = result.displacements[groups];
+            if (count == 0)
+                continue;
+            printf("    [%2" PRIuPTR "] = %-10" PRIuPTR " %6.2f %%\n", groups, count,
+                   (double)count / entry_size * 100.0);
+        }
+        printf("\n");
+    }
+
     void dump_entries(uint32_t max_entries = 0) {
         printf("\n");
         printf("   #       hash     index     key                            value\n");
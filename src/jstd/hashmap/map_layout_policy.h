@@ -52,4 +52,24 @@ struct default_layout_policy {
     static constexpr bool needStoreHash = true;
 };
 
+//
+// Always use the indirect key and value, the entries are stored in a dense array
+// (in insertion order for cluster_flat_map, until an erase moves the last entry into
+// the erased slot), so the iteration only touches the live entries.
+//
+template <typename Key, typename Value>
+struct dense_layout_policy {
+    static constexpr bool autoDetectPairLayout = true;
+    static constexpr bool isIsolatedKeyValue = false;
+
+    static constexpr bool autoDetectIsIndirectKey = false;
+    static constexpr bool isIndirectKey = true;
+
+    static constexpr bool autoDetectIsIndirectValue = false;
+    static constexpr bool isIndirectValue = true;
+
+    static constexpr bool autoDetectStoreHash = true;
+    static constexpr bool needStoreHash = true;
+};
+
 } // namespace jstd
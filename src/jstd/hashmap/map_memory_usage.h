@@ -0,0 +1,148 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_MAP_MEMORY_USAGE_H
+#define JSTD_HASHMAP_MAP_MEMORY_USAGE_H
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace jstd {
+
+//
+// The memory footprint of a hash map, see memory_usage() of the maps.
+// The footprints of many maps can be summed up with operator +=.
+//
+struct map_memory_usage {
+    std::size_t object_bytes  = 0;  // sizeof(map)
+    std::size_t ctrl_bytes    = 0;  // The ctrl bytes, and the other per group metadata
+    std::size_t slot_bytes    = 0;  // The slot array
+    std::size_t padding_bytes = 0;  // The alignment padding and the sentinel groups
+    std::size_t heap_bytes    = 0;  // The heap memory owned by the keys and values, see heap_usage<T>
+
+    // The bytes allocated by the map itself.
+    std::size_t table_bytes() const noexcept {
+        return (this->ctrl_bytes + this->slot_bytes + this->padding_bytes);
+    }
+
+    std::size_t total() const noexcept {
+        return (this->object_bytes + this->table_bytes() + this->heap_bytes);
+    }
+
+    map_memory_usage & operator += (const map_memory_usage & other) noexcept {
+        this->object_bytes  += other.object_bytes;
+        this->ctrl_bytes    += other.ctrl_bytes;
+        this->slot_bytes    += other.slot_bytes;
+        this->padding_bytes += other.padding_bytes;
+        this->heap_bytes    += other.heap_bytes;
+        return *this;
+    }
+};
+
+//
+// The customization point of the heap memory owned by a key or value, specialize
+// it for the user types. The value is false if the type never owns heap memory,
+// then the maps don't need to walk the elements.
+//
+template <typename T, typename Enable = void>
+struct heap_usage : public std::false_type {
+    static std::size_t bytes(const T & value) noexcept {
+        (void)value;
+        return 0;
+    }
+};
+
+template <typename T>
+inline std::size_t heap_usage_of(const T & value) noexcept {
+    return heap_usage<typename std::remove_cv<T>::type>::bytes(value);
+}
+
+template <typename CharT, typename Traits, typename Allocator>
+struct heap_usage<std::basic_string<CharT, Traits, Allocator>> : public std::true_type {
+    static std::size_t bytes(const std::basic_string<CharT, Traits, Allocator> & str) noexcept {
+        // The short string is stored in the string object itself.
+        const char * data = reinterpret_cast<const char *>(str.data());
+        const char * first = reinterpret_cast<const char *>(&str);
+        if (data >= first && data < (first + sizeof(str)))
+            return 0;
+        else
+            return ((str.capacity() + 1) * sizeof(CharT));
+    }
+};
+
+template <typename T, typename Allocator>
+struct heap_usage<std::vector<T, Allocator>> : public std::true_type {
+    static std::size_t bytes(const std::vector<T, Allocator> & vec) noexcept {
+        std::size_t total_bytes = vec.capacity() * sizeof(T);
+        if (heap_usage<typename std::remove_cv<T>::type>::value) {
+            for (const auto & value : vec) {
+                total_bytes += heap_usage_of(value);
+            }
+        }
+        return total_bytes;
+    }
+};
+
+template <typename T1, typename T2>
+struct heap_usage<std::pair<T1, T2>>
+    : public std::integral_constant<bool, heap_usage<typename std::remove_cv<T1>::type>::value ||
+                                          heap_usage<typename std::remove_cv<T2>::type>::value> {
+    static std::size_t bytes(const std::pair<T1, T2> & pair) noexcept {
+        return (heap_usage_of(pair.first) + heap_usage_of(pair.second));
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_MAP_MEMORY_USAGE_H
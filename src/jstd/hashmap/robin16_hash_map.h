@@ -79,6 +79,7 @@
 #include "jstd/support/BitUtils.h"
 #include "jstd/support/Power2.h"
 #include "jstd/support/BitVec.h"
+#include "jstd/hashmap/map_memory_usage.h"
 
 #ifdef _MSC_VER
 #ifndef __SSE2__
@@ -1498,10 +1499,50 @@ public:
         return index;
     }
 
+    static constexpr size_type group_width() noexcept { return kGroupWidth; }
+
+    //
+    // Call visitor(slot_index, probe_start, ctrl_hash) for each element,
+    // the lookup of the element begins probing at its home slot.
+    //
+    template <typename Visitor>
+    void visit_slot_layout(Visitor && visitor) const {
+        if (!this->is_valid())
+            return;
+        for (size_type slot_index = 0; slot_index < this->slot_capacity(); slot_index++) {
+            const ctrl_type * ctrl = this->ctrl_at(slot_index);
+            if (ctrl->isUsed()) {
+                const slot_type * slot = this->slot_at(slot_index);
+                size_type probe_start = this->index_for_hash(this->get_hash(slot->value.first));
+                visitor(slot_index, probe_start, ctrl->hash);
+            }
+        }
+    }
+
     float load_factor() const {
         return ((float)this->slot_size() / this->slot_capacity());
     }
 
+    map_memory_usage memory_usage() const {
+        map_memory_usage usage;
+        usage.object_bytes = sizeof(*this);
+        if (this->is_valid()) {
+            usage.ctrl_bytes = this->slot_capacity() * sizeof(ctrl_type);
+            usage.padding_bytes = this->group_capacity() * sizeof(group_type) - usage.ctrl_bytes;
+        }
+        if (this->slots_ != nullptr) {
+            usage.slot_bytes = this->slot_capacity() * sizeof(slot_type);
+            if (heap_usage<value_type>::value) {
+                for (size_type slot_index = 0; slot_index < this->slot_capacity(); slot_index++) {
+                    if (this->ctrl_at(slot_index)->isUsed()) {
+                        usage.heap_bytes += heap_usage_of(this->slot_at(slot_index)->value);
+                    }
+                }
+            }
+        }
+        return usage;
+    }
+
     void max_load_factor(float mlf) {
         if (mlf < kMinLoadFactor)
             mlf = kMinLoadFactor;
@@ -83,6 +83,7 @@
 #include "jstd/support/Power2.h"
 #include "jstd/support/BitVec.h"
 #include "jstd/support/CPUPrefetch.h"
+#include "jstd/hashmap/map_memory_usage.h"
 
 #ifdef _MSC_VER
 #ifndef __SSE2__
@@ -3304,10 +3305,58 @@ public:
         return ctrl_index;
     }
 
+    static constexpr size_type group_width() noexcept { return kGroupWidth; }
+
+    //
+    // Call visitor(slot_index, probe_start, ctrl_hash) for each element,
+    // the lookup of the element begins probing at its home slot.
+    // If the ctrl hash isn't stored, all ctrl hashes are 0.
+    //
+    template <typename Visitor>
+    void visit_slot_layout(Visitor && visitor) const {
+        if (!this->is_valid())
+            return;
+        for (size_type ctrl_index = 0; ctrl_index < this->max_slot_capacity(); ctrl_index++) {
+            const ctrl_type * ctrl = this->ctrl_at(ctrl_index);
+            if (ctrl->isUsed()) {
+                const slot_type * slot = this->slot_at(this->index_of(ctrl));
+                hash_code_t hash_code = this->get_hash(slot->value.first);
+                visitor(ctrl_index, this->index_for_hash(hash_code), this->get_ctrl_hash(hash_code));
+            }
+        }
+    }
+
     float load_factor() const {
         return ((float)this->slot_size() / this->slot_capacity());
     }
 
+    map_memory_usage memory_usage() const {
+        map_memory_usage usage;
+        usage.object_bytes = sizeof(*this);
+        if (this->ctrls_ != this_type::default_empty_ctrls()) {
+            size_type max_ctrl_capacity = (this->group_count() + 1) * kGroupWidth;
+            usage.ctrl_bytes = this->max_slot_capacity() * sizeof(ctrl_type);
+            usage.slot_bytes = this->max_slot_capacity() * sizeof(slot_type);
+#if ROBIN_USE_SEPARATE_SLOTS
+            size_type alloc_bytes = max_ctrl_capacity * sizeof(ctrl_type) +
+                                    this->max_slot_capacity() * sizeof(slot_type);
+#else
+            size_type alloc_bytes = this->TotalAllocSize<kSlotAlignment>(max_ctrl_capacity,
+                                        this->max_slot_capacity()) * sizeof(ctrl_type);
+#endif
+            usage.padding_bytes = alloc_bytes - usage.ctrl_bytes - usage.slot_bytes;
+        }
+        if (heap_usage<value_type>::value && (this->slots_ != nullptr)) {
+            for (size_type ctrl_index = 0; ctrl_index < this->max_slot_capacity(); ctrl_index++) {
+                const ctrl_type * ctrl = this->ctrl_at(ctrl_index);
+                if (ctrl->isUsed()) {
+                    usage.heap_bytes += heap_usage_of(this->slot_at(this->index_of(ctrl))->value);
+                }
+            }
+        }
+        return usage;
+    }
+
     void max_load_factor(float mlf) {
         if (mlf < kMinLoadFactor)
             mlf = kMinLoadFactor;
@@ -4289,7 +4338,7 @@ private:
     // Given the pointer of ctrls, the capacity of a ctrl and slot,
     // computes the total allocate size of the backing array.
     template <size_type SlotAlignment>
-    inline size_type TotalAllocSize(size_type ctrl_capacity, size_type slot_capacity) {
+    inline size_type TotalAllocSize(size_type ctrl_capacity, size_type slot_capacity) const {
         const size_type num_ctrl_bytes = ctrl_capacity * sizeof(ctrl_type);
         const size_type num_slot_bytes = slot_capacity * sizeof(slot_type);
         const size_type total_bytes = num_ctrl_bytes + SlotAlignment + num_slot_bytes;
@@ -0,0 +1,138 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_RUN_IN_THREADS_HPP
+#define JSTD_HASHMAP_RUN_IN_THREADS_HPP
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <exception>            // For std::exception_ptr
+#include <thread>
+#include <utility>              // For std::forward()
+
+namespace jstd {
+
+//
+// Call func(t) by thread_count threads, t = [0, thread_count), the calling thread runs t = 0,
+// see cluster_flat_table::parallel_build(), the parallel rehash and
+// sharded_cluster_flat_map::parallel_for_each().
+// The first exception of the threads is rethrown after all threads are joined and
+// on_joined() is called.
+//
+// The workers wait until all of them are created. If a thread can't be created,
+// the created ones are joined without calling func(), and it returns false,
+// the caller does the work serially then.
+//
+template <typename Func, typename JoinedFunc>
+bool run_in_threads(std::size_t thread_count, Func && func, JoinedFunc && on_joined)
+{
+    std::vector<std::exception_ptr> errors(thread_count);
+    auto run = [&func, &errors](std::size_t t) {
+        try {
+            func(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    // 0: the workers are being created, 1: run, -1: cancelled.
+    std::atomic<int> start_state(0);
+    auto run_worker = [&run, &start_state](std::size_t t) {
+        int state;
+        while ((state = start_state.load(std::memory_order_acquire)) == 0) {
+            std::this_thread::yield();
+        }
+        if (state > 0) {
+            run(t);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    bool is_started = true;
+    try {
+        workers.reserve(thread_count - 1);
+        for (std::size_t t = 1; t < thread_count; t++) {
+            workers.emplace_back(run_worker, t);
+        }
+    } catch (...) {
+        // std::system_error or std::bad_alloc
+        is_started = false;
+    }
+
+    start_state.store(is_started ? 1 : -1, std::memory_order_release);
+    if (is_started) {
+        run(0);
+    }
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+    if (!is_started) {
+        return false;
+    }
+
+    on_joined();
+    for (std::exception_ptr & error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    return true;
+}
+
+template <typename Func>
+bool run_in_threads(std::size_t thread_count, Func && func)
+{
+    return jstd::run_in_threads(thread_count, std::forward<Func>(func), []() {});
+}
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_RUN_IN_THREADS_HPP
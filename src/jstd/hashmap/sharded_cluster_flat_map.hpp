@@ -0,0 +1,480 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_HASHMAP_SHARDED_CLUSTER_FLAT_MAP_HPP
+#define JSTD_HASHMAP_SHARDED_CLUSTER_FLAT_MAP_HPP
+
+#pragma once
+
+#include <stdint.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cmath>                // For std::sqrt()
+#include <memory>               // For std::allocator<T>
+#include <functional>           // For std::hash<Key>
+#include <type_traits>
+#include <utility>              // For std::pair<F, S>
+#include <algorithm>            // For std::min()
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hashmap/map_memory_usage.h"
+#include "jstd/hashmap/run_in_threads.hpp"
+
+namespace jstd {
+
+//
+// A front-end of Shards independent cluster_flat_maps shared by threads, each shard has
+// its own std::shared_mutex and grows by itself, so a rehash only stalls 1/Shards of
+// the keys. The shards are padded to the cache line, they don't share the lines.
+//
+// The shard is selected by the high bits of a remix of the hash code (see prehash()),
+// the remix is independent of the index and the ctrl hash of the shard, so the keys of
+// a shard still spread over its groups. The hash code is passed to the shard, the key
+// is only hashed once.
+//
+template <typename Key, typename Value, std::size_t Shards = 16,
+          typename Hash = std::hash< typename std::remove_const<Key>::type >,
+          typename KeyEqual = std::equal_to< typename std::remove_const<Key>::type >,
+          typename Allocator = std::allocator< std::pair<const typename std::remove_const<Key>::type,
+                                                         typename std::remove_const<Value>::type> >,
+          typename Group = flat_map_cluster16<cluster_meta_ctrl>,
+          typename LayoutPolicy = jstd::default_layout_policy<Key, Value> >
+class sharded_cluster_flat_map
+{
+public:
+    typedef cluster_flat_map<Key, Value, Hash, KeyEqual, Allocator, Group, LayoutPolicy> map_type;
+
+    typedef typename map_type::size_type        size_type;
+    typedef typename map_type::key_type         key_type;
+    typedef typename map_type::mapped_type      mapped_type;
+    typedef typename map_type::value_type       value_type;
+    typedef typename map_type::init_type        init_type;
+    typedef typename map_type::hasher           hasher;
+    typedef typename map_type::key_equal        key_equal;
+    typedef typename map_type::allocator_type   allocator_type;
+
+    typedef typename map_type::iterator         iterator;
+    typedef typename map_type::const_iterator   const_iterator;
+
+    using this_type = sharded_cluster_flat_map<Key, Value, Shards, Hash, KeyEqual,
+                                               Allocator, Group, LayoutPolicy>;
+
+    static constexpr size_type kShards = Shards;
+    static constexpr size_type kCacheLineSize = 64;
+
+    static_assert(((kShards & (kShards - 1)) == 0) && (kShards >= 2),
+                  "jstd::sharded_cluster_flat_map<K, V, Shards>: Shards must be power of 2 and >= 2.");
+
+private:
+    static constexpr size_type log2_of(size_type n) noexcept {
+        return (n <= 1) ? 0 : (1 + this_type::log2_of(n / 2));
+    }
+
+    static constexpr size_type kShardBits = this_type::log2_of(kShards);
+
+    // It's an odd multiplier other than the golden ratio of fibonacci_hash_policy.
+    static constexpr std::uint64_t kShardMultiplier = 0xD6E8FEB86659FD93ull;
+
+    typedef std::shared_mutex                   mutex_type;
+    typedef std::shared_lock<mutex_type>        shared_lock;
+    typedef std::unique_lock<mutex_type>        unique_lock;
+
+    struct alignas(kCacheLineSize) shard_type {
+        mutable mutex_type  mutex;
+        map_type            map;
+    };
+
+    shard_type  shards_[kShards];
+
+public:
+    sharded_cluster_flat_map() : sharded_cluster_flat_map(0) {}
+
+    explicit sharded_cluster_flat_map(size_type capacity, hasher const & hash = hasher(),
+                                      key_equal const & pred = key_equal(),
+                                      allocator_type const & allocator = allocator_type()) {
+        size_type shard_capacity = this_type::shard_capacity_for(capacity);
+        for (size_type i = 0; i < kShards; i++) {
+            this->shards_[i].map = map_type(shard_capacity, hash, pred, allocator);
+        }
+    }
+
+    sharded_cluster_flat_map(sharded_cluster_flat_map const &) = delete;
+    sharded_cluster_flat_map & operator = (sharded_cluster_flat_map const &) = delete;
+
+    ~sharded_cluster_flat_map() {}
+
+    ///
+    /// Observers
+    ///
+    static constexpr size_type shard_count() noexcept {
+        return kShards;
+    }
+
+    std::size_t prehash(const key_type & key) const {
+        return this->shards_[0].map.prehash(key);
+    }
+
+    //
+    // Return the shard of the key, it's [0, shard_count()).
+    //
+    size_type shard_index(const key_type & key) const {
+        return this_type::shard_for_hash(this->prehash(key));
+    }
+
+    ///
+    /// Capacity
+    ///
+    bool empty() const {
+        return (this->size() == 0);
+    }
+
+    //
+    // The shards are locked one by one, so it isn't a snapshot.
+    //
+    size_type size() const {
+        size_type total = 0;
+        for (size_type i = 0; i < kShards; i++) {
+            const shard_type & shard = this->shards_[i];
+            shared_lock lock(shard.mutex);
+            total += shard.map.size();
+        }
+        return total;
+    }
+
+    size_type capacity() const {
+        size_type total = 0;
+        for (size_type i = 0; i < kShards; i++) {
+            const shard_type & shard = this->shards_[i];
+            shared_lock lock(shard.mutex);
+            total += shard.map.capacity();
+        }
+        return total;
+    }
+
+    size_type shard_size(size_type index) const {
+        assert(index < kShards);
+        const shard_type & shard = this->shards_[index];
+        shared_lock lock(shard.mutex);
+        return shard.map.size();
+    }
+
+    //
+    // Reserve the room of new_capacity elements in total, each shard gets its share
+    // plus the room of the unevenness of the hash codes.
+    //
+    void reserve(size_type new_capacity) {
+        size_type shard_capacity = this_type::shard_capacity_for(new_capacity);
+        for (size_type i = 0; i < kShards; i++) {
+            shard_type & shard = this->shards_[i];
+            unique_lock lock(shard.mutex);
+            shard.map.reserve(shard_capacity);
+        }
+    }
+
+    void rehash(size_type new_capacity) {
+        size_type shard_capacity = this_type::shard_capacity_for(new_capacity);
+        for (size_type i = 0; i < kShards; i++) {
+            shard_type & shard = this->shards_[i];
+            unique_lock lock(shard.mutex);
+            shard.map.rehash(shard_capacity);
+        }
+    }
+
+    void shrink_to_fit() {
+        for (size_type i = 0; i < kShards; i++) {
+            shard_type & shard = this->shards_[i];
+            unique_lock lock(shard.mutex);
+            shard.map.shrink_to_fit();
+        }
+    }
+
+    void clear() {
+        for (size_type i = 0; i < kShards; i++) {
+            shard_type & shard = this->shards_[i];
+            unique_lock lock(shard.mutex);
+            shard.map.clear();
+        }
+    }
+
+    ///
+    /// Memory usage
+    ///
+    map_memory_usage memory_usage() const {
+        map_memory_usage usage;
+        for (size_type i = 0; i < kShards; i++) {
+            const shard_type & shard = this->shards_[i];
+            shared_lock lock(shard.mutex);
+            map_memory_usage shard_usage = shard.map.memory_usage();
+            // The shard objects are counted by sizeof(*this).
+            shard_usage.object_bytes = 0;
+            usage += shard_usage;
+        }
+        usage.object_bytes = sizeof(*this);
+        return usage;
+    }
+
+    ///
+    /// Lookup
+    ///
+    size_type count(const key_type & key) const {
+        return (this->contains(key) ? 1 : 0);
+    }
+
+    bool contains(const key_type & key) const {
+        std::size_t hash_code = this->prehash(key);
+        const shard_type & shard = this->shard_for(hash_code);
+        shared_lock lock(shard.mutex);
+        return (shard.map.find(key, hash_code) != shard.map.end());
+    }
+
+    //
+    // Copy the mapped value out, return false if the key is not exists.
+    //
+    bool find(const key_type & key, mapped_type & value) const {
+        return this->visit(key, [&value](const value_type & kv) {
+            value = kv.second;
+        });
+    }
+
+    //
+    // Call visitor(value_type &) under the exclusive shard lock if the key exists.
+    //
+    template <typename Visitor>
+    bool visit(const key_type & key, Visitor && visitor) {
+        std::size_t hash_code = this->prehash(key);
+        shard_type & shard = this->shard_for(hash_code);
+        unique_lock lock(shard.mutex);
+        iterator iter = shard.map.find(key, hash_code);
+        if (iter != shard.map.end()) {
+            visitor(*iter);
+            return true;
+        }
+        return false;
+    }
+
+    //
+    // Call visitor(const value_type &) under the shared shard lock if the key exists.
+    //
+    template <typename Visitor>
+    bool visit(const key_type & key, Visitor && visitor) const {
+        std::size_t hash_code = this->prehash(key);
+        const shard_type & shard = this->shard_for(hash_code);
+        shared_lock lock(shard.mutex);
+        const_iterator iter = shard.map.find(key, hash_code);
+        if (iter != shard.map.end()) {
+            visitor(*iter);
+            return true;
+        }
+        return false;
+    }
+
+    //
+    // Call visitor(const value_type &) for each element, shard by shard under the shared lock.
+    //
+    template <typename Visitor>
+    void for_each(Visitor && visitor) const {
+        for (size_type i = 0; i < kShards; i++) {
+            this->for_each_in_shard(i, visitor);
+        }
+    }
+
+    //
+    // The same as for_each(), but the shards are visited by thread_count threads
+    // (0 means std::thread::hardware_concurrency()), the visitor must be thread-safe.
+    //
+    // The workers wait until all of them are created, if a thread can't be created,
+    // no shard is visited by the threads and it falls back to for_each(). The first
+    // exception thrown by the visitor is rethrown after all threads are joined.
+    //
+    template <typename Visitor>
+    void parallel_for_each(Visitor && visitor, size_type thread_count = 0) const {
+        if (thread_count == 0) {
+            thread_count = static_cast<size_type>(std::thread::hardware_concurrency());
+        }
+        thread_count = (std::min)(thread_count, kShards);
+        if (thread_count <= 1) {
+            this->for_each(visitor);
+            return;
+        }
+
+        // If the threads can't be created, visit the shards serially.
+        bool is_started = jstd::run_in_threads(thread_count, [this, &visitor, thread_count](size_type t) {
+            for (size_type i = t; i < kShards; i += thread_count) {
+                this->for_each_in_shard(i, visitor);
+            }
+        });
+        if (!is_started) {
+            this->for_each(visitor);
+        }
+    }
+
+    ///
+    /// Modifiers
+    ///
+    bool insert(const value_type & value) {
+        return this->try_emplace(value.first, value.second);
+    }
+
+    bool insert(const init_type & value) {
+        return this->try_emplace(value.first, value.second);
+    }
+
+    bool insert(init_type && value) {
+        return this->try_emplace(std::move(value.first), std::move(value.second));
+    }
+
+    template <typename KeyT, typename... Args>
+    bool try_emplace(KeyT && key, Args && ... args) {
+        std::size_t hash_code = this->prehash(key);
+        shard_type & shard = this->shard_for(hash_code);
+        unique_lock lock(shard.mutex);
+        bool inserted = shard.map.try_emplace_with_hash(hash_code, std::forward<KeyT>(key),
+                                                        std::forward<Args>(args)...).second;
+        return inserted;
+    }
+
+    //
+    // Return true if the key is inserted, false if it's assigned.
+    //
+    template <typename MappedT>
+    bool insert_or_assign(const key_type & key, MappedT && value) {
+        std::size_t hash_code = this->prehash(key);
+        shard_type & shard = this->shard_for(hash_code);
+        unique_lock lock(shard.mutex);
+        iterator iter = shard.map.find(key, hash_code);
+        if (iter != shard.map.end()) {
+            iter->second = std::forward<MappedT>(value);
+            return false;
+        }
+        shard.map.try_emplace_with_hash(hash_code, key, std::forward<MappedT>(value));
+        return true;
+    }
+
+    size_type erase(const key_type & key) {
+        std::size_t hash_code = this->prehash(key);
+        shard_type & shard = this->shard_for(hash_code);
+        unique_lock lock(shard.mutex);
+        size_type erased = shard.map.erase(key, hash_code);
+        return erased;
+    }
+
+    //
+    // Erase all the elements which pred(const value_type &) returns true,
+    // return the number of the elements erased.
+    //
+    template <typename Pred>
+    size_type erase_if(Pred && pred) {
+        size_type erased = 0;
+        for (size_type i = 0; i < kShards; i++) {
+            shard_type & shard = this->shards_[i];
+            unique_lock lock(shard.mutex);
+            map_type & map = shard.map;
+            for (const_iterator iter = map.cbegin(); iter != map.cend(); ) {
+                if (pred(*iter)) {
+                    iter = map.erase(iter);
+                    erased++;
+                } else {
+                    ++iter;
+                }
+            }
+        }
+        return erased;
+    }
+
+private:
+    //
+    // The raw hash code may have weak bits, e.g. the low bits of an identity hasher
+    // for the strided keys, which fibonacci_hash_policy leaves weak, and the index or
+    // the ctrl hash of the shard may take any bits of it. So the hash code is remixed
+    // by another odd multiplier, and the shard is taken from the highest bits of the
+    // product, they depend on all bits of the hash code.
+    //
+    static size_type shard_for_hash(std::size_t hash_code) noexcept {
+        std::uint64_t remixed = static_cast<std::uint64_t>(hash_code) * kShardMultiplier;
+        return static_cast<size_type>(remixed >> (64 - kShardBits));
+    }
+
+    shard_type & shard_for(std::size_t hash_code) noexcept {
+        return this->shards_[this_type::shard_for_hash(hash_code)];
+    }
+
+    const shard_type & shard_for(std::size_t hash_code) const noexcept {
+        return this->shards_[this_type::shard_for_hash(hash_code)];
+    }
+
+    //
+    // The share of a shard, and 3 standard deviations of the binomial distribution
+    // of the keys, so the most shards don't grow before the total capacity is reached.
+    //
+    static size_type shard_capacity_for(size_type capacity) noexcept {
+        if (capacity == 0)
+            return 0;
+        size_type share = (capacity + kShards - 1) / kShards;
+        size_type deviation = static_cast<size_type>(std::sqrt(static_cast<double>(share)) * 3.0);
+        return (share + deviation);
+    }
+
+    template <typename Visitor>
+    void for_each_in_shard(size_type index, Visitor & visitor) const {
+        const shard_type & shard = this->shards_[index];
+        shared_lock lock(shard.mutex);
+        const map_type & map = shard.map;
+        for (const_iterator iter = map.cbegin(); iter != map.cend(); ++iter) {
+            visitor(*iter);
+        }
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_HASHMAP_SHARDED_CLUSTER_FLAT_MAP_HPP
@@ -9,12 +9,16 @@
 #include "jstd/basic/stddef.h"
 #include "jstd/basic/stdint.h"
 #include "jstd/basic/stdsize.h"
+#include "jstd/basic/platform.h"
 
 #include <string.h>
 #include <wchar.h>
-#include <nmmintrin.h>  // For SSE 4.2
 #include <assert.h>
 
+#if defined(JSTD_IS_X86) && defined(__SSE4_2__)
+#include <nmmintrin.h>  // For SSE 4.2
+#endif
+
 #include <cstdint>
 #include <cstddef>      // For std::size_t
 #include <string>
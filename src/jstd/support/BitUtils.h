@@ -18,7 +18,7 @@
 #endif
 
 // defined(__GNUC__) && (__GNUC__ * 1000 + __GNUC_MINOR__ >= 4005)
-#if defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))
+#if (defined(__GNUC__) || (defined(__clang__) && !defined(_MSC_VER))) && defined(JSTD_IS_X86)
 #include <x86intrin.h>
 #endif
 
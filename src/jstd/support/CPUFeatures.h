@@ -0,0 +1,117 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+  -------------------------------------------------------------------
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+************************************************************************************/
+
+#ifndef JSTD_SUPPORT_CPU_FEATURES_H
+#define JSTD_SUPPORT_CPU_FEATURES_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jstd/config/config.h"
+#include "jstd/support/CPUID.h"
+
+//
+// Runtime CPU feature detection, it's the library version of tools/cpuid/cpuid_x86.c,
+// used to choose the SIMD kernels at runtime instead of at compile time (-march=native).
+// Both of them use the cpuid and xgetbv of jstd/support/CPUID.h.
+//
+// On the non-x86 targets, all of the x86 features are reported as unsupported.
+//
+
+namespace jstd {
+
+struct CPUFeatures {
+    bool hasSSE2;
+    bool hasSSE3;
+    bool hasSSSE3;
+    bool hasSSE4_1;
+    bool hasSSE4_2;
+    bool hasPOPCNT;
+    bool hasAVX;
+    bool hasAVX2;
+    bool hasBMI1;
+    bool hasBMI2;
+    bool hasAVX512F;
+    bool hasAVX512DQ;
+    bool hasAVX512BW;
+    bool hasAVX512VL;
+
+    CPUFeatures() {
+        this->detect();
+    }
+
+    //
+    // The result is detected only once, at the first call.
+    //
+    static const CPUFeatures & get() {
+        static const CPUFeatures s_features;
+        return s_features;
+    }
+
+private:
+    void detect() {
+        hasSSE2 = hasSSE3 = hasSSSE3 = hasSSE4_1 = hasSSE4_2 = false;
+        hasPOPCNT = hasAVX = hasAVX2 = hasBMI1 = hasBMI2 = false;
+        hasAVX512F = hasAVX512DQ = hasAVX512BW = hasAVX512VL = false;
+
+#if defined(JSTD_IS_X86)
+        int eax, ebx, ecx, edx;
+        jstd_cpuid(0, &eax, &ebx, &ecx, &edx);
+        int max_leaf = eax;
+        if (max_leaf < 1)
+            return;
+
+        jstd_cpuid(1, &eax, &ebx, &ecx, &edx);
+        hasSSE2   = ((edx & (1 << 26)) != 0);
+        hasSSE3   = ((ecx & (1 <<  0)) != 0);
+        hasSSSE3  = ((ecx & (1 <<  9)) != 0);
+        hasSSE4_1 = ((ecx & (1 << 19)) != 0);
+        hasSSE4_2 = ((ecx & (1 << 20)) != 0);
+        hasPOPCNT = ((ecx & (1 << 23)) != 0);
+
+        // The OS must save the YMM (and ZMM) registers, see support_avx() in cpuid_x86.c
+        bool os_ymm_enabled = false, os_zmm_enabled = false;
+        bool cpu_avx = ((ecx & (1 << 28)) != 0);
+        bool cpu_osxsave = ((ecx & (1 << 27)) != 0);
+        if (cpu_avx && cpu_osxsave) {
+            int xcr0_eax, xcr0_edx;
+            jstd_xgetbv(0, &xcr0_eax, &xcr0_edx);
+            os_ymm_enabled = ((xcr0_eax & 0x06) == 0x06);
+            os_zmm_enabled = ((xcr0_eax & 0xE6) == 0xE6);
+        }
+        hasAVX = cpu_avx && os_ymm_enabled;
+
+        if (max_leaf >= 7) {
+            jstd_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+            hasBMI1 = ((ebx & (1 <<  3)) != 0);
+            hasBMI2 = ((ebx & (1 <<  8)) != 0);
+            hasAVX2 = hasAVX && ((ebx & (1 << 5)) != 0);
+            if (os_zmm_enabled) {
+                hasAVX512F  = ((ebx & (1 << 16)) != 0);
+                hasAVX512DQ = hasAVX512F && ((ebx & (1 << 17)) != 0);
+                hasAVX512BW = hasAVX512F && ((ebx & (1 << 30)) != 0);
+                hasAVX512VL = hasAVX512F && ((ebx & (1u << 31)) != 0);
+            }
+        }
+#endif // JSTD_IS_X86
+    }
+};
+
+} // namespace jstd
+
+#endif // JSTD_SUPPORT_CPU_FEATURES_H
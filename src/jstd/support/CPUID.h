@@ -0,0 +1,100 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+  -------------------------------------------------------------------
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+************************************************************************************/
+
+#ifndef JSTD_SUPPORT_CPUID_H
+#define JSTD_SUPPORT_CPUID_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+//
+// The cpuid and xgetbv instructions of x86. It's plain C, so it's shared by
+// jstd::CPUFeatures and the get-arch tool (tools/cpuid/cpuid_x86.c).
+//
+
+#include "jstd/basic/platform.h"
+
+#if defined(JSTD_IS_X86)
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define JSTD_CPUID_INLINE   __inline
+#else
+#define JSTD_CPUID_INLINE   inline
+#endif
+
+static JSTD_CPUID_INLINE
+void jstd_cpuid(int op, int * eax, int * ebx, int * ecx, int * edx) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int cpuInfo[4] = { -1 };
+    __cpuid(cpuInfo, op);
+
+    *eax = cpuInfo[0];
+    *ebx = cpuInfo[1];
+    *ecx = cpuInfo[2];
+    *edx = cpuInfo[3];
+#elif defined(__i386__) && defined(__PIC__)
+    __asm__ __volatile__
+    ("mov %%ebx, %%edi;"
+     "cpuid;"
+     "xchgl %%ebx, %%edi;"
+     : "=a" (*eax), "=D" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (op), "c" (0) : "cc");
+#else
+    __asm__ __volatile__
+    ("cpuid": "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (op), "c" (0) : "cc");
+#endif
+}
+
+static JSTD_CPUID_INLINE
+void jstd_cpuid_count(int op, int count, int * eax, int * ebx, int * ecx, int * edx) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int cpuInfo[4] = { -1 };
+    __cpuidex(cpuInfo, op, count);
+
+    *eax = cpuInfo[0];
+    *ebx = cpuInfo[1];
+    *ecx = cpuInfo[2];
+    *edx = cpuInfo[3];
+#elif defined(__i386__) && defined(__PIC__)
+    __asm__ __volatile__
+    ("mov %%ebx, %%edi;"
+     "cpuid;"
+     "xchgl %%ebx, %%edi;"
+     : "=a" (*eax), "=D" (*ebx), "=c" (*ecx), "=d" (*edx) : "0" (op), "2" (count) : "cc");
+#else
+    __asm__ __volatile__
+    ("cpuid": "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "0" (op), "2" (count) : "cc");
+#endif
+}
+
+static JSTD_CPUID_INLINE
+void jstd_xgetbv(int op, int * eax, int * edx) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned __int64 result = _xgetbv(op);
+    *eax = (int)(result & 0xFFFFFFFFull);
+    *edx = (int)(result >> 32);
+#else
+    // Use binary code for xgetbv
+    __asm__ __volatile__
+    (".byte 0x0f, 0x01, 0xd0": "=a" (*eax), "=d" (*edx) : "c" (op) : "cc");
+#endif
+}
+
+#endif // JSTD_IS_X86
+
+#endif // JSTD_SUPPORT_CPUID_H
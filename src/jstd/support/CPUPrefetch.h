@@ -24,6 +24,7 @@
 #endif
 
 #include "jstd/config/config.h"
+#include "jstd/basic/stddef.h"
 
 #ifdef __SSE__
 #include <xmmintrin.h>
@@ -103,6 +104,10 @@ void Prefetch_Write_Nta(const void * addr);
 // safe for all currently supported platforms. However, prefetch for
 // store may have problems depending on the target platform.
 //
+// They must be forced inline: GCC finds a wrapper of __builtin_prefetch
+// to be "looping const", so a call of it that isn't inlined early
+// is removed as dead code, with the prefetch.
+//
 
 //
 // ARM Prefetching with __builtin_prefetch()
@@ -136,25 +141,29 @@ void Prefetch_Write_Nta(const void * addr);
 //      3: (Default), High, L1 cache, leave the data in the L1, L2, and L3 cache levels after the access.
 //
 
-inline void Prefetch_Read_T0(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T0(const void * addr)
 {
     // Note: this uses prefetcht0 on Intel.
     __builtin_prefetch(addr, 0, 3);
 }
 
-inline void Prefetch_Read_T1(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T1(const void * addr)
 {
     // Note: this uses prefetcht1 on Intel.
     __builtin_prefetch(addr, 0, 2);
 }
 
-inline void Prefetch_Read_T2(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T2(const void * addr)
 {
     // Note: this uses prefetcht2 on Intel.
     __builtin_prefetch(addr, 0, 1);
 }
 
-inline void Prefetch_Read_Nta(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_Nta(const void * addr)
 {
     // Note: this uses prefetchtnta on Intel.
     __builtin_prefetch(addr, 0, 0);
@@ -162,25 +171,29 @@ inline void Prefetch_Read_Nta(const void * addr)
 
 // -----------------------------------------------------------------
 
-inline void Prefetch_Write_T0(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T0(const void * addr)
 {
     // Note: this uses prefetcht0 on Intel.
     __builtin_prefetch(addr, 1, 3);
 }
 
-inline void Prefetch_Write_T1(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T1(const void * addr)
 {
     // Note: this uses prefetcht1 on Intel.
     __builtin_prefetch(addr, 1, 2);
 }
 
-inline void Prefetch_Write_T2(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T2(const void * addr)
 {
     // Note: this uses prefetcht2 on Intel.
     __builtin_prefetch(addr, 1, 1);
 }
 
-inline void Prefetch_Write_Nta(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_Nta(const void * addr)
 {
     // Note: this uses prefetchtnta on Intel.
     __builtin_prefetch(addr, 1, 0);
@@ -190,44 +203,52 @@ inline void Prefetch_Write_Nta(const void * addr)
 
 #define JSTD_HAVE_CPU_PREFETCH  1
 
-inline void Prefetch_Read_T0(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T0(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T0);
 }
 
-inline void Prefetch_Read_T1(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T1(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T1);
 }
 
-inline void Prefetch_Read_T2(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_T2(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T2);
 }
 
-inline void Prefetch_Read_Nta(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Read_Nta(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_NTA);
 }
 
 // -----------------------------------------------------------------
 
-inline void Prefetch_Write_T0(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T0(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T0);
 }
 
-inline void Prefetch_Write_T1(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T1(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T1);
 }
 
-inline void Prefetch_Write_T2(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_T2(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_T2);
 }
 
-inline void Prefetch_Write_Nta(const void * addr)
+JSTD_FORCED_INLINE
+void Prefetch_Write_Nta(const void * addr)
 {
     _mm_prefetch(reinterpret_cast<const char *>(addr), _MM_HINT_NTA);
 }
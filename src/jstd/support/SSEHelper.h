@@ -6,6 +6,10 @@
 #pragma once
 #endif
 
+#include "jstd/basic/platform.h"
+
+#if defined(JSTD_IS_X86) && defined(__SSE4_2__)
+
 #include <nmmintrin.h>  // For SSE 4.2
 
 namespace jstd {
@@ -40,4 +44,6 @@ struct SSEHelper<wchar_t> {
 
 } // namespace jstd
 
+#endif // JSTD_IS_X86 && __SSE4_2__
+
 #endif // JSTD_SSE_HELPER_H
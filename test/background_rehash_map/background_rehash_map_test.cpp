@@ -0,0 +1,299 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "jstd/hashmap/background_rehash_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+typedef jstd::background_rehash_map<std::size_t, std::size_t>   map_type;
+typedef std::unordered_map<std::size_t, std::size_t>            ref_map_type;
+
+// The value carries its key, so a reader can tell a torn or a wrong value.
+static const std::size_t kValueScale = 1000;
+
+static std::size_t make_value(std::size_t key, std::size_t version)
+{
+    return key * kValueScale + (version % kValueScale);
+}
+
+//
+// Compare the whole map with the reference by size(), for_each() and find().
+//
+static bool is_same_map(const map_type & map, const ref_map_type & ref)
+{
+    if (map.size() != ref.size())
+        return false;
+
+    std::size_t count = 0;
+    bool passed = true;
+    map.for_each([&](const std::pair<const std::size_t, std::size_t> & kv) {
+        auto iter = ref.find(kv.first);
+        if ((iter == ref.end()) || (iter->second != kv.second))
+            passed = false;
+        count++;
+    });
+    if (!passed || (count != ref.size()))
+        return false;
+
+    for (auto iter = ref.begin(); iter != ref.end(); ++iter) {
+        std::size_t value = 0;
+        if (!map.find(iter->first, value) || (value != iter->second))
+            return false;
+    }
+    return true;
+}
+
+//
+// One random operation on the map and the reference, the results must agree.
+// The erased keys are picked again on purpose, an erase during the build only
+// marks the key in the erased set, and the next insert revives it.
+//
+static bool random_operation(map_type & map, ref_map_type & ref, std::uint64_t & state,
+                             std::size_t key_base, std::size_t key_range, std::size_t key_step,
+                             std::size_t version)
+{
+    std::size_t key = key_base + (next_random(state) % key_range) * key_step;
+    std::size_t value = make_value(key, version);
+    std::size_t op = next_random(state) % 8;
+    if (op < 3) {
+        bool inserted = map.insert(key, value);
+        bool ref_inserted = ref.emplace(key, value).second;
+        if (inserted != ref_inserted)
+            return false;
+    } else if (op < 5) {
+        bool inserted = map.insert_or_assign(key, value);
+        bool ref_inserted = (ref.find(key) == ref.end());
+        ref[key] = value;
+        if (inserted != ref_inserted)
+            return false;
+    } else if (op < 7) {
+        if (map.erase(key) != ref.erase(key))
+            return false;
+    } else {
+        std::size_t found_value = 0;
+        bool found = map.find(key, found_value);
+        auto iter = ref.find(key);
+        if (found != (iter != ref.end()))
+            return false;
+        if (found && (found_value != iter->second))
+            return false;
+        if (map.contains(key) != found)
+            return false;
+    }
+    return true;
+}
+
+//
+// A single writer, the helper thread rehashes while the writer keeps going.
+//
+static bool sequential_differential_test()
+{
+    static const std::size_t kKeyRange = 60000;
+    static const std::size_t kOperations = 600000;
+
+    map_type map;
+    ref_map_type ref;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    std::size_t start_capacity = map.capacity();
+    std::size_t rehashing_ops = 0;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kOperations; i++) {
+        if (map.is_rehashing())
+            rehashing_ops++;
+        if (!random_operation(map, ref, state, 0, kKeyRange, 1, i)) {
+            passed = false;
+            break;
+        }
+        if ((i % 50000) == 0) {
+            passed = passed && is_same_map(map, ref);
+        }
+    }
+
+    map.wait_for_rehash();
+    passed = passed && is_same_map(map, ref);
+
+    // The table grew through some background rehashes, and some operations
+    // ran during them.
+    std::size_t rehash_count = 0;
+    for (std::size_t capacity = start_capacity; capacity < map.capacity(); capacity *= 2) {
+        rehash_count++;
+    }
+    if ((rehash_count < 3) || (rehashing_ops == 0))
+        passed = false;
+
+    printf("sequential_differential_test: size = %zu, capacity = %zu, rehashing ops = %zu\n",
+           ref.size(), map.capacity(), rehashing_ops);
+    print_result("sequential_differential_test", passed);
+    return passed;
+}
+
+//
+// Some writers and some readers. Each writer owns the keys of its residue class,
+// so it can check every result against its own reference map. The readers check
+// the stable keys which are never written again, and that any value found
+// belongs to its key.
+//
+static bool concurrent_differential_test()
+{
+    static const std::size_t kWriters = 4;
+    static const std::size_t kReaders = 2;
+    static const std::size_t kStableKeys = 1000;
+    static const std::size_t kKeyRange = 20000;
+    static const std::size_t kOperations = 150000;
+
+    map_type map;
+    ref_map_type stable_ref;
+
+    // The stable keys are the multiples of (kWriters + 1), the writers use the others.
+    for (std::size_t i = 0; i < kStableKeys; i++) {
+        std::size_t key = i * (kWriters + 1);
+        map.insert(key, make_value(key, 0));
+        stable_ref.emplace(key, make_value(key, 0));
+    }
+    std::size_t start_capacity = map.capacity();
+
+    std::vector<ref_map_type> writer_refs(kWriters);
+    std::atomic<std::size_t> writers_done(0);
+    std::atomic<std::size_t> rehashing_ops(0);
+    std::atomic<bool> writers_passed(true);
+    std::atomic<bool> readers_passed(true);
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kWriters; t++) {
+        threads.emplace_back([&, t]() {
+            ref_map_type & ref = writer_refs[t];
+            std::uint64_t state = 0x2545F4914F6CDD1Dull * (t + 1);
+            std::size_t rehashing = 0;
+            for (std::size_t i = 0; i < kOperations; i++) {
+                if (map.is_rehashing())
+                    rehashing++;
+                if (!random_operation(map, ref, state, t + 1, kKeyRange, kWriters + 1, i)) {
+                    writers_passed.store(false);
+                    break;
+                }
+                if ((i % 1024) == 0)
+                    std::this_thread::yield();
+            }
+            rehashing_ops.fetch_add(rehashing);
+            writers_done.fetch_add(1);
+        });
+    }
+    for (std::size_t t = 0; t < kReaders; t++) {
+        threads.emplace_back([&, t]() {
+            std::uint64_t state = 0xD1B54A32D192ED03ull * (t + 1);
+            std::size_t round = 0;
+            while (writers_done.load() < kWriters) {
+                std::size_t key = (next_random(state) % kStableKeys) * (kWriters + 1);
+                std::size_t value = 0;
+                if (!map.find(key, value) || (value != make_value(key, 0))) {
+                    readers_passed.store(false);
+                    break;
+                }
+                // Any key: if it's found, the value must be of it.
+                key = next_random(state) % (kKeyRange * (kWriters + 1));
+                bool is_match = true;
+                map.visit(key, [&](const std::pair<const std::size_t, std::size_t> & kv) {
+                    is_match = (kv.first == key) && ((kv.second / kValueScale) == key);
+                });
+                if (!is_match) {
+                    readers_passed.store(false);
+                    break;
+                }
+                if ((++round % 256) == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (std::size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    map.wait_for_rehash();
+
+    ref_map_type ref(stable_ref);
+    for (std::size_t t = 0; t < kWriters; t++) {
+        ref.insert(writer_refs[t].begin(), writer_refs[t].end());
+    }
+    bool passed = writers_passed.load() && readers_passed.load() && is_same_map(map, ref);
+
+    std::size_t rehash_count = 0;
+    for (std::size_t capacity = start_capacity; capacity < map.capacity(); capacity *= 2) {
+        rehash_count++;
+    }
+    if ((rehash_count < 3) || (rehashing_ops.load() == 0))
+        passed = false;
+
+    printf("concurrent_differential_test: size = %zu, capacity = %zu, rehashing ops = %zu\n",
+           ref.size(), map.capacity(), rehashing_ops.load());
+    print_result("concurrent_differential_test", passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+    if (!sequential_differential_test())
+        failed++;
+    if (!concurrent_differential_test())
+        failed++;
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,199 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include <type_traits>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#define TEST_KEY_COUNT  5000
+#include "common/test_utils.h"
+
+//
+// The blocks allocated by each allocator id, a block must be freed by an allocator
+// of the same id, or the test fails.
+//
+static std::map<void *, int> g_blocks;
+static std::size_t g_wrong_frees = 0;
+
+//
+// A stateful allocator, the allocators of the different ids aren't equal.
+//
+template <typename T, bool POCCA, bool POCMA, bool POCS>
+class id_allocator {
+public:
+    typedef T value_type;
+
+    typedef std::integral_constant<bool, POCCA> propagate_on_container_copy_assignment;
+    typedef std::integral_constant<bool, POCMA> propagate_on_container_move_assignment;
+    typedef std::integral_constant<bool, POCS>  propagate_on_container_swap;
+    typedef std::false_type                     is_always_equal;
+
+    template <typename U>
+    struct rebind {
+        typedef id_allocator<U, POCCA, POCMA, POCS> other;
+    };
+
+    int id;
+
+    explicit id_allocator(int id = 0) noexcept : id(id) {}
+
+    template <typename U>
+    id_allocator(const id_allocator<U, POCCA, POCMA, POCS> & other) noexcept : id(other.id) {}
+
+    T * allocate(std::size_t n) {
+        T * ptr = std::allocator<T>().allocate(n);
+        g_blocks[(void *)ptr] = this->id;
+        return ptr;
+    }
+
+    void deallocate(T * ptr, std::size_t n) {
+        auto iter = g_blocks.find((void *)ptr);
+        if ((iter == g_blocks.end()) || (iter->second != this->id))
+            g_wrong_frees++;
+        if (iter != g_blocks.end())
+            g_blocks.erase(iter);
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator == (const id_allocator<U, POCCA, POCMA, POCS> & rhs) const noexcept {
+        return (this->id == rhs.id);
+    }
+
+    template <typename U>
+    bool operator != (const id_allocator<U, POCCA, POCMA, POCS> & rhs) const noexcept {
+        return (this->id != rhs.id);
+    }
+};
+
+//
+// The copy and the move assignments between the maps of the unequal allocators,
+// for each combination of the propagation traits. Every block must be freed by
+// the allocator which allocated it, and the allocator of the result must follow
+// propagate_on_container_copy_assignment or propagate_on_container_move_assignment.
+//
+template <bool POCCA, bool POCMA, bool POCS>
+static bool assign_test(const char * name)
+{
+    typedef id_allocator<std::pair<const std::size_t, std::string>, POCCA, POCMA, POCS> allocator_type;
+    typedef jstd::cluster_flat_map<std::size_t, std::string, std::hash<std::size_t>,
+                                   std::equal_to<std::size_t>, allocator_type>  map_type;
+    typedef std::unordered_map<std::size_t, std::string>                        ref_map_type;
+
+    bool passed = true;
+    g_wrong_frees = 0;
+    {
+        map_type map1(0, std::hash<std::size_t>(), std::equal_to<std::size_t>(), allocator_type(1));
+        map_type map2(0, std::hash<std::size_t>(), std::equal_to<std::size_t>(), allocator_type(2));
+        map_type map3(0, std::hash<std::size_t>(), std::equal_to<std::size_t>(), allocator_type(3));
+        ref_map_type ref1, ref2;
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            map1.emplace(i, make_string(i));
+            ref1.emplace(i, make_string(i));
+        }
+        for (std::size_t i = 0; i < kKeyCount / 3; i++) {
+            map2.emplace(i + kKeyCount, make_string(i));
+            ref2.emplace(i + kKeyCount, make_string(i));
+        }
+
+        // Copy assignment
+        map2 = map1;
+        passed = passed && is_same_map(map2, ref1) && is_same_map(map1, ref1);
+        passed = passed && (map2.get_allocator().id == (POCCA ? 1 : 2));
+
+        // Grow the copy, the new arrays come from its own allocator
+        for (std::size_t i = kKeyCount; i < kKeyCount * 2; i++) {
+            map2.emplace(i, make_string(i));
+            ref1.emplace(i, make_string(i));
+        }
+        passed = passed && is_same_map(map2, ref1);
+
+        // Move assignment
+        map3 = std::move(map2);
+        passed = passed && is_same_map(map3, ref1);
+        passed = passed && (map3.get_allocator().id == (POCMA ? map2.get_allocator().id : 3));
+        map3.erase(std::size_t(0));
+        ref1.erase(std::size_t(0));
+        passed = passed && is_same_map(map3, ref1);
+    }
+    passed = passed && (g_wrong_frees == 0) && g_blocks.empty();
+    g_blocks.clear();
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!assign_test<true, true, false>("assign_test<POCCA, POCMA, !POCS>"))
+        failed++;
+    if (!assign_test<true, true, true>("assign_test<POCCA, POCMA, POCS>"))
+        failed++;
+    if (!assign_test<false, false, false>("assign_test<!POCCA, !POCMA, !POCS>"))
+        failed++;
+    if (!assign_test<false, false, true>("assign_test<!POCCA, !POCMA, POCS>"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
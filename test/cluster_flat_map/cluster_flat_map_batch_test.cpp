@@ -0,0 +1,411 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// find_batch(), contains_batch(), insert_batch() and insert_or_assign_batch(),
+// and the operations with a precomputed hash code, against the scalar operations.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#define TEST_KEY_COUNT  20000
+#include "common/test_utils.h"
+
+// The batch sizes around the pipeline depth and the chunk size of the batch.
+static const std::size_t kBatchSizes[] = { 0, 1, 3, 8, 31, 64, 65, 256, 1000 };
+
+template <typename Key>
+struct key_maker;
+
+template <>
+struct key_maker<std::size_t> {
+    static std::size_t make(std::size_t i) {
+        return i * 2654435761ull + 1;
+    }
+};
+
+template <>
+struct key_maker<std::string> {
+    static std::string make(std::size_t i) {
+        return make_string(i);
+    }
+};
+
+//
+// The keys of a batch: the hits and the misses (i >= kKeyCount aren't inserted),
+// with the duplicate keys in the same batch.
+//
+template <typename Key>
+static std::vector<Key> make_batch_keys(std::size_t count, std::uint64_t & state)
+{
+    std::vector<Key> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        if ((i >= 2) && ((next_random(state) % 8) == 0))
+            keys.push_back(keys[next_random(state) % i]);
+        else
+            keys.push_back(key_maker<Key>::make(next_random(state) % (kKeyCount * 2)));
+    }
+    return keys;
+}
+
+//
+// find_batch() and contains_batch() return the same as find() and contains().
+//
+template <typename Key>
+static bool find_batch_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<Key, std::size_t>    map_type;
+    typedef typename map_type::iterator                 iterator;
+    typedef typename map_type::const_iterator           const_iterator;
+
+    map_type map;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.emplace(key_maker<Key>::make(i), i);
+    }
+
+    for (std::size_t n = 0; n < sizeof(kBatchSizes) / sizeof(kBatchSizes[0]); n++) {
+        std::size_t count = kBatchSizes[n];
+        std::vector<Key> keys = make_batch_keys<Key>(count, state);
+
+        std::unique_ptr<iterator[]> iters(new iterator[count + 1]);
+        std::unique_ptr<const_iterator[]> citers(new const_iterator[count + 1]);
+        std::unique_ptr<bool[]> founds(new bool[count + 1]);
+
+        const map_type & cmap = map;
+        map.find_batch(keys.data(), count, iters.get());
+        cmap.find_batch(keys.data(), count, citers.get());
+        cmap.contains_batch(keys.data(), count, founds.get());
+
+        for (std::size_t i = 0; i < count; i++) {
+            iterator iter = map.find(keys[i]);
+            if ((iters[i] != iter) || (citers[i] != cmap.find(keys[i])))
+                passed = false;
+            if (founds[i] != map.contains(keys[i]))
+                passed = false;
+            if ((iter != map.end()) && (iters[i]->first != keys[i]))
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// insert_batch() and insert_or_assign_batch() give the same contents as the loops of
+// insert() and insert_or_assign(), the duplicate keys in a batch included, and return
+// the number of the inserted values. Each batch starts near the threshold, so it grows the table.
+//
+template <typename Key>
+static bool insert_batch_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<Key, std::size_t>    map_type;
+    typedef typename map_type::value_type               value_type;
+    typedef std::pair<Key, std::size_t>                 pair_type;
+
+    map_type insert_map, insert_ref;
+    map_type assign_map, assign_ref;
+    map_type assign2_map, assign2_ref;
+    std::uint64_t state = 0x2545F4914F6CDD1Dull;
+    std::size_t growths = 0;
+    bool passed = true;
+
+    std::size_t round = 0;
+    while (insert_ref.size() < kKeyCount) {
+        std::size_t count = kBatchSizes[round % (sizeof(kBatchSizes) / sizeof(kBatchSizes[0]))];
+        round++;
+
+        std::vector<Key> keys = make_batch_keys<Key>(count, state);
+        std::vector<pair_type> values;
+        std::vector<std::size_t> mapped;
+        for (std::size_t i = 0; i < count; i++) {
+            values.push_back(pair_type(keys[i], round * 100000 + i));
+            mapped.push_back(round * 100000 + i);
+        }
+
+        std::size_t capacity = insert_map.slot_capacity();
+        std::size_t old_size = insert_ref.size();
+        for (std::size_t i = 0; i < count; i++) {
+            insert_ref.insert(value_type(values[i].first, values[i].second));
+            assign_ref.insert_or_assign(values[i].first, values[i].second);
+            assign2_ref.insert_or_assign(keys[i], mapped[i]);
+        }
+
+        std::size_t inserted = insert_map.insert_batch(values.data(), count);
+        if (inserted != (insert_ref.size() - old_size))
+            passed = false;
+        if (insert_map.slot_capacity() != capacity)
+            growths++;
+
+        inserted = assign_map.insert_or_assign_batch(values.data(), count);
+        if (inserted != (insert_ref.size() - old_size))
+            passed = false;
+        inserted = assign2_map.insert_or_assign_batch(keys.data(), mapped.data(), count);
+        if (inserted != (insert_ref.size() - old_size))
+            passed = false;
+
+        passed = passed && is_same_map(insert_map, insert_ref) &&
+                 is_same_map(assign_map, assign_ref) && is_same_map(assign2_map, assign2_ref);
+        if (!passed)
+            break;
+    }
+    // Some batches must have grown the table.
+    if (growths == 0)
+        passed = false;
+
+    printf("insert_batch: rounds = %zu, growths = %zu\n", round, growths);
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The same in a table reserved over kBatchPrefetchMinBytes, so the batches take the prefetch
+// pipeline instead of the loop of insert(): the inserts, then the updates of the same keys.
+//
+template <typename Key>
+static bool insert_batch_reserved_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<Key, std::size_t>    map_type;
+    typedef typename map_type::table_type               table_type;
+    typedef typename map_type::slot_type                slot_type;
+    typedef typename map_type::value_type               value_type;
+    typedef std::pair<Key, std::size_t>                 pair_type;
+
+    map_type insert_map, insert_ref;
+    map_type assign_map, assign_ref;
+    std::uint64_t state = 0x7F4A7C159E3779B9ull;
+    bool passed = true;
+
+    std::size_t reserved = table_type::kBatchPrefetchMinBytes / sizeof(slot_type);
+    insert_map.reserve(reserved);
+    assign_map.reserve(reserved);
+    std::size_t capacity = insert_map.slot_capacity();
+    if ((capacity * sizeof(slot_type)) < table_type::kBatchPrefetchMinBytes)
+        passed = false;
+
+    for (std::size_t round = 1; round <= 2 * kKeyCount / 1000; round++) {
+        std::vector<Key> keys = make_batch_keys<Key>(1000, state);
+        std::vector<pair_type> values;
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            values.push_back(pair_type(keys[i], round * 100000 + i));
+        }
+
+        std::size_t old_size = insert_ref.size();
+        for (std::size_t i = 0; i < values.size(); i++) {
+            insert_ref.insert(value_type(values[i].first, values[i].second));
+            assign_ref.insert_or_assign(values[i].first, values[i].second);
+        }
+
+        if (insert_map.insert_batch(values.data(), values.size()) != (insert_ref.size() - old_size))
+            passed = false;
+        if (assign_map.insert_or_assign_batch(values.data(), values.size()) !=
+            (assign_ref.size() - old_size))
+            passed = false;
+
+        passed = passed && is_same_map(insert_map, insert_ref) && is_same_map(assign_map, assign_ref);
+        if (!passed)
+            break;
+    }
+    // The batches didn't grow the table, so all of them took the pipeline.
+    if ((insert_map.slot_capacity() != capacity) || (assign_map.slot_capacity() != capacity))
+        passed = false;
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The values whose key is only convertible to the key_type: std::pair<const char *, size_t>
+// into a cluster_flat_map<std::string, size_t>, in a small table and in a table reserved
+// over kBatchPrefetchMinBytes, where the keys are hashed before they are inserted.
+//
+static bool insert_batch_convertible_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::string, std::size_t>    map_type;
+    typedef map_type::table_type                                table_type;
+    typedef map_type::slot_type                                 slot_type;
+    typedef std::pair<const char *, std::size_t>                pair_type;
+
+    bool passed = true;
+
+    for (std::size_t reserved = 0; reserved <= 1; reserved++) {
+        map_type insert_map, assign_map, ref;
+        if (reserved != 0) {
+            insert_map.reserve(table_type::kBatchPrefetchMinBytes / sizeof(slot_type));
+            assign_map.reserve(table_type::kBatchPrefetchMinBytes / sizeof(slot_type));
+        }
+
+        std::vector<std::string> keys;
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            keys.push_back(make_string(i % (kKeyCount / 2)));
+        }
+
+        for (std::size_t first = 0; first < kKeyCount; first += 1000) {
+            std::vector<pair_type> values;
+            std::size_t old_size = ref.size();
+            for (std::size_t i = first; i < first + 1000; i++) {
+                values.push_back(pair_type(keys[i].c_str(), i));
+                ref.insert_or_assign(keys[i], i);
+            }
+
+            if (insert_map.insert_batch(values.data(), values.size()) != (ref.size() - old_size))
+                passed = false;
+            if (assign_map.insert_or_assign_batch(values.data(), values.size()) != (ref.size() - old_size))
+                passed = false;
+        }
+
+        // The keys of the second half are the duplicates, insert_batch() keeps the first values.
+        passed = passed && is_same_map(assign_map, ref) && (insert_map.size() == ref.size());
+        for (std::size_t i = 0; i < kKeyCount / 2; i++) {
+            auto iter = insert_map.find(keys[i]);
+            if ((iter == insert_map.end()) || (iter->second != i))
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// find(key, hash), emplace_with_hash(), try_emplace_with_hash() and erase(key, hash)
+// with the hash codes of prehash(), computed before the table grows.
+//
+template <typename Key>
+static bool prehash_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<Key, std::size_t>    map_type;
+
+    map_type map, ref;
+    std::vector<Key> keys;
+    std::vector<std::size_t> hash_codes;
+    bool passed = true;
+
+    // The hash codes are computed while the table is empty.
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        keys.push_back(key_maker<Key>::make(i));
+        hash_codes.push_back(map.prehash(keys[i]));
+    }
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t k = i / 2;
+        auto result = ((i & 1) == 0) ? map.emplace_with_hash(hash_codes[k], keys[k], i)
+                                     : map.try_emplace_with_hash(hash_codes[k], keys[k], i);
+        auto ref_result = ref.emplace(keys[k], i);
+        if ((result.second != ref_result.second) || (result.first->first != keys[k]) ||
+            (result.first->second != ref_result.first->second))
+            passed = false;
+    }
+    passed = passed && is_same_map(map, ref);
+
+    const map_type & cmap = map;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        if ((map.find(keys[i], hash_codes[i]) != map.find(keys[i])) ||
+            (cmap.find(keys[i], hash_codes[i]) != cmap.find(keys[i])))
+            passed = false;
+    }
+
+    for (std::size_t i = 0; i < kKeyCount; i += 3) {
+        if (map.erase(keys[i], hash_codes[i]) != ref.erase(keys[i]))
+            passed = false;
+    }
+    passed = passed && is_same_map(map, ref);
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        if (map.find(keys[i], hash_codes[i]) != map.find(keys[i]))
+            passed = false;
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!find_batch_test<std::size_t>("find_batch_test<size_t>"))
+        failed++;
+    if (!find_batch_test<std::string>("find_batch_test<std::string>"))
+        failed++;
+
+    if (!insert_batch_test<std::size_t>("insert_batch_test<size_t>"))
+        failed++;
+    if (!insert_batch_test<std::string>("insert_batch_test<std::string>"))
+        failed++;
+    if (!insert_batch_reserved_test<std::size_t>("insert_batch_reserved_test<size_t>"))
+        failed++;
+    if (!insert_batch_reserved_test<std::string>("insert_batch_reserved_test<std::string>"))
+        failed++;
+    if (!insert_batch_convertible_test("insert_batch_convertible_test"))
+        failed++;
+
+    if (!prehash_test<std::size_t>("prehash_test<size_t>"))
+        failed++;
+    if (!prehash_test<std::string>("prehash_test<std::string>"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,257 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#define TEST_KEY_COUNT  88000
+#include "common/test_utils.h"
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t>    map_type;
+typedef std::unordered_map<std::size_t, std::size_t>        ref_map_type;
+
+static const std::size_t kChurnRounds = 20;
+
+//
+// The erase doesn't move the elements, it clears the overflow bits that the erased
+// element was the last one to need, so they don't cover the table, and the table
+// doesn't grow or rehash at a constant size.
+//
+template <typename EraseFunc>
+static bool churn_test(const char * name, EraseFunc && erase_func)
+{
+    map_type map;
+    ref_map_type ref;
+    std::vector<std::size_t> keys;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+
+    map.reserve(kKeyCount);
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = next_random(state);
+        if (map.emplace(key, i).second) {
+            ref.emplace(key, i);
+            keys.push_back(key);
+        }
+    }
+    std::size_t capacity = map.slot_capacity();
+
+    bool passed = true;
+    std::size_t max_overflow_groups = 0;
+    for (std::size_t round = 0; round < kChurnRounds; round++) {
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            std::size_t index = next_random(state) % keys.size();
+            if (!erase_func(map, keys[index])) {
+                passed = false;
+                break;
+            }
+            ref.erase(keys[index]);
+
+            std::size_t key = next_random(state);
+            if (map.emplace(key, i).second)
+                ref.emplace(key, i);
+            keys[index] = key;
+        }
+
+        map_type::stats_type stats = map.stats();
+        if (stats.overflow_groups > max_overflow_groups)
+            max_overflow_groups = stats.overflow_groups;
+    }
+
+    // The size doesn't change, so the table must not grow.
+    if (map.slot_capacity() != capacity)
+        passed = false;
+    // If the overflow bits aren't cleared, almost all the groups overflow by now.
+    if (max_overflow_groups > map.group_capacity() / 2)
+        passed = false;
+
+    if (map.size() != ref.size())
+        passed = false;
+    for (auto iter = ref.begin(); iter != ref.end(); ++iter) {
+        auto map_iter = map.find(iter->first);
+        if ((map_iter == map.end()) || (map_iter->second != iter->second)) {
+            passed = false;
+            break;
+        }
+    }
+    // The misses must stop.
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = next_random(state);
+        if ((map.count(key) != 0) != (ref.count(key) != 0)) {
+            passed = false;
+            break;
+        }
+    }
+
+    printf("%s: max overflow groups = %zu / %zu\n",
+           name, max_overflow_groups, map.group_capacity());
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The erase doesn't move the other elements: the pointers to them are still valid,
+// and the loop which erases while iterating visits each element once.
+//
+template <typename EraseFunc>
+static bool erase_while_iterating_test(const char * name, EraseFunc && erase_func)
+{
+    static const std::size_t kCount = kKeyCount / 8;
+
+    map_type map;
+    std::vector<std::size_t> keys;
+    std::vector<const std::size_t *> values(kCount);
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    // The random keys, so some groups overflow.
+    while (keys.size() < kCount) {
+        std::size_t key = next_random(state);
+        if (map.emplace(key, keys.size()).second)
+            keys.push_back(key);
+    }
+    for (auto iter = map.cbegin(); iter != map.cend(); ++iter) {
+        values[iter->second] = &iter->second;
+    }
+
+    // Erase the odd values while iterating.
+    std::vector<std::size_t> visits(kCount, 0);
+    for (auto iter = map.begin(); iter != map.end(); ) {
+        visits[iter->second]++;
+        if ((iter->second & 1) != 0)
+            iter = erase_func(map, iter);
+        else
+            ++iter;
+    }
+
+    if (map.size() != (kCount + 1) / 2)
+        passed = false;
+    for (std::size_t i = 0; i < kCount; i++) {
+        if (visits[i] != 1)
+            passed = false;
+        auto iter = map.find(keys[i]);
+        if ((i & 1) == 0) {
+            if ((iter == map.end()) || (&iter->second != values[i]) || (iter->second != i))
+                passed = false;
+        } else {
+            if (iter != map.end())
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!erase_while_iterating_test("erase_while_iterating_test<erase(iterator)>",
+            [](map_type & map, map_type::iterator iter) {
+            return map.erase(iter);
+        })) {
+        failed++;
+    }
+
+#if !CLUSTER_USE_ERASE_COMPACTION
+    // erase(key) of the current element, the next element is taken before.
+    if (!erase_while_iterating_test("erase_while_iterating_test<erase(key)>",
+            [](map_type & map, map_type::iterator iter) {
+            map_type::iterator next = iter;
+            ++next;
+            map.erase(iter->first);
+            return next;
+        })) {
+        failed++;
+    }
+#endif
+
+    // find() + erase(iterator)
+    if (!churn_test("churn_test<erase(iterator)>", [](map_type & map, std::size_t key) {
+            map_type::iterator iter = map.find(key);
+            if (iter == map.end())
+                return false;
+            map.erase(iter);
+            return true;
+        })) {
+        failed++;
+    }
+
+    // erase(first, last) of one element
+    if (!churn_test("churn_test<erase(first, last)>", [](map_type & map, std::size_t key) {
+            map_type::const_iterator first = map.find(key);
+            if (first == map.cend())
+                return false;
+            map_type::const_iterator last = first;
+            ++last;
+            map.erase(first, last);
+            return true;
+        })) {
+        failed++;
+    }
+
+    // erase(key)
+    if (!churn_test("churn_test<erase(key)>", [](map_type & map, std::size_t key) {
+            return (map.erase(key) == 1);
+        })) {
+        failed++;
+    }
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
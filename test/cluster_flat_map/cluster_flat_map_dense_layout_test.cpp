@@ -0,0 +1,257 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// cluster_flat_map with dense_layout_policy: the entries are dense, the iteration
+// is in insertion order until an erase (which moves the last entry into the hole),
+// and it only visits the live entries.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hashmap/map_layout_policy.h"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t, std::hash<std::size_t>, std::equal_to<std::size_t>,
+                               std::allocator<std::pair<const std::size_t, std::size_t>>,
+                               jstd::flat_map_cluster16<jstd::cluster_meta_ctrl>,
+                               jstd::dense_layout_policy<std::size_t, std::size_t>>     map_type;
+
+static_assert(map_type::table_type::kIsIndirectKV,
+              "dense_layout_policy must force the indirect mode");
+
+//
+// The keys of the model, in the order the map iterates them: the inserts append,
+// the erases move the last key into the hole.
+//
+struct order_model {
+    std::vector<std::size_t> keys;
+    std::unordered_map<std::size_t, std::size_t> index;
+
+    void insert(std::size_t key) {
+        if (this->index.find(key) == this->index.end()) {
+            this->index[key] = this->keys.size();
+            this->keys.push_back(key);
+        }
+    }
+
+    void erase(std::size_t key) {
+        auto iter = this->index.find(key);
+        if (iter != this->index.end()) {
+            std::size_t pos = iter->second;
+            std::size_t last = this->keys.back();
+            this->keys[pos] = last;
+            this->index[last] = pos;
+            this->keys.pop_back();
+            this->index.erase(key);
+        }
+    }
+
+    void clear() {
+        this->keys.clear();
+        this->index.clear();
+    }
+};
+
+//
+// The iteration visits size() entries, each key once, in the order of the model.
+//
+static bool is_same_order(const map_type & map, const order_model & model)
+{
+    if (map.size() != model.keys.size())
+        return false;
+
+    std::size_t count = 0;
+    for (auto iter = map.cbegin(); iter != map.cend(); ++iter) {
+        if ((count >= model.keys.size()) || (iter->first != model.keys[count]) ||
+            (iter->second != make_size_t(iter->first)))
+            return false;
+        count++;
+    }
+    return (count == model.keys.size());
+}
+
+//
+// The random keys in the iteration order after the inserts, through the growths,
+// and an insert of an existing key doesn't move it.
+//
+static bool insert_order_test(const char * name)
+{
+    map_type map;
+    order_model model;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = next_random(state) % (kKeyCount * 4);
+        map.emplace(key, make_size_t(key));
+        model.insert(key);
+    }
+    passed = is_same_order(map, model);
+
+    // Insert the existing keys again.
+    for (std::size_t i = 0; i < model.keys.size(); i += 7) {
+        std::size_t key = model.keys[i];
+        map.emplace(key, make_size_t(key));
+    }
+    passed = passed && is_same_order(map, model);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The random erases (by key and by iterator) between the inserts, the iteration
+// only visits the live entries, in the order of the model.
+//
+static bool erase_order_test(const char * name)
+{
+    static const std::size_t kOperations = kKeyCount * 2;
+    static const std::size_t kKeyRange = kKeyCount / 2;
+
+    map_type map;
+    order_model model;
+    std::uint64_t state = 0x2545F4914F6CDD1Dull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kOperations && passed; i++) {
+        std::size_t key = next_random(state) % kKeyRange;
+        std::size_t op = next_random(state) % 4;
+        if (op <= 1) {
+            map.emplace(key, make_size_t(key));
+            model.insert(key);
+        } else if (op == 2) {
+            map.erase(key);
+            model.erase(key);
+        } else {
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                map.erase(iter);
+                model.erase(key);
+            }
+        }
+        if ((i % (kOperations / 16)) == 0)
+            passed = is_same_order(map, model);
+    }
+    passed = passed && is_same_order(map, model);
+
+    // Erase the half of the keys.
+    std::vector<std::size_t> keys = model.keys;
+    for (std::size_t i = 0; i < keys.size(); i += 2) {
+        map.erase(keys[i]);
+        model.erase(keys[i]);
+    }
+    passed = passed && is_same_order(map, model);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// After clear(), the iteration is empty, and the new inserts are in the insertion
+// order again.
+//
+static bool clear_order_test(const char * name)
+{
+    map_type map;
+    order_model model;
+    std::uint64_t state = 0x853C49E6748FEA9Bull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = next_random(state) % (kKeyCount * 4);
+        map.emplace(key, make_size_t(key));
+        model.insert(key);
+    }
+    for (std::size_t i = 0; i < model.keys.size(); i += 3) {
+        std::size_t key = model.keys[i];
+        map.erase(key);
+        model.erase(key);
+    }
+    passed = is_same_order(map, model);
+
+    map.clear();
+    model.clear();
+    passed = passed && map.empty() && (map.cbegin() == map.cend()) && is_same_order(map, model);
+
+    for (std::size_t i = 0; i < kKeyCount / 2; i++) {
+        std::size_t key = next_random(state) % (kKeyCount * 4);
+        map.emplace(key, make_size_t(key));
+        model.insert(key);
+    }
+    passed = passed && is_same_order(map, model);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!insert_order_test("insert_order_test"))
+        failed++;
+    if (!erase_order_test("erase_order_test"))
+        failed++;
+    if (!clear_order_test("clear_order_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
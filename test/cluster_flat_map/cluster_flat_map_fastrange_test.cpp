@@ -0,0 +1,219 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// Built with CLUSTER_USE_FASTRANGE_INDEX=1, the capacity is any multiple of the group width,
+// the table grows by CLUSTER_FASTRANGE_GROWTH_PERCENT, see cluster_flat_table::index_for_hash().
+//
+#if !defined(CLUSTER_USE_FASTRANGE_INDEX) || (CLUSTER_USE_FASTRANGE_INDEX == 0)
+#error "cluster_flat_map_fastrange_test must be built with CLUSTER_USE_FASTRANGE_INDEX=1"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t>    map_type;
+typedef std::unordered_map<std::size_t, std::size_t>        ref_map_type;
+
+//
+// The capacity of the larger tables is a multiple of the group width,
+// and each growth is CLUSTER_FASTRANGE_GROWTH_PERCENT of the old capacity.
+//
+static bool is_valid_capacity(const map_type & map)
+{
+    std::size_t group_width = map.slot_capacity() / map.group_capacity();
+    return ((map.slot_capacity() % group_width) == 0);
+}
+
+static bool growth_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    bool passed = true;
+
+    std::size_t growths = 0;
+    std::size_t capacity = map.slot_capacity();
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = i * 2654435761ull;
+        map.emplace(key, i);
+        ref.emplace(key, i);
+        if (map.slot_capacity() != capacity) {
+            std::size_t group_width = map.slot_capacity() / map.group_capacity();
+            if (!is_valid_capacity(map))
+                passed = false;
+            if (capacity > group_width * 4) {
+                std::size_t expected = capacity * CLUSTER_FASTRANGE_GROWTH_PERCENT / 100;
+                if ((map.slot_capacity() < expected) ||
+                    (map.slot_capacity() >= expected + group_width))
+                    passed = false;
+            }
+            capacity = map.slot_capacity();
+            growths++;
+        }
+    }
+    passed = passed && is_same_map(map, ref);
+
+    printf("growths = %zu, capacity = %zu\n", growths, map.slot_capacity());
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// reserve(n) leaves a headroom over the max load factor,
+// the table doesn't grow while it's filled to n.
+//
+static bool reserve_test(const char * name)
+{
+    static const std::size_t kReserveSizes[] = { 100, 1000, 4099, 88000, 100003 };
+    bool passed = true;
+
+    for (std::size_t n = 0; n < sizeof(kReserveSizes) / sizeof(kReserveSizes[0]); n++) {
+        std::size_t reserve_size = kReserveSizes[n];
+        map_type map;
+        map.reserve(reserve_size);
+        std::size_t capacity = map.slot_capacity();
+        if (!is_valid_capacity(map))
+            passed = false;
+        // At least 1/8 of the threshold is left when the table holds the reserved size.
+        if (map.slot_threshold() < reserve_size + reserve_size / 8)
+            passed = false;
+        // And it's not rounded up to the next power of 2.
+        if (capacity > reserve_size * 2)
+            passed = false;
+
+        for (std::size_t i = 0; i < reserve_size; i++) {
+            map.emplace(i * 7 + 1, i);
+        }
+        if (map.slot_capacity() != capacity)
+            passed = false;
+
+        printf("reserve(%zu): capacity = %zu, threshold = %zu\n",
+               reserve_size, capacity, map.slot_threshold());
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// insert(), find(), erase(), rehash() and shrink_to_fit() against std::unordered_map.
+//
+static bool insert_find_erase_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = i * 7 + 1;
+        if (!map.emplace(key, i).second)
+            passed = false;
+        ref.emplace(key, i);
+    }
+    passed = passed && is_same_map(map, ref);
+
+    for (std::size_t i = 0; i < kKeyCount; i += 2) {
+        std::size_t key = i * 7 + 1;
+        if (map.erase(key) != ref.erase(key))
+            passed = false;
+    }
+    for (std::size_t i = 1; i < kKeyCount; i += 4) {
+        std::size_t key = i * 7 + 1;
+        auto iter = map.find(key);
+        if (iter == map.end()) {
+            passed = false;
+            continue;
+        }
+        map.erase(iter);
+        ref.erase(key);
+    }
+    // The missing keys.
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = i * 7 + 2;
+        if ((map.find(key) != map.end()) || (map.erase(key) != 0))
+            passed = false;
+    }
+    passed = passed && is_same_map(map, ref);
+
+    map.shrink_to_fit();
+    passed = passed && is_valid_capacity(map) && is_same_map(map, ref);
+
+    map.rehash(kKeyCount * 3);
+    passed = passed && is_valid_capacity(map) && (map.slot_capacity() >= kKeyCount * 3);
+    passed = passed && is_same_map(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!growth_test("growth_test"))
+        failed++;
+    if (!reserve_test("reserve_test"))
+        failed++;
+    if (!insert_find_erase_test("insert_find_erase_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
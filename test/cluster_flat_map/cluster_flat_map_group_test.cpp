@@ -0,0 +1,272 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// Each group type of cluster_flat_table that this compiler and target support:
+// the match kernels against a scalar model of the ctrls, and cluster_flat_map<..., Group>
+// against std::unordered_map.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hashmap/flat_map_cluster.hpp"
+#include "jstd/hashmap/flat_map_cluster_dispatch.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+static const std::size_t kMatchRounds = 20000;
+
+//
+// 64 keys share a hash code, so a group has the multiple matches
+// and the probes overflow into the next groups.
+//
+struct clustered_hash {
+    typedef std::size_t result_type;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        return std::hash<std::size_t>()(key / 64);
+    }
+};
+
+//
+// The random ctrls of a group: empty or a few hash values, with or without
+// the overflow bit, the kernels must ignore the overflow bit.
+//
+template <typename Group>
+struct group_model {
+    static constexpr std::size_t kGroupWidth = Group::kGroupWidth;
+
+    std::uint8_t hashes[kGroupWidth];
+
+    void build(Group & group, std::uint64_t & state) {
+        group.init();
+        for (std::size_t pos = 0; pos < kGroupWidth; pos++) {
+            std::size_t random = next_random(state);
+            // A few hash values, so the same hash appears in several lanes.
+            this->hashes[pos] = ((random % 4) == 0) ? std::uint8_t(0)
+                                                    : static_cast<std::uint8_t>(1 + (random >> 8) % 5);
+            if (((random >> 16) % 3) == 0) {
+                group.set_used(pos, 1);
+                group.set_overflow(pos);
+            }
+            if (this->hashes[pos] == 0)
+                group.set_empty(pos);
+            else
+                group.set_used(pos, this->hashes[pos]);
+        }
+    }
+
+    template <typename Bitmask, typename Pred>
+    Bitmask mask_of(Pred && pred) const {
+        Bitmask mask = 0;
+        for (std::size_t pos = 0; pos < kGroupWidth; pos++) {
+            if (pred(this->hashes[pos]))
+                mask |= static_cast<Bitmask>(Bitmask(1) << pos);
+        }
+        return mask;
+    }
+};
+
+//
+// match_empty(), match_used() and match_hash() of the kernel against the model.
+//
+template <typename Group, typename Kernel>
+static bool match_test(const char * name, const Kernel & kernel)
+{
+    typedef jstd::cluster_kernel_traits<Group>  kernel_traits;
+    typedef typename Group::bitmask_type        bitmask_type;
+
+    alignas(64) Group group;
+    group_model<Group> model;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    for (std::size_t round = 0; round < kMatchRounds && passed; round++) {
+        model.build(group, state);
+        if (kernel_traits::match_empty(kernel, &group) !=
+            model.template mask_of<bitmask_type>([](std::uint8_t hash) { return (hash == 0); }))
+            passed = false;
+        if (kernel_traits::match_used(kernel, &group) !=
+            model.template mask_of<bitmask_type>([](std::uint8_t hash) { return (hash != 0); }))
+            passed = false;
+        for (std::uint8_t hash = 1; hash <= 6; hash++) {
+            if (kernel_traits::match_hash(kernel, &group, hash) !=
+                model.template mask_of<bitmask_type>([hash](std::uint8_t h) { return (h == hash); }))
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+template <typename Group>
+static bool match_test(const char * name)
+{
+    return match_test<Group>(name, jstd::cluster_kernel_traits<Group>::kernel());
+}
+
+//
+// The random inserts, erases and lookups of cluster_flat_map<..., Group>
+// against std::unordered_map.
+//
+template <typename Group, typename Hash>
+static bool map_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::size_t, std::size_t, Hash, std::equal_to<std::size_t>,
+                                   std::allocator<std::pair<const std::size_t, std::size_t>>,
+                                   Group>                       map_type;
+    typedef std::unordered_map<std::size_t, std::size_t>        ref_map_type;
+
+    static const std::size_t kOperations = kKeyCount * 4;
+    static const std::size_t kKeyRange = kKeyCount / 2;
+
+    map_type map;
+    ref_map_type ref;
+    std::uint64_t state = 0x2545F4914F6CDD1Dull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kOperations && passed; i++) {
+        std::size_t key = next_random(state) % kKeyRange;
+        std::size_t op = next_random(state) % 4;
+        if (op <= 1) {
+            auto result = map.emplace(key, i);
+            auto ref_result = ref.emplace(key, i);
+            if ((result.second != ref_result.second) || (result.first->second != ref_result.first->second))
+                passed = false;
+        } else if (op == 2) {
+            if (map.erase(key) != ref.erase(key))
+                passed = false;
+        } else {
+            auto iter = map.find(key);
+            auto ref_iter = ref.find(key);
+            if (((iter != map.end()) != (ref_iter != ref.end())) ||
+                ((iter != map.end()) && (iter->second != ref_iter->second)))
+                passed = false;
+        }
+    }
+    passed = passed && is_same_map(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+template <typename Group>
+static bool group_test(const char * name)
+{
+    printf("%s: kernel = %s\n", name, Group::kernel_name());
+
+    bool passed = match_test<Group>("match_test");
+    passed = map_test<Group, std::hash<std::size_t>>("map_test<std::hash>") && passed;
+    passed = map_test<Group, clustered_hash>("map_test<clustered_hash>") && passed;
+    return passed;
+}
+
+#if defined(JSTD_IS_X86)
+
+//
+// Each kernel of flat_map_cluster64_dispatch that this CPU supports, not only
+// the one chosen by cluster64_kernels::current().
+//
+static bool dispatch_kernels_test()
+{
+    typedef jstd::flat_map_cluster64_dispatch<jstd::cluster_meta_ctrl> group_type;
+
+    const jstd::CPUFeatures & cpu = jstd::CPUFeatures::get();
+    bool passed = match_test<group_type>("match_test<sse2>", &jstd::cluster64_kernels::sse2());
+    if (cpu.hasAVX2)
+        passed = match_test<group_type>("match_test<avx2>", &jstd::cluster64_kernels::avx2()) && passed;
+    if (cpu.hasAVX512BW)
+        passed = match_test<group_type>("match_test<avx512bw>", &jstd::cluster64_kernels::avx512bw()) && passed;
+    return passed;
+}
+
+#endif // JSTD_IS_X86
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+#if (JSTD_USE_SWAR != 0)
+    // The build of cluster_flat_map_group_swar_test: the portable kernel, not the SIMD one.
+    bool is_swar = (strcmp(jstd::flat_map_cluster16<jstd::cluster_meta_ctrl>::kernel_name(), "swar") == 0);
+    print_result("flat_map_cluster16 uses the swar kernel", is_swar);
+    if (!is_swar)
+        failed++;
+#endif
+
+    if (!group_test<jstd::flat_map_cluster16<jstd::cluster_meta_ctrl>>("flat_map_cluster16"))
+        failed++;
+#if defined(__AVX2__)
+    if (!group_test<jstd::flat_map_cluster32<jstd::cluster_meta_ctrl>>("flat_map_cluster32"))
+        failed++;
+#endif
+#if defined(__AVX512BW__)
+    if (!group_test<jstd::flat_map_cluster64<jstd::cluster_meta_ctrl>>("flat_map_cluster64"))
+        failed++;
+#endif
+#if defined(JSTD_IS_X86)
+    if (!group_test<jstd::flat_map_cluster64_dispatch<jstd::cluster_meta_ctrl>>("flat_map_cluster64_dispatch"))
+        failed++;
+    if (!dispatch_kernels_test())
+        failed++;
+#endif
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,238 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// The hash policies of cluster_flat_table: mix_hash_code(), index_for_mixed_hash()
+// and ctrl_for_mixed_hash() of jstd::fibonacci_hash_policy and jstd::mum_hash_policy,
+// and the collision chains of cluster_flat_map with the identity std::hash<int>.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hasher/hashes.h"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+// The keys are i * stride, std::hash<int> is the identity.
+static const std::size_t kStrides[] = { 1, 64, 1024 };
+
+//
+// std::hash<int> with the fibonacci_hash_policy, cluster_flat_map selects
+// the mum_hash_policy for std::hash<int>.
+//
+struct fibonacci_int_hash : public std::hash<int> {
+    typedef jstd::fibonacci_hash_policy<fibonacci_int_hash> hash_policy;
+};
+
+static std::size_t ctrl_bits(std::size_t ctrl_hash)
+{
+    return (ctrl_hash & 0x7Fu);
+}
+
+//
+// The ctrl bits of each shift are the 7 bits right below the index bits, so they never
+// overlap, down to the shift of 7 where the ctrl bits are the lowest bits. The smallest
+// capacity (2) has the shift of 63, its index is the top bit.
+//
+static bool fibonacci_bits_test(const char * name)
+{
+    typedef jstd::fibonacci_hash_policy<fibonacci_int_hash> policy_type;
+
+    policy_type policy;
+    bool passed = true;
+
+    std::size_t min_capacity = 2;
+    if (policy.calc_next_capacity(min_capacity) != 63)
+        passed = false;
+
+    for (std::size_t shift = 63; shift >= policy_type::kCtrlHashBits; shift--) {
+        policy.commit(static_cast<std::uint8_t>(shift));
+        for (int i = 0; i < 1000; i++) {
+            std::size_t mixed = policy.mix_hash_code<int>(std::hash<int>()(i * 1024));
+            std::size_t index = policy.index_for_mixed_hash(mixed);
+            std::size_t ctrl = ctrl_bits(policy.ctrl_for_mixed_hash(mixed));
+            if (((index << 7) | ctrl) != (mixed >> (shift - policy_type::kCtrlHashBits)))
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The ctrl bits are independent of the index bits: the keys of each index, at the smallest
+// capacities, have about all of the 128 ctrl values. If the ctrl bits were taken from the bits
+// of the index, each index would have a few ctrl values only.
+//
+template <typename Policy>
+static bool independent_bits_test(const char * name)
+{
+    static constexpr std::size_t kKeysPerIndex = 512;
+
+    Policy policy;
+    bool passed = true;
+
+    for (std::size_t stride : kStrides) {
+        for (std::size_t capacity = 2; capacity <= 256; capacity *= 8) {
+            std::size_t new_capacity = capacity;
+            policy.commit(policy.calc_next_capacity(new_capacity));
+
+            std::vector<std::uint8_t> seen(capacity * 128, 0);
+            for (std::size_t i = 0; i < capacity * kKeysPerIndex; i++) {
+                int key = static_cast<int>(i * stride);
+                std::size_t mixed = policy.template mix_hash_code<int>(std::hash<int>()(key));
+                std::size_t index = policy.index_for_mixed_hash(mixed);
+                std::size_t ctrl = ctrl_bits(policy.ctrl_for_mixed_hash(mixed));
+                if (index >= capacity) {
+                    passed = false;
+                    break;
+                }
+                seen[index * 128 + ctrl] = 1;
+            }
+
+            std::size_t min_ctrls = 128;
+            for (std::size_t index = 0; index < capacity; index++) {
+                std::size_t ctrls = 0;
+                for (std::size_t ctrl = 0; ctrl < 128; ctrl++) {
+                    ctrls += seen[index * 128 + ctrl];
+                }
+                if (ctrls < min_ctrls)
+                    min_ctrls = ctrls;
+            }
+            // 512 random keys miss about 2 of the 128 values.
+            if (min_ctrls < 100)
+                passed = false;
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The number of groups between the home group of each key and the group where it's stored,
+// close to the max load factor and at the smallest capacity.
+//
+template <typename Hash>
+static bool probe_length_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<int, int, Hash>  map_type;
+    typedef typename map_type::size_type            size_type;
+
+    static constexpr size_type kGroupWidth = map_type::group_type::kGroupWidth;
+    static constexpr size_type kMaxProbeLength = 8;
+
+    bool passed = true;
+
+    for (std::size_t stride : kStrides) {
+        for (std::size_t count : { std::size_t(1), std::size_t(12), kKeyCount }) {
+            map_type map;
+            for (std::size_t i = 0; i < count; i++) {
+                map.emplace(static_cast<int>(i * stride), static_cast<int>(i));
+            }
+
+            size_type group_capacity = (map.bucket_count() + (kGroupWidth - 1)) / kGroupWidth;
+            size_type total_length = 0, max_length = 0;
+            for (auto iter = map.begin(); iter != map.end(); ++iter) {
+                size_type home_group = map.home_bucket(iter->first) / kGroupWidth;
+                size_type group = map.bucket(iter->first) / kGroupWidth;
+                size_type length = (group + group_capacity - home_group) % group_capacity;
+                total_length += length;
+                if (length > max_length)
+                    max_length = length;
+            }
+
+            if ((map.size() != count) || (max_length > kMaxProbeLength) ||
+                (total_length > map.size() / 4))
+                passed = false;
+            if (count == kKeyCount) {
+                printf("%s: keys = i * %u, load_factor = %0.3f, avg_probe = %0.3f, max_probe = %u\n",
+                       name, (uint32_t)stride, (double)map.load_factor(),
+                       (double)total_length / map.size(), (uint32_t)max_length);
+            }
+        }
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!fibonacci_bits_test("fibonacci_bits_test"))
+        failed++;
+
+    if (!independent_bits_test<jstd::fibonacci_hash_policy<fibonacci_int_hash>>(
+            "independent_bits_test<fibonacci_hash_policy>"))
+        failed++;
+    if (!independent_bits_test<jstd::mum_hash_policy<std::hash<int>>>(
+            "independent_bits_test<mum_hash_policy>"))
+        failed++;
+
+#if CLUSTER_USE_HASH_POLICY
+    if (!probe_length_test<std::hash<int>>("probe_length_test<mum_hash_policy>"))
+        failed++;
+    if (!probe_length_test<fibonacci_int_hash>("probe_length_test<fibonacci_hash_policy>"))
+        failed++;
+#endif
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,242 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// Built with CLUSTER_USE_INCREMENTAL_REHASH=1, the growth keeps the old arrays, and each
+// non-const operation migrates a few old groups, see cluster_flat_table::start_incremental_rehash().
+//
+#if !defined(CLUSTER_USE_INCREMENTAL_REHASH) || (CLUSTER_USE_INCREMENTAL_REHASH == 0)
+#error "cluster_flat_map_incremental_rehash_test must be built with CLUSTER_USE_INCREMENTAL_REHASH=1"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t>    map_type;
+typedef std::unordered_map<std::size_t, std::size_t>        ref_map_type;
+
+static std::size_t make_key(std::size_t i)
+{
+    return i * 2654435761ull + 1;
+}
+
+//
+// The const lookups and the iteration don't migrate, they must see
+// the elements of both the old and the new arrays.
+//
+static bool is_same_map_rehashing(const map_type & map, const ref_map_type & ref)
+{
+    if (!is_same_map(map, ref))
+        return false;
+
+    for (auto ref_iter = ref.begin(); ref_iter != ref.end(); ++ref_iter) {
+        if (!map.contains(ref_iter->first))
+            return false;
+    }
+    return true;
+}
+
+//
+// Insert until a growth starts the incremental rehash.
+//
+static void insert_until_rehashing(map_type & map, ref_map_type & ref, std::size_t & next)
+{
+    while (!map.is_rehashing()) {
+        std::size_t key = make_key(next);
+        map.emplace(key, next);
+        ref.emplace(key, next);
+        next++;
+    }
+}
+
+//
+// The lookups in the middle of a migration: the const lookups don't migrate,
+// and the non-const find(), insert() and erase() migrate and still see all keys.
+//
+static bool lookup_while_rehashing_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    std::size_t next = 0;
+    std::size_t rehashes = 0;
+    bool passed = true;
+
+    while (ref.size() < kKeyCount) {
+        insert_until_rehashing(map, ref, next);
+        rehashes++;
+
+        // Const lookups, the migration doesn't move on.
+        const map_type & cmap = map;
+        passed = passed && is_same_map_rehashing(cmap, ref);
+        if (!map.is_rehashing())
+            passed = false;
+
+        // The misses look up both arrays.
+        for (std::size_t i = 0; i < 1000; i++) {
+            if (cmap.find(make_key(next + i)) != cmap.end())
+                passed = false;
+        }
+
+        // Non-const lookups migrate the old groups, every key is found before and after its move.
+        std::size_t steps = 0;
+        for (std::size_t i = 0; (i < next) && map.is_rehashing(); i++) {
+            std::size_t key = make_key(i);
+            auto iter = map.find(key);
+            auto ref_iter = ref.find(key);
+            if (ref_iter == ref.end()) {
+                if (iter != map.end())
+                    passed = false;
+            } else if ((iter == map.end()) || (iter->second != ref_iter->second)) {
+                passed = false;
+            }
+            steps++;
+            // Erase and insert back some keys in the middle of the migration.
+            if ((i % 7) == 0) {
+                if (map.erase(key) != ref.erase(key))
+                    passed = false;
+            } else if ((i % 7) == 1) {
+                map.insert_or_assign(key, i + 1);
+                ref[key] = i + 1;
+            }
+        }
+        if (steps == 0)
+            passed = false;
+        passed = passed && is_same_map_rehashing(map, ref);
+
+        // Erase by the iterators of the old arrays.
+        insert_until_rehashing(map, ref, next);
+        for (auto iter = map.begin(); (iter != map.end()) && map.is_rehashing(); ) {
+            if ((iter->second % 5) == 0) {
+                ref.erase(iter->first);
+                iter = map.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+        map.finish_rehash();
+        passed = passed && !map.is_rehashing() && is_same_map_rehashing(map, ref);
+        if (!passed)
+            break;
+    }
+
+    printf("rehashes = %zu, size = %zu, capacity = %zu\n",
+           rehashes, map.size(), map.slot_capacity());
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The copy, the move, the swap, rehash() and clear() in the middle of a migration.
+//
+static bool copy_move_while_rehashing_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    std::size_t next = 0;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount / 4; i++) {
+        map.emplace(make_key(i), i);
+        ref.emplace(make_key(i), i);
+        next++;
+    }
+    insert_until_rehashing(map, ref, next);
+
+    map_type copy(map);
+    passed = passed && is_same_map_rehashing(copy, ref) && is_same_map_rehashing(map, ref);
+
+    map_type assigned;
+    assigned.emplace(make_key(kKeyCount * 4), 0);
+    assigned = map;
+    passed = passed && is_same_map_rehashing(assigned, ref);
+
+    map_type moved(std::move(copy));
+    passed = passed && is_same_map_rehashing(moved, ref);
+
+    map_type other;
+    other.swap(moved);
+    passed = passed && is_same_map_rehashing(other, ref) && moved.empty();
+
+    // rehash() finishes the migration first.
+    map.rehash(map.slot_capacity() * 2);
+    passed = passed && !map.is_rehashing() && is_same_map_rehashing(map, ref);
+
+    insert_until_rehashing(map, ref, next);
+    map.clear();
+    ref.clear();
+    passed = passed && !map.is_rehashing() && is_same_map_rehashing(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!lookup_while_rehashing_test("lookup_while_rehashing_test"))
+        failed++;
+    if (!copy_move_while_rehashing_test("copy_move_while_rehashing_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
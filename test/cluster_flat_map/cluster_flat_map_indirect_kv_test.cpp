@@ -0,0 +1,329 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// The mapped type is larger than 32 bytes, so cluster_flat_table switches to the indirect
+// mode (kIsIndirectKV): the elements are dense, and the erase moves the last element into
+// the hole. Also built with CLUSTER_USE_INCREMENTAL_REHASH=1.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// 56 bytes with a std::string, so a wrong move or a double destroy shows up.
+//
+struct large_value {
+    std::size_t a;
+    std::size_t b;
+    std::size_t c;
+    std::string str;
+
+    large_value() : a(0), b(0), c(0) {}
+    explicit large_value(std::size_t i)
+        : a(i), b(i * 3 + 1), c(~i), str(make_string(i)) {}
+
+    bool operator == (const large_value & rhs) const {
+        return (this->a == rhs.a) && (this->b == rhs.b) &&
+               (this->c == rhs.c) && (this->str == rhs.str);
+    }
+};
+
+typedef jstd::cluster_flat_map<std::size_t, large_value>    map_type;
+typedef std::unordered_map<std::size_t, large_value>        ref_map_type;
+
+static_assert((sizeof(large_value) > sizeof(std::size_t) * 4),
+              "large_value must be larger than 32 bytes");
+static_assert(map_type::table_type::kIsIndirectKV,
+              "cluster_flat_map<std::size_t, large_value> must be in the indirect mode");
+
+//
+// The random inserts, assigns and erases (by key and by iterator) against
+// std::unordered_map, through the growths.
+//
+static bool random_operation_test(const char * name)
+{
+    static const std::size_t kOperations = kKeyCount * 4;
+    static const std::size_t kKeyRange = kKeyCount / 2;
+
+    map_type map;
+    ref_map_type ref;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kOperations && passed; i++) {
+        std::size_t key = next_random(state) % kKeyRange;
+        std::size_t op = next_random(state) % 8;
+        switch (op) {
+        case 0:
+        case 1:
+        case 2: {
+            auto result = map.emplace(key, large_value(i));
+            auto ref_result = ref.emplace(key, large_value(i));
+            if ((result.second != ref_result.second) || (result.first->first != key) ||
+                !(result.first->second == ref_result.first->second))
+                passed = false;
+            break;
+        }
+        case 3: {
+            auto result = map.insert_or_assign(key, large_value(i));
+            ref[key] = large_value(i);
+            if ((result.first->first != key) || !(result.first->second == ref[key]))
+                passed = false;
+            break;
+        }
+        case 4:
+        case 5: {
+            if (map.erase(key) != ref.erase(key))
+                passed = false;
+            break;
+        }
+        case 6: {
+            auto iter = map.find(key);
+            if ((iter != map.end()) != (ref.count(key) != 0)) {
+                passed = false;
+            } else if (iter != map.end()) {
+                map.erase(iter);
+                ref.erase(key);
+            }
+            break;
+        }
+        default: {
+            auto iter = map.find(key);
+            auto ref_iter = ref.find(key);
+            if ((iter != map.end()) != (ref_iter != ref.end()) ||
+                ((iter != map.end()) && !(iter->second == ref_iter->second)))
+                passed = false;
+            break;
+        }
+        }
+        if ((i % (kOperations / 8)) == 0)
+            passed = passed && is_same_map(map, ref);
+    }
+    passed = passed && is_same_map(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// Erase the odd values while iterating: the erase moves the last element into the hole,
+// and returns the iterator to it, so every element is still visited once.
+// Then erase a range in the middle.
+//
+static bool erase_while_iterating_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    std::vector<std::size_t> visits(kKeyCount, 0);
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t key = i * 2654435761ull + 1;
+        map.emplace(key, large_value(i));
+        if ((i & 1) == 0)
+            ref.emplace(key, large_value(i));
+    }
+
+    for (auto iter = map.begin(); iter != map.end(); ) {
+        visits[iter->second.a]++;
+        if ((iter->second.a & 1) != 0)
+            iter = map.erase(iter);
+        else
+            ++iter;
+    }
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        if (visits[i] != 1) {
+            passed = false;
+            break;
+        }
+    }
+    passed = passed && is_same_map(map, ref);
+
+    // erase(first, last) of the second quarter
+    std::size_t index = 0;
+    auto first = map.cbegin(), last = map.cbegin();
+    for (auto iter = map.cbegin(); iter != map.cend(); ++iter, ++index) {
+        if (index == map.size() / 4)
+            first = iter;
+        if (index == map.size() / 2) {
+            last = iter;
+            break;
+        }
+    }
+    std::vector<std::size_t> erased_keys;
+    for (auto iter = first; iter != last; ++iter) {
+        erased_keys.push_back(iter->first);
+    }
+    map.erase(first, last);
+    for (std::size_t i = 0; i < erased_keys.size(); i++) {
+        ref.erase(erased_keys[i]);
+    }
+    passed = passed && !erased_keys.empty() && is_same_map(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// rehash(), reserve() and shrink_to_fit() after the erases.
+//
+static bool rehash_shrink_test(const char * name)
+{
+    map_type map;
+    ref_map_type ref;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.emplace(i, large_value(i));
+        ref.emplace(i, large_value(i));
+    }
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        if ((i % 4) != 0) {
+            map.erase(i);
+            ref.erase(i);
+        }
+    }
+    passed = passed && is_same_map(map, ref);
+
+    std::size_t capacity = map.slot_capacity();
+    map.shrink_to_fit();
+    passed = passed && (map.slot_capacity() < capacity) && is_same_map(map, ref);
+
+    map.rehash(kKeyCount * 2);
+    passed = passed && (map.slot_capacity() >= kKeyCount * 2) && is_same_map(map, ref);
+
+    map.reserve(kKeyCount * 4);
+    for (std::size_t i = kKeyCount; i < kKeyCount * 2; i++) {
+        map.emplace(i, large_value(i));
+        ref.emplace(i, large_value(i));
+    }
+    passed = passed && is_same_map(map, ref);
+
+    map.clear();
+    ref.clear();
+    passed = passed && map.empty() && (map.begin() == map.end()) && is_same_map(map, ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+static bool copy_move_swap_test(const char * name)
+{
+    map_type map1, map2;
+    ref_map_type ref1, ref2;
+    bool passed = true;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map1.emplace(i, large_value(i));
+        ref1.emplace(i, large_value(i));
+    }
+    for (std::size_t i = 0; i < kKeyCount / 10; i++) {
+        map2.emplace(i + kKeyCount, large_value(i));
+        ref2.emplace(i + kKeyCount, large_value(i));
+    }
+
+    map_type copy1(map1);
+    passed = passed && is_same_map(copy1, ref1) && is_same_map(map1, ref1);
+
+    map_type copy2;
+    copy2.emplace(kKeyCount * 2, large_value(0));
+    copy2 = map2;
+    passed = passed && is_same_map(copy2, ref2);
+
+    map_type moved1(std::move(copy1));
+    passed = passed && is_same_map(moved1, ref1) && copy1.empty();
+
+    map_type moved2;
+    moved2 = std::move(copy2);
+    passed = passed && is_same_map(moved2, ref2) && copy2.empty();
+
+    moved1.swap(moved2);
+    passed = passed && is_same_map(moved1, ref2) && is_same_map(moved2, ref1);
+
+    // The copies are independent of the originals.
+    moved2.erase(std::size_t(0));
+    moved1.emplace(kKeyCount * 3, large_value(3));
+    passed = passed && is_same_map(map1, ref1) && is_same_map(map2, ref2);
+    ref1.erase(std::size_t(0));
+    ref2.emplace(kKeyCount * 3, large_value(3));
+    passed = passed && is_same_map(moved1, ref2) && is_same_map(moved2, ref1);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!random_operation_test("random_operation_test"))
+        failed++;
+    if (!erase_while_iterating_test("erase_while_iterating_test"))
+        failed++;
+    if (!rehash_shrink_test("rehash_shrink_test"))
+        failed++;
+    if (!copy_move_swap_test("copy_move_swap_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,279 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// Built with CLUSTER_USE_OVERFLOW_COUNTER=1, each group has a saturating counter of
+// the elements displaced past it, see cluster_flat_table::decrease_overflow_counters().
+//
+#if !defined(CLUSTER_USE_OVERFLOW_COUNTER) || (CLUSTER_USE_OVERFLOW_COUNTER == 0)
+#error "cluster_flat_map_overflow_counter_test must be built with CLUSTER_USE_OVERFLOW_COUNTER=1"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// All the keys have the same hash code, so they fill their home group and then
+// the next groups in order, each key displaced past all the groups before it.
+//
+struct collide_hash {
+    typedef std::size_t result_type;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        (void)key;
+        return 0x5A5A5A5Aul;
+    }
+};
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t, collide_hash>  collide_map;
+
+// The groups passed by n colliding keys: all but the last group they fill.
+static std::size_t passed_groups(std::size_t n, std::size_t group_width)
+{
+    return (n != 0) ? ((n - 1) / group_width) : 0;
+}
+
+static std::size_t overflow_groups(const collide_map & map)
+{
+    return map.stats().overflow_groups;
+}
+
+static bool is_all_found(const collide_map & map, const std::vector<std::size_t> & keys,
+                         std::size_t first, std::size_t last)
+{
+    for (std::size_t i = first; i < last; i++) {
+        auto iter = map.find(keys[i]);
+        if ((iter == map.end()) || (iter->second != keys[i] * 3))
+            return false;
+    }
+    return true;
+}
+
+//
+// The counters are exact while they don't saturate: an insert counts the groups it
+// passes, an erase (by key or by iterator) uncounts them, and the emptied table has
+// no overflow group left, whatever the order of the erases.
+//
+static bool exact_counter_test(const char * name)
+{
+    static const std::size_t kCollideCount = 200;
+
+    collide_map map;
+    map.reserve(1024);
+    const std::size_t slot_capacity = map.slot_capacity();
+    const std::size_t group_width = map.slot_capacity() / map.group_capacity();
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    bool passed = true;
+
+    std::vector<std::size_t> keys;
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        keys.push_back(i * 7 + 1);
+    }
+
+    // Insert, then erase the last inserted keys first.
+    for (std::size_t n = 1; n <= kCollideCount; n++) {
+        map.emplace(keys[n - 1], keys[n - 1] * 3);
+        if (overflow_groups(map) != passed_groups(n, group_width))
+            passed = false;
+    }
+    for (std::size_t n = kCollideCount; n > 0; n--) {
+        if ((n & 1) == 0) {
+            if (map.erase(keys[n - 1]) != 1)
+                passed = false;
+        } else {
+            auto iter = map.find(keys[n - 1]);
+            if (iter == map.end())
+                passed = false;
+            else
+                map.erase(iter);
+        }
+        if (overflow_groups(map) != passed_groups(n - 1, group_width))
+            passed = false;
+        passed = passed && is_all_found(map, keys, 0, n - 1);
+    }
+    passed = passed && map.empty() && (overflow_groups(map) == 0);
+
+    // Insert again, then erase in a random order.
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        map.emplace(keys[i], keys[i] * 3);
+    }
+    std::size_t max_overflow_groups = overflow_groups(map);
+    for (std::size_t i = kCollideCount - 1; i > 0; i--) {
+        std::size_t j = next_random(state) % (i + 1);
+        std::swap(keys[i], keys[j]);
+    }
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        if (map.erase(keys[i]) != 1)
+            passed = false;
+        if (map.find(keys[i]) != map.end())
+            passed = false;
+        passed = passed && is_all_found(map, keys, i + 1, kCollideCount);
+    }
+    passed = passed && map.empty() && (overflow_groups(map) == 0);
+    passed = passed && (map.slot_capacity() == slot_capacity);
+
+    printf("overflow groups = %zu / %zu, after erase all = %zu\n",
+           max_overflow_groups, map.group_capacity(), overflow_groups(map));
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// A counter that reached the max is sticky: the erases don't decrease it, so the
+// keys displaced past its group are still found, until a rehash rebuilds it.
+//
+static bool saturated_counter_test(const char * name)
+{
+    static const std::size_t kCollideCount = 384;
+
+    collide_map map;
+    map.reserve(1024);
+    const std::size_t group_width = map.slot_capacity() / map.group_capacity();
+    std::uint64_t state = 0x2545F4914F6CDD1Dull;
+    bool passed = true;
+
+    std::vector<std::size_t> keys;
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        keys.push_back(i * 7 + 1);
+        map.emplace(keys[i], keys[i] * 3);
+    }
+    // The groups passed by 255 keys or more.
+    std::size_t saturated_groups = 0;
+    while (kCollideCount >= group_width * (saturated_groups + 1) + 255) {
+        saturated_groups++;
+    }
+    if ((saturated_groups == 0) || (overflow_groups(map) != passed_groups(kCollideCount, group_width)))
+        passed = false;
+
+    for (std::size_t i = kCollideCount - 1; i > 0; i--) {
+        std::size_t j = next_random(state) % (i + 1);
+        std::swap(keys[i], keys[j]);
+    }
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        map.erase(keys[i]);
+        passed = passed && is_all_found(map, keys, i + 1, kCollideCount);
+    }
+    std::size_t sticky_groups = overflow_groups(map);
+    passed = passed && map.empty() && (sticky_groups == saturated_groups);
+
+    map.emplace(keys[0], keys[0] * 3);
+    map.rehash(map.slot_capacity() * 2);
+    passed = passed && (overflow_groups(map) == 0) && is_all_found(map, keys, 0, 1);
+
+    printf("saturated groups = %zu, after erase all = %zu, after rehash = %zu\n",
+           saturated_groups, sticky_groups, overflow_groups(map));
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The copy and the move take the counters with the slots, the rehash rebuilds them:
+// the counts stay exact, the erase of all the keys brings each one back to zero.
+//
+static bool copy_move_rehash_test(const char * name)
+{
+    static const std::size_t kCollideCount = 200;
+
+    collide_map map;
+    map.reserve(1024);
+    const std::size_t group_width = map.slot_capacity() / map.group_capacity();
+    bool passed = true;
+
+    std::vector<std::size_t> keys;
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        keys.push_back(i * 7 + 1);
+        map.emplace(keys[i], keys[i] * 3);
+    }
+    const std::size_t expected = passed_groups(kCollideCount, group_width);
+
+    collide_map copy(map);
+    passed = passed && (overflow_groups(copy) == expected) && is_all_found(copy, keys, 0, kCollideCount);
+
+    collide_map moved(std::move(copy));
+    passed = passed && (overflow_groups(moved) == expected) && is_all_found(moved, keys, 0, kCollideCount);
+
+    map.rehash(map.slot_capacity() * 4);
+    passed = passed && (overflow_groups(map) == expected) && is_all_found(map, keys, 0, kCollideCount);
+
+    for (std::size_t i = 0; i < kCollideCount; i++) {
+        moved.erase(keys[i]);
+        map.erase(keys[i]);
+    }
+    passed = passed && moved.empty() && (overflow_groups(moved) == 0);
+    passed = passed && map.empty() && (overflow_groups(map) == 0);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!exact_counter_test("exact_counter_test"))
+        failed++;
+    if (!saturated_counter_test("saturated_counter_test"))
+        failed++;
+    if (!copy_move_rehash_test("copy_move_rehash_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
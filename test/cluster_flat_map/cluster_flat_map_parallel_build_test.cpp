@@ -0,0 +1,252 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// cluster_flat_map::parallel_build(): the partitioned fill keeps the first value of
+// the duplicate keys, the values deferred past the range ends are still found, and
+// the tables it doesn't partition are filled serially with the same contents.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#define TEST_KEY_COUNT  200000
+#include "common/test_utils.h"
+
+typedef std::pair<std::size_t, std::size_t>         value_type;
+typedef std::unordered_map<std::size_t, std::size_t> ref_map_type;
+
+//
+// The value of a key is the index of its first occurrence, an eighth of the keys
+// occur again later in the range, so they often fall in the other chunks.
+//
+static std::vector<value_type> make_values(std::size_t count, ref_map_type & ref)
+{
+    std::vector<value_type> values;
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    values.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t key;
+        if ((i >= 2) && ((next_random(state) % 8) == 0))
+            key = values[next_random(state) % i].first;
+        else
+            key = next_random(state);
+        values.push_back(std::make_pair(key, i));
+        ref.emplace(key, i);
+    }
+    return values;
+}
+
+//
+// Each number of threads, 0 (hardware_concurrency()) and more than the table can
+// partition too, gives the first value of each key and returns the number of the
+// distinct keys, and it reserves the table once for all the values.
+//
+static bool first_value_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::size_t, std::size_t> map_type;
+
+    static const std::size_t kThreadCounts[] = { 0, 2, 3, 4, 8, 1000 };
+
+    ref_map_type ref;
+    auto values = make_values(kKeyCount, ref);
+
+    map_type reserved;
+    reserved.reserve(values.size());
+
+    bool passed = true;
+    for (std::size_t t = 0; t < sizeof(kThreadCounts) / sizeof(kThreadCounts[0]); t++) {
+        map_type map;
+        std::size_t inserted = map.parallel_build(values.begin(), values.end(), kThreadCounts[t]);
+        if ((inserted != ref.size()) || (map.slot_capacity() != reserved.slot_capacity()))
+            passed = false;
+        passed = passed && is_same_map(map, ref);
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// 64 keys share each hash code, so the clusters often probe past the end of their
+// group range: the deferred values are inserted at last, and the overflow marks
+// set by the threads still lead the lookups and the erases to them.
+//
+struct clustered_hash {
+    typedef std::size_t result_type;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        return std::hash<std::size_t>()(key / 64);
+    }
+};
+
+static bool deferred_value_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::size_t, std::size_t, clustered_hash> map_type;
+
+    static const std::size_t kCount = 65536;
+
+    std::vector<value_type> values;
+    for (std::size_t i = 0; i < kCount; i++) {
+        values.push_back(std::make_pair(i, i * 3));
+    }
+
+    map_type map;
+    std::size_t inserted = map.parallel_build(values.begin(), values.end(), 4);
+    bool passed = (inserted == kCount) && (map.size() == kCount);
+
+    for (std::size_t i = 0; i < kCount; i++) {
+        auto iter = map.find(i);
+        if ((iter == map.end()) || (iter->second != i * 3))
+            passed = false;
+        if (map.find(kCount + i) != map.end())
+            passed = false;
+    }
+    for (std::size_t i = 0; i < kCount; i += 2) {
+        if (map.erase(i) != 1)
+            passed = false;
+    }
+    for (std::size_t i = 0; i < kCount; i++) {
+        bool found = (map.find(i) != map.end());
+        if (found != ((i & 1) != 0))
+            passed = false;
+    }
+
+    print_result(name, passed);
+    return passed;
+}
+
+// Larger than 32 bytes, so it's stored in the indirect layout.
+struct big_value {
+    std::size_t data[8];
+
+    big_value() : data() {}
+    big_value(std::size_t i) : data() { data[0] = i; }
+
+    bool operator == (const big_value & rhs) const noexcept {
+        return (this->data[0] == rhs.data[0]);
+    }
+};
+
+//
+// The non-empty table, the small range, the single thread, the non random access
+// iterators and the indirect layout are inserted serially, with the same contents.
+//
+static bool fallback_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::size_t, std::size_t> map_type;
+
+    bool passed = true;
+    ref_map_type ref;
+    auto values = make_values(kKeyCount / 2, ref);
+
+    // The non-empty table.
+    map_type map;
+    std::size_t half = values.size() / 2;
+    for (std::size_t i = 0; i < half; i++) {
+        map.insert(values[i]);
+    }
+    std::size_t old_size = map.size();
+    std::size_t inserted = map.parallel_build(values.begin() + half, values.end(), 4);
+    if (inserted != (map.size() - old_size))
+        passed = false;
+    passed = passed && is_same_map(map, ref);
+
+    // The small range and the single thread.
+    ref_map_type small_ref;
+    auto small_values = make_values(100, small_ref);
+    map_type small_map;
+    inserted = small_map.parallel_build(small_values.begin(), small_values.end(), 4);
+    passed = passed && (inserted == small_ref.size()) && is_same_map(small_map, small_ref);
+
+    map_type single_map;
+    inserted = single_map.parallel_build(values.begin(), values.end(), 1);
+    passed = passed && (inserted == ref.size()) && is_same_map(single_map, ref);
+
+    // The non random access iterators.
+    std::list<value_type> list(values.begin(), values.end());
+    map_type list_map;
+    inserted = list_map.parallel_build(list.begin(), list.end(), 4);
+    passed = passed && (inserted == ref.size()) && is_same_map(list_map, ref);
+
+    // The indirect layout.
+    std::vector<std::pair<std::size_t, big_value>> big_values(values.begin(), values.end());
+    std::unordered_map<std::size_t, big_value> big_ref(ref.begin(), ref.end());
+    jstd::cluster_flat_map<std::size_t, big_value> big_map;
+    inserted = big_map.parallel_build(big_values.begin(), big_values.end(), 4);
+    passed = passed && (inserted == big_ref.size()) && is_same_map(big_map, big_ref);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!first_value_test("first_value_test"))
+        failed++;
+    if (!deferred_value_test("deferred_value_test"))
+        failed++;
+    if (!fallback_test("fallback_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,213 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// Built with CLUSTER_USE_PARALLEL_REHASH=1 and a small CLUSTER_PARALLEL_REHASH_MIN_SIZE,
+// so the growths of a small test already migrate by the threads, see
+// cluster_flat_table::parallel_migrate().
+//
+#if !defined(CLUSTER_USE_PARALLEL_REHASH) || (CLUSTER_USE_PARALLEL_REHASH == 0)
+#error "cluster_flat_map_parallel_rehash_test must be built with CLUSTER_USE_PARALLEL_REHASH=1"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// The threads move and destroy the values at once, so the live values are counted
+// atomically. A value moved twice, or lost, leaves the count off the size.
+//
+struct counted_value {
+    static std::atomic<std::ptrdiff_t> live_count;
+
+    std::size_t value;
+
+    counted_value(std::size_t v = 0) noexcept : value(v) { live_count++; }
+    counted_value(const counted_value & other) noexcept : value(other.value) { live_count++; }
+    counted_value(counted_value && other) noexcept : value(other.value) { live_count++; }
+    ~counted_value() { live_count--; }
+
+    counted_value & operator = (const counted_value & other) noexcept {
+        this->value = other.value;
+        return *this;
+    }
+};
+
+std::atomic<std::ptrdiff_t> counted_value::live_count(0);
+
+// The value may throw when it's moved, the threads can't migrate it.
+struct throwing_value {
+    std::size_t value;
+
+    throwing_value(std::size_t v = 0) : value(v) {}
+    throwing_value(const throwing_value & other) : value(other.value) {}
+};
+
+// Larger than 32 bytes, so it's stored in the indirect layout.
+struct big_value {
+    std::size_t data[8];
+};
+
+static_assert(jstd::cluster_flat_map<std::size_t, counted_value>::table_type::kIsParallelRehash,
+              "The nothrow movable values must migrate by the parallel rehash");
+static_assert(!jstd::cluster_flat_map<std::size_t, throwing_value>::table_type::kIsParallelRehash,
+              "The values which may throw when moved must migrate serially");
+static_assert(!jstd::cluster_flat_map<std::size_t, big_value>::table_type::kIsParallelRehash,
+              "The indirect layout must migrate serially");
+
+//
+// 64 keys share a hash code, so the threads contend for the same groups
+// and set the overflow bits of the long chains at once.
+//
+struct clustered_hash {
+    typedef std::size_t result_type;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        return std::hash<std::size_t>()(key / 64);
+    }
+};
+
+//
+// The keys [first, last) are found with their values, the next ones are not found,
+// and each live value is in the map.
+//
+template <typename Map>
+static bool is_all_found(const Map & map, std::size_t first, std::size_t last, std::size_t step)
+{
+    std::size_t count = 0;
+    for (std::size_t key = first; key < last; key += step) {
+        auto iter = map.find(key);
+        if ((iter == map.end()) || (iter->second.value != key * 3))
+            return false;
+        if (map.find(last + key) != map.end())
+            return false;
+        count++;
+    }
+    return (count == map.size()) &&
+           (counted_value::live_count.load() == static_cast<std::ptrdiff_t>(map.size()));
+}
+
+//
+// Each growth past CLUSTER_PARALLEL_REHASH_MIN_SIZE migrates by the threads: every value
+// is moved once and destroyed once, and the overflow bits lead to all of them, through
+// the growths, reserve(), shrink_to_fit() after the erases and rehash().
+//
+template <typename Hash>
+static bool migrate_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<std::size_t, counted_value, Hash> map_type;
+
+    std::size_t parallel_growths = 0;
+    bool passed = true;
+    {
+        map_type map;
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            std::size_t capacity = map.slot_capacity();
+            std::size_t size = map.size();
+            map.emplace(i, counted_value(i * 3));
+            if (map.slot_capacity() != capacity) {
+                if (size >= CLUSTER_PARALLEL_REHASH_MIN_SIZE)
+                    parallel_growths++;
+                passed = passed && is_all_found(map, 0, i + 1, 1);
+            }
+        }
+        passed = passed && (parallel_growths != 0) && is_all_found(map, 0, kKeyCount, 1);
+
+        std::size_t capacity = map.slot_capacity();
+        map.reserve(kKeyCount * 4);
+        passed = passed && (map.slot_capacity() > capacity) && is_all_found(map, 0, kKeyCount, 1);
+
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            if ((i % 4) != 0)
+                map.erase(i);
+        }
+        capacity = map.slot_capacity();
+        map.shrink_to_fit();
+        passed = passed && (map.slot_capacity() < capacity) && is_all_found(map, 0, kKeyCount, 4);
+
+        map.rehash(kKeyCount * 2);
+        passed = passed && (map.slot_capacity() >= kKeyCount * 2) && is_all_found(map, 0, kKeyCount, 4);
+
+        // The migrated table still inserts and erases.
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            if ((i % 4) != 0)
+                map.emplace(i, counted_value(i * 3));
+        }
+        passed = passed && is_all_found(map, 0, kKeyCount, 1);
+    }
+    passed = passed && (counted_value::live_count.load() == 0);
+
+    printf("%s: parallel growths = %zu\n", name, parallel_growths);
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!migrate_test<std::hash<std::size_t>>("migrate_test<std::hash>"))
+        failed++;
+    if (!migrate_test<clustered_hash>("migrate_test<clustered_hash>"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,285 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+//
+// Built with CLUSTER_USE_SEPARATE_SLOTS=0, the groups, the ctrls and the slots
+// share one allocation, see cluster_flat_table::create_slots().
+//
+#if !defined(CLUSTER_USE_SEPARATE_SLOTS) || (CLUSTER_USE_SEPARATE_SLOTS != 0)
+#error "cluster_flat_map_shared_slots_test must be built with CLUSTER_USE_SEPARATE_SLOTS=0"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <functional>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#define TEST_KEY_COUNT  50000
+#include "common/test_utils.h"
+
+//
+// The live blocks of an allocator and the address range of the last one.
+//
+struct block_stats {
+    std::size_t     live_blocks;
+    std::size_t     live_bytes;
+    std::uintptr_t  first;
+    std::uintptr_t  last;
+
+    block_stats() noexcept : live_blocks(0), live_bytes(0), first(0), last(0) {}
+};
+
+template <typename T>
+class block_allocator {
+public:
+    typedef T value_type;
+
+    block_stats * stats;
+
+    explicit block_allocator(block_stats * s) noexcept : stats(s) {}
+
+    template <typename U>
+    block_allocator(const block_allocator<U> & other) noexcept : stats(other.stats) {}
+
+    T * allocate(std::size_t n) {
+        T * ptr = std::allocator<T>().allocate(n);
+        this->stats->live_blocks++;
+        this->stats->live_bytes += n * sizeof(T);
+        this->stats->first = reinterpret_cast<std::uintptr_t>(ptr);
+        this->stats->last = reinterpret_cast<std::uintptr_t>(ptr + n);
+        return ptr;
+    }
+
+    void deallocate(T * ptr, std::size_t n) noexcept {
+        this->stats->live_blocks--;
+        this->stats->live_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator == (const block_allocator<U> & other) const noexcept {
+        return (this->stats == other.stats);
+    }
+
+    template <typename U>
+    bool operator != (const block_allocator<U> & other) const noexcept {
+        return (this->stats != other.stats);
+    }
+};
+
+//
+// The value is aligned stricter than the ctrls, the slots must still be aligned
+// inside the shared allocation. The pair is 64 bytes, so it's stored indirectly.
+//
+struct alignas(32) aligned_value {
+    std::size_t value;
+
+    aligned_value() noexcept : value(0) {}
+    aligned_value(std::size_t v) noexcept : value(v) {}
+};
+
+template <typename Value>
+using block_map = jstd::cluster_flat_map<std::size_t, Value, std::hash<std::size_t>,
+                                         std::equal_to<std::size_t>,
+                                         block_allocator<std::pair<const std::size_t, Value>>>;
+
+//
+// Every element lies in the block [first, last), after the groups of the map,
+// and is aligned as its type requires.
+//
+template <typename Map>
+static bool is_in_block(const Map & map, std::uintptr_t first, std::uintptr_t last)
+{
+    typedef typename Map::value_type    value_type;
+    typedef typename Map::group_type    group_type;
+
+    std::uintptr_t slots_first = first + map.group_capacity() * sizeof(group_type);
+    std::size_t count = 0;
+    for (auto iter = map.begin(); iter != map.end(); ++iter) {
+        std::uintptr_t addr = reinterpret_cast<std::uintptr_t>(&(*iter));
+        if ((addr < slots_first) || (addr + sizeof(value_type) > last))
+            return false;
+        if ((addr % alignof(value_type)) != 0)
+            return false;
+        if (iter->second.value != iter->first * 3)
+            return false;
+        count++;
+    }
+    return (count == map.size());
+}
+
+//
+// A table holds one block, through the growth, rehash(), shrink_to_fit() and clear(),
+// and gives it back when it's destroyed.
+//
+template <typename Value>
+static bool single_block_test(const char * name)
+{
+    typedef block_map<Value>                    map_type;
+    typedef typename map_type::allocator_type   allocator_type;
+
+    block_stats stats;
+    allocator_type allocator(&stats);
+    bool passed = true;
+    {
+        map_type map(allocator);
+        if (stats.live_blocks != 0)
+            passed = false;
+
+        std::size_t rehashes = 0;
+        std::size_t slot_capacity = map.slot_capacity();
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            map.emplace(i, Value(i * 3));
+            if (stats.live_blocks != 1)
+                passed = false;
+            if (map.slot_capacity() != slot_capacity) {
+                slot_capacity = map.slot_capacity();
+                passed = passed && is_in_block(map, stats.first, stats.last);
+                rehashes++;
+            }
+        }
+
+        map.rehash(map.slot_capacity() * 4);
+        passed = passed && (stats.live_blocks == 1) && is_in_block(map, stats.first, stats.last);
+        std::size_t max_bytes = stats.live_bytes;
+
+        for (std::size_t i = 0; i < kKeyCount; i += 2) {
+            map.erase(i);
+        }
+        map.shrink_to_fit();
+        passed = passed && (stats.live_blocks == 1) && (stats.live_bytes < max_bytes);
+        passed = passed && is_in_block(map, stats.first, stats.last);
+
+        map.clear();
+        passed = passed && (stats.live_blocks <= 1) && map.empty();
+
+        printf("rehashes = %zu, max block = %zu bytes\n", rehashes, max_bytes);
+    }
+    if ((stats.live_blocks != 0) || (stats.live_bytes != 0))
+        passed = false;
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// A copy allocates its own block, a move and a swap hand the blocks over.
+//
+static bool copy_move_swap_test(const char * name)
+{
+    typedef block_map<aligned_value>            map_type;
+    typedef map_type::allocator_type            allocator_type;
+
+    block_stats stats;
+    allocator_type allocator(&stats);
+    bool passed = true;
+    {
+        map_type map(allocator);
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            map.emplace(i, aligned_value(i * 3));
+        }
+        std::uintptr_t first = stats.first, last = stats.last;
+
+        map_type copy(map);
+        passed = passed && (stats.live_blocks == 2) && is_in_block(copy, stats.first, stats.last);
+        passed = passed && (stats.first != first) && is_in_block(map, first, last);
+        std::uintptr_t copy_first = stats.first, copy_last = stats.last;
+
+        map_type moved(std::move(map));
+        passed = passed && (stats.live_blocks == 2) && is_in_block(moved, first, last);
+
+        map_type other(allocator);
+        other.emplace(1, aligned_value(3));
+        passed = passed && (stats.live_blocks == 3);
+        std::uintptr_t other_first = stats.first, other_last = stats.last;
+
+        moved.swap(other);
+        passed = passed && (stats.live_blocks == 3);
+        passed = passed && (moved.size() == 1) && is_in_block(moved, other_first, other_last);
+        passed = passed && (other.size() == kKeyCount) && is_in_block(other, first, last);
+        passed = passed && is_in_block(copy, copy_first, copy_last);
+    }
+    if ((stats.live_blocks != 0) || (stats.live_bytes != 0))
+        passed = false;
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// A small value in the direct layout, it needs no padding between the groups and the slots.
+//
+struct small_value {
+    std::size_t value;
+
+    small_value() noexcept : value(0) {}
+    small_value(std::size_t v) noexcept : value(v) {}
+};
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!single_block_test<small_value>("single_block_test<small_value>"))
+        failed++;
+    if (!single_block_test<aligned_value>("single_block_test<aligned_value>"))
+        failed++;
+    if (!copy_move_swap_test("copy_move_swap_test<aligned_value>"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// cluster_flat_map built with CLUSTER_USE_STATS=1: the hit, miss, histogram and
+// rehash counters of stats(), and the striped counters are not embedded in the map.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+typedef jstd::cluster_flat_map<std::size_t, std::size_t>    map_type;
+typedef map_type::stats_type                                stats_type;
+typedef stats_type::size_type                               size_type;
+
+static_assert((CLUSTER_USE_STATS != 0), "the test must be built with CLUSTER_USE_STATS=1");
+
+//
+// The histogram counts each operation once, and the probed groups are at least
+// the groups counted by the histogram (except the last bucket).
+//
+static bool is_valid_probe_stats(const jstd::cluster_flat_probe_stats & probe)
+{
+    static const size_type kHistogramSize = jstd::cluster_flat_probe_stats::kHistogramSize;
+
+    if (probe.count != probe.hits + probe.misses)
+        return false;
+
+    size_type histogram_count = 0;
+    size_type histogram_groups = 0;
+    for (size_type i = 0; i < kHistogramSize; i++) {
+        histogram_count += probe.histogram[i];
+        histogram_groups += probe.histogram[i] * (i + 1);
+    }
+    if (histogram_count != probe.count)
+        return false;
+    if (probe.probed_groups < histogram_groups)
+        return false;
+    if ((probe.count != 0) && (probe.max_probed_groups == 0))
+        return false;
+    return true;
+}
+
+//
+// The counters of the inserts, finds and erases in one thread.
+//
+static bool counters_test(const char * name)
+{
+    map_type map;
+    bool passed = true;
+
+    stats_type stats = map.stats();
+    passed = stats.enabled && (stats.find.count == 0) && (stats.insert.count == 0) &&
+             (stats.erase.count == 0) && (stats.rehash_count == 0);
+
+    // The new keys are the insert misses, the existing keys are the hits.
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.emplace(i, make_size_t(i));
+    }
+    for (std::size_t i = 0; i < kKeyCount; i += 4) {
+        map.emplace(i, make_size_t(i));
+    }
+    stats = map.stats();
+    passed = passed && (stats.insert.misses == kKeyCount) && (stats.insert.hits == kKeyCount / 4) &&
+             is_valid_probe_stats(stats.insert);
+    // The growths from the empty map.
+    passed = passed && (stats.rehash_count > 0);
+
+    map.reset_stats();
+    stats = map.stats();
+    passed = passed && (stats.insert.count == 0) && (stats.rehash_count == 0);
+
+    // Each key is found, then the same count of the missing keys.
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        if (map.find(i) == map.end())
+            passed = false;
+        if (map.find(i + kKeyCount) != map.end())
+            passed = false;
+    }
+    stats = map.stats();
+    passed = passed && (stats.find.hits == kKeyCount) && (stats.find.misses == kKeyCount) &&
+             is_valid_probe_stats(stats.find) && (stats.insert.count == 0);
+
+    // Erase the half of the keys, and the missing keys.
+    for (std::size_t i = 0; i < kKeyCount; i += 2) {
+        map.erase(i);
+        map.erase(i + kKeyCount);
+    }
+    stats = map.stats();
+    passed = passed && (stats.erase.hits == kKeyCount / 2) && (stats.erase.misses == kKeyCount / 2) &&
+             is_valid_probe_stats(stats.erase);
+
+    // One rehash of reserve().
+    map.reset_stats();
+    map.reserve(map.slot_capacity() * 4);
+    stats = map.stats();
+    passed = passed && (stats.rehash_count == 1) && (stats.size == kKeyCount / 2) &&
+             (stats.slot_capacity == map.slot_capacity());
+
+    // The copy has its own counters.
+    map_type copy(map);
+    passed = passed && (copy.stats().rehash_count == 0) && (copy.stats().find.count == 0);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The concurrent const lookups record into the stripes of their threads, the
+// threads which share a stripe (e.g. there is only one hardware thread) may lose
+// some counts, so only the bounds are checked.
+//
+static bool concurrent_find_test(const char * name)
+{
+    static const std::size_t kThreads = 4;
+
+    map_type map;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.emplace(i, make_size_t(i));
+    }
+    map.reset_stats();
+
+    const map_type & const_map = map;
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&const_map]() {
+            for (std::size_t i = 0; i < kKeyCount; i++) {
+                const_map.find(i);
+            }
+        });
+    }
+    for (std::size_t t = 0; t < kThreads; t++) {
+        threads[t].join();
+    }
+
+    stats_type stats = map.stats();
+    bool passed = (stats.find.misses == 0) && (stats.find.hits > 0) &&
+                  (stats.find.hits <= kKeyCount * kThreads);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// The stripes are allocated at the first record, not embedded in the map.
+//
+static bool map_size_test(const char * name)
+{
+    typedef jstd::cluster_flat_map<int, int> int_map_type;
+
+    bool passed = (sizeof(int_map_type) < 256);
+    printf("sizeof(cluster_flat_map<int, int>) = %u\n", (unsigned)sizeof(int_map_type));
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!counters_test("counters_test"))
+        failed++;
+    if (!concurrent_find_test("concurrent_find_test"))
+        failed++;
+    if (!map_size_test("map_size_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,140 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#ifndef JSTD_TEST_COMMON_TEST_UTILS_H
+#define JSTD_TEST_COMMON_TEST_UTILS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+//
+// The helpers shared by the tests in test/: each test is one translation unit,
+// so they are static and defined here.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "jstd/test/Test.h"
+
+//
+// The number of the keys of a test, define TEST_KEY_COUNT before the include
+// to change it.
+//
+#ifndef TEST_KEY_COUNT
+#define TEST_KEY_COUNT  100000
+#endif
+
+static const std::size_t kKeyCount = TEST_KEY_COUNT;
+
+static void print_result(const char * name, bool passed)
+{
+    printf("%s: ", name);
+    if (passed)
+        jstd::print_passed();
+    else
+        jstd::print_failed();
+    printf("\n");
+}
+
+static std::size_t next_random(std::uint64_t & state)
+{
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return static_cast<std::size_t>(state);
+}
+
+static std::size_t make_size_t(std::size_t i)
+{
+    return i * 31 + 7;
+}
+
+static std::string make_string(std::size_t i)
+{
+    // Longer than the small string buffer.
+    return std::string("cluster_flat_map_value_") + std::to_string(i);
+}
+
+//
+// The map and the reference map have the same elements: each element of the map is
+// found in the reference map, the iteration visits size() elements, and each element
+// of the reference map is found by map.find().
+//
+template <typename Map, typename RefMap>
+static bool is_same_map(const Map & map, const RefMap & ref)
+{
+    if (map.size() != ref.size())
+        return false;
+
+    std::size_t count = 0;
+    for (auto iter = map.cbegin(); iter != map.cend(); ++iter) {
+        auto ref_iter = ref.find(iter->first);
+        if ((ref_iter == ref.end()) || !(ref_iter->second == iter->second))
+            return false;
+        count++;
+    }
+    if (count != ref.size())
+        return false;
+
+    for (auto ref_iter = ref.begin(); ref_iter != ref.end(); ++ref_iter) {
+        auto iter = map.find(ref_iter->first);
+        if ((iter == map.end()) || !(iter->second == ref_iter->second))
+            return false;
+    }
+    return true;
+}
+
+#endif // JSTD_TEST_COMMON_TEST_UTILS_H
@@ -0,0 +1,515 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "jstd/hashmap/concurrent_cluster_flat_map.hpp"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+static const std::size_t kThreads = 8;
+
+//
+// The element of the torn read test, the writers always keep a == b.
+//
+struct pair_value {
+    std::size_t a;
+    std::size_t b;
+};
+
+template <typename Func>
+void run_threads(std::size_t thread_count, Func && func)
+{
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(func, i);
+    }
+    for (std::size_t i = 0; i < thread_count; i++) {
+        threads[i].join();
+    }
+}
+
+//
+// All threads insert the same keys in different orders, the table grows from empty.
+// Each key must be inserted only once, and visited by all the other threads.
+// A round is short, so it's repeated to interleave the threads even on a few cores.
+//
+bool insert_unique_test()
+{
+    typedef jstd::concurrent_cluster_flat_map<std::size_t, std::size_t> map_type;
+
+    static const std::size_t kKeys = 4000;
+    static const std::size_t kRounds = 128;
+
+    bool passed = true;
+    for (std::size_t round = 0; round < kRounds && passed; round++) {
+        map_type map;
+        std::atomic<std::size_t> inserted(0);
+
+        run_threads(kThreads, [&map, &inserted](std::size_t thread_id) {
+            std::size_t count = 0;
+            for (std::size_t i = 0; i < kKeys; i++) {
+                // 7919 is a prime, so every thread visits all keys in its own order.
+                std::size_t key = (i * 7919 + thread_id * (kKeys / kThreads)) % kKeys;
+                if (map.insert_or_visit(std::make_pair(key, std::size_t(1)),
+                                        [](map_type::value_type & value) { value.second++; })) {
+                    count++;
+                }
+            }
+            inserted.fetch_add(count, std::memory_order_relaxed);
+        });
+
+        if ((inserted.load() != kKeys) || (map.size() != kKeys))
+            passed = false;
+        for (std::size_t key = 0; key < kKeys && passed; key++) {
+            std::size_t visits = 0;
+            if (map.cvisit(key, [&visits](const map_type::value_type & value) { visits = value.second; }) != 1 ||
+                visits != kThreads) {
+                passed = false;
+            }
+        }
+        std::size_t elements = map.cvisit_all([](const map_type::value_type &) {});
+        if (elements != kKeys)
+            passed = false;
+    }
+
+    print_result("insert_unique_test", passed);
+    return passed;
+}
+
+//
+// The readers cvisit() the keys while the writers keep assigning, erasing and inserting
+// them again, a reader must never see a torn element.
+//
+bool cvisit_torn_read_test()
+{
+    typedef jstd::concurrent_cluster_flat_map<std::size_t, pair_value> map_type;
+
+    static const std::size_t kKeys = 4096;
+    static const std::size_t kWriters = kThreads / 2;
+    static const std::size_t kRounds = 32;
+
+    map_type map;
+    for (std::size_t key = 0; key < kKeys; key++) {
+        map.insert(std::make_pair(key, pair_value { key, key }));
+    }
+
+    std::atomic<std::size_t> writers_done(0);
+    std::atomic<std::size_t> torn_reads(0);
+    std::atomic<std::size_t> found(0);
+
+    run_threads(kThreads, [&](std::size_t thread_id) {
+        if (thread_id < kWriters) {
+            for (std::size_t round = 1; round <= kRounds; round++) {
+                for (std::size_t key = thread_id; key < kKeys; key += kWriters) {
+                    // The values of a key are always equal to the key modulo kKeys.
+                    std::size_t value = key + round * kKeys;
+                    if ((key % 8) == (round % 8)) {
+                        map.erase(key);
+                        map.insert(std::make_pair(key, pair_value { value, value }));
+                    } else {
+                        map.insert_or_assign(key, pair_value { value, value });
+                    }
+                }
+                // Let the readers run between the rounds on the few cores.
+                std::this_thread::yield();
+            }
+            writers_done.fetch_add(1, std::memory_order_release);
+        } else {
+            std::size_t torn = 0, hits = 0;
+            do {
+                for (std::size_t key = 0; key < kKeys; key++) {
+                    hits += map.cvisit(key, [key, &torn](const map_type::value_type & value) {
+                        if ((value.first != key) || (value.second.a != value.second.b) ||
+                            ((value.second.a % kKeys) != key)) {
+                            torn++;
+                        }
+                    });
+                }
+                std::this_thread::yield();
+            } while (writers_done.load(std::memory_order_acquire) < kWriters);
+            torn_reads.fetch_add(torn, std::memory_order_relaxed);
+            found.fetch_add(hits, std::memory_order_relaxed);
+        }
+    });
+
+    bool passed = (torn_reads.load() == 0) && (found.load() != 0) && (map.size() == kKeys);
+    for (std::size_t key = 0; key < kKeys; key++) {
+        pair_value last = { 0, 0 };
+        if (map.cvisit(key, [&last](const map_type::value_type & value) { last = value.second; }) != 1 ||
+            (last.a != key + kRounds * kKeys) || (last.b != last.a)) {
+            passed = false;
+            break;
+        }
+    }
+
+    print_result("cvisit_torn_read_test", passed);
+    return passed;
+}
+
+//
+// The inserters insert the disjoint keys and look them up at once, while another
+// thread keeps growing and shrinking the table by rehash() and reserve().
+//
+bool rehash_coordination_test()
+{
+    typedef jstd::concurrent_cluster_flat_map<std::size_t, std::size_t> map_type;
+
+    static const std::size_t kKeysPerThread = 8192;
+    static const std::size_t kInserters = kThreads - 1;
+
+    map_type map;
+    std::atomic<std::size_t> inserters_done(0);
+    std::atomic<std::size_t> lost(0);
+    std::atomic<std::size_t> rehashes(0);
+
+    run_threads(kThreads, [&](std::size_t thread_id) {
+        if (thread_id < kInserters) {
+            std::size_t missing = 0;
+            for (std::size_t i = 0; i < kKeysPerThread; i++) {
+                std::size_t key = thread_id * kKeysPerThread + i;
+                map.insert(std::make_pair(key, key * 2));
+                std::size_t value = 0;
+                if (map.cvisit(key, [&value](const map_type::value_type & v) { value = v.second; }) != 1 ||
+                    value != key * 2) {
+                    missing++;
+                }
+            }
+            lost.fetch_add(missing, std::memory_order_relaxed);
+            inserters_done.fetch_add(1, std::memory_order_release);
+        } else {
+            std::size_t count = 0;
+            do {
+                if ((count % 2) == 0)
+                    map.reserve(map.size() * 4);
+                else
+                    map.rehash(0);
+                count++;
+                std::this_thread::yield();
+            } while (inserters_done.load(std::memory_order_acquire) < kInserters);
+            rehashes.store(count, std::memory_order_relaxed);
+        }
+    });
+
+    static const std::size_t kTotal = kInserters * kKeysPerThread;
+    bool passed = (lost.load() == 0) && (map.size() == kTotal) && (rehashes.load() != 0);
+    for (std::size_t key = 0; key < kTotal; key++) {
+        if (map.count(key) != 1) {
+            passed = false;
+            break;
+        }
+    }
+    std::size_t elements = map.cvisit_all([](const map_type::value_type &) {});
+    if (elements != kTotal)
+        passed = false;
+
+    print_result("rehash_coordination_test", passed);
+    return passed;
+}
+
+//
+// Each thread erases and inserts its own random keys at a fixed size. The erases leave
+// the overflow bits, they must not pile up until the misses probe the whole table,
+// and the table must not grow.
+//
+bool churn_test()
+{
+    typedef jstd::concurrent_cluster_flat_map<std::size_t, std::size_t> map_type;
+
+    static const std::size_t kKeysPerThread = 88000 / kThreads;
+    static const std::size_t kChurnRounds = 20;
+
+    map_type map(kKeysPerThread * kThreads);
+    std::vector<std::vector<std::size_t>> keys(kThreads);
+    std::atomic<std::size_t> failures(0);
+    std::atomic<std::size_t> max_overflow_groups(0);
+
+    // The low bits of a key are its thread, so the threads never share a key.
+    for (std::size_t t = 0; t < kThreads; t++) {
+        std::uint64_t state = 0x9E3779B97F4A7C15ull + t;
+        while (keys[t].size() < kKeysPerThread) {
+            std::size_t key = (next_random(state) & ~std::size_t(7)) | t;
+            if (map.insert(std::make_pair(key, key)))
+                keys[t].push_back(key);
+        }
+    }
+    std::size_t capacity = map.capacity();
+
+    run_threads(kThreads, [&](std::size_t thread_id) {
+        std::vector<std::size_t> & my_keys = keys[thread_id];
+        std::uint64_t state = 0x2545F4914F6CDD1Dull + thread_id;
+        std::size_t errors = 0;
+        for (std::size_t round = 0; round < kChurnRounds; round++) {
+            for (std::size_t i = 0; i < my_keys.size(); i++) {
+                std::size_t index = next_random(state) % my_keys.size();
+                if (map.erase(my_keys[index]) != 1)
+                    errors++;
+                std::size_t key;
+                do {
+                    key = (next_random(state) & ~std::size_t(7)) | thread_id;
+                } while (!map.insert(std::make_pair(key, key)));
+                my_keys[index] = key;
+            }
+            if (thread_id == 0) {
+                std::size_t overflow_groups = map.overflow_groups();
+                if (overflow_groups > max_overflow_groups.load(std::memory_order_relaxed))
+                    max_overflow_groups.store(overflow_groups, std::memory_order_relaxed);
+            }
+        }
+        failures.fetch_add(errors, std::memory_order_relaxed);
+    });
+
+    std::size_t group_capacity = map.capacity() / map_type::group_width();
+    bool passed = (failures.load() == 0) && (map.size() == kKeysPerThread * kThreads);
+    // The size doesn't change, so the table must not grow.
+    if (map.capacity() != capacity)
+        passed = false;
+    // If the overflow bits aren't cleared, almost all the groups overflow by now.
+    if (max_overflow_groups.load() > group_capacity / 2)
+        passed = false;
+    for (std::size_t t = 0; t < kThreads && passed; t++) {
+        for (std::size_t i = 0; i < keys[t].size(); i++) {
+            std::size_t value = 0;
+            if (map.cvisit(keys[t][i], [&value](const map_type::value_type & v) { value = v.second; }) != 1 ||
+                value != keys[t][i]) {
+                passed = false;
+                break;
+            }
+        }
+    }
+
+    printf("churn_test: max overflow groups = %zu / %zu\n", max_overflow_groups.load(), group_capacity);
+    print_result("churn_test", passed);
+    return passed;
+}
+
+//
+// Whether the value of the key is make_string(key) followed by the '+' appended by
+// the visitors, return the number of the '+'.
+//
+static bool is_valid_string_value(std::size_t key, const std::string & value, std::size_t & appends)
+{
+    std::string prefix = make_string(key);
+    if (value.compare(0, prefix.size(), prefix) != 0)
+        return false;
+    appends = value.size() - prefix.size();
+    return (value.find_first_not_of('+', prefix.size()) == std::string::npos);
+}
+
+//
+// The std::string values are always read under the group locks and their old arrays are
+// destroyed at once by the rehash. While the inserters insert the disjoint keys, the other
+// threads run each of visit(), visit_all(), erase_if(key, pred), erase_if(pred), and the
+// cvisit() with rehash() and reserve(). The visitors append a '+' to the values of the keys
+// (key % 7 >= 2), the erases take the keys (key % 7 == 0) and (key % 7 == 1), so each key
+// ends up either erased or holding all the '+' appended to it.
+//
+bool string_value_test()
+{
+    typedef jstd::concurrent_cluster_flat_map<std::size_t, std::string> map_type;
+
+    static_assert(!map_type::kIsOptimisticRead, "std::string must not be read optimistically");
+
+    static const std::size_t kInserters = 3;
+    static const std::size_t kKeysPerThread = 8192;
+    static const std::size_t kTotal = kInserters * kKeysPerThread;
+
+    map_type map;
+    std::atomic<std::size_t> inserters_done(0);
+    std::atomic<std::size_t> appends(0);
+    std::atomic<std::size_t> erased_by_key(0);
+    std::atomic<std::size_t> erased_by_pred(0);
+    std::atomic<std::size_t> bad_values(0);
+    std::atomic<std::size_t> rehashes(0);
+
+    run_threads(kThreads, [&](std::size_t thread_id) {
+        if (thread_id < kInserters) {
+            for (std::size_t i = 0; i < kKeysPerThread; i++) {
+                std::size_t key = thread_id * kKeysPerThread + i;
+                if (!map.emplace(key, make_string(key)))
+                    bad_values.fetch_add(1, std::memory_order_relaxed);
+                // Let the other threads run between the inserts on the few cores.
+                if ((i % 16) == 0)
+                    std::this_thread::yield();
+            }
+            inserters_done.fetch_add(1, std::memory_order_release);
+            return;
+        }
+
+        static const std::size_t kMinRounds = 4096;
+
+        std::size_t count = 0, bad = 0;
+        std::uint64_t state = 0x9E3779B97F4A7C15ull + thread_id;
+        for (std::size_t round = 0; (round < kMinRounds) ||
+             (inserters_done.load(std::memory_order_acquire) < kInserters); round++) {
+            std::size_t key = next_random(state) % kTotal;
+            switch (thread_id) {
+            case 3:
+                if ((key % 7) >= 2) {
+                    count += map.visit(key, [](map_type::value_type & value) {
+                        value.second.push_back('+');
+                    });
+                }
+                break;
+            case 4:
+                if ((key % 64) == 0) {
+                    map.visit_all([&count](map_type::value_type & value) {
+                        if ((value.first % 7) >= 2) {
+                            value.second.push_back('+');
+                            count++;
+                        }
+                    });
+                }
+                break;
+            case 5:
+                count += map.erase_if(key, [](map_type::value_type & value) {
+                    return ((value.first % 7) == 0);
+                });
+                break;
+            case 6:
+                if ((key % 64) == 0) {
+                    count += map.erase_if([](map_type::value_type & value) {
+                        return ((value.first % 7) == 1);
+                    });
+                }
+                break;
+            default:
+                map.cvisit(key, [key, &bad](const map_type::value_type & value) {
+                    std::size_t n;
+                    if ((value.first != key) || !is_valid_string_value(key, value.second, n))
+                        bad++;
+                });
+                if ((key % 256) == 0) {
+                    if ((count % 2) == 0)
+                        map.reserve(map.size() * 4);
+                    else
+                        map.rehash(0);
+                    count++;
+                }
+                break;
+            }
+            if ((key % 16) == 0)
+                std::this_thread::yield();
+        }
+
+        bad_values.fetch_add(bad, std::memory_order_relaxed);
+        if ((thread_id == 3) || (thread_id == 4))
+            appends.fetch_add(count, std::memory_order_relaxed);
+        else if (thread_id == 5)
+            erased_by_key.fetch_add(count, std::memory_order_relaxed);
+        else if (thread_id == 6)
+            erased_by_pred.fetch_add(count, std::memory_order_relaxed);
+        else
+            rehashes.fetch_add(count, std::memory_order_relaxed);
+    });
+
+    // Each key is either erased, or has the value with its appends.
+    std::size_t erased_keys[2] = { 0, 0 };
+    std::size_t total_appends = 0;
+    for (std::size_t key = 0; key < kTotal; key++) {
+        std::size_t n = 0;
+        bool valid = true;
+        std::size_t found = map.cvisit(key, [key, &n, &valid](const map_type::value_type & value) {
+            valid = is_valid_string_value(key, value.second, n);
+        });
+        if (!valid || ((key % 7) < 2 && n != 0))
+            bad_values.fetch_add(1, std::memory_order_relaxed);
+        if (found == 0) {
+            if ((key % 7) < 2)
+                erased_keys[key % 7]++;
+            else
+                bad_values.fetch_add(1, std::memory_order_relaxed);
+        }
+        total_appends += n;
+    }
+
+    bool passed = (bad_values.load() == 0) && (total_appends == appends.load()) &&
+                  (erased_keys[0] == erased_by_key.load()) && (erased_keys[1] == erased_by_pred.load()) &&
+                  (map.size() == kTotal - erased_keys[0] - erased_keys[1]) &&
+                  (appends.load() != 0) && (erased_by_pred.load() != 0) && (rehashes.load() != 0);
+
+    // What the concurrent erases left.
+    std::size_t rest = map.erase_if([](map_type::value_type & value) { return ((value.first % 7) < 2); });
+    passed = passed && (map.size() == kTotal - (kTotal + 6) / 7 - (kTotal + 5) / 7) &&
+             (rest == (kTotal + 6) / 7 + (kTotal + 5) / 7 - erased_keys[0] - erased_keys[1]);
+    std::size_t elements = map.visit_all([](map_type::value_type &) {});
+    passed = passed && (elements == map.size());
+
+    printf("string_value_test: appends = %zu, erased by key = %zu, erased by pred = %zu, rehashes = %zu\n",
+           appends.load(), erased_by_key.load(), erased_by_pred.load(), rehashes.load());
+    print_result("string_value_test", passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+    if (!insert_unique_test())
+        failed++;
+    if (!cvisit_torn_read_test())
+        failed++;
+    if (!rehash_coordination_test())
+        failed++;
+    if (!churn_test())
+        failed++;
+    if (!string_value_test())
+        failed++;
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
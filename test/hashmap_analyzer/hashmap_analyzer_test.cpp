@@ -0,0 +1,170 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// HashMapAnalyzer::start_cluster_analyse() over the visit_slot_layout() of each map:
+// the analysed entries are the elements of the map, and the group occupancy and
+// the displacements add up.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hashmap/robin_hash_map.h"
+#include "jstd/hashmap/flat16_hash_map.h"
+#include "jstd/hashmap/robin16_hash_map.h"
+#include "jstd/hashmap/hashmap_analyzer.h"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// The totals of the cluster analysis of the map.
+//
+template <typename Map>
+static bool is_valid_cluster_result(const Map & map)
+{
+    typedef jstd::HashMapAnalyzer<Map>                      analyzer_type;
+    typedef typename analyzer_type::ClusterResult           result_type;
+    typedef typename analyzer_type::size_type               size_type;
+
+    static_assert(analyzer_type::kIsClusterSupported, "the map must support visit_slot_layout()");
+
+    analyzer_type analyzer(map);
+    if (!analyzer.start_cluster_analyse())
+        return false;
+
+    const result_type & result = analyzer.cluster_result();
+    if (!result.isInited || (result.entry_size != map.size()))
+        return false;
+    if (result.group_width != Map::group_width())
+        return false;
+    if (result.slot_capacity < map.slot_capacity())
+        return false;
+
+    // Each group is counted once, by its used slots, which are the entries.
+    size_type groups = 0, used_slots = 0;
+    for (size_type used = 0; used < result.group_occupancy.size(); used++) {
+        groups += result.group_occupancy[used];
+        used_slots += result.group_occupancy[used] * used;
+    }
+    if ((groups != result.group_capacity) || (used_slots != map.size()))
+        return false;
+
+    // Each entry is counted once, by its displacement.
+    size_type entries = 0, displacement = 0;
+    for (size_type groups = 0; groups < result.displacements.size(); groups++) {
+        entries += result.displacements[groups];
+        displacement += result.displacements[groups] * groups;
+    }
+    if (entries != map.size())
+        return false;
+    if (map.size() != 0) {
+        if (result.displaced_count != map.size() - result.displacements[0])
+            return false;
+        if ((result.displacements.size() != result.max_displacement + 1) ||
+            (result.displacements[result.max_displacement] == 0))
+            return false;
+        double avg_displacement = (double)displacement / map.size();
+        if ((result.avg_displacement < avg_displacement - 1e-9) ||
+            (result.avg_displacement > avg_displacement + 1e-9))
+            return false;
+        // The probe starts are the home slots, std::hash keys are rarely far from them.
+        if (result.avg_displacement > 1.0)
+            return false;
+    }
+    if (result.overflow_groups > result.group_capacity)
+        return false;
+    return true;
+}
+
+//
+// Analyse the map when it's empty, after the inserts, and after the erases.
+//
+template <typename Map>
+static bool analyse_test(const char * name)
+{
+    Map map;
+    bool passed = is_valid_cluster_result(map);
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.emplace(i, make_size_t(i));
+    }
+    passed = passed && is_valid_cluster_result(map);
+
+    for (std::size_t i = 0; i < kKeyCount; i += 3) {
+        map.erase(i);
+    }
+    passed = passed && is_valid_cluster_result(map);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!analyse_test<jstd::cluster_flat_map<std::size_t, std::size_t>>("cluster_flat_map"))
+        failed++;
+    if (!analyse_test<jstd::robin_hash_map<std::size_t, std::size_t>>("robin_hash_map"))
+        failed++;
+    if (!analyse_test<jstd::flat16_hash_map<std::size_t, std::size_t>>("flat16_hash_map"))
+        failed++;
+    if (!analyse_test<jstd::robin16_hash_map<std::size_t, std::size_t>>("robin16_hash_map"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,438 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+
+//
+// memory_usage() of robin_hash_map, flat16_hash_map and robin16_hash_map, and the
+// heap_usage<T> customization point: the table bytes against the capacity times
+// the sizes of the ctrl and slot types, and the heap bytes of the long strings.
+// memory_usage() of cluster_flat_map against the bytes held by its allocator, in the
+// direct and the indirect layout, and during an incremental rehash.
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "jstd/hashmap/cluster_flat_map.hpp"
+#include "jstd/hashmap/robin_hash_map.h"
+#include "jstd/hashmap/flat16_hash_map.h"
+#include "jstd/hashmap/robin16_hash_map.h"
+#include "jstd/hashmap/map_memory_usage.h"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// A user type which owns a heap block, counted by its heap_usage<> specialization.
+//
+struct blob {
+    std::vector<char> data;
+
+    blob() {}
+    explicit blob(std::size_t size) : data(size, 'x') {}
+};
+
+namespace jstd {
+
+template <>
+struct heap_usage<blob> : public std::true_type {
+    static std::size_t bytes(const blob & value) noexcept {
+        return value.data.capacity();
+    }
+};
+
+} // namespace jstd
+
+static std::string make_short_string(std::size_t i)
+{
+    // In the small string buffer.
+    return std::to_string(i % 1000);
+}
+
+//
+// The slots of robin_hash_map include the tail after slot_capacity() for the probes,
+// the other maps allocate slot_capacity() slots.
+//
+template <typename Map>
+static std::size_t table_slots(const Map & map)
+{
+    return map.slot_capacity();
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual,
+          typename LayoutPolicy, typename Allocator>
+static std::size_t table_slots(const jstd::robin_hash_map<Key, Value, Hash, KeyEqual,
+                                                          LayoutPolicy, Allocator> & map)
+{
+    return map.max_slot_capacity();
+}
+
+//
+// The sentinel group of flat16_hash_map and robin16_hash_map is the padding.
+//
+template <typename Map>
+static bool is_valid_padding(const Map & map, const jstd::map_memory_usage & usage)
+{
+    return (usage.padding_bytes == map.group_capacity() * sizeof(typename Map::group_type) - usage.ctrl_bytes);
+}
+
+template <typename Key, typename Value, typename Hash, typename KeyEqual,
+          typename LayoutPolicy, typename Allocator>
+static bool is_valid_padding(const jstd::robin_hash_map<Key, Value, Hash, KeyEqual,
+                                                        LayoutPolicy, Allocator> & map,
+                             const jstd::map_memory_usage & usage)
+{
+    // The ctrls are rounded up to whole groups, plus a sentinel group.
+    return (usage.padding_bytes < usage.ctrl_bytes);
+}
+
+//
+// The table bytes of an empty and a filled map, the heap bytes are checked by the caller.
+//
+template <typename Map>
+static bool is_valid_table_usage(const Map & map, const jstd::map_memory_usage & usage)
+{
+    typedef typename Map::ctrl_type ctrl_type;
+    typedef typename Map::slot_type slot_type;
+
+    if (usage.object_bytes != sizeof(Map))
+        return false;
+    if (usage.total() != usage.object_bytes + usage.table_bytes() + usage.heap_bytes)
+        return false;
+    if (map.slot_capacity() == 0)
+        return (usage.table_bytes() == 0);
+
+    std::size_t slots = table_slots(map);
+    if (usage.slot_bytes != slots * sizeof(slot_type))
+        return false;
+    if (usage.ctrl_bytes != slots * sizeof(ctrl_type))
+        return false;
+    return is_valid_padding(map, usage);
+}
+
+//
+// The size_t values own no heap memory, the short strings are in the string objects,
+// and the long strings are counted by their capacities.
+//
+template <template <typename...> class MapT>
+static bool memory_usage_test(const char * name)
+{
+    typedef MapT<std::size_t, std::size_t>      int_map_type;
+    typedef MapT<std::size_t, std::string>      string_map_type;
+    typedef MapT<std::string, blob>             blob_map_type;
+
+    bool passed = true;
+
+    int_map_type int_map;
+    passed = is_valid_table_usage(int_map, int_map.memory_usage()) &&
+             (int_map.memory_usage().heap_bytes == 0);
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        int_map.emplace(i, make_size_t(i));
+    }
+    jstd::map_memory_usage usage = int_map.memory_usage();
+    passed = passed && is_valid_table_usage(int_map, usage) && (usage.heap_bytes == 0);
+
+    string_map_type short_map, long_map;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        short_map.emplace(i, make_short_string(i));
+        long_map.emplace(i, make_string(i));
+    }
+    usage = short_map.memory_usage();
+    passed = passed && is_valid_table_usage(short_map, usage) && (usage.heap_bytes == 0);
+
+    std::size_t long_bytes = 0;
+    for (auto iter = long_map.cbegin(); iter != long_map.cend(); ++iter) {
+        long_bytes += iter->second.capacity() + 1;
+    }
+    usage = long_map.memory_usage();
+    passed = passed && is_valid_table_usage(long_map, usage) &&
+             (usage.heap_bytes == long_bytes) && (long_bytes > kKeyCount * 24);
+
+    // The long string keys and the user type values.
+    blob_map_type blob_map;
+    std::size_t blob_bytes = 0;
+    for (std::size_t i = 0; i < kKeyCount / 10; i++) {
+        auto result = blob_map.emplace(make_string(i), blob(i % 100));
+        blob_bytes += result.first->first.capacity() + 1 + result.first->second.data.capacity();
+    }
+    usage = blob_map.memory_usage();
+    passed = passed && is_valid_table_usage(blob_map, usage) && (usage.heap_bytes == blob_bytes);
+
+    print_result(name, passed);
+    return passed;
+}
+
+//
+// An allocator which counts the bytes it holds.
+//
+template <typename T>
+class counting_allocator {
+public:
+    typedef T value_type;
+
+    std::size_t * live_bytes;
+
+    explicit counting_allocator(std::size_t * live) noexcept : live_bytes(live) {}
+
+    template <typename U>
+    counting_allocator(const counting_allocator<U> & other) noexcept : live_bytes(other.live_bytes) {}
+
+    T * allocate(std::size_t n) {
+        *this->live_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T * ptr, std::size_t n) noexcept {
+        *this->live_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator == (const counting_allocator<U> & other) const noexcept {
+        return (this->live_bytes == other.live_bytes);
+    }
+
+    template <typename U>
+    bool operator != (const counting_allocator<U> & other) const noexcept {
+        return (this->live_bytes != other.live_bytes);
+    }
+};
+
+// Larger than 32 bytes, so it's stored in the indirect layout.
+struct big_value {
+    std::size_t data[8];
+
+    big_value() : data() {}
+    explicit big_value(std::size_t i) : data() { data[0] = i; }
+};
+
+template <typename Value>
+using counted_cluster_map = jstd::cluster_flat_map<std::size_t, Value, std::hash<std::size_t>,
+                                                   std::equal_to<std::size_t>,
+                                                   counting_allocator<std::pair<const std::size_t, Value>>>;
+
+//
+// Add the ctrl and slot bytes of the arrays of a cluster_flat_map: a group per kGroupWidth
+// slots, plus two 32-bit indexes per slot in the indirect layout and a byte per group with
+// the overflow counters. The direct slots are slot_capacity slots, the indirect slots only
+// hold the max load factor (7/8) of them.
+//
+template <typename Map>
+static void add_cluster_arrays(jstd::map_memory_usage & usage,
+                               std::size_t group_capacity, std::size_t slot_capacity)
+{
+    typedef typename Map::table_type    table_type;
+    typedef typename Map::group_type    group_type;
+    typedef typename Map::slot_type     slot_type;
+
+    usage.ctrl_bytes += group_capacity * sizeof(group_type);
+    if (table_type::kIsIndirectKV) {
+        usage.ctrl_bytes += slot_capacity * 2 * sizeof(std::uint32_t);
+        usage.slot_bytes += (slot_capacity * 7 / 8) * sizeof(slot_type);
+    } else {
+        usage.slot_bytes += slot_capacity * sizeof(slot_type);
+    }
+#if CLUSTER_USE_OVERFLOW_COUNTER
+    usage.ctrl_bytes += group_capacity;
+#endif
+}
+
+static bool is_same_arrays(const jstd::map_memory_usage & usage, const jstd::map_memory_usage & expected)
+{
+    return ((usage.ctrl_bytes == expected.ctrl_bytes) && (usage.slot_bytes == expected.slot_bytes));
+}
+
+//
+// memory_usage() of cluster_flat_map: the table bytes are the bytes held by the allocator,
+// and the ctrl and slot bytes match the layout.
+//
+template <typename Value>
+static bool cluster_memory_usage_test(const char * name, bool is_indirect)
+{
+    typedef counted_cluster_map<Value>              map_type;
+    typedef counting_allocator<typename map_type::value_type> allocator_type;
+
+    std::size_t live_bytes = 0;
+    bool passed = (map_type::table_type::kIsIndirectKV == is_indirect);
+    {
+        map_type map(0, allocator_type(&live_bytes));
+        jstd::map_memory_usage usage = map.memory_usage();
+        passed = passed && (usage.object_bytes == sizeof(map)) && (usage.table_bytes() == 0) &&
+                 (live_bytes == 0);
+
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            map.emplace(i, Value(i));
+        }
+        map.finish_rehash();
+        usage = map.memory_usage();
+        jstd::map_memory_usage expected;
+        add_cluster_arrays<map_type>(expected, map.group_capacity(), map.slot_capacity());
+        passed = passed && (usage.object_bytes == sizeof(map)) && (usage.heap_bytes == 0) &&
+                 (usage.table_bytes() == live_bytes) && is_same_arrays(usage, expected);
+        printf("%s: size = %u, ctrl_bytes = %u, slot_bytes = %u, padding_bytes = %u\n",
+               name, (uint32_t)map.size(), (uint32_t)usage.ctrl_bytes,
+               (uint32_t)usage.slot_bytes, (uint32_t)usage.padding_bytes);
+    }
+    passed = passed && (live_bytes == 0);
+
+    print_result(name, passed);
+    return passed;
+}
+
+#if CLUSTER_USE_INCREMENTAL_REHASH
+//
+// Right after each growth of an incremental rehash, memory_usage() has the new arrays and
+// the old arrays, which are half of them, and only the new arrays after finish_rehash().
+//
+template <typename Value>
+static bool cluster_rehash_usage_test(const char * name)
+{
+    typedef counted_cluster_map<Value>              map_type;
+    typedef counting_allocator<typename map_type::value_type> allocator_type;
+
+    std::size_t live_bytes = 0;
+    std::size_t rehashes = 0;
+    bool passed = true;
+    {
+        map_type map(0, allocator_type(&live_bytes));
+        for (std::size_t i = 0; i < kKeyCount; i++) {
+            std::size_t old_slot_capacity = map.slot_capacity();
+            std::size_t old_group_capacity = map.group_capacity();
+            map.emplace(i, Value(i));
+            if (!map.is_rehashing() || (map.slot_capacity() == old_slot_capacity))
+                continue;
+
+            jstd::map_memory_usage usage = map.memory_usage();
+            jstd::map_memory_usage expected;
+            add_cluster_arrays<map_type>(expected, map.group_capacity(), map.slot_capacity());
+            add_cluster_arrays<map_type>(expected, old_group_capacity, old_slot_capacity);
+            passed = passed && (usage.table_bytes() == live_bytes) && is_same_arrays(usage, expected);
+            rehashes++;
+        }
+
+        map.finish_rehash();
+        jstd::map_memory_usage usage = map.memory_usage();
+        jstd::map_memory_usage expected;
+        add_cluster_arrays<map_type>(expected, map.group_capacity(), map.slot_capacity());
+        passed = passed && (usage.table_bytes() == live_bytes) && is_same_arrays(usage, expected);
+    }
+    passed = passed && (rehashes > 0) && (live_bytes == 0);
+
+    printf("%s: incremental rehashes = %u\n", name, (uint32_t)rehashes);
+    print_result(name, passed);
+    return passed;
+}
+#endif
+
+//
+// heap_usage<> of the standard containers, and the sum of the usages.
+//
+static bool heap_usage_test(const char * name)
+{
+    std::string short_str = make_short_string(1);
+    std::string long_str = make_string(1);
+    bool passed = (jstd::heap_usage_of(short_str) == 0) &&
+                  (jstd::heap_usage_of(long_str) == long_str.capacity() + 1);
+
+    std::vector<std::string> strings;
+    strings.push_back(short_str);
+    strings.push_back(long_str);
+    passed = passed && (jstd::heap_usage_of(strings) ==
+                        strings.capacity() * sizeof(std::string) + strings[1].capacity() + 1);
+
+    std::pair<std::size_t, std::string> pair(1, long_str);
+    passed = passed && (jstd::heap_usage_of(pair) == pair.second.capacity() + 1);
+    passed = passed && !jstd::heap_usage<std::pair<std::size_t, std::size_t>>::value &&
+                       jstd::heap_usage<std::pair<std::size_t, blob>>::value;
+
+    jstd::map_memory_usage usage1, usage2;
+    usage1.object_bytes = 1; usage1.ctrl_bytes = 2; usage1.slot_bytes = 3;
+    usage1.padding_bytes = 4; usage1.heap_bytes = 5;
+    usage2 = usage1;
+    usage2 += usage1;
+    passed = passed && (usage2.table_bytes() == 18) && (usage2.total() == 30);
+
+    print_result(name, passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+
+    if (!memory_usage_test<jstd::robin_hash_map>("robin_hash_map"))
+        failed++;
+    if (!memory_usage_test<jstd::flat16_hash_map>("flat16_hash_map"))
+        failed++;
+    if (!memory_usage_test<jstd::robin16_hash_map>("robin16_hash_map"))
+        failed++;
+    if (!cluster_memory_usage_test<std::size_t>("cluster_flat_map<size_t, size_t>", false))
+        failed++;
+    if (!cluster_memory_usage_test<big_value>("cluster_flat_map<size_t, big_value>",
+                                              (CLUSTER_USE_INDIRECT_KV != 0)))
+        failed++;
+#if CLUSTER_USE_INCREMENTAL_REHASH
+    if (!cluster_rehash_usage_test<std::size_t>("cluster_rehash_usage_test<size_t>"))
+        failed++;
+    if (!cluster_rehash_usage_test<big_value>("cluster_rehash_usage_test<big_value>"))
+        failed++;
+#endif
+    if (!heap_usage_test("heap_usage_test"))
+        failed++;
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
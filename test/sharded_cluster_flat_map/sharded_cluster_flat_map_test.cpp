@@ -0,0 +1,256 @@
+/************************************************************************************
+
+  CC BY-SA 4.0 License
+
+  Copyright (c) 2024 XiongHui Guo (gz_shines at msn.com)
+
+  https://github.com/shines77/cluster_flat_map
+  https://gitee.com/shines77/cluster_flat_map
+
+*************************************************************************************
+
+  CC Attribution-ShareAlike 4.0 International
+
+  https://creativecommons.org/licenses/by-sa/4.0/deed.en
+
+  You are free to:
+
+    1. Share -- copy and redistribute the material in any medium or format.
+
+    2. Adapt -- remix, transforn, and build upon the material for any purpose,
+    even commerically.
+
+    The licensor cannot revoke these freedoms as long as you follow the license terms.
+
+  Under the following terms:
+
+    * Attribution -- You must give appropriate credit, provide a link to the license,
+    and indicate if changes were made. You may do so in any reasonable manner,
+    but not in any way that suggests the licensor endorses you or your use.
+
+    * ShareAlike -- If you remix, transform, or build upon the material, you must
+    distribute your contributions under the same license as the original.
+
+    * No additional restrictions -- You may not apply legal terms or technological
+    measures that legally restrict others from doing anything the license permits.
+
+  Notices:
+
+    * You do not have to comply with the license for elements of the material
+    in the public domain or where your use is permitted by an applicable exception
+    or limitation.
+
+    * No warranties are given. The license may not give you all of the permissions
+    necessary for your intended use. For example, other rights such as publicity,
+    privacy, or moral rights may limit how you use the material.
+
+************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <atomic>
+#include <stdexcept>
+#include <utility>
+
+#include "jstd/hashmap/sharded_cluster_flat_map.hpp"
+#include "jstd/hasher/hashes.h"
+#include "jstd/test/Test.h"
+
+#include "common/test_utils.h"
+
+//
+// The identity hashers, the strided keys leave the low bits of the hash code zero.
+//
+struct mum_identity_hash {
+    typedef std::size_t result_type;
+    typedef jstd::mum_hash_policy<mum_identity_hash> hash_policy;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        return key;
+    }
+};
+
+struct fibonacci_identity_hash {
+    typedef std::size_t result_type;
+    typedef jstd::fibonacci_hash_policy<fibonacci_identity_hash> hash_policy;
+
+    std::size_t operator () (std::size_t key) const noexcept {
+        return key;
+    }
+};
+
+static const std::size_t kKeyStride = 2048;
+
+//
+// Insert the strided keys, every shard should get about 1/Shards of them.
+//
+template <typename Hash>
+bool shard_balance_test(const char * name)
+{
+    typedef jstd::sharded_cluster_flat_map<std::size_t, std::size_t, 16, Hash> map_type;
+
+    map_type map;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.insert(std::make_pair(i * kKeyStride, i));
+    }
+
+    bool passed = (map.size() == kKeyCount);
+
+    // The binomial deviation of a share is about 242 keys, allow 6 times of it.
+    std::size_t share = kKeyCount / map_type::shard_count();
+    std::size_t tolerance = static_cast<std::size_t>(std::sqrt(static_cast<double>(share)) * 6.0);
+    std::size_t min_size = kKeyCount, max_size = 0;
+    for (std::size_t i = 0; i < map_type::shard_count(); i++) {
+        std::size_t shard_size = map.shard_size(i);
+        if (shard_size < min_size)
+            min_size = shard_size;
+        if (shard_size > max_size)
+            max_size = shard_size;
+    }
+    if ((min_size + tolerance < share) || (max_size > share + tolerance))
+        passed = false;
+
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t value = 0;
+        if (!map.find(i * kKeyStride, value) || (value != i)) {
+            passed = false;
+            break;
+        }
+    }
+
+    printf("shard_balance_test<%s>: share = %zu, min = %zu, max = %zu\n",
+           name, share, min_size, max_size);
+    print_result("shard_balance_test", passed);
+    return passed;
+}
+
+typedef jstd::sharded_cluster_flat_map<std::size_t, std::size_t, 16> sharded_map_type;
+
+//
+// Every element is visited once by the threads, and the exception thrown
+// by the visitor on a worker is rethrown to the caller.
+//
+bool parallel_for_each_test()
+{
+    sharded_map_type map;
+    std::size_t expected_sum = 0;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.insert(std::make_pair(i, i * 3));
+        expected_sum += i * 3;
+    }
+
+    bool passed = true;
+    static const std::size_t thread_counts[] = { 1, 3, 4, 16, 64 };
+    for (std::size_t thread_count : thread_counts) {
+        std::atomic<std::size_t> count(0), sum(0);
+        map.parallel_for_each([&](const sharded_map_type::value_type & kv) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            sum.fetch_add(kv.second, std::memory_order_relaxed);
+        }, thread_count);
+        if ((count.load() != kKeyCount) || (sum.load() != expected_sum))
+            passed = false;
+    }
+
+    // The key is in one shard only, it's visited by one of the threads.
+    static const std::size_t kBadKey = kKeyCount / 2;
+    for (std::size_t thread_count : thread_counts) {
+        bool is_caught = false;
+        try {
+            map.parallel_for_each([](const sharded_map_type::value_type & kv) {
+                if (kv.first == kBadKey)
+                    throw std::runtime_error("parallel_for_each_test");
+            }, thread_count);
+        } catch (const std::runtime_error &) {
+            is_caught = true;
+        }
+        if (!is_caught)
+            passed = false;
+    }
+
+    print_result("parallel_for_each_test", passed);
+    return passed;
+}
+
+//
+// reserve() gives every shard its share plus the room of the unevenness,
+// so inserting the reserved number of elements doesn't rehash any shard.
+//
+bool reserve_test()
+{
+    sharded_map_type map;
+    map.reserve(kKeyCount);
+    std::size_t capacity = map.capacity();
+
+    bool passed = (capacity >= kKeyCount);
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.insert(std::make_pair(i * kKeyStride, i));
+    }
+    if ((map.size() != kKeyCount) || (map.capacity() != capacity))
+        passed = false;
+
+    printf("reserve_test: capacity = %zu, after insert = %zu, ", capacity, map.capacity());
+    if (passed)
+        jstd::print_passed();
+    else
+        jstd::print_failed();
+    printf("\n");
+    return passed;
+}
+
+//
+// erase_if() erases exactly the matching elements of all shards.
+//
+bool erase_if_test()
+{
+    sharded_map_type map;
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        map.insert(std::make_pair(i, i));
+    }
+
+    std::size_t erased = map.erase_if([](const sharded_map_type::value_type & kv) {
+        return ((kv.second % 3) != 0);
+    });
+
+    bool passed = (erased == kKeyCount - (kKeyCount + 2) / 3) &&
+                  (map.size() == kKeyCount - erased);
+    for (std::size_t i = 0; i < kKeyCount; i++) {
+        std::size_t value = 0;
+        bool found = map.find(i, value);
+        if (found != ((i % 3) == 0) || (found && (value != i))) {
+            passed = false;
+            break;
+        }
+    }
+
+    // Nothing left to erase.
+    if (map.erase_if([](const sharded_map_type::value_type & kv) {
+            return ((kv.second % 3) != 0);
+        }) != 0) {
+        passed = false;
+    }
+
+    print_result("erase_if_test", passed);
+    return passed;
+}
+
+int main(int argc, char * argv[])
+{
+    int failed = 0;
+    if (!shard_balance_test<mum_identity_hash>("mum_hash_policy"))
+        failed++;
+    if (!shard_balance_test<fibonacci_identity_hash>("fibonacci_hash_policy"))
+        failed++;
+    if (!parallel_for_each_test())
+        failed++;
+    if (!reserve_test())
+        failed++;
+    if (!erase_if_test())
+        failed++;
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
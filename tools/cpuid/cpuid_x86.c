@@ -40,9 +40,8 @@
 #include <string.h>
 #include "cpuid.h"
 
-#if defined(_MSC_VER) && !defined(__clang__)
-#include <intrin.h>
-#endif
+// The cpuid and xgetbv instructions are shared with the library.
+#include "jstd/support/CPUID.h"
 
 #if defined(_MSC_VER) && !defined(__clang__)
 #define C_INLINE __inline
@@ -81,34 +80,6 @@
 // x86_64 cpuid : https://www.cnblogs.com/TaigaCon/p/7882216.html
 //
 
-#if defined(_MSC_VER) && !defined(__clang__)
-
-void cpuid(int op, int * eax, int * ebx, int * ecx, int * edx)
-{
-    int cpuInfo[4] = { -1 };
-
-    __cpuid(cpuInfo, op);
-
-    *eax = cpuInfo[0];
-    *ebx = cpuInfo[1];
-    *ecx = cpuInfo[2];
-    *edx = cpuInfo[3];
-}
-
-void cpuid_count(int op, int count, int * eax, int * ebx, int * ecx, int * edx)
-{
-    int cpuInfo[4] = { -1 };
-
-    __cpuidex(cpuInfo, op, count);
-
-    *eax = cpuInfo[0];
-    *ebx = cpuInfo[1];
-    *ecx = cpuInfo[2];
-    *edx = cpuInfo[3];
-}
-
-#else
-
 #ifndef CPUIDEMU
 
 #if defined(__APPLE__) && defined(__i386__)
@@ -120,30 +91,12 @@ void cpuid_count(int op, int count, int * eax, int * ebx, int * ecx, int * edx);
 
 static C_INLINE void cpuid(int op, int * eax, int * ebx, int * ecx, int * edx)
 {
-#if defined(__i386__) && defined(__PIC__)
-    __asm__ __volatile__
-    ("mov %%ebx, %%edi;"
-     "cpuid;"
-     "xchgl %%ebx, %%edi;"
-     : "=a" (*eax), "=D" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (op), "c" (0) : "cc");
-#else
-    __asm__ __volatile__
-    ("cpuid": "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (op), "c" (0) : "cc");
-#endif
+    jstd_cpuid(op, eax, ebx, ecx, edx);
 }
 
 static C_INLINE void cpuid_count(int op, int count, int * eax, int * ebx, int * ecx, int * edx)
 {
-#if defined(__i386__) && defined(__PIC__)
-    __asm__ __volatile__
-    ("mov %%ebx, %%edi;"
-     "cpuid;"
-     "xchgl %%ebx, %%edi;"
-     : "=a" (*eax), "=D" (*ebx), "=c" (*ecx), "=d" (*edx) : "0" (op), "2" (count) : "cc");
-#else
-    __asm__ __volatile__
-    ("cpuid": "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "0" (op), "2" (count) : "cc");
-#endif
+    jstd_cpuid_count(op, count, eax, ebx, ecx, edx);
 }
 #endif // (__APPLE__ && __i386__)
 
@@ -194,8 +147,6 @@ void cpuid_count(unsigned int op, unsigned int count, unsigned int * eax,
 
 #endif // !defined(CPUIDEMU)
 
-#endif // (_MSC_VER && !__clang__)
-
 static C_INLINE int have_cpuid(void)
 {
     int eax, ebx, ecx, edx;
@@ -215,23 +166,8 @@ static C_INLINE int have_excpuid(void)
 }
 
 #ifndef NO_AVX
-struct reg64_t {
-    int low;
-    int high;
-};
-
 static C_INLINE void xgetbv(int op, int * eax, int * edx) {
-    // Use binary code for xgetbv
-#if defined(_MSC_VER) && !defined(__clang__)
-    unsigned __int64 result = __xgetbv(op);
-
-    struct reg64_t * r64 = (struct reg64_t *)&result;
-    *eax = r64->low;
-    *edx = r64->high;
-#else
-    __asm__ __volatile__
-    (".byte 0x0f, 0x01, 0xd0": "=a" (*eax), "=d" (*edx) : "c" (op) : "cc");
-#endif // _MSC_VER
+    jstd_xgetbv(op, eax, edx);
 }
 #endif // NO_AVX
 
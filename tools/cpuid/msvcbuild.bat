@@ -15,7 +15,7 @@
 
 @setlocal
 @set MSVC_ARCH=%Platform% %CommandPromptType% %PreferredToolArchitecture%
-@set CPUID_COMPILE=cl /nologo /c /O2 /W3 /D_CRT_SECURE_NO_DEPRECATE /D_CRT_STDIO_INLINE=__declspec(dllexport)__inline
+@set CPUID_COMPILE=cl /nologo /c /O2 /W3 /I..\..\src /D_CRT_SECURE_NO_DEPRECATE /D_CRT_STDIO_INLINE=__declspec(dllexport)__inline
 @set CPUID_LINK=link /nologo
 @set CPUID_MT=mt /nologo
 @set CPUID_LIB=lib /nologo /nodefaultlib